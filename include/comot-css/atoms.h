@@ -0,0 +1,228 @@
+#ifndef ATOMS_H
+#define ATOMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Generated by tools/gen_atoms.py from tools/atoms.txt, do not edit.
+
+// Known CSS names: units, at-rules, functions, properties and keywords.
+// Names are matched ignoring ASCII case; the values are stable.
+typedef enum {
+  TOK_ATOM_UNKNOWN = 0,                     // not a known name
+  TOK_ATOM_PERCENT,                         // %
+  TOK_ATOM_PX,                              // px
+  TOK_ATOM_EM,                              // em
+  TOK_ATOM_REM,                             // rem
+  TOK_ATOM_EX,                              // ex
+  TOK_ATOM_CH,                              // ch
+  TOK_ATOM_VW,                              // vw
+  TOK_ATOM_VH,                              // vh
+  TOK_ATOM_VMIN,                            // vmin
+  TOK_ATOM_VMAX,                            // vmax
+  TOK_ATOM_CM,                              // cm
+  TOK_ATOM_MM,                              // mm
+  TOK_ATOM_Q,                               // q
+  TOK_ATOM_IN,                              // in
+  TOK_ATOM_PT,                              // pt
+  TOK_ATOM_PC,                              // pc
+  TOK_ATOM_DEG,                             // deg
+  TOK_ATOM_RAD,                             // rad
+  TOK_ATOM_GRAD,                            // grad
+  TOK_ATOM_TURN,                            // turn
+  TOK_ATOM_S,                               // s
+  TOK_ATOM_MS,                              // ms
+  TOK_ATOM_HZ,                              // hz
+  TOK_ATOM_KHZ,                             // khz
+  TOK_ATOM_DPI,                             // dpi
+  TOK_ATOM_DPCM,                            // dpcm
+  TOK_ATOM_DPPX,                            // dppx
+  TOK_ATOM_X,                               // x
+  TOK_ATOM_FR,                              // fr
+  TOK_ATOM_CHARSET,                         // charset
+  TOK_ATOM_IMPORT,                          // import
+  TOK_ATOM_NAMESPACE,                       // namespace
+  TOK_ATOM_MEDIA,                           // media
+  TOK_ATOM_SUPPORTS,                        // supports
+  TOK_ATOM_FONT_FACE,                       // font-face
+  TOK_ATOM_KEYFRAMES,                       // keyframes
+  TOK_ATOM_WEBKIT_KEYFRAMES,                // -webkit-keyframes
+  TOK_ATOM_PAGE,                            // page
+  TOK_ATOM_LAYER,                           // layer
+  TOK_ATOM_CONTAINER,                       // container
+  TOK_ATOM_PROPERTY,                        // property
+  TOK_ATOM_COUNTER_STYLE,                   // counter-style
+  TOK_ATOM_FONT_FEATURE_VALUES,             // font-feature-values
+  TOK_ATOM_VIEWPORT,                        // viewport
+  TOK_ATOM_DOCUMENT,                        // document
+  TOK_ATOM_SCOPE,                           // scope
+  TOK_ATOM_STARTING_STYLE,                  // starting-style
+  TOK_ATOM_URL,                             // url
+  TOK_ATOM_SRC,                             // src
+  TOK_ATOM_RGB,                             // rgb
+  TOK_ATOM_RGBA,                            // rgba
+  TOK_ATOM_HSL,                             // hsl
+  TOK_ATOM_HSLA,                            // hsla
+  TOK_ATOM_HWB,                             // hwb
+  TOK_ATOM_LAB,                             // lab
+  TOK_ATOM_LCH,                             // lch
+  TOK_ATOM_OKLAB,                           // oklab
+  TOK_ATOM_OKLCH,                           // oklch
+  TOK_ATOM_COLOR_MIX,                       // color-mix
+  TOK_ATOM_CALC,                            // calc
+  TOK_ATOM_MIN,                             // min
+  TOK_ATOM_MAX,                             // max
+  TOK_ATOM_CLAMP,                           // clamp
+  TOK_ATOM_VAR,                             // var
+  TOK_ATOM_ENV,                             // env
+  TOK_ATOM_ATTR,                            // attr
+  TOK_ATOM_FORMAT,                          // format
+  TOK_ATOM_LOCAL,                           // local
+  TOK_ATOM_LINEAR_GRADIENT,                 // linear-gradient
+  TOK_ATOM_RADIAL_GRADIENT,                 // radial-gradient
+  TOK_ATOM_CONIC_GRADIENT,                  // conic-gradient
+  TOK_ATOM_REPEATING_LINEAR_GRADIENT,       // repeating-linear-gradient
+  TOK_ATOM_REPEATING_RADIAL_GRADIENT,       // repeating-radial-gradient
+  TOK_ATOM_IMAGE_SET,                       // image-set
+  TOK_ATOM_TRANSLATE,                       // translate
+  TOK_ATOM_TRANSLATEX,                      // translatex
+  TOK_ATOM_TRANSLATEY,                      // translatey
+  TOK_ATOM_TRANSLATE3D,                     // translate3d
+  TOK_ATOM_SCALE,                           // scale
+  TOK_ATOM_ROTATE,                          // rotate
+  TOK_ATOM_SKEW,                            // skew
+  TOK_ATOM_MATRIX,                          // matrix
+  TOK_ATOM_PERSPECTIVE,                     // perspective
+  TOK_ATOM_CUBIC_BEZIER,                    // cubic-bezier
+  TOK_ATOM_STEPS,                           // steps
+  TOK_ATOM_COUNTER,                         // counter
+  TOK_ATOM_COUNTERS,                        // counters
+  TOK_ATOM_NOT,                             // not
+  TOK_ATOM_IS,                              // is
+  TOK_ATOM_WHERE,                           // where
+  TOK_ATOM_HAS,                             // has
+  TOK_ATOM_NTH_CHILD,                       // nth-child
+  TOK_ATOM_NTH_LAST_CHILD,                  // nth-last-child
+  TOK_ATOM_NTH_OF_TYPE,                     // nth-of-type
+  TOK_ATOM_NTH_LAST_OF_TYPE,                // nth-last-of-type
+  TOK_ATOM_LANG,                            // lang
+  TOK_ATOM_DIR,                             // dir
+  TOK_ATOM_ALIGN_CONTENT,                   // align-content
+  TOK_ATOM_ALIGN_ITEMS,                     // align-items
+  TOK_ATOM_ALIGN_SELF,                      // align-self
+  TOK_ATOM_ANIMATION,                       // animation
+  TOK_ATOM_ANIMATION_DELAY,                 // animation-delay
+  TOK_ATOM_ANIMATION_DURATION,              // animation-duration
+  TOK_ATOM_ANIMATION_NAME,                  // animation-name
+  TOK_ATOM_BACKGROUND,                      // background
+  TOK_ATOM_BACKGROUND_COLOR,                // background-color
+  TOK_ATOM_BACKGROUND_IMAGE,                // background-image
+  TOK_ATOM_BACKGROUND_POSITION,             // background-position
+  TOK_ATOM_BACKGROUND_REPEAT,               // background-repeat
+  TOK_ATOM_BACKGROUND_SIZE,                 // background-size
+  TOK_ATOM_BORDER,                          // border
+  TOK_ATOM_BORDER_BOTTOM,                   // border-bottom
+  TOK_ATOM_BORDER_COLLAPSE,                 // border-collapse
+  TOK_ATOM_BORDER_COLOR,                    // border-color
+  TOK_ATOM_BORDER_LEFT,                     // border-left
+  TOK_ATOM_BORDER_RADIUS,                   // border-radius
+  TOK_ATOM_BORDER_RIGHT,                    // border-right
+  TOK_ATOM_BORDER_STYLE,                    // border-style
+  TOK_ATOM_BORDER_TOP,                      // border-top
+  TOK_ATOM_BORDER_WIDTH,                    // border-width
+  TOK_ATOM_BOTTOM,                          // bottom
+  TOK_ATOM_BOX_SHADOW,                      // box-shadow
+  TOK_ATOM_BOX_SIZING,                      // box-sizing
+  TOK_ATOM_CLEAR,                           // clear
+  TOK_ATOM_COLOR,                           // color
+  TOK_ATOM_CONTENT,                         // content
+  TOK_ATOM_CURSOR,                          // cursor
+  TOK_ATOM_DISPLAY,                         // display
+  TOK_ATOM_FLEX,                            // flex
+  TOK_ATOM_FLEX_BASIS,                      // flex-basis
+  TOK_ATOM_FLEX_DIRECTION,                  // flex-direction
+  TOK_ATOM_FLEX_GROW,                       // flex-grow
+  TOK_ATOM_FLEX_SHRINK,                     // flex-shrink
+  TOK_ATOM_FLEX_WRAP,                       // flex-wrap
+  TOK_ATOM_FLOAT,                           // float
+  TOK_ATOM_FONT,                            // font
+  TOK_ATOM_FONT_FAMILY,                     // font-family
+  TOK_ATOM_FONT_SIZE,                       // font-size
+  TOK_ATOM_FONT_STYLE,                      // font-style
+  TOK_ATOM_FONT_WEIGHT,                     // font-weight
+  TOK_ATOM_GAP,                             // gap
+  TOK_ATOM_GRID,                            // grid
+  TOK_ATOM_GRID_AREA,                       // grid-area
+  TOK_ATOM_GRID_COLUMN,                     // grid-column
+  TOK_ATOM_GRID_ROW,                        // grid-row
+  TOK_ATOM_GRID_TEMPLATE_AREAS,             // grid-template-areas
+  TOK_ATOM_GRID_TEMPLATE_COLUMNS,           // grid-template-columns
+  TOK_ATOM_GRID_TEMPLATE_ROWS,              // grid-template-rows
+  TOK_ATOM_HEIGHT,                          // height
+  TOK_ATOM_JUSTIFY_CONTENT,                 // justify-content
+  TOK_ATOM_LEFT,                            // left
+  TOK_ATOM_LETTER_SPACING,                  // letter-spacing
+  TOK_ATOM_LINE_HEIGHT,                     // line-height
+  TOK_ATOM_LIST_STYLE,                      // list-style
+  TOK_ATOM_MARGIN,                          // margin
+  TOK_ATOM_MARGIN_BOTTOM,                   // margin-bottom
+  TOK_ATOM_MARGIN_LEFT,                     // margin-left
+  TOK_ATOM_MARGIN_RIGHT,                    // margin-right
+  TOK_ATOM_MARGIN_TOP,                      // margin-top
+  TOK_ATOM_MAX_HEIGHT,                      // max-height
+  TOK_ATOM_MAX_WIDTH,                       // max-width
+  TOK_ATOM_MIN_HEIGHT,                      // min-height
+  TOK_ATOM_MIN_WIDTH,                       // min-width
+  TOK_ATOM_OBJECT_FIT,                      // object-fit
+  TOK_ATOM_OPACITY,                         // opacity
+  TOK_ATOM_ORDER,                           // order
+  TOK_ATOM_OUTLINE,                         // outline
+  TOK_ATOM_OVERFLOW,                        // overflow
+  TOK_ATOM_OVERFLOW_X,                      // overflow-x
+  TOK_ATOM_OVERFLOW_Y,                      // overflow-y
+  TOK_ATOM_PADDING,                         // padding
+  TOK_ATOM_PADDING_BOTTOM,                  // padding-bottom
+  TOK_ATOM_PADDING_LEFT,                    // padding-left
+  TOK_ATOM_PADDING_RIGHT,                   // padding-right
+  TOK_ATOM_PADDING_TOP,                     // padding-top
+  TOK_ATOM_POINTER_EVENTS,                  // pointer-events
+  TOK_ATOM_POSITION,                        // position
+  TOK_ATOM_RIGHT,                           // right
+  TOK_ATOM_TEXT_ALIGN,                      // text-align
+  TOK_ATOM_TEXT_DECORATION,                 // text-decoration
+  TOK_ATOM_TEXT_OVERFLOW,                   // text-overflow
+  TOK_ATOM_TEXT_TRANSFORM,                  // text-transform
+  TOK_ATOM_TOP,                             // top
+  TOK_ATOM_TRANSFORM,                       // transform
+  TOK_ATOM_TRANSITION,                      // transition
+  TOK_ATOM_VERTICAL_ALIGN,                  // vertical-align
+  TOK_ATOM_VISIBILITY,                      // visibility
+  TOK_ATOM_WHITE_SPACE,                     // white-space
+  TOK_ATOM_WIDTH,                           // width
+  TOK_ATOM_WORD_BREAK,                      // word-break
+  TOK_ATOM_Z_INDEX,                         // z-index
+  TOK_ATOM_IMPORTANT,                       // important
+  TOK_ATOM_INHERIT,                         // inherit
+  TOK_ATOM_INITIAL,                         // initial
+  TOK_ATOM_UNSET,                           // unset
+  TOK_ATOM_REVERT,                          // revert
+  TOK_ATOM_NONE,                            // none
+  TOK_ATOM_AUTO,                            // auto
+  TOK_ATOM_AND,                             // and
+  TOK_ATOM_ONLY,                            // only
+  TOK_ATOM_COUNT
+} TokAtom;
+
+// Longest known name, in bytes
+#define TOK_ATOM_MAX_LEN 25
+
+// Atom of a name (without '@', '(' or a number), TOK_ATOM_UNKNOWN if none
+TokAtom tokAtomLookup(const char *name, size_t len);
+
+// Same, for a name whose tokNameHash() is already known
+TokAtom tokAtomLookupHashed(const char *name, size_t len, uint32_t hash);
+
+// Lower-case name of an atom, "" for TOK_ATOM_UNKNOWN
+const char *tokAtomName(TokAtom atom);
+
+#endif  // !ATOMS_H
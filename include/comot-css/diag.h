@@ -1,17 +1,67 @@
 #ifndef DIAG_H
 #define DIAG_H
 
-#include "tokenizer_impl.h"
-
-/**
- * @brief Logs a diagnostic message with the given `message`, `ctx`, `line`, and `column`
- *
- * @param message a human-readable diagnostic message
- * @param ctx     a pointer to the original source code
- * @param line    the line number in the source code where the diagnostic occurred
- * @param column  the column number in the source code where the diagnostic occurred
- */
-void logDiagnostic(const char* message, const char *ctx, size_t line, size_t column);
+#include <stddef.h>
 
-#endif
+typedef struct Tokenizer Tokenizer;   // forward dcl
+
+// Parse errors the tokenizer, parser and selector compiler report. They
+// are never printed and nothing is allocated for them: by default they
+// are only counted. A caller can collect structured records in a buffer
+// it owns and/or have them handed to a callback, and turn them into text
+// only if it wants (tokFormatDiagnostic).
+typedef enum {
+  TOK_DIAG_EOF_IN_COMMENT,      // comment not closed before end of input
+  TOK_DIAG_EOF_IN_STRING,       // string not closed before end of input
+  TOK_DIAG_NEWLINE_IN_STRING,   // unescaped newline in a string (bad string)
+  TOK_DIAG_EOF_IN_URL,          // url( not closed before end of input
+  TOK_DIAG_BAD_URL_CHAR,        // quote, '(' or non-printable in url( (bad url)
+  TOK_DIAG_BAD_URL_ESCAPE,      // invalid escape in url( (bad url)
+  TOK_DIAG_EOF_IN_ESCAPE,       // backslash at end of input
+  TOK_DIAG_INVALID_ESCAPE,      // backslash that does not start an escape
+  TOK_DIAG_EOF_IN_BLOCK,        // block, function or rule not closed before end of input
+  TOK_DIAG_INVALID_DECLARATION, // declaration without ':' or junk in a declaration list (dropped)
+  TOK_DIAG_RULE_WITHOUT_BLOCK,  // qualified rule ended before its '{' (dropped)
+  TOK_DIAG_INVALID_SELECTOR,    // selector that does not parse or is not supported
+  TOK_DIAG_CODE_COUNT
+} TokDiagCode;
+
+typedef enum {
+  TOK_DIAG_WARNING,             // recovered, the token is still well-formed
+  TOK_DIAG_ERROR                // produced an error or bad-* token
+} TokDiagSeverity;
+
+// A diagnostic record
+typedef struct {
+  TokDiagCode code;
+  TokDiagSeverity severity;
+  size_t offset;                // byte offset into the input (into the whole
+                                // stream in streaming mode)
+} TokDiagnostic;
+
+// Queue records in `records`, a ring of `capacity` entries owned by the
+// caller. Records that arrive while it is full are dropped (but counted).
+void tokSetDiagnosticBuffer(Tokenizer *t, TokDiagnostic *records, size_t capacity);
+
+// Take up to `max` queued records, oldest first; returns the number taken
+size_t tokReadDiagnostics(Tokenizer *t, TokDiagnostic *out, size_t max);
 
+// Hand every diagnostic to `onDiag` as it is reported. In streaming mode
+// it is called just before the token it belongs to is emitted.
+typedef void (*TokDiagCallback)(const TokDiagnostic *diag, void *userData);
+
+void tokSetDiagnosticCallback(Tokenizer *t, TokDiagCallback onDiag, void *userData);
+
+// Number of diagnostics reported so far, including ones that were dropped
+// because the buffer was full or the tokenizer's error limit was reached
+size_t tokDiagnosticCount(const Tokenizer *t);
+
+// Static description of a code
+const char *tokDiagnosticMessage(TokDiagCode code);
+
+// Format a record as "PARSE ERR at line:column: message" plus a snippet of
+// the input (offset only in streaming mode). snprintf-style: returns the
+// length of the full text and writes at most `cap` bytes, NUL-terminated.
+int tokFormatDiagnostic(Tokenizer *t, const TokDiagnostic *diag, char *buf, size_t cap);
+
+#endif
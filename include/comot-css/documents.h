@@ -0,0 +1,56 @@
+#ifndef DOCUMENTS_H
+#define DOCUMENTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+
+// Tokenizing many stylesheets at once on a pool of threads. Each thread
+// has its own arenas and a tokenizer it reuses (tokReset) for every
+// document it takes; documents are taken largest first and idle threads
+// steal work from busy ones. Inputs must stay valid during the call (and,
+// for tokTokenizeDocuments, for as long as token offsets are used).
+//
+// The options apply to every document, except that diagBuffer is ignored:
+// onDiagnostic, if set, is called on the pool threads.
+
+// One stylesheet
+typedef struct {
+  const uint8_t *input;
+  size_t len;
+} TokDocument;
+
+// Called on a pool thread for each document, with a tokenizer positioned at
+// its start (NULL if the input was rejected). The tokenizer is only valid
+// during the call. Calls for different documents may run concurrently.
+typedef void (*TokDocumentCallback)(size_t index, Tokenizer *t, void *userData);
+
+// Hand every document to `onDocument` on up to `threads` threads (0 = one
+// per core). Returns false on invalid arguments.
+bool tokForEachDocument(const TokDocument *docs, size_t count, const TokOptions *options,
+                        unsigned threads, TokDocumentCallback onDocument, void *userData);
+
+// Compact tokens of a document, ending with TOKEN_EOF
+typedef struct {
+  const CompactToken *tokens;   // NULL if the document was rejected or memory ran out
+  size_t count;
+  size_t errorCount;            // Diagnostics reported for the document
+  const char *text;             // Bytes the offsets refer to (input after a BOM)
+} TokDocumentTokens;
+
+typedef struct TokDocumentSet TokDocumentSet;
+
+// Tokenize every document into compact token arrays on up to `threads`
+// threads (0 = one per core). NULL on invalid arguments or no memory.
+TokDocumentSet *tokTokenizeDocuments(const TokDocument *docs, size_t count,
+                                     const TokOptions *options, unsigned threads);
+
+// Tokens of document `index`
+TokDocumentTokens tokDocumentTokens(const TokDocumentSet *set, size_t index);
+
+// Free the token arrays
+void tokDocumentSetDestroy(TokDocumentSet *set);
+
+#endif  // !DOCUMENTS_H
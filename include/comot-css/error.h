@@ -3,7 +3,8 @@
 
 #include <stddef.h>
 #include "comot-css/tokens.h"
+#include "comot-css/diag.h"
 
-Token emitErrorToken(Tokenizer *t, const char* message, const DecodedStream *value, size_t length, size_t line, size_t column);
+Token emitErrorToken(Tokenizer *t, TokDiagCode code, const char *value, size_t length);
 
 #endif
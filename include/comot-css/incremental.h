@@ -0,0 +1,61 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+
+// Keeping the tokens of a text that is being edited (editors, language
+// servers) up to date. After an edit only the tokens around it are
+// tokenized again, until the new tokens line up with the old ones, so the
+// cost of an edit depends on its size and not on the size of the text.
+//
+// The text must be UTF-8 without a BOM (as editors hold it) and is owned by
+// the caller; after every edit the list is given the whole new text, which
+// may have moved. Diagnostics of re-tokenized tokens go to the sinks in the
+// options.
+
+// An edit: `removed` bytes at `offset` of the old text were replaced by
+// `inserted` bytes
+typedef struct {
+  size_t offset;
+  size_t removed;
+  size_t inserted;
+} TokEdit;
+
+// Tokens an edit changed: old tokens [first, first + removed) were replaced
+// by new tokens [first, first + inserted)
+typedef struct {
+  size_t first;
+  size_t removed;
+  size_t inserted;
+} TokTokenChange;
+
+typedef struct TokTokenList TokTokenList;
+
+// Tokenize `text`; the list allocates from `arena`. TOK_OPT_UTF8 and
+// TOK_OPT_NO_POSITIONS are implied. NULL on invalid input or no memory.
+TokTokenList *tokTokenListCreate(const uint8_t *text, size_t len, Arena *arena,
+                                 const TokOptions *options);
+
+// Apply an edit. `text` is the whole text after it. Returns false on
+// invalid arguments (the list is unchanged) or when the arena runs out
+// (the list is then unusable and must be created again).
+bool tokTokenListEdit(TokTokenList *list, const uint8_t *text, size_t len,
+                      const TokEdit *edit, TokTokenChange *change);
+
+// Number of tokens, including the final TOKEN_EOF
+size_t tokTokenListCount(const TokTokenList *list);
+
+// Token `index`, with its offset in the current text
+CompactToken tokTokenListGet(const TokTokenList *list, size_t index);
+
+// Index of the last token starting at or before `offset` (0 if none)
+size_t tokTokenListFind(const TokTokenList *list, size_t offset);
+
+// Tokenizer over the current text, for tokExpandToken() and tokResolvePosition()
+Tokenizer *tokTokenListTokenizer(const TokTokenList *list);
+
+#endif  // !INCREMENTAL_H
@@ -0,0 +1,39 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "comot-css/tokens.h"
+#include "arena_alloc.h"
+
+// Name interner: maps ident, function, at-keyword and hash names to dense
+// 32-bit handles, so maps keyed by name can use the handle instead of the
+// string. Names are compared exactly (case-sensitively) after decoding
+// escapes. An interner may be shared by several tokenizers, but not by
+// tokenizers running on different threads.
+typedef struct TokInterner TokInterner;
+
+// Handle of tokens that have no interned name
+#define TOK_NO_NAME 0
+
+// Create an interner; names and tables are allocated from `arena`, which
+// must outlive it. `expected` is the number of names to size it for (may be 0).
+TokInterner *tokInternerCreate(Arena *arena, size_t expected);
+
+// Handle of a name, interning a copy of it first if it is new. Returns
+// TOK_NO_NAME if the arena is exhausted.
+uint32_t tokIntern(TokInterner *in, const char *name, size_t len);
+
+// Name and hash of a handle (empty span and 0 for invalid handles)
+TokenSpan tokInternedName(const TokInterner *in, uint32_t handle);
+uint32_t tokInternedHash(const TokInterner *in, uint32_t handle);
+
+// Number of distinct names interned so far. Handles run from 1 to this.
+size_t tokInternerCount(const TokInterner *in);
+
+// Hash of a name with ASCII letters lower-cased (32-bit FNV-1a). The
+// tokenizer computes it while scanning names, and the atom table and the
+// interner use it.
+uint32_t tokNameHash(const char *name, size_t len);
+
+#endif  // !INTERN_H
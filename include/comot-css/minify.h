@@ -0,0 +1,37 @@
+#ifndef MINIFY_H
+#define MINIFY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+
+// Minifying a stylesheet straight from its tokens, in the same pass that
+// tokenizes it. The output is a sequence of spans pointing into the
+// tokenizer's input (or at short static strings), handed to a sink in
+// batches like the iovecs of writev(); no output string is built.
+// Neighbouring spans that are contiguous in the input are merged, so
+// unchanged stretches of the stylesheet go out as one span.
+//
+// Comments are dropped. Whitespace is dropped next to { } ; , > ~ !,
+// after : ( [ and before ) ], and other runs become one space.
+// Numbers lose redundant zeros ("0.50" -> ".5", "010.0%" -> "10%"), zero
+// lengths their unit ("0px" -> "0") outside functions and flex values, and
+// the ';' before a '}' is removed. Custom property values keep their
+// numbers as written.
+
+// Spans passed to the sink at most per call
+#define TOK_MINIFY_BATCH 64
+
+// Receives a batch of output spans; returns false to stop minifying
+typedef bool (*TokMinifySink)(const TokenSpan *spans, size_t count, void *userData);
+
+// Minify the rest of the tokenizer's input. Returns false on invalid
+// arguments (including streaming tokenizers and ones that skip whitespace
+// or comments) or if the sink returned false.
+bool tokMinify(Tokenizer *t, TokMinifySink sink, void *userData);
+
+// Minify into a file descriptor with writev() (write() where it is missing)
+bool tokMinifyToFd(Tokenizer *t, int fd);
+
+#endif  // !MINIFY_H
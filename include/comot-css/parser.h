@@ -0,0 +1,68 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+
+// Parsing a token stream into rules, declarations and component values,
+// following the algorithms of CSS Syntax Level 3. The tree is one flat
+// array of nodes allocated from an arena: the children of a node are the
+// `count` nodes from index `first`, and nodes[0] is the root. Nothing is
+// allocated per node.
+//
+// The blocks of qualified rules hold declarations (and at-rules). The
+// blocks of @media, @supports, @layer, @container, @document, @scope,
+// @starting-style and @keyframes hold rules; other at-rules hold
+// declarations. Parse errors are reported as diagnostics of the tokenizer.
+
+typedef enum {
+  TOK_NODE_STYLESHEET,          // root: rules
+  TOK_NODE_DECLARATION_LIST,    // root of tokParseDeclarations: declarations and at-rules
+  TOK_NODE_AT_RULE,             // prelude values, then the block if TOK_NODE_HAS_BLOCK
+  TOK_NODE_QUALIFIED_RULE,      // prelude values, then the block
+  TOK_NODE_DECLARATION,         // value, without !important and surrounding whitespace
+  TOK_NODE_BLOCK,               // {}, [] or () block: values, or rules/declarations
+  TOK_NODE_FUNCTION,            // arguments
+  TOK_NODE_TOKEN                // any other token
+} TokNodeType;
+
+// TokNode flags
+#define TOK_NODE_HAS_BLOCK 0x01   // the last child of a rule is its block
+#define TOK_NODE_IMPORTANT 0x02   // declaration ends with !important
+#define TOK_NODE_UNCLOSED  0x04   // block, function or rule ran into the end of input
+#define TOK_NODE_ERROR     0x08   // token kind is TOKEN_KIND_ERROR
+
+// A node of the tree. For a token node, offset/length/token are those of
+// its CompactToken, so tokExpandToken() gives the full token.
+typedef struct {
+  uint32_t offset;      // first byte of the node in the input
+  uint32_t length;      // bytes it spans (blocks up to their closing bracket)
+  uint32_t first;       // index of the first child
+  uint32_t count;       // number of children
+  uint32_t nameLength;  // bytes of the name at `offset` (at-rules including '@',
+                        // declarations, functions)
+  uint16_t atom;        // TokAtom of that name, or of an ident/dimension token
+  uint8_t type;         // TokNodeType
+  uint8_t token;        // TokenType of a token node, opening bracket of a block
+  uint8_t flags;        // TOK_NODE_* bits
+} TokNode;
+
+typedef struct {
+  const TokNode *nodes;
+  size_t count;
+  const char *text;     // the input offsets are relative to
+} TokSyntaxTree;
+
+// Parse the rest of the tokenizer's input as a stylesheet. The tree is
+// allocated from `arena`. Returns false on invalid arguments (including
+// streaming tokenizers) or when the arena runs out.
+bool tokParseStylesheet(Tokenizer *t, Arena *arena, TokSyntaxTree *out);
+
+// Parse the rest of the input as a list of declarations, e.g. a style
+// attribute
+bool tokParseDeclarations(Tokenizer *t, Arena *arena, TokSyntaxTree *out);
+
+#endif  // !PARSER_H
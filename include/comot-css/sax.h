@@ -0,0 +1,55 @@
+#ifndef SAX_H
+#define SAX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "comot-css/atoms.h"
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+
+// Event-driven parsing: the rules and declarations of a stylesheet are
+// handed to callbacks as they are read, and no tree is built. Memory use
+// does not grow with the stylesheet, only with how deeply blocks nest.
+// Blocks are interpreted as by tokParseStylesheet() (parser.h), and parse
+// errors are reported as diagnostics of the tokenizer. Spans point into
+// the tokenizer's input.
+
+// An at-rule or qualified rule, reported once its prelude is read
+typedef struct {
+  TokenSpan name;       // at-rule name without '@', empty for qualified rules
+  TokAtom atom;         // TokAtom of the name
+  TokenSpan prelude;    // without surrounding whitespace
+  size_t offset;        // byte offset of the rule
+  bool hasBlock;        // a block follows, closed by onBlockEnd
+} TokSaxRule;
+
+// A declaration
+typedef struct {
+  TokenSpan name;
+  TokAtom atom;
+  TokenSpan value;      // without surrounding whitespace and !important
+  size_t firstToken;    // index of the value's first token in the tokNext() stream
+  size_t tokenCount;    // number of tokens it spans there (0 if empty)
+  size_t offset;        // byte offset of the name
+  bool important;
+} TokSaxDeclaration;
+
+// Callbacks, each of which may be NULL
+typedef struct {
+  void (*onAtRuleStart)(const TokSaxRule *rule, void *userData);
+  void (*onQualifiedRuleStart)(const TokSaxRule *rule, void *userData);
+  void (*onDeclaration)(const TokSaxDeclaration *decl, void *userData);
+  void (*onBlockEnd)(size_t offset, void *userData);   // offset of the '}'
+  void *userData;
+} TokSaxHandler;
+
+// Parse the rest of the tokenizer's input as a stylesheet, calling the
+// handler's callbacks. Returns false on invalid arguments (including
+// streaming tokenizers) or if the nesting stack outgrows the tokenizer's
+// arena.
+bool tokParseStylesheetEvents(Tokenizer *t, const TokSaxHandler *handler);
+
+// Parse the rest of the input as a list of declarations
+bool tokParseDeclarationEvents(Tokenizer *t, const TokSaxHandler *handler);
+
+#endif  // !SAX_H
@@ -0,0 +1,89 @@
+#ifndef SELECTOR_H
+#define SELECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+
+// Compiled selectors. A selector list (e.g. the prelude of a qualified
+// rule) is compiled once into bytecode that is matched right to left,
+// starting from the element being tested, against a document the caller
+// exposes through TokElementInterface.
+//
+// Supported: type and universal selectors, #id, .class, attribute
+// selectors with every operator and the i/s flags, the descendant, '>',
+// '+' and '~' combinators, :root, :empty, :first-/:last-/:only-child and
+// -of-type, :nth-child(), :nth-last-child(), :nth-of-type() and
+// :nth-last-of-type() with An+B, :not(), :is(), :where() and :matches(),
+// and pseudo-elements (which match their originating element). Other
+// pseudo-classes are left to the interface. Namespaces, :has() and other
+// functional pseudo-classes make a selector invalid.
+
+// Specificity, packed so that comparing two values compares specificities;
+// each component saturates at 1023
+#define TOK_SPECIFICITY(a, b, c) (((uint32_t) (a) << 20) | ((uint32_t) (b) << 10) | (uint32_t) (c))
+#define TOK_SPECIFICITY_A(s) ((s) >> 20)
+#define TOK_SPECIFICITY_B(s) (((s) >> 10) & 0x3FF)
+#define TOK_SPECIFICITY_C(s) ((s) & 0x3FF)
+
+// TokSelector flags
+#define TOK_SELECTOR_PSEUDO_ELEMENT 0x01   // ends with a pseudo-element
+
+// A name or value used by a selector, decoded and NUL-terminated
+typedef struct {
+  const char *data;
+  uint32_t length;
+  uint32_t nameId;      // handle from the tokenizer's interner, or TOK_NO_NAME
+} TokSelectorName;
+
+// One complex selector of a list
+typedef struct {
+  uint32_t code;        // offset of its first instruction
+  uint32_t specificity; // TOK_SPECIFICITY
+  uint32_t flags;       // TOK_SELECTOR_* bits
+} TokSelector;
+
+typedef struct {
+  const TokSelector *selectors;   // the list, in order
+  size_t count;
+  const uint32_t *code;           // bytecode, see selector.c
+  size_t codeLength;
+  const TokSelectorName *names;   // operands of the bytecode
+  size_t nameCount;
+} TokSelectorList;
+
+// The caller's document. Elements are opaque pointers; each callback gets
+// the interface's userData. Callbacks marked optional may be NULL, in which
+// case what needs them never matches.
+typedef struct {
+  const void *(*parent)(const void *element, void *userData);          // parent element or NULL
+  const void *(*previousSibling)(const void *element, void *userData); // previous element sibling or NULL
+  const void *(*nextSibling)(const void *element, void *userData);     // optional, for :last-child etc.
+  TokenSpan (*localName)(const void *element, void *userData);         // compared ignoring ASCII case
+  TokenSpan (*id)(const void *element, void *userData);                // optional, empty if none
+  bool (*hasClass)(const void *element, const TokSelectorName *name, void *userData);  // optional
+  // Optional: whether the element has the attribute, and its value
+  bool (*attribute)(const void *element, const TokSelectorName *name, TokenSpan *value, void *userData);
+  bool (*isEmpty)(const void *element, void *userData);                // optional, for :empty
+  // Optional: pseudo-classes the compiler does not know (:hover, :checked, ...)
+  bool (*pseudoClass)(const void *element, const TokSelectorName *name, void *userData);
+  void *userData;
+} TokElementInterface;
+
+// Compile the rest of the tokenizer's input as a selector list, allocating
+// from `arena`. Returns false on invalid arguments, an invalid selector
+// (reported as TOK_DIAG_INVALID_SELECTOR) or when the arena runs out.
+bool tokCompileSelectors(Tokenizer *t, Arena *arena, TokSelectorList *out);
+
+// Whether selector `index` of a list matches an element
+bool tokSelectorMatches(const TokSelectorList *list, size_t index, const void *element,
+                        const TokElementInterface *dom);
+
+// Whether any selector of a list matches; `specificity` (may be NULL)
+// receives the highest specificity among those that do
+bool tokSelectorListMatches(const TokSelectorList *list, const void *element,
+                            const TokElementInterface *dom, uint32_t *specificity);
+
+#endif  // !SELECTOR_H
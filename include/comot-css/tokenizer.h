@@ -4,14 +4,113 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include "comot-css/tokens.h"
+#include "comot-css/intern.h"
+#include "comot-css/diag.h"
 #include "arena_alloc.h"
 
 typedef struct Tokenizer Tokenizer;   // forward dcl
 
+// Flags for TokOptions
+typedef enum {
+  TOK_OPT_DEFAULT         = 0,
+  TOK_OPT_SKIP_WHITESPACE = 1 << 0,   // Never return TOKEN_WHITESPACE
+  TOK_OPT_SKIP_COMMENTS   = 1 << 1,   // Never return TOKEN_COMMENT
+  TOK_OPT_NO_POSITIONS    = 1 << 2,   // Leave Token.line/column 0 (tokResolvePosition still works)
+  TOK_OPT_UTF8            = 1 << 3    // Input is UTF-8: skip encoding sniffing and binary checks
+} TokOptionFlags;
+
+// Diagnostics recorded before they are only counted, unless set otherwise
+#define TOK_DEFAULT_MAX_ERRORS 10
+
+// Options for tokCreateEx. Zeroed options behave like tokCreate.
+typedef struct {
+  unsigned flags;                 // TokOptionFlags
+  size_t maxErrors;               // 0 = TOK_DEFAULT_MAX_ERRORS, SIZE_MAX = no limit
+  TokDiagnostic *diagBuffer;      // see tokSetDiagnosticBuffer (may be NULL)
+  size_t diagCapacity;
+  TokDiagCallback onDiagnostic;   // see tokSetDiagnosticCallback (may be NULL)
+  void *diagUserData;
+} TokOptions;
+
 // Create/destroy tokenizer
 Tokenizer *tokCreate(const uint8_t *input, size_t len, Arena *arena);
+Tokenizer *tokCreateEx(const uint8_t *input, size_t len, Arena *arena, const TokOptions *options);
+
+// Tokenize new input with an existing tokenizer, keeping its options and
+// buffers. Not for streaming tokenizers.
+bool tokReset(Tokenizer *t, const uint8_t *input, size_t len);
 
 // Get next token
 Token tokNext(Tokenizer *t);
 
+// Number of arena allocations made since the tokenizer was created.
+// Stays 0 while tokenizing in-memory input with tokNext.
+size_t tokAllocationCount(const Tokenizer *t);
+
+// Intern the names of ident, function, at-keyword and hash tokens into `in`
+// (see intern.h) and set Token.nameId. NULL turns interning off.
+void tokSetInterner(Tokenizer *t, TokInterner *in);
+
+// Structure-of-arrays token buffer filled by tokNextBatch
+typedef struct {
+  uint8_t *types;       // TokenType of each token
+  uint32_t *offsets;    // byte offset of each token from the start of input
+  uint32_t *lengths;    // byte length of each token
+  size_t *lines;        // optional (may be NULL)
+  size_t *columns;      // optional (may be NULL)
+} TokenBatch;
+
+// Get up to `max` tokens at once; returns the number written. Stops after
+// TOKEN_EOF.
+size_t tokNextBatch(Tokenizer *t, TokenBatch *out, size_t max);
+
+// Value of a token per CSS Syntax: ident/function/at-keyword/hash names,
+// string contents and url addresses with escapes decoded. Values without
+// escapes point into the input; others are decoded into `buf` (data is NULL
+// and length the size needed if `cap` is too small) or into the arena.
+TokenSpan tokValue(const Token *tok, char *buf, size_t cap);
+TokenSpan tokValueArena(const Token *tok, Arena *arena);
+
+// Line and column (1-based, columns in code points) of a byte offset into
+// the input. Not available in streaming mode.
+bool tokResolvePosition(Tokenizer *t, size_t offset, size_t *line, size_t *column);
+
+// Compact tokens: convert to/from Token, or fill an array directly.
+// Offsets are relative to the tokenizer's input; not for streaming mode.
+CompactToken tokCompactToken(const Tokenizer *t, const Token *tok);
+Token tokExpandToken(Tokenizer *t, CompactToken ct);
+size_t tokNextCompact(Tokenizer *t, CompactToken *out, size_t max);
+
+// Same tokens, diagnostics and final position as tokNextCompact, with the
+// input split into chunks tokenized on up to `threads` threads (0 = one per
+// core). The threads belong to a pool started on first use and kept for
+// later calls. Small inputs are tokenized on the calling thread.
+size_t tokNextCompactParallel(Tokenizer *t, CompactToken *out, size_t max, unsigned threads);
+
+// Flags for tokCreateFromFile
+typedef enum {
+  TOK_FILE_DEFAULT  = 0,
+  TOK_FILE_WILLNEED = 1 << 0,   // Ask the kernel to prefetch the whole file
+  TOK_FILE_NO_MMAP  = 1 << 1    // Read the file into the arena instead of mapping it
+} TokFileFlags;
+
+// Tokenize a file through a read-only memory mapping. Token.value stays
+// valid until tokClose().
+Tokenizer *tokCreateFromFile(const char *path, Arena *arena, unsigned flags);
+
+// Release the resources a tokenizer holds outside its arena (file mappings)
+void tokClose(Tokenizer *t);
+
+// Streaming (push) mode: tokens are handed to `onToken` as chunks arrive.
+// Token.value is only valid for the duration of the callback.
+typedef void (*TokTokenCallback)(const Token *tok, void *userData);
+
+Tokenizer *tokCreateStream(Arena *arena, TokTokenCallback onToken, void *userData);
+
+// Feed the next chunk of UTF-8 input; returns false on arena exhaustion
+bool tokFeed(Tokenizer *t, const uint8_t *chunk, size_t len);
+
+// Flush the remaining input and emit TOKEN_EOF
+bool tokFinish(Tokenizer *t);
+
 #endif
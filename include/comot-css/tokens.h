@@ -2,6 +2,8 @@
 #define TOKENS_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "atoms.h"
 
 // Token types
 typedef enum {
@@ -40,6 +42,21 @@ typedef enum {
   TOKEN_KIND_ERROR
 } TokenKind;
 
+// Numeric type of NUMBER, PERCENTAGE and DIMENSION tokens
+typedef enum {
+  TOKEN_NUMERIC_NONE,     // not a numeric token
+  TOKEN_NUMERIC_INTEGER,  // no fraction and no exponent
+  TOKEN_NUMERIC_NUMBER
+} TokenNumericType;
+
+// Numeric value, computed while the token is scanned
+typedef struct {
+  double value;           // correctly rounded value of the number
+  int64_t integer;        // exact value of integers, saturated to int64 range
+  uint32_t unitOffset;    // bytes from token start to the unit or '%'
+  TokenNumericType type;
+} TokenNumeric;
+
 // Token structure
 typedef struct {
   TokenType type;
@@ -48,6 +65,30 @@ typedef struct {
   size_t length;        // length of the token
   size_t line;          // line number where token starts
   size_t column;        // column number where token starts
+  TokenNumeric numeric; // number, percentage and dimension tokens only
+  TokAtom atom;         // known name of ident, function, at-keyword and
+                        // dimension unit tokens ('%' for percentages)
+  uint32_t nameId;      // interned name of ident, function, at-keyword and
+                        // hash tokens, if the tokenizer has an interner
 } Token;
 
+// A byte span holding a token's value (not NUL-terminated)
+typedef struct {
+  const char *data;
+  size_t length;
+} TokenSpan;
+
+// Compact token: 12 bytes instead of 48, for keeping whole token arrays.
+// Positions are not stored; tokExpandToken() resolves them on demand.
+typedef struct {
+  uint32_t offset;      // byte offset of the token from the start of input
+  uint32_t length;      // length of the token in bytes
+  uint8_t type;         // TokenType
+  uint8_t flags;        // TOK_COMPACT_* bits
+  uint16_t reserved;
+} CompactToken;
+
+// CompactToken flags
+#define TOK_COMPACT_ERROR 0x01    // token kind is TOKEN_KIND_ERROR
+
 #endif  // !TOKENS_H
@@ -0,0 +1,601 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include "comot-css/atoms.h"
+#include "comot-css/minify.h"
+#include "parser_impl.h"
+
+#if !defined(_WIN32)
+#include <sys/uio.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+// Minifier state. The output is collected as spans into `batch` and
+// handed to the sink whenever it fills up.
+typedef struct {
+  Tokenizer *t;
+  TokMinifySink sink;
+  void *userData;
+  bool failed;            // The sink returned false
+  TokenSpan batch[TOK_MINIFY_BATCH];
+  size_t count;
+  TokenType prevType;     // Last token written (as written), TOKEN_EOF before the first
+  char prevDelim;         // Its code point if it is a delim
+  const char *space;      // First byte of the whitespace since then, or NULL
+  bool gap;               // A comment was dropped since then
+  bool rewritten;         // It was written shorter than in the input
+  bool hexEscape;         // It ends with a hex escape
+  TokenSpan semicolon;    // A ';' held back until the next token shows up
+  size_t depth;           // Open blocks and functions
+  size_t functionDepth;   // Open functions, and parentheses inside them
+  size_t customDepth;     // depth + 1 inside a custom property's value, else 0
+  bool customName;        // The last token written names a custom property
+  size_t flexDepth;       // depth + 1 inside a flex or -webkit-flex value, else 0
+  bool flexName;          // The last token written names one of them
+} Minifier;
+
+/**
+ * @brief Hands the collected spans to the sink.
+ *
+ * @param m The minifier.
+ */
+static void flush(Minifier *m) {
+  if(m->count && !m->failed && !m->sink(m->batch, m->count, m->userData))
+    m->failed = true;
+
+  m->count = 0;
+}
+
+/**
+ * @brief Appends bytes to the output.
+ *
+ * Bytes that directly follow the last span in memory extend it, so a run
+ * of tokens copied unchanged becomes a single span.
+ *
+ * @param m The minifier.
+ * @param data The bytes, in the input or static.
+ * @param length Their length.
+ */
+static void emit(Minifier *m, const char *data, size_t length) {
+  if(!length)
+    return;
+
+  if(m->count) {
+    TokenSpan *last = &m->batch[m->count - 1];
+
+    if(last->data + last->length == data) {
+      last->length += length;
+      return;
+    }
+  }
+
+  if(m->count == TOK_MINIFY_BATCH)
+    flush(m);
+
+  m->batch[m->count++] = (TokenSpan) { data, length };
+}
+
+/**
+ * @brief Checks whether two tokens would read as different tokens if
+ *        written with nothing between them.
+ *
+ * Only asked for tokens that were not already adjacent in the input: the
+ * table errs on the safe side, and tokens the input had together need
+ * nothing between them.
+ *
+ * Follows the table in CSS Syntax Level 3, section 9 (serialization),
+ * with a number also kept apart from a following '%', and '-' from '>'
+ * (which could make a CDC).
+ *
+ * @param prev The first token's type.
+ * @param prevDelim Its code point if it is a delim.
+ * @param next The second token's type.
+ * @param nextDelim Its code point if it is a delim.
+ * @return true if something must separate them.
+ */
+static bool needsSeparator(TokenType prev, char prevDelim, TokenType next, char nextDelim) {
+  bool name = next == TOKEN_IDENT || next == TOKEN_FUNCTION || next == TOKEN_URL ||
+              next == TOKEN_BAD_URL || (next == TOKEN_DELIM && nextDelim == '-');
+  bool number = next == TOKEN_NUMBER || next == TOKEN_PERCENTAGE || next == TOKEN_DIMENSION;
+
+  switch(prev) {
+    case TOKEN_IDENT:
+      return name || number || next == TOKEN_CDC || next == TOKEN_LEFT_PAREN;
+    case TOKEN_AT_KEYWORD:
+    case TOKEN_HASH:
+    case TOKEN_DIMENSION:
+      return name || number || next == TOKEN_CDC;
+    case TOKEN_NUMBER:
+      return name || number || next == TOKEN_CDC || (next == TOKEN_DELIM && nextDelim == '%');
+    case TOKEN_DELIM:
+      switch(prevDelim) {
+        case '#':
+          return name || number || next == TOKEN_CDC;
+        case '-':
+          return name || number || next == TOKEN_CDC || (next == TOKEN_DELIM && nextDelim == '>');
+        case '@':
+          return name || next == TOKEN_CDC;
+        case '.':
+        case '+':
+          return number;
+        case '/':
+          return next == TOKEN_DELIM && nextDelim == '*';
+        default:
+          return false;
+      }
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Checks whether whitespace after a token is never significant.
+ *
+ * @param type The token's type.
+ * @param delim Its code point if it is a delim.
+ * @return true if the whitespace can be dropped.
+ */
+static inline bool dropsSpaceAfter(TokenType type, char delim) {
+  switch(type) {
+    case TOKEN_LEFT_CURLY:
+    case TOKEN_RIGHT_CURLY:
+    case TOKEN_SEMICOLON:
+    case TOKEN_COMMA:
+    case TOKEN_COLON:
+    case TOKEN_LEFT_PAREN:
+    case TOKEN_LEFT_SQUARE:
+    case TOKEN_FUNCTION:
+      return true;
+    case TOKEN_DELIM:
+      return delim == '>' || delim == '~' || delim == '!';
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Checks whether whitespace before a token is never significant.
+ *
+ * Not so before ':', '(' and '[', which would join a selector's compound
+ * or turn an ident into a function.
+ *
+ * @param type The token's type.
+ * @param delim Its code point if it is a delim.
+ * @return true if the whitespace can be dropped.
+ */
+static inline bool dropsSpaceBefore(TokenType type, char delim) {
+  switch(type) {
+    case TOKEN_LEFT_CURLY:
+    case TOKEN_RIGHT_CURLY:
+    case TOKEN_SEMICOLON:
+    case TOKEN_COMMA:
+    case TOKEN_RIGHT_PAREN:
+    case TOKEN_RIGHT_SQUARE:
+      return true;
+    case TOKEN_DELIM:
+      return delim == '>' || delim == '~' || delim == '!';
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Checks whether a token only is what it is because a newline
+ *        follows it.
+ *
+ * A bad string would run on, and a '\\' delim would become an escape.
+ * The whitespace after them starts with that newline, which is kept.
+ *
+ * @param type The token's type.
+ * @param delim Its code point if it is a delim.
+ * @return true for such tokens.
+ */
+static inline bool endsAtNewline(TokenType type, char delim) {
+  return type == TOKEN_BAD_STRING || (type == TOKEN_DELIM && delim == '\\');
+}
+
+/**
+ * @brief Checks whether a token ends with a hex escape, which would take
+ *        a following whitespace character into the token.
+ *
+ * Errs on the safe side for an escaped '\\' followed by hex digits.
+ *
+ * @param start The token's first byte.
+ * @param end Input position after it.
+ * @return true if it may end with a hex escape.
+ */
+static bool endsWithHexEscape(const char *start, const char *end) {
+  const char *p = end;
+
+  while(p > start && end - p < 6 && isxdigit((unsigned char) p[-1]))
+    p--;
+
+  return p != end && p > start && p[-1] == '\\';
+}
+
+/**
+ * @brief Shortens a number, percentage or dimension.
+ *
+ * Leading zeros of the integer part and trailing zeros of the fraction
+ * go, and so does a '.' left with no fraction. The sign is kept, and
+ * numbers with an exponent are left as they are. Each piece is a span of
+ * the token itself.
+ *
+ * @param m The minifier.
+ * @param tok The token.
+ * @param end Input position after it.
+ * @param pieces Receives up to 3 spans: sign, digits and unit.
+ * @param type Receives the type of the result: TOKEN_NUMBER for a zero
+ *             length that lost its unit, else the token's type.
+ * @return The number of spans.
+ */
+static size_t shortenNumber(const Minifier *m, const Token *tok, const char *end,
+                            TokenSpan *pieces, TokenType *type) {
+  const char *s = tok->value;
+  const char *unit = tok->type == TOKEN_NUMBER ? end : s + tok->numeric.unitOffset;
+  const char *p = s;
+  size_t count = 0;
+
+  *type = tok->type;
+
+  if(*p == '+' || *p == '-')
+    p++;
+
+  const char *intStart = p;
+  while(p < unit && *p >= '0' && *p <= '9')
+    p++;
+
+  const char *intEnd = p;
+  const char *fracStart = p;
+  const char *fracEnd = p;
+
+  if(p < unit && *p == '.') {
+    fracStart = ++p;
+    while(p < unit && *p >= '0' && *p <= '9')
+      p++;
+    fracEnd = p;
+  }
+
+  if(p != unit) {
+    pieces[0] = (TokenSpan) { s, (size_t) (end - s) };
+    return 1;
+  }
+
+  const char *zero = NULL;
+
+  while(intStart < intEnd && *intStart == '0')
+    zero = intStart++;
+
+  while(fracEnd > fracStart && fracEnd[-1] == '0')
+    zero = --fracEnd;
+
+  if(*s == '+' || *s == '-')
+    pieces[count++] = (TokenSpan) { s, 1 };
+
+  if(intStart == intEnd && fracStart == fracEnd) {
+    // Every digit was a zero, so `zero` is set
+    pieces[count++] = (TokenSpan) { zero, 1 };
+
+    // In flex, "1 0px" is a grow and a basis but "1 0" a grow and a shrink
+    if(tok->type == TOKEN_DIMENSION && tok->atom >= TOK_ATOM_PX && tok->atom <= TOK_ATOM_PC &&
+       !m->functionDepth && !m->flexDepth) {
+      *type = TOKEN_NUMBER;
+      return count;
+    }
+  }
+  else if(fracStart == fracEnd) {
+    pieces[count++] = (TokenSpan) { intStart, (size_t) (intEnd - intStart) };
+  }
+  else {
+    const char *from = intStart == intEnd ? fracStart - 1 : intStart;
+    pieces[count++] = (TokenSpan) { from, (size_t) (fracEnd - from) };
+  }
+
+  pieces[count++] = (TokenSpan) { unit, (size_t) (end - unit) };
+
+  return count;
+}
+
+/**
+ * @brief Checks whether a token names the flex shorthand.
+ *
+ * @param tok The token.
+ * @return true for "flex" and "-webkit-flex", in any ASCII case.
+ */
+static bool isFlexName(const Token *tok) {
+  static const char webkit[] = "-webkit-flex";
+
+  if(tok->type != TOKEN_IDENT)
+    return false;
+
+  if(tok->atom == TOK_ATOM_FLEX)
+    return true;
+
+  if(tok->length != sizeof(webkit) - 1)
+    return false;
+
+  for(size_t i = 0; i < tok->length; i++) {
+    char ch = tok->value[i];
+    if(ch >= 'A' && ch <= 'Z')
+      ch = (char) (ch - 'A' + 'a');
+    if(ch != webkit[i])
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Tracks the blocks, functions, custom properties and flex values a
+ *        token opens or closes.
+ *
+ * @param m The minifier.
+ * @param tok The token.
+ */
+static void updateContext(Minifier *m, const Token *tok) {
+  switch(tok->type) {
+    case TOKEN_FUNCTION:
+      m->functionDepth++;
+      m->depth++;
+      break;
+    case TOKEN_LEFT_PAREN:
+      if(m->functionDepth)
+        m->functionDepth++;
+      m->depth++;
+      break;
+    case TOKEN_LEFT_SQUARE:
+    case TOKEN_LEFT_CURLY:
+      m->depth++;
+      break;
+    case TOKEN_RIGHT_PAREN:
+    case TOKEN_RIGHT_SQUARE:
+    case TOKEN_RIGHT_CURLY:
+      if(tok->type == TOKEN_RIGHT_PAREN && m->functionDepth)
+        m->functionDepth--;
+      if(m->depth)
+        m->depth--;
+      if(m->customDepth > m->depth + 1)
+        m->customDepth = 0;
+      if(m->flexDepth > m->depth + 1)
+        m->flexDepth = 0;
+      break;
+    case TOKEN_SEMICOLON:
+      if(m->customDepth == m->depth + 1)
+        m->customDepth = 0;
+      if(m->flexDepth == m->depth + 1)
+        m->flexDepth = 0;
+      break;
+    case TOKEN_COLON:
+      if(m->customName && !m->customDepth)
+        m->customDepth = m->depth + 1;
+      if(m->flexName && !m->flexDepth)
+        m->flexDepth = m->depth + 1;
+      break;
+    default:
+      break;
+  }
+
+  m->customName = tok->type == TOKEN_IDENT && tok->length > 2 &&
+                  tok->value[0] == '-' && tok->value[1] == '-';
+  m->flexName = isFlexName(tok);
+}
+
+/**
+ * @brief Writes a token that is neither whitespace nor a comment.
+ *
+ * @param m The minifier.
+ * @param tok The token.
+ * @param start Where it starts in the input (before "url(" for url tokens).
+ * @param end Input position after it.
+ */
+static void writeToken(Minifier *m, const Token *tok, const char *start, const char *end) {
+  TokenType type = tok->type;
+  char delim = type == TOKEN_DELIM ? *tok->value : 0;
+  TokenSpan pieces[3] = { { start, (size_t) (end - start) } };
+  size_t count = 1;
+  size_t length = 0;
+
+  if((type == TOKEN_NUMBER || type == TOKEN_PERCENTAGE || type == TOKEN_DIMENSION) && !m->customDepth)
+    count = shortenNumber(m, tok, end, pieces, &type);
+
+  for(size_t i = 0; i < count; i++)
+    length += pieces[i].length;
+
+  bool rewritten = length != (size_t) (end - start);
+
+  if(m->semicolon.length) {
+    if(type != TOKEN_RIGHT_CURLY) {
+      emit(m, m->semicolon.data, m->semicolon.length);
+      m->prevType = TOKEN_SEMICOLON;
+      m->prevDelim = 0;
+      m->rewritten = false;
+      m->hexEscape = false;
+    }
+
+    m->semicolon.length = 0;
+  }
+
+  if(m->prevType != TOKEN_EOF) {
+    bool merges = needsSeparator(m->prevType, m->prevDelim, type, delim);
+
+    // Shortening would cost a separator the input did without
+    if(merges && rewritten && !m->space && !m->gap && !m->rewritten) {
+      pieces[0] = (TokenSpan) { start, (size_t) (end - start) };
+      count = 1;
+      type = tok->type;
+      rewritten = false;
+      merges = needsSeparator(m->prevType, m->prevDelim, type, delim);
+    }
+
+    if(m->space && endsAtNewline(m->prevType, m->prevDelim))
+      emit(m, m->space, 1);
+    else if(m->space && (merges || !(dropsSpaceAfter(m->prevType, m->prevDelim) || dropsSpaceBefore(type, delim)))) {
+      if(m->hexEscape)
+        emit(m, "/**/", 4);
+      emit(m, *m->space == ' ' ? m->space : " ", 1);
+    }
+    else if(!m->space && merges && (m->gap || m->rewritten || rewritten))
+      emit(m, "/**/", 4);
+  }
+
+  m->space = NULL;
+  m->gap = false;
+  updateContext(m, tok);
+
+  if(type == TOKEN_SEMICOLON) {
+    m->semicolon = pieces[0];
+    return;
+  }
+
+  for(size_t i = 0; i < count; i++)
+    emit(m, pieces[i].data, pieces[i].length);
+
+  m->prevType = type;
+  m->prevDelim = delim;
+  m->rewritten = rewritten;
+  m->hexEscape = endsWithHexEscape(start, end);
+}
+
+/**
+ * @brief Minifies the rest of a tokenizer's input.
+ *
+ * Tokens are read and written in one pass; see minify.h for what is
+ * changed. The ';' before a '}' is held back until the next token shows
+ * whether it is needed, and whitespace until it is known whether the
+ * tokens around it need it.
+ *
+ * @param t The tokenizer, not in streaming mode and not skipping
+ *          whitespace or comments.
+ * @param sink Receives the output in batches of spans.
+ * @param userData Passed to the sink.
+ * @return true on success, false on invalid arguments or if the sink
+ *         returned false.
+ */
+bool tokMinify(Tokenizer *t, TokMinifySink sink, void *userData) {
+  if(!t || !sink || t->streaming || t->skipWhitespace || t->skipComments)
+    return false;
+
+  Minifier m;
+  memset(&m, 0, sizeof(Minifier));
+  m.t = t;
+  m.sink = sink;
+  m.userData = userData;
+  m.prevType = TOKEN_EOF;
+
+  while(!m.failed) {
+    const char *start = t->curr;
+    Token tok = tokNext(t);
+
+    if(tok.type == TOKEN_EOF)
+      break;
+
+    if(tok.type == TOKEN_WHITESPACE) {
+      if(!m.space)
+        m.space = start;
+      continue;
+    }
+
+    if(tok.type == TOKEN_COMMENT) {
+      m.gap = true;
+      continue;
+    }
+
+    // The ')' of "url(x)" is its own token; it is written with the url
+    if(urlParenLeft(t, &tok))
+      t->curr++;
+
+    writeToken(&m, &tok, start, t->curr);
+  }
+
+  // A final ';' is kept: it may end an at-rule
+  emit(&m, m.semicolon.data, m.semicolon.length);
+  if(m.space && endsAtNewline(m.prevType, m.prevDelim) && !m.semicolon.length)
+    emit(&m, m.space, 1);
+  flush(&m);
+
+  return !m.failed;
+}
+
+/**
+ * @brief Writes a batch of spans to a file descriptor.
+ *
+ * @param spans The spans.
+ * @param count The number of spans, at most TOK_MINIFY_BATCH.
+ * @param userData Points to the file descriptor.
+ * @return true on success, false on a write error.
+ */
+static bool writeSpans(const TokenSpan *spans, size_t count, void *userData) {
+  int fd = *(const int *) userData;
+
+#if !defined(_WIN32)
+  struct iovec iov[TOK_MINIFY_BATCH];
+
+  for(size_t i = 0; i < count; i++) {
+    iov[i].iov_base = (void *) spans[i].data;
+    iov[i].iov_len = spans[i].length;
+  }
+
+  size_t first = 0;
+
+  while(first < count) {
+    ssize_t written = writev(fd, iov + first, (int) (count - first));
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+
+    // Skip what was written, which may end inside a span
+    size_t n = (size_t) written;
+    while(first < count && n >= iov[first].iov_len)
+      n -= iov[first++].iov_len;
+
+    if(first < count) {
+      iov[first].iov_base = (char *) iov[first].iov_base + n;
+      iov[first].iov_len -= n;
+    }
+  }
+#else
+  for(size_t i = 0; i < count; i++) {
+    const char *data = spans[i].data;
+    size_t left = spans[i].length;
+
+    while(left) {
+      int written = _write(fd, data, (unsigned) (left < 1u << 30 ? left : 1u << 30));
+      if(written < 0) {
+        if(errno == EINTR)
+          continue;
+        return false;
+      }
+
+      data += written;
+      left -= (size_t) written;
+    }
+  }
+#endif
+
+  return true;
+}
+
+/**
+ * @brief Minifies the rest of a tokenizer's input into a file descriptor.
+ *
+ * Each batch of spans is written with one writev() call where partial
+ * writes allow it.
+ *
+ * @param t The tokenizer, as for tokMinify().
+ * @param fd An open file descriptor.
+ * @return true on success, false on invalid arguments or a write error.
+ */
+bool tokMinifyToFd(Tokenizer *t, int fd) {
+  if(fd < 0)
+    return false;
+
+  return tokMinify(t, writeSpans, &fd);
+}
@@ -0,0 +1,632 @@
+#include <stdalign.h>
+#include <string.h>
+#include "comot-css/atoms.h"
+#include "comot-css/parser.h"
+#include "parser_impl.h"
+
+#define TOK_PARSE_MIN_NODES 256
+
+// Rule blocks nested deeper than this are kept as plain blocks of component
+// values, so hostile input cannot exhaust the stack. Component values
+// themselves are consumed without recursion.
+#define TOK_PARSE_MAX_RULE_DEPTH 64
+
+#define NO_FRAME UINT32_MAX
+
+// Parser state. Nodes whose parent is still open wait on `pending`, right
+// after their parent; when the parent is closed they are moved to `nodes`
+// as one contiguous run, so a node's children always are.
+typedef struct {
+  Tokenizer *t;
+  Arena *arena;
+  Token tok;              // Current token
+  const char *tokStart;   // Where it starts (before "url(" for url tokens)
+  const char *tokEnd;     // Input position after it
+  const char *prevEnd;    // Input position after the token before it
+  bool reconsume;         // Hand out the current token again
+  bool failed;            // The arena is exhausted
+  size_t depth;           // Rule blocks open
+  TokNode *nodes;         // Finished nodes, nodes[0] is the root
+  size_t nodeCount;
+  size_t nodeCap;
+  TokNode *pending;       // Open nodes and the children collected for them
+  size_t pendingCount;
+  size_t pendingCap;
+} Parser;
+
+static void consumeRuleList(Parser *p, bool topLevel);
+static void consumeDeclarationList(Parser *p);
+
+/**
+ * @brief Makes room for `need` nodes in one of the parser's arrays.
+ *
+ * The first array holds at least TOK_PARSE_MIN_NODES nodes; see
+ * tokArenaGrow().
+ *
+ * @param p The parser.
+ * @param array The array.
+ * @param cap Its capacity.
+ * @param used The nodes it holds.
+ * @param need The nodes it must be able to hold.
+ * @return true on success, false (and p->failed set) if the arena is exhausted.
+ */
+static bool reserveNodes(Parser *p, TokNode **array, size_t *cap, size_t used, size_t need) {
+  if(need < TOK_PARSE_MIN_NODES)
+    need = TOK_PARSE_MIN_NODES;
+
+  if(!tokArenaGrow(p->arena, (void **) array, cap, used, need, sizeof(TokNode), alignof(TokNode))) {
+    p->failed = true;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Moves to the next token, skipping comments.
+ *
+ * @param p The parser.
+ */
+static void nextToken(Parser *p) {
+  if(p->reconsume) {
+    p->reconsume = false;
+    return;
+  }
+
+  size_t tokens = 0;
+  size_t index;
+
+  p->prevEnd = p->tokEnd;
+  p->tok = readParserToken(p->t, &p->tokStart, &tokens, &index);
+  p->tokEnd = p->t->curr;
+}
+
+/**
+ * @brief Checks whether the current token ends the list being consumed.
+ *
+ * Inside a rule block the closing '}' plays the part of the end of input.
+ *
+ * @param p The parser.
+ * @return true at the end of the list.
+ */
+static inline bool isListEnd(const Parser *p) {
+  return p->tok.type == TOKEN_EOF || (p->depth && p->tok.type == TOKEN_RIGHT_CURLY);
+}
+
+/**
+ * @brief Appends a node to the children of the innermost open node.
+ *
+ * @param p The parser.
+ * @param node The node.
+ * @return Its index on the pending stack, or NO_FRAME if the arena is exhausted.
+ */
+static uint32_t pushNode(Parser *p, TokNode node) {
+  if(!reserveNodes(p, &p->pending, &p->pendingCap, p->pendingCount, p->pendingCount + 1))
+    return NO_FRAME;
+
+  p->pending[p->pendingCount] = node;
+
+  return (uint32_t) p->pendingCount++;
+}
+
+/**
+ * @brief Opens a node that starts at the current token.
+ *
+ * The name of at-rules, declarations and functions is the current token.
+ *
+ * @param p The parser.
+ * @param type The node type.
+ * @param token The opening bracket of a block, 0 otherwise.
+ * @return Its index on the pending stack, or NO_FRAME if the arena is exhausted.
+ */
+static uint32_t openNode(Parser *p, TokNodeType type, TokenType token) {
+  TokNode node = {0};
+
+  node.offset = (uint32_t) (p->tokStart - p->t->start);
+  node.type = (uint8_t) type;
+  node.token = (uint8_t) token;
+
+  if(type == TOK_NODE_AT_RULE || type == TOK_NODE_DECLARATION || type == TOK_NODE_FUNCTION) {
+    node.nameLength = (uint32_t) p->tok.length;
+    node.atom = (uint16_t) p->tok.atom;
+  }
+
+  return pushNode(p, node);
+}
+
+/**
+ * @brief Closes an open node, moving its children to the node array.
+ *
+ * The node stays on the pending stack as a child of its own parent.
+ *
+ * @param p The parser.
+ * @param frame The node's index on the pending stack.
+ * @param end The input position the node ends at.
+ */
+static void closeNode(Parser *p, uint32_t frame, const char *end) {
+  size_t children = p->pendingCount - (frame + 1);
+
+  if(!reserveNodes(p, &p->nodes, &p->nodeCap, p->nodeCount, p->nodeCount + children))
+    return;
+
+  TokNode *node = &p->pending[frame];
+
+  if(children)
+    memcpy(p->nodes + p->nodeCount, node + 1, children * sizeof(TokNode));
+
+  node->first = (uint32_t) p->nodeCount;
+  node->count = (uint32_t) children;
+  node->length = (uint32_t) (end - (p->t->start + node->offset));
+
+  p->nodeCount += children;
+  p->pendingCount = frame + 1;
+}
+
+/**
+ * @brief Drops an open node and everything consumed for it.
+ *
+ * @param p The parser.
+ * @param frame The node's index on the pending stack.
+ * @param nodeMark The node count when it was opened.
+ */
+static inline void dropNode(Parser *p, uint32_t frame, size_t nodeMark) {
+  p->pendingCount = frame;
+  p->nodeCount = nodeMark;
+}
+
+/**
+ * @brief Returns the token that closes a block or function.
+ *
+ * @param node The open block or function.
+ * @return The closing token type.
+ */
+static inline TokenType closingToken(const TokNode *node) {
+  switch(node->token) {
+    case TOKEN_LEFT_CURLY:
+      return TOKEN_RIGHT_CURLY;
+    case TOKEN_LEFT_SQUARE:
+      return TOKEN_RIGHT_SQUARE;
+    default:
+      return TOKEN_RIGHT_PAREN;
+  }
+}
+
+/**
+ * @brief Consumes a component value starting at the current token.
+ *
+ * Blocks and functions are consumed up to their closing token. Nesting is
+ * tracked on the pending stack instead of by recursion: while a node is
+ * open its `first` field links to the enclosing open node. At the end of
+ * input every open node is closed and the TOKEN_EOF is left to be
+ * consumed again.
+ *
+ * @param p The parser, with the first token of the value current.
+ */
+static void consumeComponentValue(Parser *p) {
+  uint32_t frame = NO_FRAME;
+
+  while(!p->failed) {
+    const Token *tok = &p->tok;
+
+    if(frame != NO_FRAME && tok->type == closingToken(&p->pending[frame])) {
+      uint32_t parent = p->pending[frame].first;
+
+      closeNode(p, frame, p->tokEnd);
+      if(parent == NO_FRAME)
+        return;
+
+      frame = parent;
+    }
+    else if(tok->type == TOKEN_EOF) {
+      reportDiagnostic(p->t, TOK_DIAG_EOF_IN_BLOCK, p->tokStart);
+
+      while(frame != NO_FRAME && !p->failed) {
+        uint32_t parent = p->pending[frame].first;
+
+        p->pending[frame].flags |= TOK_NODE_UNCLOSED;
+        closeNode(p, frame, p->tokStart);
+        frame = parent;
+      }
+
+      p->reconsume = true;
+      return;
+    }
+    else if(tok->type == TOKEN_FUNCTION || tok->type == TOKEN_LEFT_CURLY ||
+            tok->type == TOKEN_LEFT_SQUARE || tok->type == TOKEN_LEFT_PAREN) {
+      bool function = tok->type == TOKEN_FUNCTION;
+      uint32_t opened = openNode(p, function ? TOK_NODE_FUNCTION : TOK_NODE_BLOCK,
+                                 function ? TOKEN_LEFT_PAREN : tok->type);
+      if(opened == NO_FRAME)
+        return;
+
+      p->pending[opened].first = frame;
+      frame = opened;
+    }
+    else {
+      TokNode node = {0};
+
+      node.offset = (uint32_t) (tok->value - p->t->start);
+      node.length = (uint32_t) tok->length;
+      node.atom = (uint16_t) tok->atom;
+      node.type = TOK_NODE_TOKEN;
+      node.token = (uint8_t) tok->type;
+      node.flags = tok->kind == TOKEN_KIND_ERROR ? TOK_NODE_ERROR : 0;
+
+      if(pushNode(p, node) == NO_FRAME || frame == NO_FRAME)
+        return;
+    }
+
+    nextToken(p);
+  }
+}
+
+/**
+ * @brief Consumes the '{' block of a rule, up to its '}'.
+ *
+ * @param p The parser, with the '{' current.
+ * @param rules Whether the block holds rules rather than declarations.
+ */
+static void consumeRuleBlock(Parser *p, bool rules) {
+  if(p->depth >= TOK_PARSE_MAX_RULE_DEPTH) {
+    consumeComponentValue(p);
+    return;
+  }
+
+  uint32_t frame = openNode(p, TOK_NODE_BLOCK, TOKEN_LEFT_CURLY);
+  if(frame == NO_FRAME)
+    return;
+
+  p->depth++;
+  if(rules)
+    consumeRuleList(p, false);
+  else
+    consumeDeclarationList(p);
+  p->depth--;
+
+  // The list stopped at the '}' or the end of input
+  nextToken(p);
+
+  if(p->tok.type == TOKEN_EOF) {
+    reportDiagnostic(p->t, TOK_DIAG_EOF_IN_BLOCK, p->tokStart);
+    p->pending[frame].flags |= TOK_NODE_UNCLOSED;
+    p->reconsume = true;
+  }
+
+  closeNode(p, frame, p->tokEnd);
+}
+
+/**
+ * @brief Consumes an at-rule: its prelude and a ';' or a block.
+ *
+ * @param p The parser, with the at-keyword current.
+ */
+static void consumeAtRule(Parser *p) {
+  uint32_t frame = openNode(p, TOK_NODE_AT_RULE, 0);
+  if(frame == NO_FRAME)
+    return;
+
+  TokAtom atom = (TokAtom) p->pending[frame].atom;
+  const char *end = p->tokEnd;
+
+  while(true) {
+    nextToken(p);
+
+    if(p->tok.type == TOKEN_SEMICOLON) {
+      end = p->tokEnd;
+      break;
+    }
+
+    if(isListEnd(p)) {
+      if(p->tok.type == TOKEN_EOF) {
+        reportDiagnostic(p->t, TOK_DIAG_EOF_IN_BLOCK, p->tokStart);
+        p->pending[frame].flags |= TOK_NODE_UNCLOSED;
+      }
+
+      p->reconsume = true;
+      end = p->prevEnd;
+      break;
+    }
+
+    if(p->tok.type == TOKEN_LEFT_CURLY) {
+      consumeRuleBlock(p, holdsRules(atom));
+      p->pending[frame].flags |= TOK_NODE_HAS_BLOCK;
+      end = p->tokEnd;
+      break;
+    }
+
+    consumeComponentValue(p);
+    if(p->failed)
+      return;
+  }
+
+  if(!p->failed)
+    closeNode(p, frame, end);
+}
+
+/**
+ * @brief Consumes a qualified rule: its prelude and its block.
+ *
+ * A rule that reaches the end of its list before a '{' is dropped.
+ *
+ * @param p The parser, with the first prelude token current.
+ */
+static void consumeQualifiedRule(Parser *p) {
+  size_t nodeMark = p->nodeCount;
+  uint32_t frame = openNode(p, TOK_NODE_QUALIFIED_RULE, 0);
+
+  while(frame != NO_FRAME && !p->failed) {
+    if(isListEnd(p)) {
+      reportDiagnostic(p->t, TOK_DIAG_RULE_WITHOUT_BLOCK, p->tokStart);
+      dropNode(p, frame, nodeMark);
+      p->reconsume = true;
+      return;
+    }
+
+    if(p->tok.type == TOKEN_LEFT_CURLY) {
+      consumeRuleBlock(p, false);
+      if(!p->failed) {
+        p->pending[frame].flags |= TOK_NODE_HAS_BLOCK;
+        closeNode(p, frame, p->tokEnd);
+      }
+      return;
+    }
+
+    consumeComponentValue(p);
+    nextToken(p);
+  }
+}
+
+/**
+ * @brief Consumes and throws away component values up to the next ';'.
+ *
+ * The ';' or the end of the list is left to be consumed again.
+ *
+ * @param p The parser, with the first token to drop current.
+ */
+static void skipDeclaration(Parser *p) {
+  size_t pendingMark = p->pendingCount;
+  size_t nodeMark = p->nodeCount;
+
+  while(!p->failed && p->tok.type != TOKEN_SEMICOLON && !isListEnd(p)) {
+    consumeComponentValue(p);
+    nextToken(p);
+  }
+
+  p->reconsume = true;
+  dropNode(p, (uint32_t) pendingMark, nodeMark);
+}
+
+/**
+ * @brief Checks whether a pending node is a whitespace token.
+ *
+ * @param node The node.
+ * @return true for whitespace.
+ */
+static inline bool isWhitespaceNode(const TokNode *node) {
+  return node->type == TOK_NODE_TOKEN && node->token == TOKEN_WHITESPACE;
+}
+
+/**
+ * @brief Trims a declaration's value and takes off a final "!important".
+ *
+ * @param p The parser.
+ * @param frame The open declaration.
+ */
+static void trimValue(Parser *p, uint32_t frame) {
+  const TokNode *values = p->pending;
+  size_t last = p->pendingCount;
+
+  while(last > frame + 1 && isWhitespaceNode(&values[last - 1]))
+    last--;
+
+  if(last > frame + 1 && values[last - 1].type == TOK_NODE_TOKEN &&
+     values[last - 1].token == TOKEN_IDENT && values[last - 1].atom == TOK_ATOM_IMPORTANT) {
+    size_t bang = last - 1;
+
+    while(bang > frame + 1 && isWhitespaceNode(&values[bang - 1]))
+      bang--;
+
+    if(bang > frame + 1 && values[bang - 1].type == TOK_NODE_TOKEN &&
+       values[bang - 1].token == TOKEN_DELIM && p->t->start[values[bang - 1].offset] == '!') {
+      p->pending[frame].flags |= TOK_NODE_IMPORTANT;
+      last = bang - 1;
+
+      while(last > frame + 1 && isWhitespaceNode(&values[last - 1]))
+        last--;
+    }
+  }
+
+  p->pendingCount = last;
+}
+
+/**
+ * @brief Consumes a declaration up to the next ';' or the end of the list.
+ *
+ * A name not followed by ':' is a parse error and the declaration is
+ * dropped. The ';' or the end of the list is left to be consumed again.
+ *
+ * @param p The parser, with the name current.
+ */
+static void consumeDeclaration(Parser *p) {
+  size_t nodeMark = p->nodeCount;
+  uint32_t frame = openNode(p, TOK_NODE_DECLARATION, 0);
+  if(frame == NO_FRAME)
+    return;
+
+  do {
+    nextToken(p);
+  } while(p->tok.type == TOKEN_WHITESPACE);
+
+  if(p->tok.type != TOKEN_COLON) {
+    reportDiagnostic(p->t, TOK_DIAG_INVALID_DECLARATION, p->t->start + p->pending[frame].offset);
+    dropNode(p, frame, nodeMark);
+    skipDeclaration(p);
+    return;
+  }
+
+  const char *end = p->tokEnd;
+
+  do {
+    nextToken(p);
+  } while(p->tok.type == TOKEN_WHITESPACE);
+
+  while(!p->failed && p->tok.type != TOKEN_SEMICOLON && !isListEnd(p)) {
+    consumeComponentValue(p);
+
+    if(p->tok.type != TOKEN_WHITESPACE)
+      end = p->tokEnd;
+
+    nextToken(p);
+  }
+
+  p->reconsume = true;
+
+  if(!p->failed) {
+    trimValue(p, frame);
+    closeNode(p, frame, end);
+  }
+}
+
+/**
+ * @brief Consumes a list of declarations and at-rules.
+ *
+ * Stops at the end of the list, which is left to be consumed again.
+ *
+ * @param p The parser.
+ */
+static void consumeDeclarationList(Parser *p) {
+  while(!p->failed) {
+    nextToken(p);
+
+    if(p->tok.type == TOKEN_WHITESPACE || p->tok.type == TOKEN_SEMICOLON)
+      continue;
+
+    if(isListEnd(p)) {
+      p->reconsume = true;
+      return;
+    }
+
+    if(p->tok.type == TOKEN_AT_KEYWORD) {
+      consumeAtRule(p);
+    }
+    else if(p->tok.type == TOKEN_IDENT) {
+      consumeDeclaration(p);
+    }
+    else {
+      reportDiagnostic(p->t, TOK_DIAG_INVALID_DECLARATION, p->tokStart);
+      skipDeclaration(p);
+    }
+  }
+}
+
+/**
+ * @brief Consumes a list of rules.
+ *
+ * Stops at the end of the list, which is left to be consumed again.
+ *
+ * @param p The parser.
+ * @param topLevel Whether this is the stylesheet itself, where CDO and CDC
+ *                 tokens are ignored.
+ */
+static void consumeRuleList(Parser *p, bool topLevel) {
+  while(!p->failed) {
+    nextToken(p);
+
+    if(p->tok.type == TOKEN_WHITESPACE)
+      continue;
+
+    if(isListEnd(p)) {
+      p->reconsume = true;
+      return;
+    }
+
+    if(topLevel && (p->tok.type == TOKEN_CDO || p->tok.type == TOKEN_CDC))
+      continue;
+
+    if(p->tok.type == TOKEN_AT_KEYWORD)
+      consumeAtRule(p);
+    else
+      consumeQualifiedRule(p);
+  }
+}
+
+/**
+ * @brief Parses the rest of a tokenizer's input into a tree.
+ *
+ * @param t The tokenizer.
+ * @param arena The arena the tree is allocated from.
+ * @param out Receives the tree.
+ * @param declarations Parse a list of declarations instead of a stylesheet.
+ * @return true on success, false on invalid arguments or arena exhaustion.
+ */
+static bool parse(Tokenizer *t, Arena *arena, TokSyntaxTree *out, bool declarations) {
+  if(!out)
+    return false;
+
+  memset(out, 0, sizeof(TokSyntaxTree));
+
+  if(!t || !arena || t->streaming || (size_t) (t->end - t->start) > UINT32_MAX)
+    return false;
+
+  Parser p;
+  memset(&p, 0, sizeof(Parser));
+  p.t = t;
+  p.arena = arena;
+  p.tokStart = t->curr;
+  p.tokEnd = t->curr;
+
+  // nodes[0] is kept for the root, which is closed last
+  if(!reserveNodes(&p, &p.nodes, &p.nodeCap, 0, 1))
+    return false;
+  p.nodeCount = 1;
+
+  uint32_t root = openNode(&p, declarations ? TOK_NODE_DECLARATION_LIST : TOK_NODE_STYLESHEET, 0);
+  if(root == NO_FRAME)
+    return false;
+
+  if(declarations)
+    consumeDeclarationList(&p);
+  else
+    consumeRuleList(&p, true);
+
+  nextToken(&p);
+  closeNode(&p, root, t->end);
+
+  if(p.failed)
+    return false;
+
+  p.nodes[0] = p.pending[root];
+
+  out->nodes = p.nodes;
+  out->count = p.nodeCount;
+  out->text = t->start;
+
+  return true;
+}
+
+/**
+ * @brief Parses the rest of a tokenizer's input as a stylesheet.
+ *
+ * Follows "consume a list of rules" with the top-level flag set; see
+ * parser.h for how blocks are interpreted.
+ *
+ * @param t The tokenizer, not in streaming mode.
+ * @param arena The arena the tree is allocated from.
+ * @param out Receives the tree.
+ * @return true on success, false on invalid arguments or arena exhaustion.
+ */
+bool tokParseStylesheet(Tokenizer *t, Arena *arena, TokSyntaxTree *out) {
+  return parse(t, arena, out, false);
+}
+
+/**
+ * @brief Parses the rest of a tokenizer's input as a list of declarations.
+ *
+ * @param t The tokenizer, not in streaming mode.
+ * @param arena The arena the tree is allocated from.
+ * @param out Receives the tree.
+ * @return true on success, false on invalid arguments or arena exhaustion.
+ */
+bool tokParseDeclarations(Tokenizer *t, Arena *arena, TokSyntaxTree *out) {
+  return parse(t, arena, out, true);
+}
@@ -0,0 +1,90 @@
+#ifndef PARSER_IMPL_H
+#define PARSER_IMPL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "comot-css/atoms.h"
+#include "comot-css/tokens.h"
+#include "tokenizer_impl.h"
+
+// Helpers shared by the tree parser (parser.c) and the event parser (sax.c)
+
+/**
+ * @brief Checks whether an at-rule's block holds rules or declarations.
+ *
+ * @param atom The at-rule's name.
+ * @return true for the conditional and grouping rules and @keyframes.
+ */
+static inline bool holdsRules(TokAtom atom) {
+  switch(atom) {
+    case TOK_ATOM_MEDIA:
+    case TOK_ATOM_SUPPORTS:
+    case TOK_ATOM_KEYFRAMES:
+    case TOK_ATOM_WEBKIT_KEYFRAMES:
+    case TOK_ATOM_LAYER:
+    case TOK_ATOM_CONTAINER:
+    case TOK_ATOM_DOCUMENT:
+    case TOK_ATOM_SCOPE:
+    case TOK_ATOM_STARTING_STYLE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Checks whether a url token's ')' was left in the input.
+ *
+ * The tokenizer reads the ')' of "url(x)" as a token of its own, while
+ * "url( x )" takes it along (together with the whitespace before it).
+ *
+ * @param t The tokenizer, just after the token.
+ * @param tok The token.
+ * @return true if the next byte is the url's ')'.
+ */
+static inline bool urlParenLeft(const Tokenizer *t, const Token *tok) {
+  if(tok->type != TOKEN_URL || t->curr >= t->end || *t->curr != ')')
+    return false;
+
+  const char *end = tok->value + tok->length;
+
+  return !(tok->length >= 2 && end[-1] == ')' && isWhitespace(end - 2));
+}
+
+/**
+ * @brief Reads the next token a parser sees.
+ *
+ * Comments are skipped, and a url token is taken together with its ')',
+ * as in the specification.
+ *
+ * @param t The tokenizer.
+ * @param start Receives where the token starts (before "url(" for url
+ *              tokens, whose value starts after it).
+ * @param tokens Counts the tokens tokNext() returned, including skipped ones.
+ * @param index Receives the index of the token in the tokNext() stream.
+ * @return The token.
+ */
+static inline Token readParserToken(Tokenizer *t, const char **start, size_t *tokens, size_t *index) {
+  const char *before;
+  Token tok;
+
+  do {
+    before = t->curr;
+    tok = tokNext(t);
+    (*tokens)++;
+  } while(tok.type == TOKEN_COMMENT);
+
+  *index = *tokens - 1;
+
+  if(urlParenLeft(t, &tok)) {
+    t->curr++;
+    (*tokens)++;
+  }
+
+  bool url = tok.type == TOKEN_URL || tok.type == TOKEN_BAD_URL;
+  *start = url && !t->skipWhitespace && !t->skipComments ? before : tok.value;
+
+  return tok;
+}
+
+#endif  // !PARSER_IMPL_H
@@ -0,0 +1,547 @@
+#include <string.h>
+#include "comot-css/atoms.h"
+#include "comot-css/sax.h"
+#include "parser_impl.h"
+
+// Nesting the parser handles without touching the arena
+#define TOK_SAX_INLINE_DEPTH 64
+
+// As in parser.c: rule blocks nested deeper than this are read as plain
+// blocks of component values
+#define TOK_PARSE_MAX_RULE_DEPTH 64
+
+// What an entry of the nesting stack holds
+typedef enum {
+  SAX_RULES,            // a list of rules
+  SAX_DECLARATIONS,     // a list of declarations
+  SAX_PAREN,            // (, or a function, in a prelude or value
+  SAX_SQUARE,
+  SAX_CURLY,
+  SAX_RULE_CURLY        // block of a rule nested too deeply, see above
+} SaxFrame;
+
+// What the current token belongs to
+typedef enum {
+  SAX_IDLE,             // nothing: between rules or declarations
+  SAX_AT_RULE,          // the prelude of an at-rule
+  SAX_QUALIFIED_RULE,   // the prelude of a qualified rule
+  SAX_DECLARATION_NAME, // a declaration, before its ':'
+  SAX_DECLARATION_VALUE,
+  SAX_SKIP              // an invalid declaration, up to the next ';'
+} SaxItem;
+
+typedef enum {
+  SAX_MARK_OTHER,
+  SAX_MARK_BANG,        // '!' delim
+  SAX_MARK_IMPORTANT    // "important" ident
+} SaxMarkKind;
+
+// A non-whitespace token of a prelude or value
+typedef struct {
+  const char *end;      // Input position after it
+  size_t last;          // Index of its last token in the tokNext() stream
+  SaxMarkKind kind;
+} SaxMark;
+
+// Parser state. Nothing is kept per rule or declaration once it has been
+// reported, so the state only grows with the nesting stack.
+typedef struct {
+  Tokenizer *t;
+  const TokSaxHandler *h;
+  Token tok;              // Current token
+  const char *tokStart;   // Where it starts (before "url(" for url tokens)
+  size_t index;           // Its index in the tokNext() stream
+  size_t tokens;          // Tokens tokNext() returned so far
+  uint8_t *stack;         // Nesting stack of SaxFrame
+  size_t depth;
+  size_t cap;
+  SaxItem item;
+  const char *itemStart;  // Where the rule or declaration starts
+  TokenSpan name;
+  TokAtom atom;
+  const char *first;      // Start of the first non-whitespace token
+  size_t firstIndex;
+  SaxMark marks[3];       // The last three non-whitespace tokens, a ring
+  size_t markCount;
+  uint8_t inlineStack[TOK_SAX_INLINE_DEPTH];
+} SaxParser;
+
+/**
+ * @brief Pushes an entry on the nesting stack.
+ *
+ * Past the inline entries the stack grows in the tokenizer's arena; see
+ * tokArenaGrow().
+ *
+ * @param p The parser.
+ * @param frame The entry.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool pushFrame(SaxParser *p, SaxFrame frame) {
+  if(p->depth == p->cap) {
+    // Counted like every other tokenizer allocation, see tokArenaAlloc()
+    p->t->allocCount++;
+
+    if(!tokArenaGrow(p->t->arena, (void **) &p->stack, &p->cap, p->depth, p->depth + 1, 1, 1))
+      return false;
+  }
+
+  p->stack[p->depth++] = (uint8_t) frame;
+
+  return true;
+}
+
+/**
+ * @brief Pushes a bracket entry if a token opens a block or function.
+ *
+ * @param p The parser.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool pushOpener(SaxParser *p) {
+  switch(p->tok.type) {
+    case TOKEN_FUNCTION:
+    case TOKEN_LEFT_PAREN:
+      return pushFrame(p, SAX_PAREN);
+    case TOKEN_LEFT_SQUARE:
+      return pushFrame(p, SAX_SQUARE);
+    case TOKEN_LEFT_CURLY:
+      return pushFrame(p, SAX_CURLY);
+    default:
+      return true;
+  }
+}
+
+/**
+ * @brief Returns the token that closes a bracket entry.
+ *
+ * @param frame The entry.
+ * @return The closing token type.
+ */
+static inline TokenType closingToken(uint8_t frame) {
+  switch(frame) {
+    case SAX_PAREN:
+      return TOKEN_RIGHT_PAREN;
+    case SAX_SQUARE:
+      return TOKEN_RIGHT_SQUARE;
+    default:
+      return TOKEN_RIGHT_CURLY;
+  }
+}
+
+/**
+ * @brief Returns a byte offset in the tokenizer's input.
+ *
+ * @param p The parser.
+ * @param at A position in the input.
+ * @return Its offset.
+ */
+static inline size_t offsetOf(const SaxParser *p, const char *at) {
+  return (size_t) (at - p->t->start);
+}
+
+/**
+ * @brief Reports the end of a rule block.
+ *
+ * @param p The parser.
+ * @param at The '}', or the end of input for an unclosed block.
+ */
+static inline void blockEnd(SaxParser *p, const char *at) {
+  if(p->h->onBlockEnd)
+    p->h->onBlockEnd(offsetOf(p, at), p->h->userData);
+}
+
+/**
+ * @brief Starts reading a rule or declaration at the current token.
+ *
+ * @param p The parser.
+ * @param item What is read.
+ */
+static void beginItem(SaxParser *p, SaxItem item) {
+  p->item = item;
+  p->itemStart = p->tokStart;
+  p->name = (TokenSpan) { p->tokStart, 0 };
+  p->atom = TOK_ATOM_NONE;
+  p->first = item == SAX_QUALIFIED_RULE ? p->tokStart : p->t->curr;
+  p->markCount = 0;
+
+  if(item == SAX_AT_RULE) {
+    p->name = (TokenSpan) { p->tok.value + 1, p->tok.length - 1 };
+    p->atom = p->tok.atom;
+  }
+  else if(item == SAX_DECLARATION_NAME) {
+    p->name = (TokenSpan) { p->tok.value, p->tok.length };
+    p->atom = p->tok.atom;
+  }
+}
+
+/**
+ * @brief Records a token of the current prelude or value.
+ *
+ * @param p The parser.
+ * @param nested Whether the token is inside a block or function, where it
+ *               cannot be part of a final "!important".
+ */
+static void markToken(SaxParser *p, bool nested) {
+  const Token *tok = &p->tok;
+
+  if(tok->type == TOKEN_WHITESPACE)
+    return;
+
+  SaxMark *mark = &p->marks[p->markCount % 3];
+
+  if(!p->markCount++) {
+    p->first = p->tokStart;
+    p->firstIndex = p->index;
+  }
+
+  mark->end = p->t->curr;
+  mark->last = p->tokens - 1;
+  mark->kind = SAX_MARK_OTHER;
+
+  if(nested)
+    return;
+
+  if(tok->type == TOKEN_DELIM && *tok->value == '!')
+    mark->kind = SAX_MARK_BANG;
+  else if(tok->type == TOKEN_IDENT && tok->atom == TOK_ATOM_IMPORTANT)
+    mark->kind = SAX_MARK_IMPORTANT;
+}
+
+/**
+ * @brief Returns one of the last three recorded tokens.
+ *
+ * @param p The parser.
+ * @param back 1 for the last token, 2 for the one before it, up to 3.
+ * @return The token's mark.
+ */
+static inline const SaxMark *markBack(const SaxParser *p, size_t back) {
+  return &p->marks[(p->markCount - back) % 3];
+}
+
+/**
+ * @brief Reports the current at-rule or qualified rule.
+ *
+ * @param p The parser.
+ * @param hasBlock Whether a block follows.
+ */
+static void emitRule(SaxParser *p, bool hasBlock) {
+  void (*callback)(const TokSaxRule *, void *) =
+    p->item == SAX_AT_RULE ? p->h->onAtRuleStart : p->h->onQualifiedRuleStart;
+
+  if(!callback)
+    return;
+
+  TokSaxRule rule;
+
+  rule.name = p->name;
+  rule.atom = p->atom;
+  rule.prelude = (TokenSpan) { p->first, 0 };
+  rule.offset = offsetOf(p, p->itemStart);
+  rule.hasBlock = hasBlock;
+
+  if(p->markCount)
+    rule.prelude.length = (size_t) (markBack(p, 1)->end - p->first);
+
+  callback(&rule, p->h->userData);
+}
+
+/**
+ * @brief Reports the current declaration.
+ *
+ * A final '!' followed by "important" is taken off the value, as the tree
+ * parser's trimValue() does.
+ *
+ * @param p The parser.
+ */
+static void emitDeclaration(SaxParser *p) {
+  if(!p->h->onDeclaration)
+    return;
+
+  TokSaxDeclaration decl;
+  size_t count = p->markCount;
+
+  decl.name = p->name;
+  decl.atom = p->atom;
+  decl.value = (TokenSpan) { p->first, 0 };
+  decl.firstToken = p->firstIndex;
+  decl.tokenCount = 0;
+  decl.offset = offsetOf(p, p->itemStart);
+  decl.important = false;
+
+  if(count >= 2 && markBack(p, 1)->kind == SAX_MARK_IMPORTANT &&
+     markBack(p, 2)->kind == SAX_MARK_BANG) {
+    decl.important = true;
+    count -= 2;
+  }
+
+  if(count) {
+    const SaxMark *last = &p->marks[(count - 1) % 3];
+
+    decl.value.length = (size_t) (last->end - p->first);
+    decl.tokenCount = last->last - p->firstIndex + 1;
+  }
+  else {
+    decl.firstToken = p->index;
+  }
+
+  p->h->onDeclaration(&decl, p->h->userData);
+}
+
+/**
+ * @brief Handles a token inside a block or function of a prelude or value.
+ *
+ * At the end of input every open bracket is closed, with one diagnostic,
+ * and the TOKEN_EOF is left to the rule or declaration.
+ *
+ * @param p The parser, with a bracket entry on top of the stack.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool stepNested(SaxParser *p) {
+  uint8_t top = p->stack[p->depth - 1];
+
+  if(p->tok.type == TOKEN_EOF) {
+    reportDiagnostic(p->t, TOK_DIAG_EOF_IN_BLOCK, p->tokStart);
+
+    // The unclosed block runs to the end of input, comments included
+    if(p->item != SAX_IDLE && p->markCount)
+      p->marks[(p->markCount - 1) % 3].end = p->t->end;
+
+    while(p->stack[p->depth - 1] >= SAX_PAREN) {
+      if(p->stack[--p->depth] == SAX_RULE_CURLY)
+        blockEnd(p, p->t->end);
+    }
+
+    return true;
+  }
+
+  if(p->item != SAX_IDLE)
+    markToken(p, true);
+
+  if(p->tok.type == closingToken(top)) {
+    p->depth--;
+    if(top == SAX_RULE_CURLY)
+      blockEnd(p, p->tokStart);
+
+    return true;
+  }
+
+  return pushOpener(p);
+}
+
+/**
+ * @brief Enters the block of the current rule.
+ *
+ * @param p The parser, with the '{' current.
+ * @param rules Whether the block holds rules rather than declarations.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool enterBlock(SaxParser *p, bool rules) {
+  emitRule(p, true);
+  p->item = SAX_IDLE;
+
+  // Every entry below a rule block is a rule or declaration list
+  if(p->depth - 1 >= TOK_PARSE_MAX_RULE_DEPTH)
+    return pushFrame(p, SAX_RULE_CURLY);
+
+  return pushFrame(p, rules ? SAX_RULES : SAX_DECLARATIONS);
+}
+
+/**
+ * @brief Handles the current token.
+ *
+ * A token that ends a rule or declaration is handled again as the start of
+ * what follows, as the specification's algorithms "reconsume" it.
+ *
+ * @param p The parser.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool step(SaxParser *p) {
+  const Token *tok = &p->tok;
+
+  if(p->stack[p->depth - 1] >= SAX_PAREN) {
+    if(!stepNested(p))
+      return false;
+    if(tok->type != TOKEN_EOF)
+      return true;
+  }
+
+  // Inside a rule block the closing '}' plays the part of the end of input
+  bool listEnd = tok->type == TOKEN_EOF || (p->depth > 1 && tok->type == TOKEN_RIGHT_CURLY);
+
+  while(true) {
+    switch(p->item) {
+      case SAX_IDLE:
+        if(tok->type == TOKEN_WHITESPACE)
+          return true;
+
+        if(listEnd) {
+          if(tok->type == TOKEN_RIGHT_CURLY) {
+            p->depth--;
+            blockEnd(p, p->tokStart);
+            return true;
+          }
+
+          for(; p->depth > 1; p->depth--) {
+            reportDiagnostic(p->t, TOK_DIAG_EOF_IN_BLOCK, p->tokStart);
+            blockEnd(p, p->t->end);
+          }
+
+          return true;
+        }
+
+        if(p->stack[p->depth - 1] == SAX_DECLARATIONS) {
+          if(tok->type == TOKEN_SEMICOLON)
+            return true;
+
+          if(tok->type == TOKEN_AT_KEYWORD) {
+            beginItem(p, SAX_AT_RULE);
+            return true;
+          }
+
+          if(tok->type == TOKEN_IDENT) {
+            beginItem(p, SAX_DECLARATION_NAME);
+            return true;
+          }
+
+          reportDiagnostic(p->t, TOK_DIAG_INVALID_DECLARATION, p->tokStart);
+          p->item = SAX_SKIP;
+          continue;
+        }
+
+        if(p->depth == 1 && (tok->type == TOKEN_CDO || tok->type == TOKEN_CDC))
+          return true;
+
+        if(tok->type == TOKEN_AT_KEYWORD) {
+          beginItem(p, SAX_AT_RULE);
+          return true;
+        }
+
+        beginItem(p, SAX_QUALIFIED_RULE);
+        continue;
+
+      case SAX_AT_RULE:
+        if(tok->type == TOKEN_SEMICOLON) {
+          emitRule(p, false);
+          p->item = SAX_IDLE;
+          return true;
+        }
+
+        if(listEnd) {
+          if(tok->type == TOKEN_EOF)
+            reportDiagnostic(p->t, TOK_DIAG_EOF_IN_BLOCK, p->tokStart);
+
+          emitRule(p, false);
+          p->item = SAX_IDLE;
+          continue;
+        }
+
+        if(tok->type == TOKEN_LEFT_CURLY)
+          return enterBlock(p, holdsRules(p->atom));
+
+        markToken(p, false);
+        return pushOpener(p);
+
+      case SAX_QUALIFIED_RULE:
+        if(listEnd) {
+          reportDiagnostic(p->t, TOK_DIAG_RULE_WITHOUT_BLOCK, p->tokStart);
+          p->item = SAX_IDLE;
+          continue;
+        }
+
+        if(tok->type == TOKEN_LEFT_CURLY)
+          return enterBlock(p, false);
+
+        markToken(p, false);
+        return pushOpener(p);
+
+      case SAX_DECLARATION_NAME:
+        if(tok->type == TOKEN_WHITESPACE)
+          return true;
+
+        if(tok->type == TOKEN_COLON) {
+          p->item = SAX_DECLARATION_VALUE;
+          p->first = p->t->curr;
+          return true;
+        }
+
+        reportDiagnostic(p->t, TOK_DIAG_INVALID_DECLARATION, p->itemStart);
+        p->item = SAX_SKIP;
+        continue;
+
+      case SAX_DECLARATION_VALUE:
+        if(tok->type == TOKEN_SEMICOLON || listEnd) {
+          emitDeclaration(p);
+          p->item = SAX_IDLE;
+          continue;
+        }
+
+        markToken(p, false);
+        return pushOpener(p);
+
+      case SAX_SKIP:
+        if(tok->type == TOKEN_SEMICOLON || listEnd) {
+          p->item = SAX_IDLE;
+          continue;
+        }
+
+        return pushOpener(p);
+    }
+  }
+}
+
+/**
+ * @brief Parses the rest of a tokenizer's input into events.
+ *
+ * @param t The tokenizer.
+ * @param handler The callbacks.
+ * @param declarations Parse a list of declarations instead of a stylesheet.
+ * @return true on success, false on invalid arguments or arena exhaustion.
+ */
+static bool parseEvents(Tokenizer *t, const TokSaxHandler *handler, bool declarations) {
+  if(!t || !handler || t->streaming)
+    return false;
+
+  SaxParser p;
+  memset(&p, 0, sizeof(SaxParser));
+  p.t = t;
+  p.h = handler;
+  p.stack = p.inlineStack;
+  p.cap = TOK_SAX_INLINE_DEPTH;
+  p.stack[p.depth++] = declarations ? SAX_DECLARATIONS : SAX_RULES;
+
+  do {
+    p.tok = readParserToken(t, &p.tokStart, &p.tokens, &p.index);
+
+    if(!step(&p))
+      return false;
+  } while(p.tok.type != TOKEN_EOF);
+
+  return true;
+}
+
+/**
+ * @brief Parses the rest of a tokenizer's input as a stylesheet, calling
+ *        a handler for each rule, declaration and end of block.
+ *
+ * The events are those of tokParseStylesheet()'s tree, in document order,
+ * and so are the diagnostics. Nesting is kept on an explicit stack rather
+ * than by recursion.
+ *
+ * @param t The tokenizer, not in streaming mode.
+ * @param handler The callbacks.
+ * @return true on success, false on invalid arguments or arena exhaustion.
+ */
+bool tokParseStylesheetEvents(Tokenizer *t, const TokSaxHandler *handler) {
+  return parseEvents(t, handler, false);
+}
+
+/**
+ * @brief Parses the rest of a tokenizer's input as a list of declarations,
+ *        calling a handler for each.
+ *
+ * @param t The tokenizer, not in streaming mode.
+ * @param handler The callbacks.
+ * @return true on success, false on invalid arguments or arena exhaustion.
+ */
+bool tokParseDeclarationEvents(Tokenizer *t, const TokSaxHandler *handler) {
+  return parseEvents(t, handler, true);
+}
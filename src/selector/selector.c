@@ -0,0 +1,1335 @@
+#include <stdalign.h>
+#include <string.h>
+#include "comot-css/intern.h"
+#include "comot-css/selector.h"
+#include "tokenizer_impl.h"
+
+#define TOK_SELECTOR_MIN_CAPACITY 64
+
+// Compounds in one complex selector, and :is()/:not() nested in each
+// other. Matching recurses once per compound and nesting level, so these
+// bound its stack use.
+#define TOK_SELECTOR_MAX_COMPOUNDS 64
+#define TOK_SELECTOR_MAX_NESTING 16
+
+// Bytecode. Every instruction starts with a word holding the opcode in its
+// low 8 bits and an operand in the other 24. A complex selector is the
+// tests of its rightmost compound, the combinator to the compound on its
+// left, that compound's tests, and so on up to OP_END.
+typedef enum {
+  OP_END,
+  OP_DESCENDANT,        // combinators
+  OP_CHILD,
+  OP_NEXT_SIBLING,
+  OP_LATER_SIBLING,
+  OP_TYPE,              // operand: name index
+  OP_ID,                // operand: name index
+  OP_CLASS,             // operand: name index
+  OP_PSEUDO,            // operand: name index, left to the interface
+  OP_ATTR,              // operand: name index; then AttrKind | ATTR_IGNORE_CASE | value index << 8
+  OP_ROOT,
+  OP_EMPTY,
+  OP_NTH,               // operand: NTH_* flags; then a and b as int32
+  OP_IS,                // operand: count; then the code offset of each selector
+  OP_NOT                // same as OP_IS
+} SelectorOp;
+
+typedef enum {
+  ATTR_EXISTS,
+  ATTR_EQUALS,          // =
+  ATTR_INCLUDES,        // ~=
+  ATTR_DASH,            // |=
+  ATTR_PREFIX,          // ^=
+  ATTR_SUFFIX,          // $=
+  ATTR_SUBSTRING        // *=
+} AttrKind;
+
+#define ATTR_IGNORE_CASE 0x80
+
+#define NTH_LAST    0x01  // count from the last sibling
+#define NTH_OF_TYPE 0x02  // count only siblings with the same name
+
+typedef struct {
+  uint32_t a, b, c;
+} Specificity;
+
+// Compiler state. The compounds of the selectors being read wait on
+// `pending` until the whole complex selector is known, then go to `code`
+// in reverse order.
+typedef struct {
+  Tokenizer *t;
+  Arena *arena;
+  Token tok;              // Current token
+  bool failed;            // The arena is exhausted
+  size_t forgiving;       // Inside :is()/:where(), which drop invalid selectors
+  size_t nesting;         // :is()/:not() levels open
+  size_t depth;           // Brackets open, the current token's included
+  uint32_t *code;
+  size_t codeLength;
+  size_t codeCap;
+  uint32_t *pending;
+  size_t pendingCount;
+  size_t pendingCap;
+  TokSelectorName *names;
+  size_t nameCount;
+  size_t nameCap;
+  TokSelector *selectors;
+  size_t selectorCount;
+  size_t selectorCap;
+} Compiler;
+
+/**
+ * @brief Makes room for one more element in one of the compiler's arrays.
+ *
+ * The first array holds TOK_SELECTOR_MIN_CAPACITY elements; see
+ * tokArenaGrow().
+ *
+ * @param c The compiler.
+ * @param array The array.
+ * @param cap Its capacity, in elements.
+ * @param used The elements it holds.
+ * @param size The size of an element.
+ * @return true on success, false (and c->failed set) if the arena is exhausted.
+ */
+static bool reserve(Compiler *c, void **array, size_t *cap, size_t used, size_t size) {
+  size_t need = used < TOK_SELECTOR_MIN_CAPACITY ? TOK_SELECTOR_MIN_CAPACITY : used + 1;
+
+  if(!tokArenaGrow(c->arena, array, cap, used, need, size, alignof(max_align_t))) {
+    c->failed = true;
+    return false;
+  }
+
+  return true;
+}
+
+static bool pushPending(Compiler *c, uint32_t word) {
+  if(!reserve(c, (void **) &c->pending, &c->pendingCap, c->pendingCount, sizeof(uint32_t)))
+    return false;
+
+  c->pending[c->pendingCount++] = word;
+
+  return true;
+}
+
+static bool pushCode(Compiler *c, uint32_t word) {
+  if(!reserve(c, (void **) &c->code, &c->codeCap, c->codeLength, sizeof(uint32_t)))
+    return false;
+
+  c->code[c->codeLength++] = word;
+
+  return true;
+}
+
+/**
+ * @brief Moves to the next token, skipping comments.
+ *
+ * @param c The compiler.
+ */
+static void nextToken(Compiler *c) {
+  do {
+    c->tok = tokNext(c->t);
+  } while(c->tok.type == TOKEN_COMMENT);
+
+  switch(c->tok.type) {
+    case TOKEN_FUNCTION:
+    case TOKEN_LEFT_PAREN:
+    case TOKEN_LEFT_SQUARE:
+    case TOKEN_LEFT_CURLY:
+      c->depth++;
+      break;
+    case TOKEN_RIGHT_PAREN:
+    case TOKEN_RIGHT_SQUARE:
+    case TOKEN_RIGHT_CURLY:
+      if(c->depth)
+        c->depth--;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Skips whitespace tokens.
+ *
+ * @param c The compiler.
+ * @return true if there were any.
+ */
+static bool skipWhitespace(Compiler *c) {
+  bool skipped = false;
+
+  while(c->tok.type == TOKEN_WHITESPACE) {
+    nextToken(c);
+    skipped = true;
+  }
+
+  return skipped;
+}
+
+static inline bool isDelim(const Compiler *c, char ch) {
+  return c->tok.type == TOKEN_DELIM && *c->tok.value == ch;
+}
+
+/**
+ * @brief Compares a name with a lower-case ASCII literal, ignoring ASCII case.
+ *
+ * @param name The name.
+ * @param literal The literal.
+ * @return true if they are equal.
+ */
+static bool nameIs(TokenSpan name, const char *literal) {
+  size_t len = strlen(literal);
+  if(name.length != len || !name.data)
+    return false;
+
+  for(size_t i = 0; i < len; i++) {
+    char ch = name.data[i];
+    if(ch >= 'A' && ch <= 'Z')
+      ch = (char) (ch - 'A' + 'a');
+    if(ch != literal[i])
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Compares two spans ignoring ASCII case.
+ *
+ * @param a The first span.
+ * @param b The second span.
+ * @return true if they are equal.
+ */
+static bool equalsIgnoringCase(const char *a, size_t aLen, const char *b, size_t bLen) {
+  if(aLen != bLen)
+    return false;
+
+  for(size_t i = 0; i < aLen; i++) {
+    unsigned char x = (unsigned char) a[i];
+    unsigned char y = (unsigned char) b[i];
+
+    if(x >= 'A' && x <= 'Z')
+      x = (unsigned char) (x - 'A' + 'a');
+    if(y >= 'A' && y <= 'Z')
+      y = (unsigned char) (y - 'A' + 'a');
+    if(x != y)
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Reports the current token as the start of an invalid selector.
+ *
+ * Inside :is() and :where() the selector is dropped instead, so nothing
+ * is reported there.
+ *
+ * @param c The compiler.
+ * @return false, for returning from the caller.
+ */
+static bool invalid(Compiler *c) {
+  if(!c->forgiving && !c->failed)
+    reportDiagnostic(c->t, TOK_DIAG_INVALID_SELECTOR, c->tok.value);
+
+  return false;
+}
+
+/**
+ * @brief Adds the decoded value of the current token to the name table.
+ *
+ * @param c The compiler.
+ * @param index Receives the name's index.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool pushName(Compiler *c, uint32_t *index) {
+  TokenSpan value = tokValueArena(&c->tok, c->arena);
+  char *copy = value.data ? arena_alloc(c->arena, value.length + 1, 1) : NULL;
+
+  if(!copy || value.length > UINT32_MAX ||
+     !reserve(c, (void **) &c->names, &c->nameCap, c->nameCount, sizeof(TokSelectorName))) {
+    c->failed = true;
+    return false;
+  }
+
+  memcpy(copy, value.data, value.length);
+  copy[value.length] = '\0';
+
+  TokSelectorName *name = &c->names[c->nameCount];
+  name->data = copy;
+  name->length = (uint32_t) value.length;
+  name->nameId = c->tok.type == TOKEN_STRING ? TOK_NO_NAME : c->tok.nameId;
+
+  *index = (uint32_t) c->nameCount++;
+
+  return true;
+}
+
+/**
+ * @brief Checks whether a hash token's name could be an identifier, as an
+ *        id selector requires.
+ *
+ * @param tok The hash token.
+ * @return true for "#a", "#-a", "#--", "#\\31" and the like.
+ */
+static bool isIdHash(const Token *tok) {
+  const unsigned char *p = (const unsigned char *) tok->value + 1;
+  const unsigned char *end = (const unsigned char *) tok->value + tok->length;
+
+  if(p < end && *p == '-')
+    p++;
+
+  if(p >= end)
+    return false;
+
+  return *p == '-' || *p == '_' || *p == '\\' || *p >= 0x80 ||
+         (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z');
+}
+
+static bool compileList(Compiler *c, bool nested, bool forgiving, Specificity *max);
+
+/**
+ * @brief Reads an integer token.
+ *
+ * @param c The compiler.
+ * @param sign Whether a sign must (1), must not (-1) or may (0) be written.
+ * @param value Receives the value.
+ * @return true if the current token is such an integer.
+ */
+static bool readInteger(const Compiler *c, int sign, int64_t *value) {
+  if(c->tok.type != TOKEN_NUMBER || c->tok.numeric.type != TOKEN_NUMERIC_INTEGER)
+    return false;
+
+  bool hasSign = *c->tok.value == '+' || *c->tok.value == '-';
+  if((sign > 0 && !hasSign) || (sign < 0 && hasSign))
+    return false;
+
+  *value = c->tok.numeric.integer;
+
+  return *value >= INT32_MIN && *value <= INT32_MAX;
+}
+
+/**
+ * @brief Reads "n", "n-" or "n-<digits>" after the A of An+B.
+ *
+ * @param text The rest of the ident or unit after A.
+ * @param len Its length.
+ * @param b Receives -<digits> for "n-<digits>".
+ * @return 1 for "n", 2 for "n-", 3 for "n-<digits>", 0 for anything else.
+ */
+static int readNTail(const char *text, size_t len, int64_t *b) {
+  if(len == 0 || (*text != 'n' && *text != 'N'))
+    return 0;
+
+  if(len == 1)
+    return 1;
+
+  if(text[1] != '-')
+    return 0;
+
+  if(len == 2)
+    return 2;
+
+  int64_t digits = 0;
+  for(size_t i = 2; i < len; i++) {
+    if(text[i] < '0' || text[i] > '9' || digits > INT32_MAX)
+      return 0;
+    digits = digits * 10 + (text[i] - '0');
+  }
+
+  *b = -digits;
+
+  return digits <= INT32_MAX ? 3 : 0;
+}
+
+/**
+ * @brief Parses the An+B argument of an :nth-*() pseudo-class.
+ *
+ * Follows the token grammar of CSS Syntax Level 3, section 6, with the
+ * current token the first of the argument and whitespace skipped.
+ *
+ * @param c The compiler.
+ * @param a Receives A.
+ * @param b Receives B.
+ * @return true if it parses.
+ */
+static bool parseAnPlusB(Compiler *c, int64_t *a, int64_t *b) {
+  const Token *tok = &c->tok;
+  const char *tail = NULL;
+  size_t tailLen = 0;
+
+  *a = 0;
+  *b = 0;
+
+  if(tok->type == TOKEN_IDENT) {
+    TokenSpan name = { tok->value, tok->length };
+
+    if(nameIs(name, "odd") || nameIs(name, "even")) {
+      *a = 2;
+      *b = nameIs(name, "odd") ? 1 : 0;
+      nextToken(c);
+      return true;
+    }
+
+    *a = *tok->value == '-' ? -1 : 1;
+    tail = tok->value + (*a < 0 ? 1 : 0);
+    tailLen = tok->length - (*a < 0 ? 1 : 0);
+  }
+  else if(tok->type == TOKEN_DELIM && *tok->value == '+') {
+    const char *plus = tok->value;
+
+    nextToken(c);
+    if(tok->type != TOKEN_IDENT || tok->value != plus + 1 || *tok->value == '-')
+      return false;
+
+    *a = 1;
+    tail = tok->value;
+    tailLen = tok->length;
+  }
+  else if(tok->type == TOKEN_DIMENSION && tok->numeric.type == TOKEN_NUMERIC_INTEGER) {
+    if(tok->numeric.integer < INT32_MIN || tok->numeric.integer > INT32_MAX)
+      return false;
+
+    *a = tok->numeric.integer;
+    tail = tok->value + tok->numeric.unitOffset;
+    tailLen = tok->length - tok->numeric.unitOffset;
+  }
+  else if(readInteger(c, 0, b)) {
+    nextToken(c);
+    return true;
+  }
+  else {
+    return false;
+  }
+
+  int form = readNTail(tail, tailLen, b);
+  nextToken(c);
+
+  if(form == 0)
+    return false;
+
+  if(form == 3)
+    return true;
+
+  skipWhitespace(c);
+
+  if(form == 2) {
+    // "n- 3"
+    if(!readInteger(c, -1, b))
+      return false;
+
+    *b = -*b;
+    nextToken(c);
+    return true;
+  }
+
+  // "n", then nothing, a signed integer, or a sign and an unsigned one
+  if(readInteger(c, 1, b)) {
+    nextToken(c);
+    return true;
+  }
+
+  if(isDelim(c, '+') || isDelim(c, '-')) {
+    bool minus = isDelim(c, '-');
+
+    nextToken(c);
+    skipWhitespace(c);
+    if(!readInteger(c, -1, b))
+      return false;
+
+    if(minus)
+      *b = -*b;
+    nextToken(c);
+  }
+
+  return true;
+}
+
+/**
+ * @brief Compiles an attribute selector.
+ *
+ * @param c The compiler, with the '[' current.
+ * @return true if it is valid.
+ */
+static bool compileAttribute(Compiler *c) {
+  uint32_t name;
+  uint32_t value = 0;
+  uint32_t kind = ATTR_EXISTS;
+
+  nextToken(c);
+  skipWhitespace(c);
+
+  if(c->tok.type != TOKEN_IDENT)
+    return invalid(c);
+
+  if(!pushName(c, &name))
+    return false;
+
+  nextToken(c);
+  skipWhitespace(c);
+
+  if(c->tok.type != TOKEN_RIGHT_SQUARE) {
+    if(c->tok.type != TOKEN_DELIM)
+      return invalid(c);
+
+    switch(*c->tok.value) {
+      case '=': kind = ATTR_EQUALS; break;
+      case '~': kind = ATTR_INCLUDES; break;
+      case '|': kind = ATTR_DASH; break;
+      case '^': kind = ATTR_PREFIX; break;
+      case '$': kind = ATTR_SUFFIX; break;
+      case '*': kind = ATTR_SUBSTRING; break;
+      default: return invalid(c);
+    }
+
+    if(kind != ATTR_EQUALS) {
+      const char *op = c->tok.value;
+
+      nextToken(c);
+      if(!isDelim(c, '=') || c->tok.value != op + 1)
+        return invalid(c);
+    }
+
+    nextToken(c);
+    skipWhitespace(c);
+
+    if(c->tok.type != TOKEN_IDENT && c->tok.type != TOKEN_STRING)
+      return invalid(c);
+
+    if(!pushName(c, &value))
+      return false;
+
+    nextToken(c);
+    skipWhitespace(c);
+
+    if(c->tok.type == TOKEN_IDENT) {
+      TokenSpan flag = { c->tok.value, c->tok.length };
+
+      if(nameIs(flag, "i"))
+        kind |= ATTR_IGNORE_CASE;
+      else if(!nameIs(flag, "s"))
+        return invalid(c);
+
+      nextToken(c);
+      skipWhitespace(c);
+    }
+  }
+
+  if(c->tok.type != TOKEN_RIGHT_SQUARE)
+    return invalid(c);
+
+  nextToken(c);
+
+  return pushPending(c, OP_ATTR | name << 8) && pushPending(c, kind | value << 8);
+}
+
+/**
+ * @brief Compiles the argument and ')' of a functional pseudo-class.
+ *
+ * @param c The compiler, with the function token current.
+ * @param spec The compound's specificity, updated.
+ * @return true if it is valid.
+ */
+static bool compileFunction(Compiler *c, Specificity *spec) {
+  TokenSpan name = tokValueArena(&c->tok, c->arena);
+  uint32_t nth = 0;
+
+  if(nameIs(name, "nth-child"))
+    nth = 0x100;
+  else if(nameIs(name, "nth-last-child"))
+    nth = 0x100 | NTH_LAST;
+  else if(nameIs(name, "nth-of-type"))
+    nth = 0x100 | NTH_OF_TYPE;
+  else if(nameIs(name, "nth-last-of-type"))
+    nth = 0x100 | NTH_LAST | NTH_OF_TYPE;
+
+  nextToken(c);
+  skipWhitespace(c);
+
+  if(nth) {
+    int64_t a, b;
+
+    if(!parseAnPlusB(c, &a, &b))
+      return invalid(c);
+
+    skipWhitespace(c);
+    if(c->tok.type != TOKEN_RIGHT_PAREN)
+      return invalid(c);
+
+    nextToken(c);
+    spec->b++;
+
+    return pushPending(c, OP_NTH | (nth & 0xFF) << 8) &&
+           pushPending(c, (uint32_t) (int32_t) a) && pushPending(c, (uint32_t) (int32_t) b);
+  }
+
+  bool not = nameIs(name, "not");
+  bool where = nameIs(name, "where");
+
+  if(!not && !where && !nameIs(name, "is") && !nameIs(name, "matches"))
+    return invalid(c);
+
+  if(c->nesting >= TOK_SELECTOR_MAX_NESTING)
+    return invalid(c);
+
+  // The instruction, then the offsets compileList() pushes
+  size_t at = c->pendingCount;
+  if(!pushPending(c, not ? OP_NOT : OP_IS))
+    return false;
+
+  Specificity max = {0};
+
+  c->nesting++;
+  if(!not)
+    c->forgiving++;
+
+  bool valid = compileList(c, true, !not, &max);
+
+  if(!not)
+    c->forgiving--;
+  c->nesting--;
+
+  // :not() reported what was wrong; an :is() list can only fail when it
+  // is not closed
+  if(!valid)
+    return not || c->failed ? false : invalid(c);
+
+  c->pending[at] |= (uint32_t) (c->pendingCount - at - 1) << 8;
+
+  if(!where) {
+    spec->a += max.a;
+    spec->b += max.b;
+    spec->c += max.c;
+  }
+
+  // compileList() stopped at the ')'
+  nextToken(c);
+
+  return true;
+}
+
+/**
+ * @brief Compiles a pseudo-class or pseudo-element.
+ *
+ * @param c The compiler, with the ':' current.
+ * @param spec The compound's specificity, updated.
+ * @param pseudoElement Set if it is a pseudo-element.
+ * @return true if it is valid.
+ */
+static bool compilePseudo(Compiler *c, Specificity *spec, bool *pseudoElement) {
+  const char *colon = c->tok.value;
+
+  nextToken(c);
+
+  // "::name", and the four pseudo-elements that may have one colon
+  if(c->tok.type == TOKEN_COLON && c->tok.value == colon + 1) {
+    nextToken(c);
+    if(c->tok.type != TOKEN_IDENT)
+      return invalid(c);
+
+    *pseudoElement = true;
+  }
+
+  if(c->tok.value != colon + 1 + (*pseudoElement ? 1 : 0))
+    return invalid(c);
+
+  if(c->tok.type == TOKEN_FUNCTION && !*pseudoElement)
+    return compileFunction(c, spec);
+
+  if(c->tok.type != TOKEN_IDENT)
+    return invalid(c);
+
+  TokenSpan name = tokValueArena(&c->tok, c->arena);
+
+  if(nameIs(name, "before") || nameIs(name, "after") || nameIs(name, "first-line") ||
+     nameIs(name, "first-letter"))
+    *pseudoElement = true;
+
+  if(*pseudoElement) {
+    spec->c++;
+    nextToken(c);
+    return true;
+  }
+
+  static const struct {
+    const char *name;
+    uint32_t op;
+    uint32_t flags;
+  } known[] = {
+    { "root", OP_ROOT, 0 },
+    { "empty", OP_EMPTY, 0 },
+    { "first-child", OP_NTH, 0 },
+    { "last-child", OP_NTH, NTH_LAST },
+    { "first-of-type", OP_NTH, NTH_OF_TYPE },
+    { "last-of-type", OP_NTH, NTH_LAST | NTH_OF_TYPE },
+    { "only-child", OP_NTH, 0x100 },
+    { "only-of-type", OP_NTH, 0x100 | NTH_OF_TYPE }
+  };
+
+  spec->b++;
+
+  for(size_t i = 0; i < sizeof(known) / sizeof(known[0]); i++) {
+    if(!nameIs(name, known[i].name))
+      continue;
+
+    nextToken(c);
+
+    if(known[i].op != OP_NTH)
+      return pushPending(c, known[i].op);
+
+    // 0n+1 from the start, the end, or both for :only-*
+    uint32_t flags = known[i].flags & 0xFF;
+
+    if(!pushPending(c, OP_NTH | flags << 8) || !pushPending(c, 0) || !pushPending(c, 1))
+      return false;
+
+    return !(known[i].flags & 0x100) ||
+           (pushPending(c, OP_NTH | (flags | NTH_LAST) << 8) && pushPending(c, 0) && pushPending(c, 1));
+  }
+
+  uint32_t index;
+  if(!pushName(c, &index))
+    return false;
+
+  nextToken(c);
+
+  return pushPending(c, OP_PSEUDO | index << 8);
+}
+
+/**
+ * @brief Compiles a compound selector.
+ *
+ * @param c The compiler, with its first token current.
+ * @param spec The specificity, updated.
+ * @param pseudoElement Set if the compound ends with a pseudo-element.
+ * @return true if it is valid.
+ */
+static bool compileCompound(Compiler *c, Specificity *spec, bool *pseudoElement) {
+  bool any = false;
+
+  if(c->tok.type == TOKEN_IDENT) {
+    uint32_t index;
+    if(!pushName(c, &index) || !pushPending(c, OP_TYPE | index << 8))
+      return false;
+
+    spec->c++;
+    nextToken(c);
+    any = true;
+  }
+  else if(isDelim(c, '*')) {
+    nextToken(c);
+    any = true;
+  }
+
+  // Namespace prefixes are not supported
+  if(isDelim(c, '|'))
+    return invalid(c);
+
+  while(!*pseudoElement) {
+    bool valid;
+
+    if(c->tok.type == TOKEN_HASH) {
+      uint32_t index;
+      if(!isIdHash(&c->tok))
+        return invalid(c);
+
+      valid = pushName(c, &index) && pushPending(c, OP_ID | index << 8);
+      spec->a++;
+      nextToken(c);
+    }
+    else if(isDelim(c, '.')) {
+      const char *dot = c->tok.value;
+      uint32_t index;
+
+      nextToken(c);
+      if(c->tok.type != TOKEN_IDENT || c->tok.value != dot + 1)
+        return invalid(c);
+
+      valid = pushName(c, &index) && pushPending(c, OP_CLASS | index << 8);
+      spec->b++;
+      nextToken(c);
+    }
+    else if(c->tok.type == TOKEN_LEFT_SQUARE) {
+      valid = compileAttribute(c);
+      spec->b++;
+    }
+    else if(c->tok.type == TOKEN_COLON) {
+      valid = compilePseudo(c, spec, pseudoElement);
+    }
+    else {
+      break;
+    }
+
+    if(!valid)
+      return false;
+
+    any = true;
+  }
+
+  return any || invalid(c);
+}
+
+/**
+ * @brief Checks whether the current token ends a complex selector.
+ *
+ * @param c The compiler.
+ * @return true at ',', at the end of input, or at the ')' of :is() and
+ *         the like.
+ */
+static inline bool isSelectorEnd(const Compiler *c) {
+  return c->tok.type == TOKEN_COMMA || c->tok.type == TOKEN_EOF ||
+         (c->nesting && c->tok.type == TOKEN_RIGHT_PAREN);
+}
+
+/**
+ * @brief Compiles a complex selector into the code, right to left.
+ *
+ * @param c The compiler, with its first token current.
+ * @param offset Receives the offset of its code.
+ * @param spec Receives its specificity.
+ * @param flags Receives its TOK_SELECTOR_* flags.
+ * @return true if it is valid.
+ */
+static bool compileComplex(Compiler *c, uint32_t *offset, Specificity *spec, uint32_t *flags) {
+  size_t marks[TOK_SELECTOR_MAX_COMPOUNDS + 1];
+  uint8_t combinators[TOK_SELECTOR_MAX_COMPOUNDS];
+  size_t base = c->pendingCount;
+  size_t compounds = 0;
+  bool pseudoElement = false;
+
+  memset(spec, 0, sizeof(Specificity));
+  *flags = 0;
+
+  skipWhitespace(c);
+
+  while(true) {
+    if(compounds == TOK_SELECTOR_MAX_COMPOUNDS)
+      return invalid(c);
+
+    marks[compounds] = c->pendingCount;
+    if(!compileCompound(c, spec, &pseudoElement))
+      return false;
+
+    compounds++;
+
+    bool space = skipWhitespace(c);
+    if(isSelectorEnd(c))
+      break;
+
+    // A pseudo-element ends the selector
+    if(pseudoElement)
+      return invalid(c);
+
+    uint8_t combinator = OP_DESCENDANT;
+
+    if(isDelim(c, '>'))
+      combinator = OP_CHILD;
+    else if(isDelim(c, '+'))
+      combinator = OP_NEXT_SIBLING;
+    else if(isDelim(c, '~'))
+      combinator = OP_LATER_SIBLING;
+    else if(!space)
+      return invalid(c);
+
+    if(combinator != OP_DESCENDANT) {
+      nextToken(c);
+      skipWhitespace(c);
+    }
+
+    combinators[compounds - 1] = combinator;
+  }
+
+  marks[compounds] = c->pendingCount;
+
+  if(c->codeLength > 0xFFFFFF)
+    return invalid(c);
+
+  *offset = (uint32_t) c->codeLength;
+  *flags = pseudoElement ? TOK_SELECTOR_PSEUDO_ELEMENT : 0;
+
+  for(size_t i = compounds; i-- > 0;) {
+    for(size_t w = marks[i]; w < marks[i + 1]; w++) {
+      if(!pushCode(c, c->pending[w]))
+        return false;
+    }
+
+    if(!pushCode(c, i ? combinators[i - 1] : OP_END))
+      return false;
+  }
+
+  c->pendingCount = base;
+
+  return true;
+}
+
+/**
+ * @brief Skips the rest of an invalid selector in a forgiving list.
+ *
+ * The selector may have failed inside brackets of its own, so this goes
+ * by the bracket depth the list itself is at.
+ *
+ * @param c The compiler.
+ * @param depth The depth of the list, its '(' included.
+ */
+static void skipSelector(Compiler *c, size_t depth) {
+  while(c->tok.type != TOKEN_EOF) {
+    if(c->tok.type == TOKEN_COMMA && c->depth == depth)
+      return;
+    if(c->tok.type == TOKEN_RIGHT_PAREN && c->depth == depth - 1)
+      return;
+
+    nextToken(c);
+  }
+}
+
+static inline uint32_t saturate(uint32_t n) {
+  return n > 0x3FF ? 0x3FF : n;
+}
+
+static inline uint32_t packSpecificity(const Specificity *spec) {
+  return TOK_SPECIFICITY(saturate(spec->a), saturate(spec->b), saturate(spec->c));
+}
+
+/**
+ * @brief Compiles a comma-separated list of complex selectors.
+ *
+ * At the top level each selector is added to the list's selectors. Nested
+ * in :is() and the like, the code offset of each is pushed on `pending`
+ * for the enclosing instruction, and the list stops at its ')'.
+ *
+ * @param c The compiler.
+ * @param nested Whether the list is the argument of a pseudo-class.
+ * @param forgiving Whether invalid selectors are dropped rather than
+ *                  making the list invalid, as in :is() and :where().
+ * @param max Receives the largest specificity of its selectors.
+ * @return true if it is valid.
+ */
+static bool compileList(Compiler *c, bool nested, bool forgiving, Specificity *max) {
+  size_t depth = c->depth;
+
+  while(true) {
+    uint32_t offset;
+    uint32_t flags;
+    Specificity spec;
+    size_t base = c->pendingCount;
+
+    skipWhitespace(c);
+
+    // ":is()" is valid and matches nothing
+    if(forgiving && c->tok.type == TOKEN_RIGHT_PAREN)
+      return true;
+
+    if(compileComplex(c, &offset, &spec, &flags)) {
+      if(packSpecificity(&spec) > packSpecificity(max))
+        *max = spec;
+
+      if(nested) {
+        if(!pushPending(c, offset))
+          return false;
+      }
+      else {
+        if(!reserve(c, (void **) &c->selectors, &c->selectorCap, c->selectorCount, sizeof(TokSelector)))
+          return false;
+
+        TokSelector *sel = &c->selectors[c->selectorCount++];
+        sel->code = offset;
+        sel->specificity = packSpecificity(&spec);
+        sel->flags = flags;
+      }
+    }
+    else if(forgiving && !c->failed) {
+      c->pendingCount = base;
+      skipSelector(c, depth);
+    }
+    else {
+      return false;
+    }
+
+    if(c->tok.type == TOKEN_COMMA) {
+      nextToken(c);
+      continue;
+    }
+
+    if(nested ? c->tok.type == TOKEN_RIGHT_PAREN : c->tok.type == TOKEN_EOF)
+      return true;
+
+    return invalid(c);
+  }
+}
+
+/**
+ * @brief Compiles the rest of a tokenizer's input as a selector list.
+ *
+ * Names and values are decoded and copied into the arena, so the list
+ * does not refer to the input. Idents keep the handle the tokenizer's
+ * interner gave them, if it has one.
+ *
+ * @param t The tokenizer, not in streaming mode.
+ * @param arena The arena the list is allocated from.
+ * @param out Receives the list.
+ * @return true on success, false on invalid arguments, an invalid selector
+ *         or arena exhaustion.
+ */
+bool tokCompileSelectors(Tokenizer *t, Arena *arena, TokSelectorList *out) {
+  if(!out)
+    return false;
+
+  memset(out, 0, sizeof(TokSelectorList));
+
+  if(!t || !arena || t->streaming)
+    return false;
+
+  Compiler c;
+  memset(&c, 0, sizeof(Compiler));
+  c.t = t;
+  c.arena = arena;
+
+  Specificity max = {0};
+
+  nextToken(&c);
+  if(!compileList(&c, false, false, &max) || c.failed)
+    return false;
+
+  out->selectors = c.selectors;
+  out->count = c.selectorCount;
+  out->code = c.code;
+  out->codeLength = c.codeLength;
+  out->names = c.names;
+  out->nameCount = c.nameCount;
+
+  return true;
+}
+
+// Matching
+
+typedef enum {
+  MATCHED,
+  RESTART_FROM_SIBLING,     // try the next candidate of the closest later-sibling combinator
+  RESTART_FROM_DESCENDANT,  // try the next candidate of the closest descendant combinator
+  NOT_MATCHED_GLOBALLY      // no candidate further out can match either
+} MatchResult;
+
+typedef struct {
+  const TokSelectorList *list;
+  const TokElementInterface *dom;
+} Matcher;
+
+static MatchResult matchComplex(const Matcher *m, uint32_t pc, const void *element);
+
+/**
+ * @brief Checks an attribute value against an attribute selector.
+ *
+ * @param value The element's value.
+ * @param kind The AttrKind, with ATTR_IGNORE_CASE.
+ * @param wanted The selector's value.
+ * @return true if it matches.
+ */
+static bool matchAttributeValue(TokenSpan value, uint32_t kind, const TokSelectorName *wanted) {
+  bool ignoreCase = kind & ATTR_IGNORE_CASE;
+  size_t n = wanted->length;
+  const char *v = value.data;
+
+  switch(kind & ~ATTR_IGNORE_CASE) {
+    case ATTR_EQUALS:
+      break;
+    case ATTR_DASH:
+      if(value.length > n && v[n] == '-')
+        value.length = n;
+      break;
+    case ATTR_PREFIX:
+      if(!n || value.length < n)
+        return false;
+      value.length = n;
+      break;
+    case ATTR_SUFFIX:
+      if(!n || value.length < n)
+        return false;
+      v += value.length - n;
+      value.length = n;
+      break;
+    case ATTR_SUBSTRING:
+      if(!n)
+        return false;
+      for(size_t i = 0; i + n <= value.length; i++) {
+        if(ignoreCase ? equalsIgnoringCase(v + i, n, wanted->data, n) : memcmp(v + i, wanted->data, n) == 0)
+          return true;
+      }
+      return false;
+    case ATTR_INCLUDES:
+      if(!n || memchr(wanted->data, ' ', n) || memchr(wanted->data, '\t', n) ||
+         memchr(wanted->data, '\n', n) || memchr(wanted->data, '\f', n) || memchr(wanted->data, '\r', n))
+        return false;
+
+      for(size_t i = 0; i < value.length;) {
+        while(i < value.length && strchr(" \t\n\f\r", v[i]))
+          i++;
+
+        size_t start = i;
+        while(i < value.length && !strchr(" \t\n\f\r", v[i]))
+          i++;
+
+        if(i - start == n && (ignoreCase ? equalsIgnoringCase(v + start, n, wanted->data, n)
+                                         : memcmp(v + start, wanted->data, n) == 0))
+          return true;
+      }
+      return false;
+    default:
+      return true;
+  }
+
+  if(value.length != n)
+    return false;
+
+  return ignoreCase ? equalsIgnoringCase(v, n, wanted->data, n) : memcmp(v, wanted->data, n) == 0;
+}
+
+/**
+ * @brief Checks an element's position among its siblings against An+B.
+ *
+ * @param m The matcher.
+ * @param element The element.
+ * @param flags NTH_* flags.
+ * @param a A.
+ * @param b B.
+ * @return true if the position is An+B for some n >= 0.
+ */
+static bool matchNth(const Matcher *m, const void *element, uint32_t flags, int64_t a, int64_t b) {
+  const TokElementInterface *dom = m->dom;
+  const void *(*step)(const void *, void *) = flags & NTH_LAST ? dom->nextSibling : dom->previousSibling;
+
+  if(!step || ((flags & NTH_OF_TYPE) && !dom->localName))
+    return false;
+
+  TokenSpan name = {0};
+  if(flags & NTH_OF_TYPE)
+    name = dom->localName(element, dom->userData);
+
+  int64_t index = 1;
+
+  for(const void *sibling = step(element, dom->userData); sibling; sibling = step(sibling, dom->userData)) {
+    if(flags & NTH_OF_TYPE) {
+      TokenSpan other = dom->localName(sibling, dom->userData);
+      if(!equalsIgnoringCase(name.data, name.length, other.data, other.length))
+        continue;
+    }
+
+    index++;
+  }
+
+  if(a == 0)
+    return index == b;
+
+  return (index - b) % a == 0 && (index - b) / a >= 0;
+}
+
+/**
+ * @brief Runs the tests of one compound against an element.
+ *
+ * @param m The matcher.
+ * @param pc The compound's first instruction; on success, receives the
+ *           position of the combinator or OP_END after it.
+ * @param element The element.
+ * @return true if every test passes.
+ */
+static bool matchCompound(const Matcher *m, uint32_t *pc, const void *element) {
+  const uint32_t *code = m->list->code;
+  const TokSelectorName *names = m->list->names;
+  const TokElementInterface *dom = m->dom;
+  uint32_t at = *pc;
+
+  while(true) {
+    uint32_t word = code[at];
+    uint32_t operand = word >> 8;
+
+    switch((SelectorOp) (word & 0xFF)) {
+      case OP_END:
+      case OP_DESCENDANT:
+      case OP_CHILD:
+      case OP_NEXT_SIBLING:
+      case OP_LATER_SIBLING:
+        *pc = at;
+        return true;
+
+      case OP_TYPE: {
+        if(!dom->localName)
+          return false;
+
+        TokenSpan name = dom->localName(element, dom->userData);
+        if(!equalsIgnoringCase(name.data, name.length, names[operand].data, names[operand].length))
+          return false;
+
+        at++;
+        break;
+      }
+
+      case OP_ID: {
+        if(!dom->id)
+          return false;
+
+        TokenSpan id = dom->id(element, dom->userData);
+        if(id.length != names[operand].length || memcmp(id.data, names[operand].data, id.length) != 0)
+          return false;
+
+        at++;
+        break;
+      }
+
+      case OP_CLASS:
+        if(!dom->hasClass || !dom->hasClass(element, &names[operand], dom->userData))
+          return false;
+
+        at++;
+        break;
+
+      case OP_PSEUDO:
+        if(!dom->pseudoClass || !dom->pseudoClass(element, &names[operand], dom->userData))
+          return false;
+
+        at++;
+        break;
+
+      case OP_ATTR: {
+        TokenSpan value = {0};
+        uint32_t kind = code[at + 1] & 0xFF;
+
+        if(!dom->attribute || !dom->attribute(element, &names[operand], &value, dom->userData))
+          return false;
+
+        if((kind & ~ATTR_IGNORE_CASE) != ATTR_EXISTS &&
+           !matchAttributeValue(value, kind, &names[code[at + 1] >> 8]))
+          return false;
+
+        at += 2;
+        break;
+      }
+
+      case OP_ROOT:
+        if(dom->parent(element, dom->userData))
+          return false;
+
+        at++;
+        break;
+
+      case OP_EMPTY:
+        if(!dom->isEmpty || !dom->isEmpty(element, dom->userData))
+          return false;
+
+        at++;
+        break;
+
+      case OP_NTH:
+        if(!matchNth(m, element, operand, (int32_t) code[at + 1], (int32_t) code[at + 2]))
+          return false;
+
+        at += 3;
+        break;
+
+      case OP_IS:
+      case OP_NOT: {
+        bool any = false;
+
+        for(uint32_t i = 0; i < operand && !any; i++)
+          any = matchComplex(m, code[at + 1 + i], element) == MATCHED;
+
+        if(any != ((word & 0xFF) == OP_IS))
+          return false;
+
+        at += 1 + operand;
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Matches a complex selector from one of its compounds on.
+ *
+ * Candidates for a combinator are tried from the nearest out; the result
+ * of a failed attempt tells how far back matching must restart, so no
+ * combination of candidates is tried twice (the approach of Servo's
+ * selector matching).
+ *
+ * @param m The matcher.
+ * @param pc The compound's first instruction.
+ * @param element The element it is tested against.
+ * @return The result.
+ */
+static MatchResult matchComplex(const Matcher *m, uint32_t pc, const void *element) {
+  const TokElementInterface *dom = m->dom;
+
+  if(!matchCompound(m, &pc, element))
+    return RESTART_FROM_SIBLING;
+
+  SelectorOp combinator = (SelectorOp) (m->list->code[pc] & 0xFF);
+  if(combinator == OP_END)
+    return MATCHED;
+
+  bool siblings = combinator == OP_NEXT_SIBLING || combinator == OP_LATER_SIBLING;
+  const void *(*step)(const void *, void *) = siblings ? dom->previousSibling : dom->parent;
+
+  for(const void *next = step(element, dom->userData); next; next = step(next, dom->userData)) {
+    MatchResult result = matchComplex(m, pc + 1, next);
+
+    if(result == MATCHED || result == NOT_MATCHED_GLOBALLY || combinator == OP_NEXT_SIBLING)
+      return result;
+
+    if(combinator == OP_CHILD)
+      return RESTART_FROM_DESCENDANT;
+
+    if(result == RESTART_FROM_DESCENDANT && combinator == OP_LATER_SIBLING)
+      return result;
+  }
+
+  return siblings ? RESTART_FROM_DESCENDANT : NOT_MATCHED_GLOBALLY;
+}
+
+/**
+ * @brief Checks whether a selector of a list matches an element.
+ *
+ * @param list The compiled list.
+ * @param index The selector, below list->count.
+ * @param element The element.
+ * @param dom The document interface; parent, previousSibling and
+ *            localName are required.
+ * @return true if it matches.
+ */
+bool tokSelectorMatches(const TokSelectorList *list, size_t index, const void *element,
+                        const TokElementInterface *dom) {
+  if(!list || index >= list->count || !element || !dom || !dom->parent || !dom->previousSibling)
+    return false;
+
+  Matcher m = { list, dom };
+
+  return matchComplex(&m, list->selectors[index].code, element) == MATCHED;
+}
+
+/**
+ * @brief Checks whether any selector of a list matches an element.
+ *
+ * @param list The compiled list.
+ * @param element The element.
+ * @param dom The document interface.
+ * @param specificity Receives the highest specificity of the matching
+ *                    selectors, or 0; may be NULL.
+ * @return true if one matches.
+ */
+bool tokSelectorListMatches(const TokSelectorList *list, const void *element,
+                            const TokElementInterface *dom, uint32_t *specificity) {
+  bool matched = false;
+  uint32_t best = 0;
+
+  for(size_t i = 0; list && i < list->count; i++) {
+    if(matched && list->selectors[i].specificity <= best)
+      continue;
+
+    if(tokSelectorMatches(list, i, element, dom)) {
+      matched = true;
+      if(list->selectors[i].specificity > best)
+        best = list->selectors[i].specificity;
+    }
+  }
+
+  if(specificity)
+    *specificity = best;
+
+  return matched;
+}
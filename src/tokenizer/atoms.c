@@ -0,0 +1,197 @@
+#include <stdint.h>
+#include "comot-css/atoms.h"
+#include "comot-css/intern.h"
+
+// Generated by tools/gen_atoms.py from tools/atoms.txt, do not edit.
+
+#define ATOM_SLOT_MASK 511
+#define ATOM_BUCKET_MASK 127
+
+// Names by atom, lower-case
+static const char *const atomNames[TOK_ATOM_COUNT] = {
+  "",
+  "%", "px", "em", "rem", "ex", "ch",
+  "vw", "vh", "vmin", "vmax", "cm", "mm",
+  "q", "in", "pt", "pc", "deg", "rad",
+  "grad", "turn", "s", "ms", "hz", "khz",
+  "dpi", "dpcm", "dppx", "x", "fr", "charset",
+  "import", "namespace", "media", "supports", "font-face", "keyframes",
+  "-webkit-keyframes", "page", "layer", "container", "property", "counter-style",
+  "font-feature-values", "viewport", "document", "scope", "starting-style", "url",
+  "src", "rgb", "rgba", "hsl", "hsla", "hwb",
+  "lab", "lch", "oklab", "oklch", "color-mix", "calc",
+  "min", "max", "clamp", "var", "env", "attr",
+  "format", "local", "linear-gradient", "radial-gradient", "conic-gradient", "repeating-linear-gradient",
+  "repeating-radial-gradient", "image-set", "translate", "translatex", "translatey", "translate3d",
+  "scale", "rotate", "skew", "matrix", "perspective", "cubic-bezier",
+  "steps", "counter", "counters", "not", "is", "where",
+  "has", "nth-child", "nth-last-child", "nth-of-type", "nth-last-of-type", "lang",
+  "dir", "align-content", "align-items", "align-self", "animation", "animation-delay",
+  "animation-duration", "animation-name", "background", "background-color", "background-image", "background-position",
+  "background-repeat", "background-size", "border", "border-bottom", "border-collapse", "border-color",
+  "border-left", "border-radius", "border-right", "border-style", "border-top", "border-width",
+  "bottom", "box-shadow", "box-sizing", "clear", "color", "content",
+  "cursor", "display", "flex", "flex-basis", "flex-direction", "flex-grow",
+  "flex-shrink", "flex-wrap", "float", "font", "font-family", "font-size",
+  "font-style", "font-weight", "gap", "grid", "grid-area", "grid-column",
+  "grid-row", "grid-template-areas", "grid-template-columns", "grid-template-rows", "height", "justify-content",
+  "left", "letter-spacing", "line-height", "list-style", "margin", "margin-bottom",
+  "margin-left", "margin-right", "margin-top", "max-height", "max-width", "min-height",
+  "min-width", "object-fit", "opacity", "order", "outline", "overflow",
+  "overflow-x", "overflow-y", "padding", "padding-bottom", "padding-left", "padding-right",
+  "padding-top", "pointer-events", "position", "right", "text-align", "text-decoration",
+  "text-overflow", "text-transform", "top", "transform", "transition", "vertical-align",
+  "visibility", "white-space", "width", "word-break", "z-index", "important",
+  "inherit", "initial", "unset", "revert", "none", "auto",
+  "and", "only"
+};
+
+// Name lengths by atom
+static const uint8_t atomLengths[TOK_ATOM_COUNT] = {
+  0, 1, 2, 2, 3, 2, 2, 2, 2, 4, 4, 2, 2, 1, 2, 2,
+  2, 3, 3, 4, 4, 1, 2, 2, 3, 3, 4, 4, 1, 2, 7, 6,
+  9, 5, 8, 9, 9, 17, 4, 5, 9, 8, 13, 19, 8, 8, 5, 14,
+  3, 3, 3, 4, 3, 4, 3, 3, 3, 5, 5, 9, 4, 3, 3, 5,
+  3, 3, 4, 6, 5, 15, 15, 14, 25, 25, 9, 9, 10, 10, 11, 5,
+  6, 4, 6, 11, 12, 5, 7, 8, 3, 2, 5, 3, 9, 14, 11, 16,
+  4, 3, 13, 11, 10, 9, 15, 18, 14, 10, 16, 16, 19, 17, 15, 6,
+  13, 15, 12, 11, 13, 12, 12, 10, 12, 6, 10, 10, 5, 5, 7, 6,
+  7, 4, 10, 14, 9, 11, 9, 5, 4, 11, 9, 10, 11, 3, 4, 9,
+  11, 8, 19, 21, 18, 6, 15, 4, 14, 11, 10, 6, 13, 11, 12, 10,
+  10, 9, 10, 9, 10, 7, 5, 7, 8, 10, 10, 7, 14, 12, 13, 11,
+  14, 8, 5, 10, 15, 13, 14, 3, 9, 10, 14, 10, 11, 5, 10, 7,
+  9, 7, 7, 5, 6, 4, 4, 3, 4
+};
+
+// Per-bucket displacement, chosen so that no two names share a slot
+static const uint16_t atomDisplacements[ATOM_BUCKET_MASK + 1] = {
+  1, 1, 1, 1, 1, 1, 2, 1, 2, 1, 2, 1,
+  2, 3, 1, 1, 3, 2, 0, 0, 1, 1, 1, 5,
+  0, 1, 2, 1, 0, 1, 2, 3, 1, 0, 1, 1,
+  0, 3, 1, 1, 1, 0, 3, 0, 0, 1, 0, 1,
+  0, 1, 1, 1, 2, 2, 1, 1, 0, 0, 0, 2,
+  1, 2, 2, 2, 1, 0, 2, 6, 1, 1, 0, 0,
+  1, 1, 0, 0, 0, 0, 2, 2, 0, 1, 1, 1,
+  1, 1, 0, 1, 1, 2, 0, 1, 2, 1, 2, 1,
+  1, 2, 2, 1, 2, 2, 2, 1, 1, 2, 1, 1,
+  1, 0, 1, 2, 1, 1, 1, 1, 3, 1, 7, 1,
+  2, 3, 3, 2, 2, 0, 1, 1
+};
+
+// Atom in each slot, 0 for empty slots
+static const uint8_t atomSlots[ATOM_SLOT_MASK + 1] = {
+  0, 149, 0, 83, 0, 0, 0, 0, 0, 111, 142, 0, 0, 148, 0, 39,
+  0, 108, 12, 0, 0, 0, 181, 0, 129, 0, 40, 184, 0, 176, 0, 0,
+  42, 37, 0, 0, 2, 114, 127, 0, 34, 85, 0, 103, 72, 0, 0, 0,
+  0, 106, 0, 0, 0, 15, 0, 0, 9, 0, 130, 200, 0, 0, 0, 0,
+  0, 158, 179, 0, 0, 0, 0, 0, 0, 0, 0, 0, 195, 0, 122, 11,
+  31, 56, 159, 0, 155, 18, 153, 0, 45, 0, 0, 199, 0, 0, 0, 0,
+  0, 123, 0, 0, 0, 0, 0, 0, 0, 0, 0, 61, 0, 0, 29, 19,
+  0, 107, 169, 0, 89, 22, 57, 0, 190, 0, 128, 0, 193, 115, 0, 53,
+  84, 0, 0, 87, 0, 0, 69, 137, 38, 117, 80, 44, 150, 99, 0, 63,
+  0, 165, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 132, 0, 168, 4,
+  104, 0, 147, 140, 0, 0, 0, 0, 0, 21, 188, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 133, 67, 0, 0, 0, 0, 47, 0, 0, 73, 0, 0,
+  60, 183, 144, 0, 79, 0, 96, 0, 0, 0, 20, 197, 0, 76, 101, 0,
+  1, 0, 0, 0, 0, 152, 30, 0, 0, 0, 0, 55, 146, 0, 0, 0,
+  124, 0, 77, 0, 0, 112, 0, 27, 0, 0, 0, 54, 116, 0, 95, 16,
+  13, 74, 0, 0, 75, 0, 0, 0, 0, 0, 0, 119, 0, 0, 143, 113,
+  0, 0, 0, 102, 0, 0, 0, 0, 139, 162, 0, 0, 0, 0, 0, 0,
+  0, 0, 172, 0, 0, 0, 194, 0, 0, 167, 0, 97, 0, 0, 0, 81,
+  90, 0, 0, 177, 156, 0, 71, 135, 154, 0, 8, 0, 7, 0, 0, 0,
+  93, 0, 0, 0, 41, 151, 58, 23, 0, 0, 0, 0, 0, 0, 32, 50,
+  0, 86, 0, 134, 0, 0, 0, 0, 24, 48, 0, 0, 160, 0, 0, 0,
+  0, 0, 14, 0, 0, 105, 49, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 17, 100, 0, 120, 166, 0, 198, 0, 0, 0, 0, 59, 0,
+  121, 0, 10, 0, 189, 0, 0, 126, 33, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 88, 196, 0, 62, 178, 0, 6, 161, 0, 175, 0, 0, 0, 0,
+  0, 0, 145, 0, 164, 182, 0, 0, 0, 0, 0, 0, 0, 173, 0, 0,
+  109, 170, 131, 0, 141, 0, 0, 0, 157, 0, 180, 66, 0, 43, 185, 0,
+  64, 0, 0, 0, 0, 0, 0, 46, 0, 0, 0, 78, 192, 0, 0, 51,
+  91, 0, 0, 26, 0, 0, 0, 0, 28, 174, 0, 0, 0, 65, 0, 0,
+  52, 0, 35, 0, 0, 94, 0, 92, 163, 0, 70, 0, 0, 0, 0, 0,
+  68, 0, 0, 82, 0, 3, 191, 0, 187, 36, 0, 0, 0, 0, 0, 138,
+  25, 0, 5, 0, 136, 0, 125, 171, 118, 186, 98, 0, 0, 0, 0, 110
+};
+
+/**
+ * @brief Lower-cases an ASCII letter, leaving every other byte as is.
+ *
+ * @param c The byte.
+ * @return The lower-cased byte.
+ */
+static inline uint8_t asciiLower(uint8_t c) {
+  return (uint8_t) (c - 'A') < 26 ? (uint8_t) (c | 0x20) : c;
+}
+
+/**
+ * @brief Maps a name's hash and bucket displacement to its slot.
+ *
+ * @param h tokNameHash() of the name.
+ * @return The slot index.
+ */
+static inline uint32_t atomSlot(uint32_t h) {
+  h ^= atomDisplacements[h & ATOM_BUCKET_MASK];
+  h ^= h >> 16;
+  h *= 0x7feb352dU;
+  h ^= h >> 15;
+  h *= 0x846ca68bU;
+  h ^= h >> 16;
+
+  return h & ATOM_SLOT_MASK;
+}
+
+/**
+ * @brief Looks up the atom of a name whose tokNameHash() is known.
+ *
+ * Compares the name against the only known name that can live in its
+ * slot, so unknown names cost the same as known ones.
+ *
+ * @param name The name bytes (not NUL-terminated).
+ * @param len The number of bytes.
+ * @param hash tokNameHash() of the name.
+ * @return The atom, or TOK_ATOM_UNKNOWN.
+ */
+TokAtom tokAtomLookupHashed(const char *name, size_t len, uint32_t hash) {
+  if(!name || len == 0 || len > TOK_ATOM_MAX_LEN)
+    return TOK_ATOM_UNKNOWN;
+
+  TokAtom atom = (TokAtom) atomSlots[atomSlot(hash)];
+  if(atomLengths[atom] != len)
+    return TOK_ATOM_UNKNOWN;
+
+  const char *known = atomNames[atom];
+  for(size_t i = 0; i < len; i++) {
+    if(asciiLower((uint8_t) name[i]) != (uint8_t) known[i])
+      return TOK_ATOM_UNKNOWN;
+  }
+
+  return atom;
+}
+
+/**
+ * @brief Looks up the atom of a name, ignoring ASCII case.
+ *
+ * @param name The name bytes (not NUL-terminated).
+ * @param len The number of bytes.
+ * @return The atom, or TOK_ATOM_UNKNOWN.
+ */
+TokAtom tokAtomLookup(const char *name, size_t len) {
+  if(!name || len == 0 || len > TOK_ATOM_MAX_LEN)
+    return TOK_ATOM_UNKNOWN;
+
+  return tokAtomLookupHashed(name, len, tokNameHash(name, len));
+}
+
+/**
+ * @brief Returns the name of an atom.
+ *
+ * @param atom The atom.
+ * @return The lower-case name, or "" for TOK_ATOM_UNKNOWN and invalid atoms.
+ */
+const char *tokAtomName(TokAtom atom) {
+  if(atom <= TOK_ATOM_UNKNOWN || atom >= TOK_ATOM_COUNT)
+    return "";
+
+  return atomNames[atom];
+}
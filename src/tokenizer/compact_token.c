@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+#include "tokenizer_impl.h"
+#include "number.h"
+
+/**
+ * @brief Converts a token into its compact form.
+ *
+ * The token must come from `t` (its value must point into the tokenizer's
+ * input) and the input must be smaller than 4 GiB.
+ *
+ * @param t The tokenizer the token was read from.
+ * @param tok The token to convert.
+ * @return The compact token.
+ */
+CompactToken tokCompactToken(const Tokenizer *t, const Token *tok) {
+  CompactToken ct = {0};
+
+  ct.offset = (uint32_t) (tok->value - t->start);
+  ct.length = (uint32_t) tok->length;
+  ct.type = (uint8_t) tok->type;
+  ct.flags = tok->kind == TOKEN_KIND_ERROR ? TOK_COMPACT_ERROR : 0;
+
+  return ct;
+}
+
+/**
+ * @brief Converts a compact token back into a full Token.
+ *
+ * The line and column are resolved from the offset on demand through
+ * tokResolvePosition(); numeric values, atoms and interned names are found
+ * again from the token text.
+ *
+ * @param t The tokenizer the token was read from.
+ * @param ct The compact token to convert.
+ * @return The equivalent Token.
+ */
+Token tokExpandToken(Tokenizer *t, CompactToken ct) {
+  Token tok;
+
+  tok.type = (TokenType) ct.type;
+  tok.kind = (ct.flags & TOK_COMPACT_ERROR) ? TOKEN_KIND_ERROR : TOKEN_KIND_VALID;
+  tok.value = t->start + ct.offset;
+  tok.length = ct.length;
+  tok.numeric = (TokenNumeric) {0};
+  tokResolvePosition(t, ct.offset, &tok.line, &tok.column);
+
+  if(tok.type == TOKEN_NUMBER || tok.type == TOKEN_PERCENTAGE || tok.type == TOKEN_DIMENSION)
+    parseNumber(tok.value, tok.value + tok.length, &tok.numeric);
+
+  tok.atom = tokenAtom(&tok, NULL);
+  tok.nameId = t->interner ? internTokenName(t->interner, &tok, NULL) : TOK_NO_NAME;
+
+  return tok;
+}
+
+/**
+ * @brief Retrieves up to `max` tokens at once as compact tokens.
+ *
+ * Stops early after TOKEN_EOF, which is always the last token written
+ * once the input is exhausted. Streaming tokenizers and inputs of 4 GiB
+ * or more are not supported and yield 0.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param out The array to fill, holding at least `max` entries.
+ * @param max The maximum number of tokens to write.
+ * @return The number of tokens written.
+ */
+size_t tokNextCompact(Tokenizer *t, CompactToken *out, size_t max) {
+  if(!t || !out || t->streaming)
+    return 0;
+
+  if((size_t) (t->end - t->start) > UINT32_MAX)
+    return 0;
+
+  size_t n = 0;
+  while(n < max) {
+    Token tok = tokNext(t);
+    out[n++] = tokCompactToken(t, &tok);
+
+    if(tok.type == TOKEN_EOF)
+      break;
+  }
+
+  return n;
+}
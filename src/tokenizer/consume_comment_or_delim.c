@@ -1,53 +1,46 @@
 #include "tokenizer_impl.h"
 #include "comot-css/tokens.h"
 #include "comot-css/error.h"
+#include "scan.h"
 
 /**
  * Consumes a comment or delimiter starting with the given code point.
  *
  * This function will consume a comment if one is present, and otherwise
- * will consume a single delimiter token.  If the end of the file is
- * reached before the start or end of the comment is found, an error is
- * logged and the function will return an error token.
+ * will consume a single delimiter token (including a lone '/' at the end
+ * of the input).  If the end of the file is reached before the end of the
+ * comment is found, an error is logged and the function will return an
+ * error token.
  *
  * @param t The tokenizer
  * @param codePoint The code point to consume as a delimiter if not a comment
  * @return A token representing the comment or delimiter
  */
 Token consumeCommentOrDelim(Tokenizer *t, char codePoint) {
-  const DecodedStream *tCurr = t->curr;
+  const char *tCurr = t->curr;
+  (void) codePoint;   // A comment always closes with "*/"
 
-  const DecodedStream *c = peekPtrAtN(t, 1);
-  if (!c) {
-    // [PARSE ERR] end of file was reached before the start of comment
-    return emitErrorToken(t, "Unexpected end of file", tCurr, t->curr - tCurr, t->line, t->column);
-  }
-
-  if (*c->bytePtr == '*') {
+  const char *c = peekPtrAtN(t, 1);
+  if (c && *c == '*') {
     // beginning of a comment: "/*"
-    advancePtrToN(t, 1);
+    const char *close = scanCommentEnd(tCurr + 2, t->end);
 
-    while (1) {
-      c = peekPtrAtN(t, 1);
-      const DecodedStream *cNext = peekPtrAtN(t, 2);
-      if (!c || !cNext) {
-        // [PARSE ERR] end of file was reached before the end of comment
-        return emitErrorToken(t, "Unexpected end of file", tCurr, t->curr - tCurr, t->line, t->column);
-      }
-
-      if (*c->bytePtr == '*' && *cNext->bytePtr == codePoint) {
-        advancePtrToN(t, 3);  // advance past the closing `*/`
-        
-        return makeToken(TOKEN_COMMENT, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, t->line, t->column);
-      }
-
-      advancePtrToN(t, 1);
+    if(close == t->end) {
+      // [PARSE ERR] end of file was reached before the end of comment;
+      // the rest of the input belongs to the comment
+      t->curr = t->end;
+
+      return emitErrorToken(t, TOK_DIAG_EOF_IN_COMMENT, tCurr, t->curr - tCurr);
     }
+
+    t->curr = close + 2;  // advance past the closing `*/`
+
+    return makeToken(t, TOKEN_COMMENT, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
   } else {
     // Not a comment; treat as a delimiter
     advancePtrToN(t, 1);
 
-    return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, t->line, t->column);
+    return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
   }
 }
 
@@ -3,14 +3,8 @@
 #include "tokenizer_impl.h"
 #include "comot-css/diag.h"
 
-#define REPLACEMENT_CHAR 0xFFFD
 #define MAX_CODE_POINT   0x10FFFF
 
-// Returns 1 if the given character c is a valid hexadecimal digit, 0 otherwise.
-static inline int isHex(const char *c) {
-  return (*c >= '0' && *c <= '9') || (*c >= 'a' && *c <= 'f') || (*c >= 'A' && *c <= 'F');
-}
-
 static inline int hexValue(const char *c) {
   if (*c >= '0' && *c <= '9')
     return *c - '0';
@@ -25,45 +19,74 @@ static inline int hexValue(const char *c) {
 }
 
 /**
- * Consumes an escaped code point from the input stream, including the
- * required backslash and up to 6 hex digits, and optional whitespace.
+ * Decodes the escape whose backslash has just been consumed.
  *
- * If the value is invalid (i.e. 0, > MAX_CODE_POINT, or surrogate pair),
- * the value is replaced with the REPLACEMENT_CHAR and a diagnostic is
- * logged.
+ * Up to 6 hex digits and one optional trailing whitespace form a hex
+ * escape; any other code point is taken literally. Hex values that are 0,
+ * > MAX_CODE_POINT or a surrogate, a NUL byte, and an escape at end of
+ * input decode to REPLACEMENT_CHAR.
  *
- * @param t  The tokenizer
+ * @param p The first byte after the backslash.
+ * @param end One past the last input byte.
+ * @param codePoint Receives the escaped code point.
+ * @return The number of bytes the escape occupies after the backslash.
  */
-void consumeEscapedCodePoint(Tokenizer *t) {
+size_t decodeEscapedCodePoint(const char *p, const char *end, uint32_t *codePoint) {
+  if(p >= end) {
+    *codePoint = REPLACEMENT_CHAR;
+    return 0;
+  }
+
+  if(!isHexDigit(p)) {
+    size_t n = utf8DecodeAt((const uint8_t *) p, (size_t) (end - p), codePoint);
+
+    // Input preprocessing turns U+0000 into REPLACEMENT_CHAR, escaped or not
+    if(*codePoint == 0)
+      *codePoint = REPLACEMENT_CHAR;
+
+    return n;
+  }
+
+  const char *q = p;
   uint32_t value = 0;
-  size_t digits = 0;
 
   // Read up to 6 hex digits
-  while(!isEof(t) && isHex(t->curr->bytePtr) && digits < 6) {
-    value = (value << 4) | hexValue(t->curr->bytePtr);
-    advancePtrToN(t, 1);
-    digits++;
+  while(q < end && isHexDigit(q) && q - p < 6) {
+    value = (value << 4) | (uint32_t) hexValue(q);
+    q++;
   }
 
   // Optional single whitespace after escape sequence
-  if (!isEof(t) && isWhitespace(t->curr->bytePtr)) {
-    advancePtrToN(t, 1);
-  }
+  if(q < end && isWhitespace(q))
+    q++;
 
   // Validate the code point
-  if (value == 0 || value > MAX_CODE_POINT || (value >= 0xD800 && value <= 0xDFFF)) {
+  if(value == 0 || value > MAX_CODE_POINT || (value >= 0xD800 && value <= 0xDFFF))
     value = REPLACEMENT_CHAR;
 
-    // TODO: replace in tokenizer input with REPLACEMENT_CHAR
-    // NOTE: this char must have been replaced before reaching thsis point
-  }
+  *codePoint = value;
+
+  return (size_t) (q - p);
+}
 
+/**
+ * Consumes an escaped code point from the input stream. The tokenizer must
+ * be positioned just after the backslash. See decodeEscapedCodePoint() for
+ * what an escape consists of.
+ *
+ * @param t  The tokenizer
+ * @return The escaped code point (REPLACEMENT_CHAR at end of input).
+ */
+uint32_t consumeEscapedCodePoint(Tokenizer *t) {
   if(isEof(t)) {
-    // [PARSE ERR]  unclosed string
-    // return bad string
-    // TODO: the replace thing needs to be done here as well.
-    logDiagnostic("Unexpected end of file", t->curr->bytePtr, t->line, t->column);
+    // [PARSE ERR] end of file right after the backslash
+    reportDiagnostic(t, TOK_DIAG_EOF_IN_ESCAPE, t->curr);
+
+    return REPLACEMENT_CHAR;
   }
 
-  return;
+  uint32_t value;
+  advancePtrToN(t, decodeEscapedCodePoint(t->curr, t->end, &value));
+
+  return value;
 }
@@ -1,9 +1,20 @@
-#include <strings.h>
 #include "tokenizer_impl.h"
 #include "comot-css/tokens.h"
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
+#include "scan.h"
+
+/**
+ * @brief Checks whether `len` bytes at `s` are "url", ignoring ASCII case.
+ *
+ * Compares in place, so no copy of the identifier is needed.
+ *
+ * @param s The identifier bytes.
+ * @param len The number of bytes.
+ * @return true if the identifier is "url", false otherwise.
+ */
+static inline bool isUrlIdent(const char *s, size_t len) {
+  // Setting bit 0x20 lower-cases ASCII letters
+  return len == 3 && (s[0] | 0x20) == 'u' && (s[1] | 0x20) == 'r' && (s[2] | 0x20) == 'l';
+}
 
 /**
  * @brief Consume an identifier-like token from the input stream
@@ -11,58 +22,33 @@
  * This function handles the weird edge cases of the CSS grammar where
  * identifiers can be followed by ( to form a function token. This
  * function is slightly more expensive than the other token-consuming
- * functions because of this.
+ * functions because of this. It never allocates.
  *
  * @return The next token in the input stream
  */
 Token consumeIdentLikeToken(Tokenizer *t) {
-  const DecodedStream *tCurr = t->curr;
-  size_t startLine = t->line;
-  size_t startCol = t->column;
-
-  if(!tCurr)
-    return makeToken(TOKEN_EOF, TOKEN_KIND_ERROR, tCurr, 0, startLine, startCol);
+  const char *tCurr = t->curr;
+  const char *str = consumeIdentSequence(t);
+  size_t len = str - tCurr;
+  Token tok;
 
-  const DecodedStream *str = consumeIdentSequence(t);
-  if(!str || str < tCurr || !tCurr)
-    return makeToken(TOKEN_EOF, TOKEN_KIND_ERROR, tCurr, 0, startLine, startCol);
+  if(!isEof(t) && *t->curr == '(') {
+    advancePtrToN(t, 1);
 
-  if(str->bytePtr < tCurr->bytePtr)
-    return makeToken(TOKEN_EOF, TOKEN_KIND_ERROR, tCurr, 0, startLine, startCol);
-
-  size_t len = str->bytePtr - tCurr->bytePtr;
-  if(len > (1 << 20)) {
-    return makeToken(TOKEN_EOF, TOKEN_KIND_ERROR, tCurr, 0, startLine, startCol);
-  }
+    if(isUrlIdent(tCurr, len)) {
+      t->curr = scanWhitespace(t->curr, t->end);
 
-  char *result = (char *) arena_alloc(t->arena, len + 1, 1);
-  if(!result) {
-    fprintf(stderr, "Arena alloc failed\n");
-    exit(1);
-  }
-
-  memcpy(result, tCurr->bytePtr, len);
-  result[len] = '\0';
-
-  if(t->curr && *t->curr->bytePtr == '(') {
-    if(!advancePtrToN(t, 1))
-      return makeToken(TOKEN_EOF, TOKEN_KIND_VALID, tCurr, 0, startLine, startCol);
-
-    if(strcasecmp(result, "url") == 0) {
-      while(t->curr && isWhitespace(t->curr->bytePtr)) {
-        if(!advancePtrToN(t, 1))
-          return makeToken(TOKEN_EOF, TOKEN_KIND_VALID, tCurr, 0, startLine, startCol);
+      if(isEof(t) || (*t->curr != '"' && *t->curr != '\'')) {
+        return consumeUrlToken(t);
       }
-
-      if(t->curr && (*t->curr->bytePtr == '"' || *t->curr->bytePtr == '\'')) {
-        return makeToken(TOKEN_FUNCTION, TOKEN_KIND_VALID, tCurr, len, startLine, startCol);
-      }
-
-      return consumeUrlToken(t);
     }
 
-    return makeToken(TOKEN_FUNCTION, TOKEN_KIND_VALID, tCurr, len, startLine, startCol);
+    tok = makeToken(t, TOKEN_FUNCTION, TOKEN_KIND_VALID, tCurr, len);
+  }
+  else {
+    tok = makeToken(t, TOKEN_IDENT, TOKEN_KIND_VALID, tCurr, len);
   }
 
-  return makeToken(TOKEN_IDENT, TOKEN_KIND_VALID, tCurr, len, startLine, startCol);
+  tagTokenName(t, &tok);
+  return tok;
 }
@@ -6,34 +6,37 @@
  * Consumes an identifier sequence starting at the current position.
  *
  * This function will consume all valid identifier characters, including escaped
- * characters.  If the end of the file is reached, the function will return the
- * current position; otherwise, it will return the position after the last
- * character of the sequence.
+ * characters.  It returns the position after the last character of the
+ * sequence, which is the end of the input if the sequence runs up to it.
+ * The tokNameHash() of the name, with escapes decoded, is computed in the
+ * same loop and left in `t->nameHash`.
  *
  * @param t The tokenizer
  * @return The position after the last character of the sequence
  */
-const DecodedStream *consumeIdentSequence(Tokenizer *t) {
-  const DecodedStream *startPtr = t->curr;
-
-  while(true) {
-    if(!advancePtrToN(t, 1))
-      break;
+const char *consumeIdentSequence(Tokenizer *t) {
+  uint32_t hash = NAME_HASH_SEED;
 
+  while(!isEof(t)) {
     if(isIdentCodePoint(t->curr)) {
-      continue;
+      hash = nameHashStep(hash, (uint8_t) *t->curr);
+      advancePtrToN(t, 1);
     } 
     else if(isNCodePointValidEscape(t, 0)) {
-      consumeEscapedCodePoint(t);  // Does internal validation
+      advancePtrToN(t, 1);         // consume '\'
+
+      uint8_t bytes[4];
+      size_t n = utf8Encode(consumeEscapedCodePoint(t), bytes);
 
-      continue;
+      for(size_t i = 0; i < n; i++)
+        hash = nameHashStep(hash, bytes[i]);
     } 
     else {
-      startPtr = t->curr;
-
       break;
     }
   }
 
-  return startPtr;
+  t->nameHash = hash;
+
+  return t->curr;
 }
@@ -1,5 +1,6 @@
 #include "tokenizer_impl.h"
 #include "comot-css/tokens.h"
+#include "number.h"
 
 /**
  * Consumes a number in the tokenizer's input stream.
@@ -7,55 +8,15 @@
  * Advances the tokenizer's current position over a number in the input stream.
  * The number is allowed to have a leading sign, and may be a decimal number
  * (i.e. have a fractional part).  If an 'e' or 'E' appears after the number,
- * an exponent may also be present.
+ * an exponent may also be present. Its value is computed in the same pass.
  *
  * @param t   Pointer to the Tokenizer instance.
+ * @param out Receives the numeric value and type of the number.
  */
-void consumeNumber(Tokenizer *t) {
-  if(*t->curr->bytePtr == '+' || *t->curr->bytePtr == '-') {
-    if (!advancePtrToN(t, 1))
-      return;
-  }
-
-  while(t->curr && t->curr->bytePtr && isDigit(t->curr->bytePtr)) {
-    if(!advancePtrToN(t, 1))
-      return;
-  }
-
-  const DecodedStream *afterDotPtr = peekPtrAtN(t, 1);
-  if(t->curr && *t->curr->bytePtr == '.' && afterDotPtr && isDigit(afterDotPtr->bytePtr)) {
-    if(!advancePtrToN(t, 2)) // consume '.' and digit
-      return;
-
-    while(t->curr && isDigit(t->curr->bytePtr)) {
-      if(!advancePtrToN(t, 1))
-        return;
-    }
-  }
+void consumeNumber(Tokenizer *t, TokenNumeric *out) {
+  const char *numberEnd = parseNumber(t->curr, t->end, out);
 
-  if(t->curr && (*t->curr->bytePtr == 'e' || *t->curr->bytePtr == 'E')) {
-    const DecodedStream *afterE = peekPtrAtN(t, 1);
-    const DecodedStream *afterSign = peekPtrAtN(t, 2);
-
-    if(afterE && isDigit(afterE->bytePtr)) {
-      if(!advancePtrToN(t, 1))
-        return;
-
-      while(t->curr && isDigit(t->curr->bytePtr)) {
-        if(!advancePtrToN(t, 1))
-          return;
-      }
-    }
-    else if(afterE && (*afterE->bytePtr == '+' || *afterE->bytePtr == '-') && afterSign && isDigit(afterSign->bytePtr)) {
-      if (!advancePtrToN(t, 2))
-        return;
-
-      while(t->curr && isDigit(t->curr->bytePtr)) {
-        if(!advancePtrToN(t, 1))
-          return;
-      }
-    }
-  }
+  advancePtrToN(t, (size_t) (numberEnd - t->curr));
 }
 
 /**
@@ -73,23 +34,30 @@ void consumeNumber(Tokenizer *t) {
  *         TOKEN_NUMBER, TOKEN_PERCENTAGE, or TOKEN_DIMENSION.
  */
 Token consumeNumericToken(Tokenizer *t) {
-  const DecodedStream *tCurr = t->curr;
-  size_t startLine = t->line;
-  size_t startCol = t->column;
+  const char *tCurr = t->curr;
+  TokenNumeric numeric;
+  Token tok;
 
-  consumeNumber(t);
+  consumeNumber(t, &numeric);
 
   if(isNextThreeCodePointStartAnIdentSequence(t)) {
-    const DecodedStream *currStream = consumeIdentSequence(t);
+    const char *currStream = consumeIdentSequence(t);
 
-    return makeToken(TOKEN_DIMENSION, TOKEN_KIND_VALID, tCurr, currStream - tCurr, startLine, startCol);
+    tok = makeToken(t, TOKEN_DIMENSION, TOKEN_KIND_VALID, tCurr, currStream - tCurr);
+    tok.numeric = numeric;
+    tagTokenName(t, &tok);
   }
-  else if(*t->curr->bytePtr == '%') {
+  else if(!isEof(t) && *t->curr == '%') {
     advancePtrToN(t, 1);
 
-    return makeToken(TOKEN_PERCENTAGE, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, startLine, startCol);
+    tok = makeToken(t, TOKEN_PERCENTAGE, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
+    tok.numeric = numeric;
+    tok.atom = TOK_ATOM_PERCENT;
   }
   else {
-    return makeToken(TOKEN_NUMBER, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, startLine, startCol);
+    tok = makeToken(t, TOKEN_NUMBER, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
+    tok.numeric = numeric;
   }
+
+  return tok;
 }
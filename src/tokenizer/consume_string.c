@@ -2,6 +2,7 @@
 #include "tokenizer_impl.h"
 #include "comot-css/tokens.h"
 #include "comot-css/diag.h"
+#include "scan.h"
 
 /**
  * Consumes a string literal token from the input stream, including the
@@ -15,26 +16,29 @@
  * @return  A token representing the string literal
  */
 Token consumeString(Tokenizer *t, char endingCodePoint) {
-  const DecodedStream *startStream = t->curr;
-  size_t startLine = t->line;
-  size_t startCol = t->column;
+  const char *startStream = t->curr;
 
   advancePtrToN(t, 1); // consume opening quote
 
-  while(!isEof(t)) {
-    const char *ptr = t->curr->bytePtr;
+  while(true) {
+    // Skip the plain run up to the next quote, backslash or newline
+    t->curr = scanStringBody(t->curr, t->end, endingCodePoint);
+    if(isEof(t))
+      break;
+
+    const char *ptr = t->curr;
 
     if(*ptr == '\n') {
-      logDiagnostic("Unclosed string literal", startStream->bytePtr, startLine, startCol);
-      return makeToken(TOKEN_BAD_STRING, TOKEN_KIND_ERROR, startStream, t->curr - startStream, startLine, startCol);
+      reportDiagnostic(t, TOK_DIAG_NEWLINE_IN_STRING, startStream);
+      return makeToken(t, TOKEN_BAD_STRING, TOKEN_KIND_ERROR, startStream, t->curr - startStream);
     }
 
     if(*ptr == '\\') {
-      const char *nxt = peekPtrAtN(t, 1)->bytePtr;
-      // printf("\nChar after:: %c\n\n", *nxt);
+      const char *nxt = peekPtrAtN(t, 1);
 
       // If next is EOF — spec says do nothing and fall through
-      if(*nxt == '\0') {
+      if(!nxt) {
+        advancePtrToN(t, 1);
         break;
       }
 
@@ -43,30 +47,19 @@ Token consumeString(Tokenizer *t, char endingCodePoint) {
         continue;
       }
 
-      // Valid escape?
-      if(isNCodePointValidEscape(t, 1)) {
-        advancePtrToN(t, 2); // consume '\'
-        consumeEscapedCodePoint(t); // modifies t->curr
-        continue;
-      }
-
-      // Invalid escape?
-      // TODO: is this an invalid escape?
-      // logDiagnostic("Invalid escape sequence in string", t->curr->bytePtr, t->line, t->column);
-      advancePtrToN(t, 2); // consume '\' and wtv follows 
+      // Valid escape
+      advancePtrToN(t, 1); // consume '\'
+      consumeEscapedCodePoint(t); // modifies t->curr
       continue;
     }
 
     if(*ptr == endingCodePoint) {
       advancePtrToN(t, 1); // consume closing quote
-      return makeToken(TOKEN_STRING, TOKEN_KIND_VALID, startStream, t->curr - startStream, startLine, startCol);
+      return makeToken(t, TOKEN_STRING, TOKEN_KIND_VALID, startStream, t->curr - startStream);
     }
-
-    // Anything else — consume it
-    advancePtrToN(t, 1);
   }
 
   // EOF before closing quote
-  logDiagnostic("Unexpected end of file in string", startStream->bytePtr, startLine, startCol);
-  return makeToken(TOKEN_STRING, TOKEN_KIND_ERROR, startStream, t->curr - startStream, startLine, startCol);
+  reportDiagnostic(t, TOK_DIAG_EOF_IN_STRING, startStream);
+  return makeToken(t, TOKEN_STRING, TOKEN_KIND_ERROR, startStream, t->curr - startStream);
 }
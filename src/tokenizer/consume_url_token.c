@@ -2,30 +2,31 @@
 #include "tokenizer_impl.h"
 #include "comot-css/tokens.h"
 #include "comot-css/diag.h"
+#include "scan.h"
 
 /**
  * Consumes any remaining characters from a bad url token, including
- * whitespace, escaped code points, and the closing ')'.
+ * whitespace and escaped code points.
  *
  * This function will advance the tokenizer until it has consumed all
- * characters up to and including the closing ')', or until it has
+ * characters up to (but not including) the closing ')', or until it has
  * reached the end of the input.
  *
  * @param t  The tokenizer
  */
 static void consumeReminantsOfBadUrl(Tokenizer *t) {
-  while(advancePtrToN(t, 1)) {
-    if(isEof(t))
+  while(!isEof(t)) {
+    if(*t->curr == ')')
       return;
 
-    if(!t->curr || !t->curr->bytePtr)
-      return;
+    if(isNCodePointValidEscape(t, 0)) {
+      advancePtrToN(t, 1);
+      consumeEscapedCodePoint(t);
 
-    if(*t->curr->bytePtr == ')')
-      return;
+      continue;
+    }
 
-    if(isNCodePointValidEscape(t, 0))
-      consumeEscapedCodePoint(t);
+    advancePtrToN(t, 1);
   }
 }
 
@@ -43,79 +44,66 @@ static void consumeReminantsOfBadUrl(Tokenizer *t) {
  * @return  A token representing the URL
  */
 Token consumeUrlToken(Tokenizer *t) {
-  const DecodedStream *tCurr = t->curr;
-  size_t startLine = t->line;
-  size_t startCol = t->column;
+  const char *tCurr = t->curr;
 
-  while(isWhitespace(t->curr->bytePtr)) {
-    if(!advancePtrToN(t, 1))
-      break;
-  }
-
-  while(t->curr && t->curr < t->end) {
-    if(!t->curr->bytePtr) {
-      logDiagnostic("Null bytePtr in tokenizer stream", t->curr ? t->curr->bytePtr : NULL, t->line, t->column);
-      
-      return makeToken(TOKEN_BAD_URL, TOKEN_KIND_ERROR, tCurr, t->curr - tCurr, startLine, startCol);
-    }
+  t->curr = scanWhitespace(t->curr, t->end);
 
-    const char *charAtCurrPtr = t->curr->bytePtr;
+  while(!isEof(t)) {
+    const char *charAtCurrPtr = t->curr;
 
     if(*charAtCurrPtr == ')')
-      return makeToken(TOKEN_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, startLine, startCol);
+      return makeToken(t, TOKEN_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
 
     if(isEof(t)) {
-      logDiagnostic("Unexpected end of file", tCurr->bytePtr, startLine, startCol);
+      reportDiagnostic(t, TOK_DIAG_EOF_IN_URL, tCurr);
 
-      return makeToken(TOKEN_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, startLine, startCol);
+      return makeToken(t, TOKEN_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
     }
 
     if(isWhitespace(charAtCurrPtr)) {
-      while(t->curr && t->curr->bytePtr && isWhitespace(t->curr->bytePtr)) {
-        if(!advancePtrToN(t, 1))
-          break;
-      }
+      t->curr = scanWhitespace(t->curr, t->end);
 
-      if(!t->curr || !t->curr->bytePtr || *t->curr->bytePtr == ')' || isEof(t)) {
+      if(isEof(t) || *t->curr == ')') {
         if(isEof(t)) {
-          logDiagnostic("Unexpected end of file", tCurr->bytePtr, startLine, startCol);
+          reportDiagnostic(t, TOK_DIAG_EOF_IN_URL, tCurr);
         }
 
         advancePtrToN(t, 1);
             
-        return makeToken(TOKEN_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, startLine, startCol);
+        return makeToken(t, TOKEN_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
       } 
       else {
         consumeReminantsOfBadUrl(t);
        
-        return makeToken(TOKEN_BAD_URL, TOKEN_KIND_ERROR, tCurr, t->curr - tCurr, startLine, startCol);
+        return makeToken(t, TOKEN_BAD_URL, TOKEN_KIND_ERROR, tCurr, t->curr - tCurr);
       }
     }
 
     if(*charAtCurrPtr == '"' || *charAtCurrPtr == '\'' || *charAtCurrPtr == '(') {
-      logDiagnostic("Non printable code point", tCurr->bytePtr, startLine, startCol);
+      reportDiagnostic(t, TOK_DIAG_BAD_URL_CHAR, tCurr);
       consumeReminantsOfBadUrl(t);
       
-      return makeToken(TOKEN_BAD_URL, TOKEN_KIND_ERROR, tCurr, t->curr - tCurr, startLine, startCol);
+      return makeToken(t, TOKEN_BAD_URL, TOKEN_KIND_ERROR, tCurr, t->curr - tCurr);
     }
 
     if(*charAtCurrPtr == '\\') {
       if(isNCodePointValidEscape(t, 0)) {
+        advancePtrToN(t, 1);
         consumeEscapedCodePoint(t);
       } 
       else {
-        logDiagnostic("Invalid escape sequence", tCurr->bytePtr, startLine, startCol);
+        reportDiagnostic(t, TOK_DIAG_BAD_URL_ESCAPE, tCurr);
         consumeReminantsOfBadUrl(t);
          
-        return makeToken(TOKEN_BAD_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, startLine, startCol);
+        return makeToken(t, TOKEN_BAD_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
       }
 
       continue;
     }
 
-    // advance pointer
-    advancePtrToN(t, 1);
+    // advance pointer past this byte and the plain run after it
+    t->curr = scanUrlBody(t->curr + 1, t->end);
   }
   
-  return makeToken(TOKEN_BAD_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr, startLine, startCol);
+  return makeToken(t, TOKEN_BAD_URL, TOKEN_KIND_VALID, tCurr, t->curr - tCurr);
 }
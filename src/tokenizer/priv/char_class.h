@@ -0,0 +1,27 @@
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Character classes of a byte, as bit flags in cssCharClass. Every byte
+// >= 0x80 (a UTF-8 lead or continuation byte) counts as ident-start.
+enum {
+  CC_WHITESPACE    = 1 << 0,  // space \t \n \r \f
+  CC_DIGIT         = 1 << 1,  // 0-9
+  CC_HEX           = 1 << 2,  // 0-9 a-f A-F
+  CC_IDENT_START   = 1 << 3,  // letter, non-ASCII, '_'
+  CC_IDENT         = 1 << 4,  // ident-start, digit, '-'
+  CC_QUOTE         = 1 << 5,  // " '
+  CC_STRUCTURAL    = 1 << 6,  // ( ) [ ] { } , : ;
+  CC_NON_PRINTABLE = 1 << 7   // U+0000-0008, U+000B, U+000E-001F, U+007F
+};
+
+extern const uint8_t cssCharClass[256];
+
+// true if the byte at `c` has any of the classes in `classes`
+static inline bool hasCharClass(const char *c, uint8_t classes) {
+  return (cssCharClass[(uint8_t) *c] & classes) != 0;
+}
+
+#endif
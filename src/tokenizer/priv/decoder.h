@@ -9,6 +9,7 @@
 
 #define REPLACEMENT_CHAR 0xFFFD
 #define MAX_INPUT_LEN 1048576
+#define MAX_CHARSET_LEN 32                 // Max declared charset length
 
 typedef enum {
   ENCODING_UTF8,
@@ -30,8 +31,23 @@ Encoding detectEncoding(const uint8_t *data, size_t len, char *declaredCharset);
 
 int isValidUtf8Cont(uint8_t b);
 
+// Same test as isValidUtf8Cont, inlined for the tokenizer's byte walk
+static inline int isUtf8ContByte(uint8_t b) {
+  return (b & 0xC0) == 0x80;
+}
+
+int isSuspiciousCssInput(const uint8_t *raw, size_t len);
+
+size_t utf8DecodeAt(const uint8_t *in, size_t len, uint32_t *codePoint);
+
+size_t utf8Encode(uint32_t cp, uint8_t *out);
+
+size_t transcodeUtf16ToUtf8(const uint8_t *in, size_t len, uint8_t *out, size_t cap, int le);
+
 size_t decodeUtf8(const uint8_t *in, size_t len, DecodedStream *out, size_t cap);
 
+size_t decodeUtf8Scalar(const uint8_t *in, size_t len, DecodedStream *out, size_t cap);
+
 size_t decodeUtf16(const uint8_t *in, size_t len, DecodedStream *out, size_t cap, int le);
 
 void tryExtractCharset(const uint8_t *data, size_t len, char *charset);
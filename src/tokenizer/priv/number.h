@@ -0,0 +1,10 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include "comot-css/tokens.h"
+
+// Scans a CSS number (sign, digits, fraction, exponent) at `p` and computes
+// its value. Returns one past its last byte, or `p` if there is no number.
+const char *parseNumber(const char *p, const char *end, TokenNumeric *out);
+
+#endif
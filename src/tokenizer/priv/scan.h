@@ -0,0 +1,24 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// Run scanners: each returns the first "interesting" byte in [p, end), or
+// `end` if there is none. They look at 16-32 bytes at a time where the CPU
+// allows (SSE2/AVX2/NEON, chosen at runtime) and fall back to a byte loop.
+
+// First byte that is not CSS whitespace (space, \t, \n, \r, \f)
+const char *scanWhitespace(const char *p, const char *end);
+
+// The '*' of the first "*/"
+const char *scanCommentEnd(const char *p, const char *end);
+
+// First `quote`, '\\' or '\n'
+const char *scanStringBody(const char *p, const char *end, char quote);
+
+// First byte that ends a plain run of url() body: quotes, parens, '\\',
+// whitespace or a non-printable code point
+const char *scanUrlBody(const char *p, const char *end);
+
+// First byte >= 0x80
+const char *scanAscii(const char *p, const char *end);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+
+// The worker threads parallel tokenizing runs on. There is one pool per
+// process; its threads are started the first time they are needed and then
+// wait for work. Work comes as jobs of numbered tasks. The thread that
+// starts a job runs its tasks too while waiting for it, so a job finishes
+// even if no pool thread is free, and a task may start a job of its own.
+
+#define TOK_POOL_MAX_THREADS 64
+
+typedef struct TokPoolJob TokPoolJob;
+
+// Runs task `index` of a job
+typedef void (*TokPoolTask)(void *ctx, size_t index);
+
+struct TokPoolJob {
+  TokPoolTask run;
+  void *ctx;
+  size_t count;         // Tasks in the job
+  bool helpable;        // Other jobs' workers may run its tasks, see tokPoolHelp
+  size_t next;          // First task not yet taken
+  size_t done;          // Tasks finished
+  TokPoolJob *link;     // Next job in the pool's list
+};
+
+typedef struct TokPool TokPool;
+
+// The process's pool, with threads started so that `threads` of them
+// (counting the caller) can work at once. Never NULL; with no threads
+// available every job runs on the thread that starts it.
+TokPool *tokSharedPool(size_t threads);
+
+// Queue a job for the pool threads; `job` must stay valid until
+// tokPoolWait() returns
+void tokPoolStart(TokPool *pool, TokPoolJob *job, TokPoolTask run, void *ctx, size_t count, bool helpable);
+
+// Run the job's tasks no one took yet, then wait for the others to finish
+void tokPoolWait(TokPool *pool, TokPoolJob *job);
+
+// Start a job and wait for it
+void tokPoolRun(TokPool *pool, TokPoolTask run, void *ctx, size_t count);
+
+// Run one task of a helpable job, if there is one waiting; returns whether
+// it did
+bool tokPoolHelp(TokPool *pool);
+
+// tokNextCompactParallel() split into `chunks`, on a given pool. Workers of
+// another job that call this let its chunks be run through tokPoolHelp().
+size_t tokNextCompactPooled(Tokenizer *t, CompactToken *out, size_t max, TokPool *pool, size_t chunks);
+
+#endif  // !THREAD_POOL_H
@@ -4,34 +4,66 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include "comot-css/tokenizer.h"
 #include "comot-css/tokens.h"
+#include "comot-css/intern.h"
+#include "comot-css/diag.h"
 #include "arena_alloc.h"
 #include "decoder.h"
-
-// Tokenizer FSM state
-typedef enum {
-  DATA_STATE,
-  IDENTIFIER_STATE,
-  STRING_STATE,
-  NUMBER_STATE,
-  WHITESPACE_STATE,
-  DELIM_STATE
-} TokenizerState;
+#include "char_class.h"
 
 // Tokenizer state structure
 typedef struct Tokenizer {
-  const DecodedStream *start;
-  const DecodedStream *curr;
-  const DecodedStream *end;
-  size_t line;
-  size_t column;
-  TokenizerState state;
-  size_t shouldLog;     // Current logging status (1 = on, 0 = off)
-  size_t errorCount;    // Total number of errors seen
-  size_t maxErrors;     // Disable logging after this many errors
-  char stringQuote;
+  const char *start;    // First byte of the (BOM-stripped) UTF-8 input
+  const char *curr;     // Next byte to consume
+  const char *end;      // One past the last input byte
+  size_t errorCount;    // Diagnostics reported so far
+  size_t maxErrors;     // Stop recording diagnostics after this many
   Arena *arena;
+  size_t allocCount;    // Arena allocations made since creation, see tokArenaAlloc
+  TokInterner *interner; // Interns token names if set, see tokSetInterner
+  uint32_t nameHash;    // tokNameHash() of the name consumeIdentSequence last read
+  uint32_t newlineCap;  // Entries `newlines` can hold, kept across tokReset
+  bool diagMuted;       // Count diagnostics without recording them, see drainTokens
+  bool skipWhitespace;  // TOK_OPT_SKIP_WHITESPACE
+  bool skipComments;    // TOK_OPT_SKIP_COMMENTS
+  bool trackPositions;  // Fill Token.line/column, off with TOK_OPT_NO_POSITIONS
+  bool inputUtf8;       // TOK_OPT_UTF8, input is not sniffed
+
+  // Streaming (push) mode, see tokenizer_stream.c
+  bool streaming;
+  bool finished;        // tokFinish() was called, no more input will come
+  bool bomChecked;
+  char *carry;          // Unfinished token bytes carried over to the next chunk
+                        // (the UTF-16 transcoding buffer for in-memory input)
+  size_t carryLen;
+  size_t carryCap;
+  size_t carryRetryLen; // Don't re-scan the carry until it holds this many bytes
+  TokTokenCallback onToken;
+  void *userData;
+
+  // Positions are resolved lazily, see tokenizer_position.c
+  const char *posPtr;   // Start of the last token a position was computed for
+  size_t posLine;       // Line and column of posPtr
+  size_t posColumn;
+  size_t *newlines;     // Offsets of every '\n' in the input, built on demand
+  size_t newlineCount;
+  bool newlinesBuilt;
+
+  // Diagnostics, see diag.c. The caller's buffer is a queue whose counters
+  // only grow; record n lives in diagBuf[n % diagCap].
+  TokDiagnostic *diagBuf;
+  size_t diagCap;
+  size_t diagHead;      // Records written so far
+  size_t diagTail;      // Records read so far
+  TokDiagCallback onDiag;
+  void *diagUserData;
+  size_t streamOffset;  // Offset of `start` in the whole stream (streaming mode)
+
+  // Read-only file mapping owned by the tokenizer, see tokenizer_file.c
+  void *mapping;
+  size_t mappingLen;
 } Tokenizer;
 
 // Shared tokenizer helpers
@@ -64,7 +96,7 @@ static inline bool isEof(Tokenizer *t) {
  *         stream if it exists, or `NULL` if the desired position is beyond
  *         the end of the stream.
  */
-static inline const DecodedStream *peekPtrAtN(Tokenizer *t, size_t n) {
+static inline const char *peekPtrAtN(Tokenizer *t, size_t n) {
   // Check if the desired position is beyond the end of the stream
   if (t->curr + n >= t->end)
     return NULL;
@@ -81,11 +113,14 @@ static inline const DecodedStream *peekPtrAtN(Tokenizer *t, size_t n) {
  * characters in the input stream that are not relevant to the current
  * token being processed.
  *
- * As the tokenizer advances, it keeps track of the line and column numbers
- * of the current position in the input stream. If a newline character is
- * encountered during the advancement, the line number is incremented and
- * the column number is reset to 1. Otherwise, the column number is simply
- * incremented by 1.
+ * The tokenizer walks the raw UTF-8 bytes, so `n` counts bytes. Every byte
+ * a CSS token boundary depends on is ASCII, and UTF-8 continuation bytes
+ * can never be mistaken for one, so multi-byte sequences are simply walked
+ * over.
+ *
+ * Line and column numbers are not tracked here: they are resolved from
+ * byte offsets only when a token or diagnostic needs them (see
+ * tokenizer_position.c), which keeps this loop free of per-byte branches.
  *
  * If the desired position is beyond the end of the stream, this function
  * returns `NULL`.
@@ -97,18 +132,9 @@ static inline const DecodedStream *peekPtrAtN(Tokenizer *t, size_t n) {
  *         stream if it exists, or `NULL` if the desired position is beyond
  *         the end of the stream.
  */
-static inline const DecodedStream *advancePtrToN(Tokenizer *t, size_t n) {
-  for(size_t i = 0; i < n && t->curr < t->end; i++) {
-    if(t->curr->bytePtr && *t->curr->bytePtr == '\n') {
-      t->line++;
-      t->column = 1;
-    }
-    else {
-      t->column++;
-    }
-
-    t->curr++;
-  }
+static inline const char *advancePtrToN(Tokenizer *t, size_t n) {
+  size_t left = (size_t) (t->end - t->curr);
+  t->curr += n < left ? n : left;
 
   return t->curr < t->end ? t->curr : NULL;
 }
@@ -125,28 +151,155 @@ static inline const DecodedStream *advancePtrToN(Tokenizer *t, size_t n) {
  * @return A pointer to the character before the current position, or `NULL`
  *         if the current position is at the start of the input stream.
  */
-static inline const DecodedStream *ptrLookback(Tokenizer *t) {
+static inline const char *ptrLookback(Tokenizer *t) {
   if(t->curr <= t->start)
     return NULL;
 
   return t->curr - 1;
 }
 
-Token makeToken(TokenType type, TokenKind kind, const DecodedStream *value, size_t length, size_t line, size_t column);
+/**
+ * @brief Checks if a character is a whitespace character.
+ *
+ * @param currCodePoint The character to check.
+ * @return true if the character is a whitespace character, false otherwise.
+ */
+static inline bool isWhitespace(const char *currCodePoint) {
+  return hasCharClass(currCodePoint, CC_WHITESPACE);
+}
 
-bool isNCodePointValidEscape(Tokenizer *t, size_t n);
+/**
+ * @brief Checks if a character is a digit (0-9).
+ *
+ * @param currCodePoint The character to check.
+ * @return true if the character is a digit, false otherwise.
+ */
+static inline bool isDigit(const char *currCodePoint) {
+  return hasCharClass(currCodePoint, CC_DIGIT);
+}
+
+/**
+ * @brief Checks if a character is a hex digit (0-9, a-f, A-F).
+ *
+ * @param currCodePoint The character to check.
+ * @return true if the character is a hex digit, false otherwise.
+ */
+static inline bool isHexDigit(const char *currCodePoint) {
+  return hasCharClass(currCodePoint, CC_HEX);
+}
+
+/**
+ * @brief Checks if a character is a valid identifier start code point.
+ *
+ * A valid identifier start code point is a letter, a non-ASCII Unicode code
+ * point, or an underscore.
+ *
+ * @param currCodePoint The character to check.
+ * @return true if the character is a valid identifier start code point, false otherwise.
+ */
+static inline bool isIdentStartCodePoint(const char *currCodePoint) {
+  return hasCharClass(currCodePoint, CC_IDENT_START);
+}
+
+/**
+ * @brief Checks if a character is a valid identifier code point.
+ *
+ * A valid identifier code point is a valid identifier start code point,
+ * a digit, or a hyphen.
+ *
+ * @param currCodePoint The character to check.
+ * @return true if the character is a valid identifier code point, false otherwise.
+ */
+static inline bool isIdentCodePoint(const char *currCodePoint) {
+  return hasCharClass(currCodePoint, CC_IDENT);
+}
+
+// Names are hashed with 32-bit FNV-1a over their bytes, ASCII letters
+// lower-cased; see tokNameHash()
+#define NAME_HASH_SEED 0x811c9dc5U
+
+/**
+ * @brief Adds one byte of a name to its hash.
+ *
+ * @param hash The hash so far (NAME_HASH_SEED for an empty name).
+ * @param c The next byte of the name.
+ * @return The updated hash.
+ */
+static inline uint32_t nameHashStep(uint32_t hash, uint8_t c) {
+  if((uint8_t) (c - 'A') < 26)
+    c |= 0x20;
+
+  return (hash ^ c) * 0x01000193U;
+}
+
+/**
+ * @brief Allocates from the tokenizer's arena, counting the allocation.
+ *
+ * Every allocation a tokenizer makes after it was created goes through
+ * here, so tokAllocationCount() can prove that a code path does not
+ * allocate.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param size The number of bytes to allocate.
+ * @param align The required alignment.
+ * @return The allocated memory, or NULL if the arena is exhausted.
+ */
+static inline void *tokArenaAlloc(Tokenizer *t, size_t size, size_t align) {
+  t->allocCount++;
+
+  return arena_alloc(t->arena, size, align);
+}
+
+/**
+ * @brief Grows an array in an arena so it holds at least `need` elements.
+ *
+ * The new array is twice as large, or as large as `need` if that is more,
+ * and the first `used` elements are copied into it. The old array cannot
+ * be freed and stays behind in the arena; doubling bounds that waste by
+ * the size of the final array.
+ *
+ * @param arena The arena.
+ * @param ptr The array, replaced on success.
+ * @param cap Its capacity in elements, 0 if there is no array yet.
+ * @param used The elements to keep.
+ * @param need The elements it must be able to hold.
+ * @param size The size of an element.
+ * @param align The alignment of an element.
+ * @return true on success, false if the arena is exhausted.
+ */
+static inline bool tokArenaGrow(Arena *arena, void **ptr, size_t *cap, size_t used, size_t need,
+                                size_t size, size_t align) {
+  if(need <= *cap)
+    return true;
+
+  size_t grownCap = *cap ? *cap * 2 : need;
+  while(grownCap < need)
+    grownCap *= 2;
 
-bool isWhitespace(const char *currCodePoint);
+  void *grown = arena_alloc(arena, grownCap * size, align);
+  if(!grown)
+    return false;
+
+  if(used)
+    memcpy(grown, *ptr, used * size);
+
+  *ptr = grown;
+  *cap = grownCap;
+
+  return true;
+}
 
-bool isDigit(const char *currCodePoint);
+void tokInitState(Tokenizer *t, const char *input, size_t len, Arena *arena);
 
-bool isLetter(const char *currCodePoint);
+Token makeToken(Tokenizer *t, TokenType type, TokenKind kind, const char *value, size_t length);
 
-bool isNonASCIICodePoint(const char *currCodePoint);
+void tokPositionAt(Tokenizer *t, const char *p, size_t *line, size_t *column);
 
-bool isIdentStartCodePoint(const char *currCodePoint);
+void tokAdvancePosition(Tokenizer *t, const char *p, size_t *line, size_t *column);
 
-bool isIdentCodePoint(const DecodedStream *currStream);
+void reportDiagnostic(Tokenizer *t, TokDiagCode code, const char *at);
+
+bool isNCodePointValidEscape(Tokenizer *t, size_t n);
 
 Token consumeIdentLikeToken(Tokenizer *t);
 
@@ -154,17 +307,27 @@ Token consumeCommentOrDelim(Tokenizer *t, char codePoint);
 
 Token consumeString(Tokenizer *t, char codePoint);
 
-void consumeEscapedCodePoint(Tokenizer *t);
+uint32_t consumeEscapedCodePoint(Tokenizer *t);
+
+size_t decodeEscapedCodePoint(const char *p, const char *end, uint32_t *codePoint);
+
+TokAtom tokenAtom(const Token *tok, const uint32_t *hash);
+
+void tagTokenName(Tokenizer *t, Token *tok);
+
+uint32_t internHashed(TokInterner *in, const char *name, size_t len, uint32_t hash);
+
+uint32_t internTokenName(TokInterner *in, const Token *tok, const uint32_t *hash);
 
-const DecodedStream *reconsumeCurrInputCodePoint(Tokenizer *t);
+const char *reconsumeCurrInputCodePoint(Tokenizer *t);
 
-const DecodedStream *consumeIdentSequence(Tokenizer *t);
+const char *consumeIdentSequence(Tokenizer *t);
 
 bool isNextThreeCodePointStartAnIdentSequence(Tokenizer *t);
 
 bool isNextThreeCodePointStartNumber(Tokenizer *t);
 
-void consumeNumber(Tokenizer *t);
+void consumeNumber(Tokenizer *t, TokenNumeric *out);
 
 Token consumeNumericToken(Tokenizer *t);
 
@@ -1,19 +1,14 @@
 #include "tokenizer_impl.h"
 
-const DecodedStream *reconsumeCurrInputCodePoint(Tokenizer *t) {
-  const DecodedStream *prev = ptrLookback(t);
+const char *reconsumeCurrInputCodePoint(Tokenizer *t) {
+  const char *prev = ptrLookback(t);
 
-  if(prev) {
-    if(*prev->bytePtr == '\n') {
-      t->line --;
-      t->column = 1;
-    }
-    else {
-      t->column --;
-    }
+  // Step back over a whole UTF-8 sequence, not just its last byte
+  while(prev && prev > t->start && isUtf8ContByte((uint8_t) *prev))
+    prev--;
 
+  if(prev)
     t->curr = prev;
-  }
 
   return prev;
 }
@@ -0,0 +1,261 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stddef.h>
+#include "thread_pool.h"
+
+#if !defined(_WIN32) && !defined(TOK_NO_THREADS)
+#include <pthread.h>
+#define TOK_THREADS 1
+#else
+#define TOK_THREADS 0
+#endif
+
+struct TokPool {
+#if TOK_THREADS
+  pthread_mutex_t lock;     // Guards everything below and every queued job
+  pthread_cond_t changed;   // A job was queued or a task finished
+#endif
+  size_t threads;           // Pool threads started; they never exit
+  TokPoolJob *jobs;         // Queued jobs, newest first
+};
+
+#if TOK_THREADS
+static TokPool sharedPool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, NULL };
+#else
+static TokPool sharedPool = { 0, NULL };
+#endif
+
+static inline void lockPool(TokPool *pool) {
+#if TOK_THREADS
+  pthread_mutex_lock(&pool->lock);
+#else
+  (void) pool;
+#endif
+}
+
+static inline void unlockPool(TokPool *pool) {
+#if TOK_THREADS
+  pthread_mutex_unlock(&pool->lock);
+#else
+  (void) pool;
+#endif
+}
+
+/**
+ * @brief Takes a task, with the pool locked.
+ *
+ * Jobs whose tasks are all taken are dropped from the list on the way.
+ *
+ * @param pool The pool.
+ * @param own A job whose tasks come first, or NULL.
+ * @param anyJob Whether tasks of jobs that are not helpable may be taken.
+ * @param job Receives the job of the task.
+ * @param index Receives the task.
+ * @return false if there is no task to take.
+ */
+static bool takeTask(TokPool *pool, TokPoolJob *own, bool anyJob, TokPoolJob **job, size_t *index) {
+  TokPoolJob *found = own && own->next < own->count ? own : NULL;
+
+  for(TokPoolJob **p = &pool->jobs; !found && *p;) {
+    TokPoolJob *j = *p;
+
+    if(j->next >= j->count) {
+      *p = j->link;
+      continue;
+    }
+
+    if(anyJob || j->helpable)
+      found = j;
+
+    p = &j->link;
+  }
+
+  if(!found)
+    return false;
+
+  *job = found;
+  *index = found->next++;
+
+  return true;
+}
+
+/**
+ * @brief Runs a task taken with takeTask(), unlocking the pool meanwhile.
+ *
+ * @param pool The pool, locked.
+ * @param job The job.
+ * @param index The task.
+ */
+static void runTask(TokPool *pool, TokPoolJob *job, size_t index) {
+  unlockPool(pool);
+  job->run(job->ctx, index);
+  lockPool(pool);
+
+  job->done++;
+
+#if TOK_THREADS
+  pthread_cond_broadcast(&pool->changed);
+#endif
+}
+
+#if TOK_THREADS
+/**
+ * @brief Runs one pool thread: takes tasks of any job, forever.
+ *
+ * @param arg The pool.
+ * @return Never returns.
+ */
+static void *runPoolThread(void *arg) {
+  TokPool *pool = arg;
+  TokPoolJob *job;
+  size_t index;
+
+  lockPool(pool);
+
+  while(true) {
+    if(takeTask(pool, NULL, true, &job, &index))
+      runTask(pool, job, index);
+    else
+      pthread_cond_wait(&pool->changed, &pool->lock);
+  }
+
+  return NULL;
+}
+#endif
+
+/**
+ * @brief Returns the process's pool, starting threads if there are fewer
+ *        than the caller wants.
+ *
+ * @param threads The threads wanted at once, the caller included.
+ * @return The pool.
+ */
+TokPool *tokSharedPool(size_t threads) {
+  TokPool *pool = &sharedPool;
+
+#if TOK_THREADS
+  if(threads > TOK_POOL_MAX_THREADS)
+    threads = TOK_POOL_MAX_THREADS;
+
+  lockPool(pool);
+
+  while(pool->threads + 1 < threads) {
+    pthread_t thread;
+
+    if(pthread_create(&thread, NULL, runPoolThread, pool) != 0)
+      break;
+
+    pthread_detach(thread);
+    pool->threads++;
+  }
+
+  unlockPool(pool);
+#else
+  (void) threads;
+#endif
+
+  return pool;
+}
+
+/**
+ * @brief Queues a job.
+ *
+ * @param pool The pool.
+ * @param job The job, valid until tokPoolWait() returns.
+ * @param run Runs one task.
+ * @param ctx Passed to `run`.
+ * @param count The number of tasks.
+ * @param helpable Whether workers of other jobs may run its tasks.
+ */
+void tokPoolStart(TokPool *pool, TokPoolJob *job, TokPoolTask run, void *ctx, size_t count, bool helpable) {
+  job->run = run;
+  job->ctx = ctx;
+  job->count = count;
+  job->helpable = helpable;
+  job->next = 0;
+  job->done = 0;
+
+  lockPool(pool);
+
+  job->link = pool->jobs;
+  pool->jobs = job;
+
+#if TOK_THREADS
+  pthread_cond_broadcast(&pool->changed);
+#endif
+
+  unlockPool(pool);
+}
+
+/**
+ * @brief Waits for a job to finish.
+ *
+ * The caller runs the job's tasks that no thread took yet and, while the
+ * last ones run elsewhere, tasks of helpable jobs.
+ *
+ * @param pool The pool.
+ * @param job The job.
+ */
+void tokPoolWait(TokPool *pool, TokPoolJob *job) {
+  TokPoolJob *other;
+  size_t index;
+
+  lockPool(pool);
+
+  while(job->done < job->count) {
+    if(takeTask(pool, job, false, &other, &index))
+      runTask(pool, other, index);
+#if TOK_THREADS
+    else
+      pthread_cond_wait(&pool->changed, &pool->lock);
+#endif
+  }
+
+  // A job with tasks left to take is always in the list
+  for(TokPoolJob **p = &pool->jobs; *p; p = &(*p)->link) {
+    if(*p == job) {
+      *p = job->link;
+      break;
+    }
+  }
+
+  unlockPool(pool);
+}
+
+/**
+ * @brief Runs a job to completion.
+ *
+ * @param pool The pool.
+ * @param run Runs one task.
+ * @param ctx Passed to `run`.
+ * @param count The number of tasks.
+ */
+void tokPoolRun(TokPool *pool, TokPoolTask run, void *ctx, size_t count) {
+  TokPoolJob job;
+
+  tokPoolStart(pool, &job, run, ctx, count, false);
+  tokPoolWait(pool, &job);
+}
+
+/**
+ * @brief Runs one task of a helpable job, if one is waiting.
+ *
+ * @param pool The pool.
+ * @return true if a task was run.
+ */
+bool tokPoolHelp(TokPool *pool) {
+  TokPoolJob *job;
+  size_t index;
+
+  lockPool(pool);
+
+  bool found = takeTask(pool, NULL, false, &job, &index);
+  if(found)
+    runTask(pool, job, index);
+
+  unlockPool(pool);
+
+  return found;
+}
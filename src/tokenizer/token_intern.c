@@ -0,0 +1,243 @@
+#include <string.h>
+#include "comot-css/intern.h"
+#include "comot-css/tokenizer.h"
+#include "tokenizer_impl.h"
+
+#define MIN_INTERN_CAPACITY 64
+
+// An interned name
+typedef struct {
+  const char *data;     // copy of the name in the interner's arena
+  uint32_t length;
+  uint32_t hash;        // tokNameHash() of the name
+} InternEntry;
+
+struct TokInterner {
+  Arena *arena;
+  uint32_t *slots;      // open-addressing table of handles, TOK_NO_NAME if empty
+  size_t slotMask;
+  InternEntry *entries; // entries[handle - 1]
+  size_t count;
+  size_t capacity;
+};
+
+/**
+ * @brief Computes the hash of a name, with ASCII letters lower-cased.
+ *
+ * @param name The name bytes (not NUL-terminated).
+ * @param len The number of bytes.
+ * @return The 32-bit FNV-1a hash of the lower-cased name.
+ */
+uint32_t tokNameHash(const char *name, size_t len) {
+  uint32_t hash = NAME_HASH_SEED;
+
+  for(size_t i = 0; i < len; i++)
+    hash = nameHashStep(hash, (uint8_t) name[i]);
+
+  return hash;
+}
+
+/**
+ * @brief Allocates the entry array and slot table of an interner.
+ *
+ * Old tables stay in the arena; entries are copied and slots rebuilt from
+ * the stored hashes.
+ *
+ * @param in The interner.
+ * @param capacity The number of names the new tables must hold.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool growInterner(TokInterner *in, size_t capacity) {
+  size_t slotCount = 1;
+  while(slotCount < capacity * 2)
+    slotCount <<= 1;
+
+  InternEntry *entries = arena_alloc(in->arena, capacity * sizeof(InternEntry), _Alignof(InternEntry));
+  uint32_t *slots = arena_alloc(in->arena, slotCount * sizeof(uint32_t), _Alignof(uint32_t));
+  if(!entries || !slots)
+    return false;
+
+  if(in->count)
+    memcpy(entries, in->entries, in->count * sizeof(InternEntry));
+  memset(slots, 0, slotCount * sizeof(uint32_t));
+
+  for(size_t i = 0; i < in->count; i++) {
+    size_t slot = entries[i].hash & (slotCount - 1);
+    while(slots[slot] != TOK_NO_NAME)
+      slot = (slot + 1) & (slotCount - 1);
+
+    slots[slot] = (uint32_t) (i + 1);
+  }
+
+  in->entries = entries;
+  in->slots = slots;
+  in->slotMask = slotCount - 1;
+  in->capacity = capacity;
+
+  return true;
+}
+
+/**
+ * @brief Creates a name interner.
+ *
+ * @param arena The arena names and tables are allocated from.
+ * @param expected The number of distinct names to size the tables for.
+ * @return The interner, or NULL if the arena is exhausted.
+ */
+TokInterner *tokInternerCreate(Arena *arena, size_t expected) {
+  if(!arena)
+    return NULL;
+
+  TokInterner *in = arena_alloc(arena, sizeof(TokInterner), _Alignof(TokInterner));
+  if(!in)
+    return NULL;
+
+  in->arena = arena;
+  in->slots = NULL;
+  in->slotMask = 0;
+  in->entries = NULL;
+  in->count = 0;
+  in->capacity = 0;
+
+  if(!growInterner(in, expected > MIN_INTERN_CAPACITY ? expected : MIN_INTERN_CAPACITY))
+    return NULL;
+
+  return in;
+}
+
+/**
+ * @brief Interns a name whose hash is already known.
+ *
+ * @param in The interner.
+ * @param name The name bytes.
+ * @param len The number of bytes.
+ * @param hash tokNameHash() of the name.
+ * @return The name's handle, or TOK_NO_NAME if the arena is exhausted.
+ */
+uint32_t internHashed(TokInterner *in, const char *name, size_t len, uint32_t hash) {
+  if(len > UINT32_MAX)
+    return TOK_NO_NAME;
+
+  size_t slot = hash & in->slotMask;
+
+  for(uint32_t handle; (handle = in->slots[slot]) != TOK_NO_NAME; slot = (slot + 1) & in->slotMask) {
+    const InternEntry *e = &in->entries[handle - 1];
+
+    if(e->hash == hash && e->length == len && memcmp(e->data, name, len) == 0)
+      return handle;
+  }
+
+  if(in->count == in->capacity || in->count == UINT32_MAX - 1) {
+    if(in->count == UINT32_MAX - 1 || !growInterner(in, in->capacity * 2))
+      return TOK_NO_NAME;
+
+    // The slot table was rebuilt, find the free slot again
+    slot = hash & in->slotMask;
+    while(in->slots[slot] != TOK_NO_NAME)
+      slot = (slot + 1) & in->slotMask;
+  }
+
+  char *copy = arena_alloc(in->arena, len ? len : 1, 1);
+  if(!copy)
+    return TOK_NO_NAME;
+  memcpy(copy, name, len);
+
+  InternEntry *e = &in->entries[in->count++];
+  e->data = copy;
+  e->length = (uint32_t) len;
+  e->hash = hash;
+
+  uint32_t handle = (uint32_t) in->count;
+  in->slots[slot] = handle;
+
+  return handle;
+}
+
+/**
+ * @brief Returns the handle of a name, interning it first if it is new.
+ *
+ * @param in The interner.
+ * @param name The name bytes (not NUL-terminated).
+ * @param len The number of bytes.
+ * @return The handle, or TOK_NO_NAME if the arena is exhausted.
+ */
+uint32_t tokIntern(TokInterner *in, const char *name, size_t len) {
+  if(!in || (!name && len))
+    return TOK_NO_NAME;
+
+  return internHashed(in, name, len, tokNameHash(name, len));
+}
+
+/**
+ * @brief Interns the name of an ident, function, at-keyword or hash token.
+ *
+ * Names are interned with escapes decoded, so the same name spelled with
+ * and without escapes gets the same handle.
+ *
+ * @param in The interner.
+ * @param tok The token.
+ * @param hash tokNameHash() of the decoded name if the caller has it, or NULL.
+ * @return The handle, or TOK_NO_NAME for other tokens or an exhausted arena.
+ */
+uint32_t internTokenName(TokInterner *in, const Token *tok, const uint32_t *hash) {
+  if(tok->type != TOKEN_IDENT && tok->type != TOKEN_FUNCTION &&
+     tok->type != TOKEN_AT_KEYWORD && tok->type != TOKEN_HASH)
+    return TOK_NO_NAME;
+
+  char buf[256];
+  TokenSpan name = tokValue(tok, buf, sizeof(buf));
+
+  if(!name.data) {
+    // Long escaped name: decode it into the arena
+    char *big = arena_alloc(in->arena, name.length, 1);
+    if(!big)
+      return TOK_NO_NAME;
+
+    name = tokValue(tok, big, name.length);
+  }
+
+  return internHashed(in, name.data, name.length, hash ? *hash : tokNameHash(name.data, name.length));
+}
+
+/**
+ * @brief Returns the name behind a handle.
+ *
+ * @param in The interner.
+ * @param handle The handle.
+ * @return The interned copy of the name, or an empty span for an invalid handle.
+ */
+TokenSpan tokInternedName(const TokInterner *in, uint32_t handle) {
+  TokenSpan span = { NULL, 0 };
+
+  if(!in || handle == TOK_NO_NAME || handle > in->count)
+    return span;
+
+  span.data = in->entries[handle - 1].data;
+  span.length = in->entries[handle - 1].length;
+
+  return span;
+}
+
+/**
+ * @brief Returns the tokNameHash() of the name behind a handle.
+ *
+ * @param in The interner.
+ * @param handle The handle.
+ * @return The hash, or 0 for an invalid handle.
+ */
+uint32_t tokInternedHash(const TokInterner *in, uint32_t handle) {
+  if(!in || handle == TOK_NO_NAME || handle > in->count)
+    return 0;
+
+  return in->entries[handle - 1].hash;
+}
+
+/**
+ * @brief Returns the number of distinct names interned.
+ *
+ * @param in The interner.
+ * @return The number of names; valid handles are 1 to this number.
+ */
+size_t tokInternerCount(const TokInterner *in) {
+  return in ? in->count : 0;
+}
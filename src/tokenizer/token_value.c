@@ -0,0 +1,282 @@
+#include <string.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+#include "tokenizer_impl.h"
+
+// How the bytes of a token map to its value
+typedef enum {
+  VALUE_RAW,        // the token text itself
+  VALUE_IDENT,      // ident-like: escapes are decoded
+  VALUE_STRING,     // escapes are decoded, escaped newlines dropped
+  VALUE_URL         // ends at ')', trailing whitespace dropped
+} ValueMode;
+
+/**
+ * @brief Finds the bytes of a token its value is made of.
+ *
+ * @param tok The token.
+ * @param begin Receives the first byte of the value.
+ * @param end Receives one past the last byte of the value.
+ * @return How the bytes in [begin, end) map to the value.
+ */
+static ValueMode valueBounds(const Token *tok, const char **begin, const char **end) {
+  *begin = tok->value;
+  *end = tok->value + tok->length;
+
+  switch(tok->type) {
+    case TOKEN_IDENT:
+    case TOKEN_FUNCTION:    // the '(' is not part of the token
+      return VALUE_IDENT;
+
+    case TOKEN_AT_KEYWORD:
+    case TOKEN_HASH:
+      (*begin)++;           // '@' or '#'
+      return VALUE_IDENT;
+
+    case TOKEN_STRING:
+      if(tok->length == 0)
+        return VALUE_RAW;
+
+      (*begin)++;           // opening quote
+      if(tok->kind == TOKEN_KIND_VALID && *end > *begin)
+        (*end)--;           // closing quote; unterminated strings have none
+
+      return VALUE_STRING;
+
+    case TOKEN_URL:
+      return VALUE_URL;
+
+    default:
+      return VALUE_RAW;
+  }
+}
+
+/**
+ * @brief Decodes a value that contains escapes.
+ *
+ * Writes at most `cap` bytes but always returns the full decoded length,
+ * so calling it with `cap` 0 measures the value.
+ *
+ * @param p The first byte of the value.
+ * @param end One past the last byte of the value.
+ * @param mode How the bytes map to the value.
+ * @param out The output buffer (may be NULL if `cap` is 0).
+ * @param cap The capacity of `out`.
+ * @return The length of the decoded value in bytes.
+ */
+static size_t decodeValue(const char *p, const char *end, ValueMode mode, char *out, size_t cap) {
+  size_t len = 0;
+  size_t keep = 0;    // length up to the last byte that is not trailing url whitespace
+
+  while(p < end) {
+    uint8_t bytes[4];
+    size_t n;
+    bool escaped = false;
+
+    if(*p == '\\') {
+      p++;
+
+      if(mode == VALUE_STRING && (p == end || *p == '\n')) {
+        // Escaped newline (line continuation) or backslash at EOF: dropped
+        if(p < end)
+          p++;
+
+        continue;
+      }
+
+      uint32_t codePoint;
+      p += decodeEscapedCodePoint(p, end, &codePoint);
+      n = utf8Encode(codePoint, bytes);
+      escaped = true;
+    }
+    else if(mode == VALUE_URL && *p == ')') {
+      break;
+    }
+    else {
+      bytes[0] = (uint8_t) *p++;
+      n = 1;
+    }
+
+    for(size_t i = 0; i < n; i++, len++) {
+      if(len < cap)
+        out[len] = (char) bytes[i];
+    }
+
+    if(mode != VALUE_URL || escaped || !isWhitespace((const char *) bytes))
+      keep = len;
+  }
+
+  return mode == VALUE_URL ? keep : len;
+}
+
+/**
+ * @brief Computes a token's value without copying, if it has no escapes.
+ *
+ * @param tok The token.
+ * @param begin Receives the first byte of the value.
+ * @param end Receives one past the last byte of the value.
+ * @param mode Receives how the bytes map to the value.
+ * @return true if [begin, end) is the value itself, false if it contains
+ *         escapes and must be decoded.
+ */
+static bool plainValue(const Token *tok, const char **begin, const char **end, ValueMode *mode) {
+  *mode = valueBounds(tok, begin, end);
+
+  if(*mode == VALUE_RAW)
+    return true;
+
+  if(memchr(*begin, '\\', (size_t) (*end - *begin)))
+    return false;
+
+  if(*mode == VALUE_URL) {
+    const char *close = memchr(*begin, ')', (size_t) (*end - *begin));
+    if(close)
+      *end = close;
+
+    while(*end > *begin && isWhitespace(*end - 1))
+      (*end)--;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Returns the value of a token, as defined by CSS Syntax.
+ *
+ * That is the name of an ident, function, at-keyword or hash token, the
+ * contents of a string token without its quotes, or the address of a url
+ * token, with escapes decoded. Any other token yields its text unchanged.
+ *
+ * A value without escapes is returned as a zero-copy span into the input.
+ * Otherwise it is decoded into `buf`; if it does not fit, the returned
+ * span has a NULL `data` and the `length` that is needed. The value is not
+ * NUL-terminated.
+ *
+ * @param tok The token.
+ * @param buf The buffer to decode escaped values into.
+ * @param cap The capacity of `buf`.
+ * @return The value.
+ */
+TokenSpan tokValue(const Token *tok, char *buf, size_t cap) {
+  TokenSpan span = { NULL, 0 };
+  if(!tok || !tok->value)
+    return span;
+
+  const char *begin, *end;
+  ValueMode mode;
+
+  if(plainValue(tok, &begin, &end, &mode)) {
+    span.data = begin;
+    span.length = (size_t) (end - begin);
+
+    return span;
+  }
+
+  span.length = decodeValue(begin, end, mode, buf, buf ? cap : 0);
+  span.data = span.length <= cap ? buf : NULL;
+
+  return span;
+}
+
+/**
+ * @brief Returns the value of a token, decoding escapes into an arena.
+ *
+ * Like tokValue(), but a value with escapes is decoded into memory
+ * allocated from `arena`. Values without escapes are still returned as
+ * zero-copy spans and allocate nothing.
+ *
+ * @param tok The token.
+ * @param arena The arena to decode escaped values into.
+ * @return The value, or a span with NULL `data` if the arena is exhausted.
+ */
+TokenSpan tokValueArena(const Token *tok, Arena *arena) {
+  TokenSpan span = { NULL, 0 };
+  if(!tok || !tok->value || !arena)
+    return span;
+
+  const char *begin, *end;
+  ValueMode mode;
+
+  if(plainValue(tok, &begin, &end, &mode)) {
+    span.data = begin;
+    span.length = (size_t) (end - begin);
+
+    return span;
+  }
+
+  size_t len = decodeValue(begin, end, mode, NULL, 0);
+  char *buf = arena_alloc(arena, len ? len : 1, 1);
+  if(!buf)
+    return span;
+
+  span.data = buf;
+  span.length = decodeValue(begin, end, mode, buf, len);
+
+  return span;
+}
+
+/**
+ * @brief Finds the atom of a token's name.
+ *
+ * The name is the value of ident, function and at-keyword tokens, the unit
+ * of dimension tokens and the '%' of percentage tokens. Names with escapes
+ * are decoded first, so "\70 x" is TOK_ATOM_PX too.
+ *
+ * @param tok The token.
+ * @param hash tokNameHash() of the decoded name if the caller has it, or NULL.
+ * @return The atom, or TOK_ATOM_UNKNOWN for other tokens and unknown names.
+ */
+TokAtom tokenAtom(const Token *tok, const uint32_t *hash) {
+  const char *begin = tok->value;
+  const char *end = tok->value + tok->length;
+
+  switch(tok->type) {
+    case TOKEN_IDENT:
+    case TOKEN_FUNCTION:
+    case TOKEN_AT_KEYWORD:
+      valueBounds(tok, &begin, &end);
+      break;
+
+    case TOKEN_DIMENSION:
+    case TOKEN_PERCENTAGE:
+      begin += tok->numeric.unitOffset;
+      break;
+
+    default:
+      return TOK_ATOM_UNKNOWN;
+  }
+
+  size_t len = (size_t) (end - begin);
+  const char *name = begin;
+  char decoded[TOK_ATOM_MAX_LEN];
+
+  // An escape is at most 8 bytes ('\\', six hex digits and a space)
+  if(len > TOK_ATOM_MAX_LEN * 8)
+    return TOK_ATOM_UNKNOWN;
+
+  if(memchr(begin, '\\', len)) {
+    len = decodeValue(begin, end, VALUE_IDENT, decoded, sizeof(decoded));
+    if(len > sizeof(decoded))
+      return TOK_ATOM_UNKNOWN;
+
+    name = decoded;
+  }
+
+  return hash ? tokAtomLookupHashed(name, len, *hash) : tokAtomLookup(name, len);
+}
+
+/**
+ * @brief Sets the atom and interned name of a token that ends in a name.
+ *
+ * Must be called right after the token's name was read by
+ * consumeIdentSequence(), whose hash of the name is reused.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param tok The ident, function, at-keyword, hash or dimension token.
+ */
+void tagTokenName(Tokenizer *t, Token *tok) {
+  tok->atom = tokenAtom(tok, &t->nameHash);
+
+  if(t->interner)
+    tok->nameId = internTokenName(t->interner, tok, &t->nameHash);
+}
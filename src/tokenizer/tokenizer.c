@@ -1,356 +1,711 @@
-#include <stdio.h>
-#include <stdlib.h>
 #include <stdalign.h>
 #include <string.h>
 #include "comot-css/tokens.h"
 #include "comot-css/tokenizer.h"
 #include "comot-css/diag.h"
 #include "decoder.h"
+#include "scan.h"
 #include "tokenizer_impl.h"
 
 #define ARENA_ALIGNMENT alignof(max_align_t)
 
+/**
+ * @brief Turns raw input into the UTF-8 bytes a tokenizer walks.
+ *
+ * Unless the caller declared the input UTF-8, input that looks like binary
+ * is rejected and the encoding is detected. A UTF-8 BOM is skipped; UTF-16
+ * input is transcoded into `*buf`, which is replaced by a larger arena
+ * allocation when `*cap` is too small.
+ *
+ * @param raw In: the raw input. Out: the UTF-8 bytes.
+ * @param len In: the raw length. Out: the UTF-8 length.
+ * @param utf8 Whether the caller declared the input UTF-8.
+ * @param arena The arena to allocate a transcoding buffer from.
+ * @param buf The transcoding buffer, may be NULL.
+ * @param cap The capacity of `*buf`.
+ * @return false if the input was rejected or the arena is exhausted.
+ */
+static bool decodeInput(const uint8_t **raw, size_t *len, bool utf8, Arena *arena, char **buf, size_t *cap) {
+  const uint8_t *in = *raw;
+  size_t n = *len;
+  Encoding enc = ENCODING_UTF8;
+
+  if(!utf8) {
+    if(isSuspiciousCssInput(in, n))
+      return false;
+
+    // Detect encoding via BOM or @charset
+    char declaredCharset[MAX_CHARSET_LEN] = {0};
+    enc = detectEncoding(in, n, &declaredCharset[0]);
+  }
+
+  if(enc == ENCODING_UTF8 && n >= 3 && in[0] == 0xEF && in[1] == 0xBB && in[2] == 0xBF) {
+    in += 3;
+    n -= 3;
+  }
+  else if(enc == ENCODING_UTF16LE || enc == ENCODING_UTF16BE) {
+    size_t need = ((n - 2) / 2) * 3;
+
+    if(need > *cap) {
+      char *grown = arena_alloc(arena, need, 1);
+      if(!grown)
+        return false;
+
+      *buf = grown;
+      *cap = need;
+    }
+
+    n = need ? transcodeUtf16ToUtf8(in + 2, n - 2, (uint8_t *) *buf, need, enc == ENCODING_UTF16LE) : 0;
+    in = (const uint8_t *) *buf;
+  }
+
+  *raw = in;
+  *len = n;
+
+  return true;
+}
+
 /**
  * @brief Create a tokenizer from a raw CSS input.
  *
- * This function initializes a tokenizer by decoding the CSS input and
- * allocating a Tokenizer structure. It will return NULL if the input is
- * invalid or if the arena allocation fails.
+ * The tokenizer walks the input bytes directly: no per-code-point array is
+ * built up front, so creating a tokenizer is O(1) in the size of UTF-8
+ * input and every `Token.value` points into the caller's buffer, which must
+ * outlive the tokenizer. A UTF-8 BOM is skipped. UTF-16 input (detected via
+ * its BOM) is transcoded once to UTF-8 in the arena, in which case token
+ * values point into that copy instead.
+ *
+ * This function will return NULL if the input is invalid or if the arena
+ * allocation fails.
  *
- * @param raw The raw CSS input to decode.
+ * @param raw The raw CSS input to tokenize.
  * @param len The length of the input.
  * @param arena The arena to allocate memory from.
  *
  * @return A pointer to a new Tokenizer, or NULL on failure.
  */
 Tokenizer *tokCreate(const uint8_t *raw, size_t len, Arena *arena) {
-  if(!arena || !raw) 
-    return NULL;
+  return tokCreateEx(raw, len, arena, NULL);
+}
 
-  DecodedStream *s = arena_alloc(arena, len * sizeof(DecodedStream), ARENA_ALIGNMENT);
-  if(!s)
+/**
+ * @brief Create a tokenizer from a raw CSS input, with options.
+ *
+ * Like tokCreate(), but the tokenizer can skip whitespace and comments
+ * itself (they are stepped over without building a Token), stop tracking
+ * line and column numbers, and record diagnostics from the start. NULL
+ * or zeroed options give the same tokenizer as tokCreate().
+ *
+ * @param raw The raw CSS input to tokenize.
+ * @param len The length of the input.
+ * @param arena The arena to allocate memory from.
+ * @param options The options, or NULL for the defaults.
+ *
+ * @return A pointer to a new Tokenizer, or NULL on failure.
+ */
+Tokenizer *tokCreateEx(const uint8_t *raw, size_t len, Arena *arena, const TokOptions *options) {
+  if(!arena || !raw || len == 0)
     return NULL;
 
-  size_t count = decodeCssInput(raw, len, s, len);
-  if(count == 0)
-    return NULL;
+  bool utf8 = options && (options->flags & TOK_OPT_UTF8);
+  char *transcoded = NULL;
+  size_t transcodedCap = 0;
 
-  printf("Decoded %zu code points.\n", count);
+  if(!decodeInput(&raw, &len, utf8, arena, &transcoded, &transcodedCap) || len == 0)
+    return NULL;
 
   Tokenizer *t = arena_alloc(arena, sizeof(Tokenizer), ARENA_ALIGNMENT);
   if(!t)
     return NULL;
 
-  t->start = s;
-  t->curr = s;
-  t->end = s + count;
-  t->line = 1;
-  t->column = 1;
-  t->state = DATA_STATE;
-  t->shouldLog = 1;
+  tokInitState(t, (const char *) raw, len, arena);
+  t->inputUtf8 = utf8;
+  t->carry = transcoded;
+  t->carryCap = transcodedCap;
+
+  if(options) {
+    t->skipWhitespace = (options->flags & TOK_OPT_SKIP_WHITESPACE) != 0;
+    t->skipComments = (options->flags & TOK_OPT_SKIP_COMMENTS) != 0;
+    t->trackPositions = (options->flags & TOK_OPT_NO_POSITIONS) == 0;
+
+    if(options->maxErrors)
+      t->maxErrors = options->maxErrors;
+
+    tokSetDiagnosticBuffer(t, options->diagBuffer, options->diagCapacity);
+    tokSetDiagnosticCallback(t, options->onDiagnostic, options->diagUserData);
+  }
+
+  return t;
+}
+
+/**
+ * @brief Points an existing tokenizer at new input.
+ *
+ * Meant for tokenizing many small inputs (inline styles, selectors) with a
+ * single tokenizer: nothing is allocated unless a buffer it already owns
+ * is too small, and the options, diagnostic sinks and interner are kept.
+ * The cursor, positions, error count and queued diagnostics start over.
+ * With TOK_OPT_UTF8 the input is taken as is apart from a UTF-8 BOM;
+ * otherwise it is checked and sniffed like tokCreate() does. Empty input
+ * is accepted and yields TOKEN_EOF.
+ *
+ * A tokenizer reading a file releases its mapping first. Streaming
+ * tokenizers cannot be reset.
+ *
+ * @param t The tokenizer to reuse.
+ * @param raw The raw CSS input to tokenize next.
+ * @param len The length of the input.
+ *
+ * @return true on success. On failure the tokenizer is left at the end of
+ *         an empty input.
+ */
+bool tokReset(Tokenizer *t, const uint8_t *raw, size_t len) {
+  if(!t || t->streaming)
+    return false;
+
+  if(t->mapping)
+    tokClose(t);
+
+  bool ok = raw || len == 0;
+  if(ok && len)
+    ok = decodeInput(&raw, &len, t->inputUtf8, t->arena, &t->carry, &t->carryCap);
+
+  if(!ok || len == 0) {
+    raw = (const uint8_t *) "";
+    len = 0;
+  }
+
+  t->start = (const char *) raw;
+  t->curr = t->start;
+  t->end = t->start + len;
+  t->errorCount = 0;
+  t->nameHash = NAME_HASH_SEED;
+
+  t->posPtr = t->start;
+  t->posLine = 1;
+  t->posColumn = 1;
+  t->newlineCount = 0;
+  t->newlinesBuilt = false;
+
+  t->diagHead = 0;
+  t->diagTail = 0;
+
+  return ok;
+}
+
+/**
+ * @brief Resets every tokenizer field to its initial state over `input`.
+ *
+ * Shared by all the constructors so a new field only has to be
+ * initialized in one place.
+ *
+ * @param t The tokenizer to initialize.
+ * @param input The first byte of the UTF-8 input.
+ * @param len The length of the input in bytes.
+ * @param arena The arena the tokenizer allocates from.
+ */
+void tokInitState(Tokenizer *t, const char *input, size_t len, Arena *arena) {
+  t->start = input;
+  t->curr = input;
+  t->end = input + len;
   t->errorCount = 0;
-  t->maxErrors = 10;
-  t->stringQuote = '\0';
+  t->maxErrors = TOK_DEFAULT_MAX_ERRORS;
   t->arena = arena;
+  t->allocCount = 0;
+  t->interner = NULL;
+  t->nameHash = NAME_HASH_SEED;
+  t->diagMuted = false;
+  t->skipWhitespace = false;
+  t->skipComments = false;
+  t->trackPositions = true;
+  t->inputUtf8 = false;
+
+  t->streaming = false;
+  t->finished = false;
+  t->bomChecked = false;
+  t->carry = NULL;
+  t->carryLen = 0;
+  t->carryCap = 0;
+  t->carryRetryLen = 0;
+  t->onToken = NULL;
+  t->userData = NULL;
+
+  t->posPtr = input;
+  t->posLine = 1;
+  t->posColumn = 1;
+  t->newlines = NULL;
+  t->newlineCount = 0;
+  t->newlineCap = 0;
+  t->newlinesBuilt = false;
+
+  t->diagBuf = NULL;
+  t->diagCap = 0;
+  t->diagHead = 0;
+  t->diagTail = 0;
+  t->onDiag = NULL;
+  t->diagUserData = NULL;
+  t->streamOffset = 0;
+
+  t->mapping = NULL;
+  t->mappingLen = 0;
+}
 
-  return t;
+// What nextToken does for a token starting with a given byte
+typedef enum {
+  DISPATCH_DELIM,
+  DISPATCH_IDENT,
+  DISPATCH_STRING,
+  DISPATCH_NUMBER,
+  DISPATCH_WHITESPACE,
+  DISPATCH_SOLIDUS,
+  DISPATCH_HASH,
+  DISPATCH_LEFT_PAREN,
+  DISPATCH_RIGHT_PAREN,
+  DISPATCH_PLUS,
+  DISPATCH_COMMA,
+  DISPATCH_MINUS,
+  DISPATCH_FULL_STOP,
+  DISPATCH_SEMICOLON,
+  DISPATCH_COLON,
+  DISPATCH_LESS_THAN,
+  DISPATCH_AT,
+  DISPATCH_LEFT_SQUARE,
+  DISPATCH_REVERSE_SOLIDUS,
+  DISPATCH_RIGHT_SQUARE,
+  DISPATCH_LEFT_CURLY,
+  DISPATCH_RIGHT_CURLY
+} DispatchAction;
+
+// Short aliases to keep the table below readable
+#define DL DISPATCH_DELIM
+#define ID DISPATCH_IDENT
+#define ST DISPATCH_STRING
+#define NM DISPATCH_NUMBER
+#define WS DISPATCH_WHITESPACE
+#define SL DISPATCH_SOLIDUS
+#define HA DISPATCH_HASH
+#define LP DISPATCH_LEFT_PAREN
+#define RP DISPATCH_RIGHT_PAREN
+#define PL DISPATCH_PLUS
+#define CM DISPATCH_COMMA
+#define MI DISPATCH_MINUS
+#define DT DISPATCH_FULL_STOP
+#define SC DISPATCH_SEMICOLON
+#define CL DISPATCH_COLON
+#define LT DISPATCH_LESS_THAN
+#define AT DISPATCH_AT
+#define LS DISPATCH_LEFT_SQUARE
+#define BS DISPATCH_REVERSE_SOLIDUS
+#define RS DISPATCH_RIGHT_SQUARE
+#define LC DISPATCH_LEFT_CURLY
+#define RC DISPATCH_RIGHT_CURLY
+#define X16(a) a, a, a, a, a, a, a, a, a, a, a, a, a, a, a, a
+
+// First byte of a token -> DispatchAction. Bytes >= 0x80 start a non-ASCII
+// code point, which is an ident-start code point.
+static const uint8_t firstByteDispatch[256] = {
+  DL, DL, DL, DL, DL, DL, DL, DL, DL, WS, WS, DL, WS, WS, DL, DL,  // 0x00-0x0F
+  DL, DL, DL, DL, DL, DL, DL, DL, DL, DL, DL, DL, DL, DL, DL, DL,  // 0x10-0x1F
+  WS, DL, ST, HA, DL, DL, DL, ST, LP, RP, DL, PL, CM, MI, DT, SL,  // SP ! " # $ % & ' ( ) * + , - . /
+  NM, NM, NM, NM, NM, NM, NM, NM, NM, NM, CL, SC, LT, DL, DL, DL,  // 0 1 2 3 4 5 6 7 8 9 : ; < = > ?
+  AT, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,  // @ A B C D E F G H I J K L M N O
+  ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, LS, BS, RS, DL, ID,  // P Q R S T U V W X Y Z [ \ ] ^ _
+  DL, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID,  // ` a b c d e f g h i j k l m n o
+  ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, ID, LC, DL, RC, DL, DL,  // p q r s t u v w x y z { | } ~
+  X16(ID), X16(ID), X16(ID), X16(ID), X16(ID), X16(ID), X16(ID), X16(ID)  // 0x80-0xFF
+};
+
+#undef DL
+#undef ID
+#undef ST
+#undef NM
+#undef WS
+#undef SL
+#undef HA
+#undef LP
+#undef RP
+#undef PL
+#undef CM
+#undef MI
+#undef DT
+#undef SC
+#undef CL
+#undef LT
+#undef AT
+#undef LS
+#undef BS
+#undef RS
+#undef LC
+#undef RC
+#undef X16
+
+// GCC and Clang jump straight to each handler through a table of label
+// addresses (computed goto); other compilers get an equivalent switch.
+#if defined(__GNUC__) && !defined(TOK_NO_COMPUTED_GOTO)
+#define TOK_COMPUTED_GOTO 1
+#define DISPATCH_CASE(action) L_##action:
+#else
+#define TOK_COMPUTED_GOTO 0
+#define DISPATCH_CASE(action) case action:
+#endif
+
+#if TOK_COMPUTED_GOTO
+// Label addresses are a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/**
+ * Steps over the whitespace and comments the tokenizer was asked to skip.
+ *
+ * Uses the same scanners as the whitespace and comment tokens, so skipped
+ * trivia costs a scan and nothing else. A comment left open at the end of
+ * input is still reported.
+ *
+ * @param t Pointer to a valid Tokenizer instance.
+ */
+static void skipTrivia(Tokenizer *t) {
+  while(t->curr < t->end) {
+    if(t->skipWhitespace && isWhitespace(t->curr)) {
+      t->curr = scanWhitespace(t->curr, t->end);
+    }
+    else if(t->skipComments && *t->curr == '/' && t->curr + 1 < t->end && t->curr[1] == '*') {
+      const char *close = scanCommentEnd(t->curr + 2, t->end);
+
+      if(close == t->end) {
+        // [PARSE ERR] end of file was reached before the end of comment
+        reportDiagnostic(t, TOK_DIAG_EOF_IN_COMMENT, t->curr);
+        t->curr = t->end;
+      }
+      else {
+        t->curr = close + 2;
+      }
+    }
+    else {
+      return;
+    }
+  }
 }
 
 /**
- * Retrieves the next token from the tokenizer's input stream.
+ * Scans the token starting at the current position.
+ *
+ * The first byte of a token decides how it is tokenized, so the byte is
+ * mapped through `firstByteDispatch` and control jumps directly to the
+ * matching handler: there is no chain of comparisons and no recursion.
  *
- * This function processes the current state of the tokenizer's finite
- * state machine (FSM) to determine the type of token present at the
- * current position in the input stream. It handles various token types
- * including identifiers, strings, numbers, delimiters, and whitespace.
- * The tokenizer's state is updated accordingly, and the appropriate
- * token is returned.
+ * @param t Pointer to a valid Tokenizer instance.
+ * @return The next Token in the input stream.
+ */
+static Token nextToken(Tokenizer *t) {
+  if(t->skipWhitespace || t->skipComments)
+    skipTrivia(t);
+
+  if(isEof(t))
+    return makeToken(t, TOKEN_EOF, TOKEN_KIND_VALID, t->curr, 0);
+
+  const char *start = t->curr;
+
+#if TOK_COMPUTED_GOTO
+  static const void *const targets[] = {
+    [DISPATCH_DELIM] = &&L_DISPATCH_DELIM,
+    [DISPATCH_IDENT] = &&L_DISPATCH_IDENT,
+    [DISPATCH_STRING] = &&L_DISPATCH_STRING,
+    [DISPATCH_NUMBER] = &&L_DISPATCH_NUMBER,
+    [DISPATCH_WHITESPACE] = &&L_DISPATCH_WHITESPACE,
+    [DISPATCH_SOLIDUS] = &&L_DISPATCH_SOLIDUS,
+    [DISPATCH_HASH] = &&L_DISPATCH_HASH,
+    [DISPATCH_LEFT_PAREN] = &&L_DISPATCH_LEFT_PAREN,
+    [DISPATCH_RIGHT_PAREN] = &&L_DISPATCH_RIGHT_PAREN,
+    [DISPATCH_PLUS] = &&L_DISPATCH_PLUS,
+    [DISPATCH_COMMA] = &&L_DISPATCH_COMMA,
+    [DISPATCH_MINUS] = &&L_DISPATCH_MINUS,
+    [DISPATCH_FULL_STOP] = &&L_DISPATCH_FULL_STOP,
+    [DISPATCH_SEMICOLON] = &&L_DISPATCH_SEMICOLON,
+    [DISPATCH_COLON] = &&L_DISPATCH_COLON,
+    [DISPATCH_LESS_THAN] = &&L_DISPATCH_LESS_THAN,
+    [DISPATCH_AT] = &&L_DISPATCH_AT,
+    [DISPATCH_LEFT_SQUARE] = &&L_DISPATCH_LEFT_SQUARE,
+    [DISPATCH_REVERSE_SOLIDUS] = &&L_DISPATCH_REVERSE_SOLIDUS,
+    [DISPATCH_RIGHT_SQUARE] = &&L_DISPATCH_RIGHT_SQUARE,
+    [DISPATCH_LEFT_CURLY] = &&L_DISPATCH_LEFT_CURLY,
+    [DISPATCH_RIGHT_CURLY] = &&L_DISPATCH_RIGHT_CURLY
+  };
+
+  goto *targets[firstByteDispatch[(uint8_t) *start]];
+  {
+#else
+  switch(firstByteDispatch[(uint8_t) *start]) {
+#endif
+    DISPATCH_CASE(DISPATCH_IDENT)
+      return consumeIdentLikeToken(t);
+
+    DISPATCH_CASE(DISPATCH_STRING)
+      // Double or single quotation mark (")
+      return consumeString(t, *start);
+
+    DISPATCH_CASE(DISPATCH_NUMBER)
+      return consumeNumericToken(t);
+
+    DISPATCH_CASE(DISPATCH_WHITESPACE)
+      t->curr = scanWhitespace(t->curr, t->end);
+
+      return makeToken(t, TOKEN_WHITESPACE, TOKEN_KIND_VALID, start, t->curr - start);
+
+    DISPATCH_CASE(DISPATCH_SOLIDUS)
+      // Comments or '/'
+      return consumeCommentOrDelim(t, '/');
+
+    DISPATCH_CASE(DISPATCH_HASH)
+      // Number sign (#)
+      advancePtrToN(t, 1);
+
+      if(!isEof(t) && (isIdentCodePoint(t->curr) || isNCodePointValidEscape(t, 0))) {
+        const char *currStream = consumeIdentSequence(t);
+        Token tok = makeToken(t, TOKEN_HASH, TOKEN_KIND_VALID, start, currStream - start);
+
+        tagTokenName(t, &tok);
+        return tok;
+      }
+
+      return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start);
+
+    DISPATCH_CASE(DISPATCH_LEFT_PAREN)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_LEFT_PAREN, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_RIGHT_PAREN)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_RIGHT_PAREN, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_PLUS)
+      // Plus sign (+)
+      if(isNextThreeCodePointStartNumber(t))
+        return consumeNumericToken(t);
+
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_COMMA)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_COMMA, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_MINUS) {
+      // Hyphen/Minus sign (-)
+      const char *nxtPtr = peekPtrAtN(t, 1);
+      const char *nxt2Ptr = peekPtrAtN(t, 2);
+
+      if(isNextThreeCodePointStartNumber(t))
+        return consumeNumericToken(t);
+
+      if(nxtPtr && nxt2Ptr && *nxtPtr == '-' && *nxt2Ptr == '>') {
+        advancePtrToN(t, 3);
+
+        return makeToken(t, TOKEN_CDC, TOKEN_KIND_VALID, start, 3);
+      }
+
+      if(isNextThreeCodePointStartAnIdentSequence(t))
+        return consumeIdentLikeToken(t);
+
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, start, 1);
+    }
+
+    DISPATCH_CASE(DISPATCH_FULL_STOP)
+      // Full stop (.)
+      if(isNextThreeCodePointStartNumber(t))
+        return consumeNumericToken(t);
+
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_SEMICOLON)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_SEMICOLON, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_COLON)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_COLON, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_LESS_THAN) {
+      // Less than sign (<)
+      const char *nxtPtr = peekPtrAtN(t, 1);
+      const char *nxt2Ptr = peekPtrAtN(t, 2);
+      const char *nxt3Ptr = peekPtrAtN(t, 3);
+
+      if(nxtPtr && *nxtPtr == '!' && nxt2Ptr && *nxt2Ptr == '-' && nxt3Ptr && *nxt3Ptr == '-') {
+        advancePtrToN(t, 4);
+
+        return makeToken(t, TOKEN_CDO, TOKEN_KIND_VALID, start, 4);
+      }
+
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, start, 1);
+    }
+
+    DISPATCH_CASE(DISPATCH_AT)
+      // Commercial 'AT' symbol (@)
+      advancePtrToN(t, 1);
+
+      if(isNextThreeCodePointStartAnIdentSequence(t)) {
+        const char *currStream = consumeIdentSequence(t);
+        Token tok = makeToken(t, TOKEN_AT_KEYWORD, TOKEN_KIND_VALID, start, currStream - start);
+
+        tagTokenName(t, &tok);
+        return tok;
+      }
+
+      return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_LEFT_SQUARE)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_LEFT_SQUARE, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_REVERSE_SOLIDUS)
+      // Reverse solidus (\)
+      if(isNCodePointValidEscape(t, 0))
+        return consumeIdentLikeToken(t);
+
+      // [PARSE ERR] a backslash followed by a newline or end of file
+      reportDiagnostic(t, TOK_DIAG_INVALID_ESCAPE, start);
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_RIGHT_SQUARE)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_RIGHT_SQUARE, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_LEFT_CURLY)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_LEFT_CURLY, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_RIGHT_CURLY)
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_RIGHT_CURLY, TOKEN_KIND_VALID, start, 1);
+
+    DISPATCH_CASE(DISPATCH_DELIM)
+#if !TOK_COMPUTED_GOTO
+    default:
+#endif
+      // Anything else as a delim
+      advancePtrToN(t, 1);
+
+      return makeToken(t, TOKEN_DELIM, TOKEN_KIND_VALID, start, 1);
+  }
+}
+
+#if TOK_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * Retrieves the next token from the tokenizer's input stream.
  *
  * @param t Pointer to the Tokenizer instance.
- * @return The next Token in the input stream, or an error Token if
- *         the tokenizer is in an invalid state or encounters an
- *         unexpected input.
+ * @return The next Token in the input stream, or a TOKEN_EOF token of
+ *         kind TOKEN_KIND_ERROR if `t` is NULL.
  */
 Token tokNext(Tokenizer *t) {
   if(!t) {
-    printf("Invalid or NULL Tokenizer type t");
+    Token eof = { .type = TOKEN_EOF, .kind = TOKEN_KIND_ERROR };
 
-    exit(1);
+    return eof;
   }
 
-  // Skip over any characters already consumed
-  while (t->curr < t->end) {
-    // Save position
-    const DecodedStream *start = t->curr;
-    size_t line = t->line;
-    size_t column = t->column;
-
-    // NOTE: FSM RUN
-    switch(t->state) {
-      case DATA_STATE:
-        if(start && start->bytePtr && isIdentStartCodePoint(start->bytePtr)) {
-          // Possibly start of identifier
-          t->state = IDENTIFIER_STATE;
-        }
-        else if(start && start->bytePtr && (*start->bytePtr == '"' || *start->bytePtr == '\'')) {
-          t->state = STRING_STATE;
-        }
-        else if(start && start->bytePtr && isDigit(start->bytePtr)) {
-          t->state = NUMBER_STATE;
-        }
-        else if (start && start->bytePtr && t->curr < t->end && isWhitespace(start->bytePtr)) {
-          t->state = WHITESPACE_STATE;
-        }
-        else {
-            t->state = DELIM_STATE;
-        }
-
-        return tokNext(t);
-      case IDENTIFIER_STATE: 
-        // Identifiers
-        t->state = DATA_STATE;
-        if(start && start->bytePtr && isIdentCodePoint(start))
-          return consumeIdentLikeToken(t);
-
-        break;
-
-      case STRING_STATE:
-        // Double or single quotation mark (")
-        t->state = DATA_STATE;
-        return consumeString(t, *start->bytePtr);
-
-        break;
-
-      case NUMBER_STATE:
-        // Digit
-        t->state = DATA_STATE;
-        return consumeNumericToken(t);
+  return nextToken(t);
+}
 
-        break;
-
-      case WHITESPACE_STATE:
-        // Whitespace
-        while (t->curr < t->end && isWhitespace(t->curr->bytePtr)) {
-          if(!advancePtrToN(t, 1))
-            break;
-        }
-
-        t->state = DATA_STATE;
-        return makeToken(TOKEN_WHITESPACE, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-
-        break;
-
-      case DELIM_STATE:
-        t->state = DATA_STATE;
-
-        // Comments or '/'
-        if(start && start->bytePtr && *start->bytePtr == '/') {
-          return consumeCommentOrDelim(t, '/');
-        }
-
-        // Number sign (#)
-        if(start && start->bytePtr && *start->bytePtr == '#') {
-          advancePtrToN(t, 1);
-
-          const DecodedStream *nxtPtr = t->curr;
-          if(isIdentCodePoint(nxtPtr) || (isNCodePointValidEscape(t, 0) && isNCodePointValidEscape(t, 1))) {
-            if(isNextThreeCodePointStartAnIdentSequence(t)) {
-              const DecodedStream *currStream = consumeIdentSequence(t);
-
-              return makeToken(TOKEN_HASH, TOKEN_KIND_VALID, start, currStream - start, line, column);
-            }
-          }
-          else {
-            advancePtrToN(t, 1);
-
-            return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-          }
-        }
-
-        // Left parenthesis (()
-        if(start && start->bytePtr && *start->bytePtr == '(') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_LEFT_PAREN, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Right parenthesis ())
-        if(start && start->bytePtr && *start->bytePtr == ')') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_RIGHT_PAREN, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Plus sign (+)
-        if(start && start->bytePtr && *start->bytePtr == '+') {
-          if(isNextThreeCodePointStartNumber(t)) {
-            return consumeNumericToken(t);
-          }
-          else {
-            advancePtrToN(t, 1);
-    
-            return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-          }
-        }
-
-        // Comma (,)
-        if(start && start->bytePtr && *start->bytePtr == ',') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_COMMA, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Hyphen/Minus sign (-)
-        if(start && start->bytePtr && *start->bytePtr == '-') {
-          const DecodedStream *nxtPtr = peekPtrAtN(t, 1);
-          const DecodedStream *nxt2Ptr = peekPtrAtN(t, 2);
-
-          // Validate next two pointers and their bytePtrs
-          if(nxtPtr && nxt2Ptr) {
-            if(isNextThreeCodePointStartNumber(t)) {
-              
-              return consumeNumericToken(t);
-            }
-            else if(*nxtPtr->bytePtr == '-' && *nxt2Ptr->bytePtr == '>') {
-              advancePtrToN(t, 3);
-            
-              return makeToken(TOKEN_CDC, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-            }
-            else if(isNextThreeCodePointStartAnIdentSequence(t)) {
-              return consumeIdentLikeToken(t);
-            }
-            else {
-              advancePtrToN(t, 1);
-            
-              return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-            }
-          } 
-          else {
-            advancePtrToN(t, 1);
-          
-            return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-          }
-        }
-
-        // Full stop (.)
-        if(start && start->bytePtr && *start->bytePtr == '.') {
-          if(isNextThreeCodePointStartNumber(t)) {
-            return consumeNumericToken(t);
-          }
-          else {
-            advancePtrToN(t, 1);
-
-            return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-          }
-        }
-
-        // Semicolon (;)
-        if(start && start->bytePtr && *start->bytePtr == ';') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_SEMICOLON, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Colon (:)
-        if(start && start->bytePtr && *start->bytePtr == ':') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_COLON, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Less than sign (<)
-        if(start && start->bytePtr && *start->bytePtr == '<') {
-          const DecodedStream *nxtPtr = peekPtrAtN(t, 1);
-          const DecodedStream *nxt2Ptr = peekPtrAtN(t, 2);
-          const DecodedStream *nxt3Ptr = peekPtrAtN(t, 3);
-
-          if(nxtPtr && *nxtPtr->bytePtr == '!' && nxt2Ptr && *nxt2Ptr->bytePtr == '-' && nxt3Ptr && *nxt3Ptr->bytePtr == '-') {
-            advancePtrToN(t, 3);
-
-            return makeToken(TOKEN_CDO, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-          }
-          else {
-            advancePtrToN(t, 1);
-
-            return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-          }
-        }
-
-        // Commercial 'AT' symbol (@)
-        if(start && start->bytePtr && *start->bytePtr == '@') {
-          advancePtrToN(t, 1);
-
-          if(isNextThreeCodePointStartAnIdentSequence(t)) {
-            const DecodedStream *currStream = consumeIdentSequence(t);
-
-            return makeToken(TOKEN_AT_KEYWORD, TOKEN_KIND_VALID, start, currStream - start, line, column);
-          }
-          else {
-            return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-          }
-        }
-
-        // Left square bracket ([)
-        if(start && start->bytePtr && *start->bytePtr == '[') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_LEFT_SQUARE, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Reverse solidus (\)
-        if(start && start->bytePtr && *start->bytePtr == '\\') {
-          if(isNCodePointValidEscape(t, 1)) {
-            if(advancePtrToN(t, 1))
-              return consumeIdentLikeToken(t);
-          }
-          else {
-            // [PARSE ERR] end of file was reached before the end of string
-            logDiagnostic("Invalid escape sequence", start->bytePtr, line, column);
-
-            advancePtrToN(t, 1);
-            size_t delta = (t->curr >= start) ? (t->curr - start) : 0;
-
-            return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, delta, line, column);
-          }
-        }
-
-        // Right square bracket (])
-        if(start && start->bytePtr && *start->bytePtr == ']') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_RIGHT_SQUARE, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Left curly bracket ({)
-        if(start && start->bytePtr && *start->bytePtr == '{') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_LEFT_CURLY, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Right curly bracket (})
-        if(start && start->bytePtr && *start->bytePtr == '}') {
-          advancePtrToN(t, 1);
-
-          return makeToken(TOKEN_RIGHT_CURLY, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-        }
-
-        // Anything else as a delim
-        advancePtrToN(t, 1);
-        return makeToken(TOKEN_DELIM, TOKEN_KIND_VALID, start, t->curr - start, line, column);
-
-      default:
-        printf("Unknown tokenizer state: %d\n", t->state);
-        exit(1);
-    }
+/**
+ * Returns the number of arena allocations the tokenizer has made since it
+ * was created.
+ *
+ * Tokenizing in-memory input with tokNext() never allocates, so this stays
+ * 0 and an arena only needs room for the tokenizer itself (plus a UTF-16
+ * transcoding buffer). Allocations come from the newline index built by
+ * tokResolvePosition() and from the carry buffer in streaming mode.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @return The number of allocations.
+ */
+size_t tokAllocationCount(const Tokenizer *t) {
+  return t ? t->allocCount : 0;
+}
 
-    // EOF
-    if(isEof(t)) {
-      return makeToken(TOKEN_EOF, TOKEN_KIND_VALID, t->curr, 0, line, column);
-    }
+/**
+ * Sets the interner the names of ident, function, at-keyword and hash
+ * tokens are interned into. Interned names are allocated from the
+ * interner's arena and do not count towards tokAllocationCount().
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param in The interner, or NULL to stop interning.
+ */
+void tokSetInterner(Tokenizer *t, TokInterner *in) {
+  if(t)
+    t->interner = in;
+}
+
+/**
+ * Retrieves up to `max` tokens at once into a structure-of-arrays batch.
+ *
+ * Token i is described by out->types[i], out->offsets[i] and
+ * out->lengths[i]; offsets are byte offsets from the start of the input.
+ * out->lines and out->columns are optional and only filled when non-NULL.
+ * The batch stops early after TOKEN_EOF, which is always the last entry
+ * written once the input is exhausted.
+ *
+ * Streaming tokenizers and inputs of 4 GiB or more are not supported
+ * (offsets are 32-bit) and yield 0.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param out The caller-provided arrays, each holding at least `max` entries.
+ * @param max The maximum number of tokens to write.
+ * @return The number of tokens written.
+ */
+size_t tokNextBatch(Tokenizer *t, TokenBatch *out, size_t max) {
+  if(!t || !out || !out->types || !out->offsets || !out->lengths || t->streaming)
+    return 0;
+
+  if((size_t) (t->end - t->start) > UINT32_MAX)
+    return 0;
+
+  uint8_t *types = out->types;
+  uint32_t *offsets = out->offsets;
+  uint32_t *lengths = out->lengths;
+  size_t *lines = out->lines;
+  size_t *columns = out->columns;
+
+  size_t n = 0;
+  while(n < max) {
+    Token tok = nextToken(t);
+
+    types[n] = (uint8_t) tok.type;
+    offsets[n] = (uint32_t) (tok.value - t->start);
+    lengths[n] = (uint32_t) tok.length;
+
+    if(lines)
+      lines[n] = tok.line;
+    if(columns)
+      columns[n] = tok.column;
+
+    n++;
 
+    if(tok.type == TOKEN_EOF)
+      break;
   }
 
-  // If we fall through the loop, return EOF
-  return makeToken(TOKEN_EOF, TOKEN_KIND_VALID, t->curr, 0, t->line, t->column);
+  return n;
 }
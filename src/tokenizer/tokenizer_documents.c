@@ -0,0 +1,615 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "comot-css/documents.h"
+#include "tokenizer_impl.h"
+#include "thread_pool.h"
+
+#if !defined(_WIN32) && !defined(TOK_NO_THREADS)
+#include <stdatomic.h>
+#include <unistd.h>
+#define TOK_THREADS 1
+#else
+#define TOK_THREADS 0
+#endif
+
+#define TOK_WORKER_ARENA_SIZE (64 * 1024)     // a worker's tokenizer and newline index
+#define TOK_TOKEN_BLOCK_SIZE (1024 * 1024)    // smallest arena holding token arrays
+#define TOK_ARENA_SLACK 256                   // arena bookkeeping on top of a request
+#define TOK_CACHE_LINE 64
+
+// A worker's share of the documents: slots [head, tail) of the pool's
+// order array, packed into one word so both ends move with a single CAS.
+// The owner takes from the head (its largest document left), thieves take
+// from the tail.
+typedef struct {
+#if TOK_THREADS
+  _Alignas(TOK_CACHE_LINE) _Atomic uint64_t range;
+#else
+  uint64_t range;
+#endif
+} WorkQueue;
+
+// An arena holding token arrays. It lives inside its own arena, so the
+// arenas of a worker form a list that needs no other storage.
+typedef struct TokenBlock {
+  Arena arena;                // The arena this block is in
+  struct TokenBlock *prev;
+} TokenBlock;
+
+struct TokDocumentSet {
+  Arena arena;                // Holds the set itself and `results`
+  TokDocumentTokens *results;
+  size_t count;
+  TokenBlock *blocks[TOK_POOL_MAX_THREADS];
+};
+
+typedef struct DocumentPool DocumentPool;
+
+// State of one worker
+typedef struct {
+  DocumentPool *pool;
+  size_t id;
+  TokenBlock *blocks;         // Token arrays (tokTokenizeDocuments)
+  Arena scratch;              // Holds `tokens`, recreated when too small
+  CompactToken *tokens;
+  size_t tokensCap;
+} PoolWorker;
+
+struct DocumentPool {
+  const TokDocument *docs;
+  size_t count;
+  size_t totalBytes;
+  TokOptions options;
+  size_t workers;
+  TokPool *threads;           // Runs the workers and the chunks of large documents
+  uint32_t *order;            // Document indices, each worker's share largest first
+  WorkQueue *queues;
+  void (*process)(PoolWorker *w, size_t index, Tokenizer *t);
+  TokDocumentCallback onDocument;
+  void *userData;
+  TokDocumentSet *set;
+};
+
+// Order entry used while sorting documents by size
+typedef struct {
+  size_t len;
+  uint32_t index;
+} DocumentSize;
+
+/**
+ * @brief Orders documents largest first, then by index.
+ *
+ * @param a The first DocumentSize.
+ * @param b The second DocumentSize.
+ * @return qsort() order.
+ */
+static int compareDocumentSizes(const void *a, const void *b) {
+  const DocumentSize *x = a;
+  const DocumentSize *y = b;
+
+  if(x->len != y->len)
+    return x->len > y->len ? -1 : 1;
+
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+ * @brief Packs a queue's head and tail into one word.
+ *
+ * @param head The first slot left.
+ * @param tail One past the last slot left.
+ * @return The packed range.
+ */
+static inline uint64_t packRange(uint32_t head, uint32_t tail) {
+  return (uint64_t) tail << 32 | head;
+}
+
+/**
+ * @brief Takes a slot from one end of a queue.
+ *
+ * @param q The queue.
+ * @param fromTail Take the last slot (stealing) instead of the first.
+ * @param slot Receives the slot.
+ * @return true if the queue was not empty.
+ */
+static bool takeSlot(WorkQueue *q, bool fromTail, uint32_t *slot) {
+#if TOK_THREADS
+  uint64_t range = atomic_load_explicit(&q->range, memory_order_relaxed);
+
+  while(true) {
+    uint32_t head = (uint32_t) range;
+    uint32_t tail = (uint32_t) (range >> 32);
+
+    if(head >= tail)
+      return false;
+
+    uint64_t next = fromTail ? packRange(head, tail - 1) : packRange(head + 1, tail);
+    if(atomic_compare_exchange_weak_explicit(&q->range, &range, next,
+                                             memory_order_relaxed, memory_order_relaxed)) {
+      *slot = fromTail ? tail - 1 : head;
+      return true;
+    }
+  }
+#else
+  uint32_t head = (uint32_t) q->range;
+  uint32_t tail = (uint32_t) (q->range >> 32);
+
+  if(head >= tail)
+    return false;
+
+  q->range = fromTail ? packRange(head, tail - 1) : packRange(head + 1, tail);
+  *slot = fromTail ? tail - 1 : head;
+
+  return true;
+#endif
+}
+
+/**
+ * @brief Finds the next document for a worker.
+ *
+ * Takes the worker's own largest document left; when its share is done,
+ * steals the smallest document left from the other workers in turn.
+ *
+ * @param pool The pool.
+ * @param id The worker.
+ * @param index Receives the document index.
+ * @return false once every document has been taken.
+ */
+static bool takeDocument(DocumentPool *pool, size_t id, size_t *index) {
+  uint32_t slot;
+
+  for(size_t i = 0; i < pool->workers; i++) {
+    size_t victim = (id + i) % pool->workers;
+
+    if(takeSlot(&pool->queues[victim], victim != id, &slot)) {
+      *index = pool->order[slot];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Allocates memory for token arrays from a worker's blocks.
+ *
+ * Starts a new block, at least TOK_TOKEN_BLOCK_SIZE large, when the
+ * current one is full.
+ *
+ * @param w The worker.
+ * @param size The number of bytes.
+ * @param align The alignment.
+ * @return The memory, or NULL if no arena could be created.
+ */
+static void *blockAlloc(PoolWorker *w, size_t size, size_t align) {
+  void *p = w->blocks ? arena_alloc(&w->blocks->arena, size, align) : NULL;
+  if(p)
+    return p;
+
+  size_t cap = size + sizeof(TokenBlock) + TOK_ARENA_SLACK;
+  Arena arena = arena_create(cap > TOK_TOKEN_BLOCK_SIZE ? cap : TOK_TOKEN_BLOCK_SIZE);
+
+  TokenBlock *block = arena_alloc(&arena, sizeof(TokenBlock), _Alignof(TokenBlock));
+  if(!block) {
+    arena_destroy(&arena);
+    return NULL;
+  }
+
+  // From here on the arena is only used through the block
+  block->arena = arena;
+  block->prev = w->blocks;
+  w->blocks = block;
+
+  return arena_alloc(&block->arena, size, align);
+}
+
+/**
+ * @brief Frees a list of token blocks.
+ *
+ * @param block The most recent block.
+ */
+static void destroyBlocks(TokenBlock *block) {
+  while(block) {
+    TokenBlock *prev = block->prev;
+    Arena arena = block->arena;
+
+    arena_destroy(&arena);
+    block = prev;
+  }
+}
+
+/**
+ * @brief Makes sure a worker's scratch token array holds `cap` tokens.
+ *
+ * @param w The worker.
+ * @param cap The number of tokens needed.
+ * @return false if the arena could not be created.
+ */
+static bool reserveScratch(PoolWorker *w, size_t cap) {
+  if(cap <= w->tokensCap)
+    return true;
+
+  if(w->tokens)
+    arena_destroy(&w->scratch);
+
+  size_t want = cap > 4096 ? cap : 4096;
+  w->scratch = arena_create(want * sizeof(CompactToken) + TOK_ARENA_SLACK);
+  w->tokens = arena_alloc(&w->scratch, want * sizeof(CompactToken), _Alignof(CompactToken));
+  w->tokensCap = w->tokens ? want : 0;
+
+  if(!w->tokens)
+    arena_destroy(&w->scratch);
+
+  return w->tokens != NULL;
+}
+
+/**
+ * @brief Hands a document to the caller's callback.
+ *
+ * @param w The worker.
+ * @param index The document index.
+ * @param t The worker's tokenizer over the document, or NULL.
+ */
+static void callbackDocument(PoolWorker *w, size_t index, Tokenizer *t) {
+  w->pool->onDocument(index, t, w->pool->userData);
+}
+
+/**
+ * @brief Tokenizes a document into a compact token array of the set.
+ *
+ * Tokens go into the worker's scratch array first and are then copied
+ * into a token block, so blocks only hold what is used. A document larger
+ * than a fair share of the whole job is itself split into chunks, which
+ * the other workers run between documents and once they ran out of them,
+ * so it does not keep one core busy after the others ran out of work.
+ *
+ * @param w The worker.
+ * @param index The document index.
+ * @param t The worker's tokenizer over the document, or NULL.
+ */
+static void collectDocument(PoolWorker *w, size_t index, Tokenizer *t) {
+  DocumentPool *pool = w->pool;
+  TokDocumentTokens *result = &pool->set->results[index];
+
+  if(!t)
+    return;
+
+  size_t len = (size_t) (t->end - t->start);
+  if(len > UINT32_MAX || !reserveScratch(w, len + 1))
+    return;
+
+  size_t count;
+  if(pool->workers > 1 && len > pool->totalBytes / pool->workers)
+    count = tokNextCompactPooled(t, w->tokens, len + 1, pool->threads, pool->workers);
+  else
+    count = tokNextCompact(t, w->tokens, len + 1);
+
+  CompactToken *tokens = blockAlloc(w, count * sizeof(CompactToken), _Alignof(CompactToken));
+  if(!tokens)
+    return;
+
+  memcpy(tokens, w->tokens, count * sizeof(CompactToken));
+
+  // Transcoded input lives in the tokenizer, which moves on to other documents
+  const char *text = t->start;
+  const char *input = (const char *) pool->docs[index].input;
+
+  if(len && (text < input || text >= input + pool->docs[index].len)) {
+    char *copy = blockAlloc(w, len, 1);
+    if(!copy)
+      return;
+
+    memcpy(copy, text, len);
+    text = copy;
+  }
+
+  result->tokens = tokens;
+  result->count = count;
+  result->errorCount = tokDiagnosticCount(t);
+  result->text = text;
+}
+
+/**
+ * @brief Runs one worker until every document has been taken.
+ *
+ * The worker creates one tokenizer in its own arena and resets it for
+ * each document. Before taking a document it runs any chunks of a large
+ * document that another worker is waiting for.
+ *
+ * @param w The worker.
+ */
+static void runWorker(PoolWorker *w) {
+  DocumentPool *pool = w->pool;
+  Arena arena = arena_create(TOK_WORKER_ARENA_SIZE);
+  Tokenizer *t = tokCreateEx((const uint8_t *) " ", 1, &arena, &pool->options);
+  size_t index;
+
+  while(true) {
+    while(tokPoolHelp(pool->threads));
+
+    if(!takeDocument(pool, w->id, &index))
+      break;
+
+    const TokDocument *doc = &pool->docs[index];
+    bool ok = t && tokReset(t, doc->input, doc->len);
+
+    pool->process(w, index, ok ? t : NULL);
+  }
+
+  if(w->tokens)
+    arena_destroy(&w->scratch);
+
+  arena_destroy(&arena);
+}
+
+/**
+ * @brief Pool task running runWorker() on worker `index`.
+ *
+ * @param ctx The PoolWorker array.
+ * @param index The worker.
+ */
+static void runWorkerTask(void *ctx, size_t index) {
+  PoolWorker *workers = ctx;
+
+  runWorker(&workers[index]);
+}
+
+/**
+ * @brief Decides how many threads to run.
+ *
+ * @param threads The requested thread count, 0 for one per online core.
+ * @param count The number of documents.
+ * @return The number of workers, at least 1.
+ */
+static size_t workerCount(unsigned threads, size_t count) {
+#if TOK_THREADS
+  size_t n = threads;
+
+  if(n == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    n = cores > 0 ? (size_t) cores : 1;
+  }
+
+  if(n > TOK_POOL_MAX_THREADS)
+    n = TOK_POOL_MAX_THREADS;
+
+  if(n > count)
+    n = count;
+
+  return n ? n : 1;
+#else
+  (void) threads;
+  (void) count;
+
+  return 1;
+#endif
+}
+
+/**
+ * @brief Splits the documents between the workers and runs the pool.
+ *
+ * Documents are sorted largest first and dealt out in turn, so every
+ * worker starts with big documents and ends with small ones, which are
+ * what idle workers steal. The workers run on the shared thread pool,
+ * with the calling thread taking part.
+ *
+ * @param pool The pool, with everything but the schedule set up.
+ * @param arena Scratch memory for the schedule.
+ * @return false if the arena is too small.
+ */
+static bool runPool(DocumentPool *pool, Arena *arena) {
+  size_t count = pool->count;
+  size_t workers = pool->workers;
+
+  DocumentSize *sizes = arena_alloc(arena, count * sizeof(DocumentSize), _Alignof(DocumentSize));
+  pool->order = arena_alloc(arena, count * sizeof(uint32_t), _Alignof(uint32_t));
+  pool->queues = arena_alloc(arena, workers * sizeof(WorkQueue), _Alignof(WorkQueue));
+  if(!sizes || !pool->order || !pool->queues)
+    return false;
+
+  pool->totalBytes = 0;
+  for(size_t i = 0; i < count; i++) {
+    sizes[i].len = pool->docs[i].len;
+    sizes[i].index = (uint32_t) i;
+    pool->totalBytes += pool->docs[i].len;
+  }
+
+  qsort(sizes, count, sizeof(DocumentSize), compareDocumentSizes);
+
+  // Worker w gets documents w, w + workers, ... in consecutive slots
+  size_t slot = 0;
+  for(size_t w = 0; w < workers; w++) {
+    size_t first = slot;
+
+    for(size_t i = w; i < count; i += workers)
+      pool->order[slot++] = sizes[i].index;
+
+#if TOK_THREADS
+    atomic_init(&pool->queues[w].range, packRange((uint32_t) first, (uint32_t) slot));
+#else
+    pool->queues[w].range = packRange((uint32_t) first, (uint32_t) slot);
+#endif
+  }
+
+  PoolWorker state[TOK_POOL_MAX_THREADS];
+  for(size_t w = 0; w < workers; w++) {
+    state[w].pool = pool;
+    state[w].id = w;
+    state[w].blocks = NULL;
+    state[w].tokens = NULL;
+    state[w].tokensCap = 0;
+  }
+
+  // A worker no thread is free for starts late; its share is stolen meanwhile
+  pool->threads = tokSharedPool(workers);
+  tokPoolRun(pool->threads, runWorkerTask, state, workers);
+
+  if(pool->set) {
+    for(size_t w = 0; w < workers; w++)
+      pool->set->blocks[w] = state[w].blocks;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Sets up a pool over a list of documents.
+ *
+ * @param pool The pool to set up.
+ * @param docs The documents.
+ * @param count The number of documents.
+ * @param options Tokenizer options for every document, or NULL.
+ * @param threads The requested thread count, 0 for one per online core.
+ */
+static void initPool(DocumentPool *pool, const TokDocument *docs, size_t count,
+                     const TokOptions *options, unsigned threads) {
+  memset(pool, 0, sizeof(*pool));
+  pool->docs = docs;
+  pool->count = count;
+  pool->workers = workerCount(threads, count);
+
+  if(options)
+    pool->options = *options;
+
+  // One buffer cannot be shared by concurrent tokenizers
+  pool->options.diagBuffer = NULL;
+  pool->options.diagCapacity = 0;
+}
+
+/**
+ * @brief Size of the schedule runPool() allocates.
+ *
+ * @param count The number of documents.
+ * @param workers The number of workers.
+ * @return The number of arena bytes needed.
+ */
+static size_t scheduleSize(size_t count, size_t workers) {
+  return count * (sizeof(DocumentSize) + sizeof(uint32_t)) + workers * sizeof(WorkQueue) + 3 * TOK_ARENA_SLACK;
+}
+
+/**
+ * @brief Hands every document to a callback, on a pool of threads.
+ *
+ * Each thread reuses one tokenizer (created with `options`) for all the
+ * documents it takes; the callback gets it positioned at the start of the
+ * document, or NULL if the document was rejected as not being CSS.
+ *
+ * @param docs The documents.
+ * @param count The number of documents.
+ * @param options Tokenizer options for every document, or NULL.
+ * @param threads The number of threads to use, 0 for one per online core.
+ * @param onDocument Called once for each document, on a pool thread.
+ * @param userData Opaque pointer passed back to `onDocument`.
+ * @return false on invalid arguments or if the schedule gets no memory.
+ */
+bool tokForEachDocument(const TokDocument *docs, size_t count, const TokOptions *options,
+                        unsigned threads, TokDocumentCallback onDocument, void *userData) {
+  if((!docs && count) || !onDocument || count > UINT32_MAX)
+    return false;
+
+  if(count == 0)
+    return true;
+
+  DocumentPool pool;
+  initPool(&pool, docs, count, options, threads);
+  pool.process = callbackDocument;
+  pool.onDocument = onDocument;
+  pool.userData = userData;
+
+  Arena arena = arena_create(scheduleSize(count, pool.workers));
+  bool ok = runPool(&pool, &arena);
+  arena_destroy(&arena);
+
+  return ok;
+}
+
+/**
+ * @brief Tokenizes every document into a compact token array.
+ *
+ * Runs the same pool as tokForEachDocument(). Token arrays are kept in
+ * arenas owned by the thread that made them and live until
+ * tokDocumentSetDestroy(). Offsets are relative to TokDocumentTokens.text,
+ * which is the document's input after a UTF-8 BOM.
+ *
+ * @param docs The documents.
+ * @param count The number of documents.
+ * @param options Tokenizer options for every document, or NULL.
+ * @param threads The number of threads to use, 0 for one per online core.
+ * @return The set of token arrays, or NULL on invalid arguments or no memory.
+ */
+TokDocumentSet *tokTokenizeDocuments(const TokDocument *docs, size_t count,
+                                     const TokOptions *options, unsigned threads) {
+  if((!docs && count) || count > UINT32_MAX)
+    return NULL;
+
+  DocumentPool pool;
+  initPool(&pool, docs, count, options, threads);
+  pool.process = collectDocument;
+
+  size_t resultsSize = count * sizeof(TokDocumentTokens);
+  Arena arena = arena_create(sizeof(TokDocumentSet) + resultsSize + scheduleSize(count, pool.workers));
+
+  TokDocumentSet *set = arena_alloc(&arena, sizeof(TokDocumentSet), _Alignof(TokDocumentSet));
+  TokDocumentTokens *results = count ? arena_alloc(&arena, resultsSize, _Alignof(TokDocumentTokens)) : NULL;
+  if(!set || (count && !results)) {
+    arena_destroy(&arena);
+    return NULL;
+  }
+
+  if(count)
+    memset(results, 0, resultsSize);
+
+  memset(set->blocks, 0, sizeof(set->blocks));
+  set->results = results;
+  set->count = count;
+  pool.set = set;
+
+  // The schedule is only needed while the pool runs, but it is small
+  if(count && !runPool(&pool, &arena)) {
+    arena_destroy(&arena);
+    return NULL;
+  }
+
+  // From here on the arena is only used through the set
+  set->arena = arena;
+
+  return set;
+}
+
+/**
+ * @brief Returns the tokens of one document of a set.
+ *
+ * @param set The set.
+ * @param index The document index.
+ * @return The tokens; `tokens` is NULL if the document was rejected, ran
+ *         out of memory, or `index` is out of range.
+ */
+TokDocumentTokens tokDocumentTokens(const TokDocumentSet *set, size_t index) {
+  TokDocumentTokens none = { NULL, 0, 0, NULL };
+
+  if(!set || index >= set->count)
+    return none;
+
+  return set->results[index];
+}
+
+/**
+ * @brief Frees a set and all its token arrays.
+ *
+ * @param set The set, may be NULL.
+ */
+void tokDocumentSetDestroy(TokDocumentSet *set) {
+  if(!set)
+    return;
+
+  for(size_t w = 0; w < TOK_POOL_MAX_THREADS; w++)
+    destroyBlocks(set->blocks[w]);
+
+  Arena arena = set->arena;
+  arena_destroy(&arena);
+}
@@ -0,0 +1,138 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include "comot-css/tokenizer.h"
+#include "tokenizer_impl.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+ * @brief Reads a whole file into the arena.
+ *
+ * Fallback for platforms without mmap and for TOK_FILE_NO_MMAP.
+ *
+ * @param path The file to read.
+ * @param arena The arena to allocate the file contents from.
+ * @param len Receives the file size in bytes.
+ * @return The file contents, or NULL on failure.
+ */
+static uint8_t *readFileIntoArena(const char *path, Arena *arena, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if(!f)
+    return NULL;
+
+  uint8_t *data = NULL;
+  long size = -1;
+
+  if(fseek(f, 0, SEEK_END) == 0)
+    size = ftell(f);
+
+  if(size > 0 && fseek(f, 0, SEEK_SET) == 0) {
+    data = arena_alloc(arena, (size_t) size, 1);
+
+    if(data && fread(data, 1, (size_t) size, f) != (size_t) size)
+      data = NULL;
+  }
+
+  fclose(f);
+  *len = data ? (size_t) size : 0;
+
+  return data;
+}
+
+/**
+ * @brief Create a tokenizer over the contents of a file.
+ *
+ * The file is mapped read-only with a sequential-access hint and tokenized
+ * in place, so there is no intermediate copy of the stylesheet and no
+ * allocation proportional to its size. Token.value points into the mapping
+ * and stays valid until tokClose() is called, which must be done once the
+ * tokenizer (and every token taken from it) is no longer used.
+ *
+ * With TOK_FILE_NO_MMAP, or on platforms without mmap, the file is read
+ * into the arena instead; tokClose() is then a no-op.
+ *
+ * @param path The path of the stylesheet to tokenize.
+ * @param arena The arena to allocate memory from.
+ * @param flags A combination of TokFileFlags.
+ *
+ * @return A pointer to a new Tokenizer, or NULL if the file cannot be read,
+ *         is empty, or the tokenizer cannot be created.
+ */
+Tokenizer *tokCreateFromFile(const char *path, Arena *arena, unsigned flags) {
+  if(!path || !arena)
+    return NULL;
+
+#if !defined(_WIN32)
+  if(!(flags & TOK_FILE_NO_MMAP)) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+      return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0 || (uintmax_t) st.st_size > SIZE_MAX) {
+      close(fd);
+      return NULL;
+    }
+
+    size_t len = (size_t) st.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // The mapping keeps the file alive
+
+    if(map == MAP_FAILED)
+      return NULL;
+
+    posix_madvise(map, len, POSIX_MADV_SEQUENTIAL);
+    if(flags & TOK_FILE_WILLNEED)
+      posix_madvise(map, len, POSIX_MADV_WILLNEED);
+
+    Tokenizer *t = tokCreate((const uint8_t *) map, len, arena);
+    if(!t) {
+      munmap(map, len);
+      return NULL;
+    }
+
+    t->mapping = map;
+    t->mappingLen = len;
+
+    return t;
+  }
+#endif
+
+  size_t len = 0;
+  uint8_t *data = readFileIntoArena(path, arena, &len);
+  if(!data)
+    return NULL;
+
+  return tokCreate(data, len, arena);
+}
+
+/**
+ * @brief Releases the resources a tokenizer holds outside of its arena.
+ *
+ * Unmaps the file mapping of a tokenizer created with tokCreateFromFile().
+ * Token values taken from it are invalid afterwards. Safe to call on any
+ * tokenizer, and more than once.
+ *
+ * @param t The tokenizer to close.
+ */
+void tokClose(Tokenizer *t) {
+  if(!t || !t->mapping)
+    return;
+
+#if !defined(_WIN32)
+  munmap(t->mapping, t->mappingLen);
+#endif
+
+  t->mapping = NULL;
+  t->mappingLen = 0;
+  t->start = t->curr = t->end = t->posPtr = NULL;
+}
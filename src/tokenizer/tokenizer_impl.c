@@ -1,4 +1,3 @@
-#include <stdio.h>
 #include <stdbool.h>
 #include "tokenizer_impl.h"
 #include "comot-css/error.h"
@@ -8,55 +7,54 @@
  * Creates a new token with the specified properties.
  *
  * This function initializes a Token structure with the provided type, kind,
- * value, length, line, and column information. It extracts the byte pointer
- * from the DecodedStream to set as the token's value.
+ * value and length. The value is a pointer into the input bytes and the
+ * length is a byte count. The line and column are resolved from the
+ * position of `value`, which must not precede the previous token's, or
+ * left 0 when the tokenizer does not track positions.
  *
+ * @param t The tokenizer instance.
  * @param type The type of the token (e.g., IDENT, FUNCTION, etc.).
  * @param kind The kind of the token (valid or error).
- * @param value The decoded stream representing the token's value.
+ * @param value Pointer to the first byte of the token in the input.
  * @param length The length of the token.
- * @param line The line number where the token starts.
- * @param column The column number where the token starts.
  * @return A Token structure initialized with the provided properties.
  */
-Token makeToken(TokenType type, TokenKind kind, const DecodedStream *value, size_t length, size_t line, size_t column) {
+Token makeToken(Tokenizer *t, TokenType type, TokenKind kind, const char *value, size_t length) {
   Token tok;
 
   tok.type = type;
   tok.kind = kind;
-  tok.value = value->bytePtr;
+  tok.value = value;
   tok.length = length;
-  tok.line = line;
-  tok.column = column;
+  tok.numeric = (TokenNumeric) {0};
+  tok.atom = TOK_ATOM_UNKNOWN;
+  tok.nameId = TOK_NO_NAME;
+
+  if(t->trackPositions)
+    tokAdvancePosition(t, value, &tok.line, &tok.column);
+  else
+    tok.line = tok.column = 0;
 
   return tok;
 }
 
 /**
- * Emits an error token with the specified properties, and logs a diagnostic
- * message if the tokenizer is set to log errors.
+ * Emits an error token with the specified properties, and reports a
+ * diagnostic for it.
  *
  * @param t The tokenizer instance.
- * @param message A human-readable diagnostic message describing the error.
- * @param value The decoded stream representing the token's value.
+ * @param code The diagnostic to report.
+ * @param value Pointer to the first byte of the token in the input.
  * @param length The length of the token.
- * @param line The line number where the token starts.
- * @param column The column number where the token starts.
  * @return A Token structure initialized with the provided properties, with
  *         its kind set to TOKEN_KIND_ERROR.
  */
-Token emitErrorToken(Tokenizer *t, const char* message, const DecodedStream *value, size_t length, size_t line, size_t column) {
-  if(t->shouldLog) {
-    logDiagnostic(message, value->bytePtr, line, column);
-    t->errorCount ++;
-
-    if(t->errorCount >= t->maxErrors) {
-      t->shouldLog = 0;
-      fprintf(stderr, "[diagnostic] Logging disabled after %ld errors\n", t->errorCount);
-    }
-  }
+Token emitErrorToken(Tokenizer *t, TokDiagCode code, const char *value, size_t length) {
+  Token tok = makeToken(t, TOKEN_ERROR, TOKEN_KIND_ERROR, value, length);
+
+  reportDiagnostic(t, code, value);
 
-  return makeToken(TOKEN_ERROR, TOKEN_KIND_ERROR, value, length, line, column);
+  return tok;
 }
 
 /**
@@ -68,92 +66,17 @@ Token emitErrorToken(Tokenizer *t, const char* message, const DecodedStream *val
  * @return true if the escape sequence is valid, false otherwise.
  */
 bool isNCodePointValidEscape(Tokenizer *t, size_t n) {
-  const DecodedStream *currCodePointPtr = peekPtrAtN(t, n);
-  if(!currCodePointPtr || *currCodePointPtr->bytePtr != '\\')
+  const char *currCodePointPtr = peekPtrAtN(t, n);
+  if(!currCodePointPtr || *currCodePointPtr != '\\')
     return false;
 
-  const DecodedStream *nextCodePointPtr = peekPtrAtN(t, n + 1);
-  if(!nextCodePointPtr || *nextCodePointPtr->bytePtr == '\n')
+  const char *nextCodePointPtr = peekPtrAtN(t, n + 1);
+  if(!nextCodePointPtr || *nextCodePointPtr == '\n')
     return false;
 
   return true;
 }
 
-/**
- * Checks if a character is a whitespace character.
- *
- * @param currCodePoint The character to check.
- *
- * @return true if the character is a whitespace character, false otherwise.
- */
-bool isWhitespace(const char *currCodePoint) {
-  return (*currCodePoint == ' ' || *currCodePoint == '\t' || *currCodePoint == '\n' || *currCodePoint == '\r' || *currCodePoint == '\f'); 
-}
-
-/**
- * Checks if a character is a digit.
- *
- * @param currCodePoint The character to check.
- *
- * @return true if the character is a digit, false otherwise.
- */
-bool isDigit(const char *currCodePoint) {
-  // 0-9
-  return (*currCodePoint >= '0' && *currCodePoint <= '9');
-}
-
-/**
- * Checks if a character is a letter.
- *
- * @param currCodePoint The character to check.
- *
- * @return true if the character is a letter, false otherwise.
- */
-bool isLetter(const char *currCodePoint) {
-  // A-Z, a-z
-  return ((*currCodePoint >= 'A' && *currCodePoint <= 'Z') || (*currCodePoint >= 'a' && *currCodePoint <= 'z'));
-}
-
-/**
- * Checks if a character is a non-ASCII Unicode code point.
- *
- * @param currCodePoint The character to check.
- *
- * @return true if the character is a non-ASCII Unicode code point, false otherwise.
- */
-bool isNonASCIICodePoint(const char *currCodePoint) {
-  // Unicode code point greater than or equal to U+0080
-  return ((unsigned char) *currCodePoint >= 0x80);
-}
-
-/**
- * Checks if a character is a valid identifier start code point.
- *
- * A valid identifier start code point is a letter, a non-ASCII Unicode code
- * point, or an underscore.
- *
- * @param currCodePoint The character to check.
- *
- * @return true if the character is a valid identifier start code point, false otherwise.
- */
-bool isIdentStartCodePoint(const char *currCodePoint) {
-  return (isLetter(currCodePoint) || isNonASCIICodePoint(currCodePoint) || (*currCodePoint == '_'));
-}
-
-/**
- * Checks if a character is a valid identifier code point.
- *
- * A valid identifier code point is a valid identifier start code point,
- * a digit, or a hyphen.
- *
- * @param currStream The decoded stream representing the character to check.
- *
- * @return true if the character is a valid identifier code point, false otherwise.
- */
-bool isIdentCodePoint(const DecodedStream *currStream) {
-  return (isIdentStartCodePoint(currStream->bytePtr) || isDigit(currStream->bytePtr) || *currStream->bytePtr == '-');
-}
-
 /**
  * Checks if the next three code points in the input stream could possibly be
  * the start of an identifier sequence.
@@ -164,18 +87,21 @@ bool isIdentCodePoint(const DecodedStream *currStream) {
  *         identifier sequence, false otherwise.
  */
 bool isNextThreeCodePointStartAnIdentSequence(Tokenizer *t) {
-  const char *firstCodePoint = t->curr->bytePtr;
-  const DecodedStream *secondCodePoint = peekPtrAtN(t, 1);
-  const DecodedStream *thirdCodePoint = peekPtrAtN(t, 2);
+  if(isEof(t))
+    return false;
+
+  const char *firstCodePoint = t->curr;
+  const char *secondCodePoint = peekPtrAtN(t, 1);
+  const char *thirdCodePoint = peekPtrAtN(t, 2);
 
   if(*firstCodePoint == '-') {
-    if(isIdentStartCodePoint(secondCodePoint->bytePtr)) {
+    if(secondCodePoint && isIdentStartCodePoint(secondCodePoint)) {
       return true;
     }
-    if(secondCodePoint && *secondCodePoint->bytePtr == '-' && thirdCodePoint && isIdentStartCodePoint(thirdCodePoint->bytePtr)) {
+    if(secondCodePoint && *secondCodePoint == '-' && thirdCodePoint && isIdentStartCodePoint(thirdCodePoint)) {
       return true;
     }
-    if(secondCodePoint && *secondCodePoint->bytePtr == '\\' && isNCodePointValidEscape(t, 1)) {
+    if(secondCodePoint && *secondCodePoint == '\\' && isNCodePointValidEscape(t, 1)) {
       return true;
     }
   }
@@ -204,21 +130,24 @@ bool isNextThreeCodePointStartAnIdentSequence(Tokenizer *t) {
  *         number sequence, false otherwise.
  */
 bool isNextThreeCodePointStartNumber(Tokenizer *t) {
-  const char *firstCodePoint = t->curr->bytePtr;
-  const DecodedStream *secondCodePoint = peekPtrAtN(t, 1);
-  const DecodedStream *thirdCodePoint = peekPtrAtN(t, 2);
+  if(isEof(t))
+    return false;
+
+  const char *firstCodePoint = t->curr;
+  const char *secondCodePoint = peekPtrAtN(t, 1);
+  const char *thirdCodePoint = peekPtrAtN(t, 2);
 
   if(*firstCodePoint == '+' || *firstCodePoint == '-') {
-    if(secondCodePoint && isDigit(secondCodePoint->bytePtr))
+    if(secondCodePoint && isDigit(secondCodePoint))
       return true;
-    else if(secondCodePoint && *secondCodePoint->bytePtr == '.' && thirdCodePoint && isDigit(thirdCodePoint->bytePtr))
+    else if(secondCodePoint && *secondCodePoint == '.' && thirdCodePoint && isDigit(thirdCodePoint))
       return true;
     else
       return false;
   }
 
   if(*firstCodePoint == '.') {
-    if(secondCodePoint && isDigit(secondCodePoint->bytePtr))
+    if(secondCodePoint && isDigit(secondCodePoint))
       return true;
     else 
       return false;
@@ -0,0 +1,357 @@
+#include <stdalign.h>
+#include <string.h>
+#include "comot-css/incremental.h"
+#include "tokenizer_impl.h"
+
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+// Bytes past the end of a token that may still decide how it ends. As for
+// streaming, no consume routine peeks further than this.
+#define TOK_RELEX_LOOKAHEAD 4
+
+#define TOK_LIST_MIN_CAPACITY 256
+
+// The tokens are kept in a gap buffer with the gap at the last edit, so an
+// edit only moves the tokens between it and the previous one. Tokens before
+// the gap hold their offset from the start of the text, tokens after it
+// their distance from the end: an edit changes neither, so nothing past it
+// has to be rewritten.
+struct TokTokenList {
+  Arena *arena;
+  Tokenizer *t;
+  CompactToken *tokens;
+  size_t capacity;
+  size_t gapStart;        // Tokens [0, gapStart) are before the gap
+  size_t gapEnd;          // Tokens [gapEnd, capacity) are after it
+  size_t len;             // Length of the current text
+  bool broken;            // An edit ran out of memory half-way
+};
+
+/**
+ * @brief Returns a token with its offset from the start of the text.
+ *
+ * @param list The token list.
+ * @param index The token index, below tokTokenListCount().
+ * @return The token.
+ */
+static inline CompactToken tokenAt(const TokTokenList *list, size_t index) {
+  if(index < list->gapStart)
+    return list->tokens[index];
+
+  CompactToken ct = list->tokens[list->gapEnd + (index - list->gapStart)];
+  ct.offset = (uint32_t) (list->len - ct.offset);
+
+  return ct;
+}
+
+/**
+ * @brief Moves the gap so that `index` tokens are before it.
+ *
+ * Offsets are converted between the two representations on the way, so
+ * the cost is the number of tokens the gap moves over.
+ *
+ * @param list The token list.
+ * @param index The new gap start, at most tokTokenListCount().
+ */
+static void moveGap(TokTokenList *list, size_t index) {
+  CompactToken *tokens = list->tokens;
+
+  while(list->gapStart > index) {
+    CompactToken ct = tokens[--list->gapStart];
+    ct.offset = (uint32_t) (list->len - ct.offset);
+    tokens[--list->gapEnd] = ct;
+  }
+
+  while(list->gapStart < index) {
+    CompactToken ct = tokens[list->gapEnd++];
+    ct.offset = (uint32_t) (list->len - ct.offset);
+    tokens[list->gapStart++] = ct;
+  }
+}
+
+/**
+ * @brief Appends a token before the gap, growing the buffer if it is full.
+ *
+ * The tokens after the gap move to the end of the larger buffer; see
+ * tokArenaGrow().
+ *
+ * @param list The token list.
+ * @param ct The token, with its offset from the start of the text.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool pushToken(TokTokenList *list, CompactToken ct) {
+  if(list->gapStart == list->gapEnd) {
+    CompactToken *old = list->tokens;
+    size_t after = list->capacity - list->gapEnd;
+    size_t need = list->capacity < TOK_LIST_MIN_CAPACITY ? TOK_LIST_MIN_CAPACITY : list->capacity + 1;
+
+    if(!tokArenaGrow(list->arena, (void **) &list->tokens, &list->capacity, list->gapStart, need,
+                     sizeof(CompactToken), alignof(CompactToken)))
+      return false;
+
+    if(after)
+      memcpy(list->tokens + list->capacity - after, old + list->gapEnd, after * sizeof(CompactToken));
+
+    list->gapEnd = list->capacity - after;
+  }
+
+  list->tokens[list->gapStart++] = ct;
+
+  return true;
+}
+
+/**
+ * @brief Checks whether two tokens are the same apart from their offsets.
+ *
+ * @param a The first token.
+ * @param b The second token.
+ * @return true if both have the same type, length and flags.
+ */
+static inline bool sameToken(CompactToken a, CompactToken b) {
+  return a.type == b.type && a.length == b.length && a.flags == b.flags;
+}
+
+/**
+ * @brief Points the list's tokenizer at a text.
+ *
+ * @param list The token list.
+ * @param text The whole text.
+ * @param len The length of the text.
+ * @return true if the text can be tokenized in place.
+ */
+static bool resetText(TokTokenList *list, const uint8_t *text, size_t len) {
+  // Offsets must refer to the caller's bytes, so a BOM cannot be skipped
+  if(len >= 3 && text[0] == 0xEF && text[1] == 0xBB && text[2] == 0xBF)
+    return false;
+
+  return tokReset(list->t, text, len);
+}
+
+/**
+ * @brief Tokenizes a text into a list that can then follow its edits.
+ *
+ * @param text The UTF-8 text, without a BOM.
+ * @param len The length of the text.
+ * @param arena The arena the list and its tokens are allocated from.
+ * @param options Tokenizer options, or NULL. TOK_OPT_UTF8 and
+ *                TOK_OPT_NO_POSITIONS are always set.
+ * @return The token list, or NULL on invalid input or arena exhaustion.
+ */
+TokTokenList *tokTokenListCreate(const uint8_t *text, size_t len, Arena *arena,
+                                 const TokOptions *options) {
+  if(!arena || (!text && len) || len > UINT32_MAX)
+    return NULL;
+
+  TokOptions opts = options ? *options : (TokOptions) {0};
+  opts.flags |= TOK_OPT_UTF8 | TOK_OPT_NO_POSITIONS;
+
+  TokTokenList *list = arena_alloc(arena, sizeof(TokTokenList), ARENA_ALIGNMENT);
+  if(!list)
+    return NULL;
+
+  memset(list, 0, sizeof(TokTokenList));
+  list->arena = arena;
+  list->t = tokCreateEx((const uint8_t *) " ", 1, arena, &opts);
+  if(!list->t || !resetText(list, text, len))
+    return NULL;
+
+  list->len = len;
+
+  while(true) {
+    Token tok = tokNext(list->t);
+    if(!pushToken(list, tokCompactToken(list->t, &tok)))
+      return NULL;
+
+    if(tok.type == TOKEN_EOF)
+      break;
+  }
+
+  return list;
+}
+
+/**
+ * @brief Updates the tokens after an edit of the text.
+ *
+ * Tokenizing restarts at the last token that starts at least
+ * TOK_RELEX_LOOKAHEAD bytes before the edit: the tokens before it cannot
+ * have changed, and the tokenizer keeps no state between tokens. A URL
+ * token does not start where it was read from (its "url(" comes first), so
+ * the token before it is used instead.
+ *
+ * It stops at the first new token past the edit that has the same type,
+ * length and distance from the end of the text as an old token: the rest
+ * of the text is unchanged from there on, so the old tokens are too and
+ * are kept as they are. Old tokens still identical before the edit are not
+ * reported as changed.
+ *
+ * @param list The token list.
+ * @param text The whole text after the edit.
+ * @param len The length of the text.
+ * @param edit The edit, in offsets of the text before it.
+ * @param change Receives the range of tokens that changed, or NULL.
+ * @return true on success, false on invalid arguments or arena exhaustion.
+ */
+bool tokTokenListEdit(TokTokenList *list, const uint8_t *text, size_t len,
+                      const TokEdit *edit, TokTokenChange *change) {
+  if(!list || list->broken || !edit || (!text && len) || len > UINT32_MAX)
+    return false;
+
+  size_t oldLen = list->len;
+  if(edit->offset > oldLen || edit->removed > oldLen - edit->offset ||
+     len != oldLen - edit->removed + edit->inserted)
+    return false;
+
+  size_t first = 0;
+  size_t cursor = 0;
+
+  if(edit->offset >= TOK_RELEX_LOOKAHEAD) {
+    first = tokTokenListFind(list, edit->offset - TOK_RELEX_LOOKAHEAD);
+
+    while(first > 0) {
+      uint8_t type = tokenAt(list, first).type;
+      if(type != TOKEN_URL && type != TOKEN_BAD_URL)
+        break;
+      first--;
+    }
+
+    if(first > 0)
+      cursor = tokenAt(list, first).offset;
+  }
+
+  if(!resetText(list, text, len))
+    return false;
+
+  // Old tokens from `first` on now sit after the gap, measured from the
+  // end, which the edit does not move for those that follow it
+  moveGap(list, first);
+  list->len = len;
+
+  size_t oldEditEnd = edit->offset + edit->removed;
+  size_t newEditEnd = edit->offset + edit->inserted;
+  size_t removed = 0;
+  size_t inserted = 0;
+  bool samePrefix = true;
+  Tokenizer *t = list->t;
+
+  t->curr = t->start + cursor;
+
+  while(true) {
+    Token tok = tokNext(t);
+    CompactToken ct = tokCompactToken(t, &tok);
+    size_t distance = len - ct.offset;
+
+    // TOKEN_EOF is empty, so at an edit at the very end it would pass for
+    // part of the prefix and be read again; it lines up further down
+    if(samePrefix && list->gapEnd < list->capacity && tok.type != TOKEN_EOF) {
+      CompactToken old = list->tokens[list->gapEnd];
+      size_t oldOffset = oldLen - old.offset;
+
+      if(oldOffset == ct.offset && ct.offset + ct.length <= edit->offset && sameToken(old, ct)) {
+        list->gapEnd++;
+        list->tokens[list->gapStart++] = ct;
+        first++;
+        continue;
+      }
+
+      samePrefix = false;
+    }
+
+    // Drop old tokens that start before this one or overlap the edit
+    while(list->gapEnd < list->capacity) {
+      CompactToken old = list->tokens[list->gapEnd];
+      if(old.offset <= distance && oldLen - old.offset >= oldEditEnd)
+        break;
+
+      list->gapEnd++;
+      removed++;
+    }
+
+    if(ct.offset >= newEditEnd && list->gapEnd < list->capacity) {
+      CompactToken old = list->tokens[list->gapEnd];
+      if(old.offset == distance && sameToken(old, ct))
+        break;
+    }
+
+    if(!pushToken(list, ct)) {
+      list->broken = true;
+      return false;
+    }
+
+    inserted++;
+
+    if(tok.type == TOKEN_EOF) {
+      // Only reached if the old TOKEN_EOF did not line up, which it always
+      // does; kept so the list stays consistent regardless
+      removed += list->capacity - list->gapEnd;
+      list->gapEnd = list->capacity;
+      break;
+    }
+  }
+
+  if(change) {
+    change->first = first;
+    change->removed = removed;
+    change->inserted = inserted;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Returns the number of tokens in a list.
+ *
+ * @param list The token list.
+ * @return The number of tokens, including the final TOKEN_EOF.
+ */
+size_t tokTokenListCount(const TokTokenList *list) {
+  return list ? list->gapStart + (list->capacity - list->gapEnd) : 0;
+}
+
+/**
+ * @brief Returns a token of a list.
+ *
+ * @param list The token list.
+ * @param index The token index, below tokTokenListCount().
+ * @return The token, with its offset in the current text.
+ */
+CompactToken tokTokenListGet(const TokTokenList *list, size_t index) {
+  if(!list || index >= tokTokenListCount(list))
+    return (CompactToken) {0};
+
+  return tokenAt(list, index);
+}
+
+/**
+ * @brief Finds the token at a byte offset with a binary search.
+ *
+ * @param list The token list.
+ * @param offset A byte offset in the current text.
+ * @return The index of the last token starting at or before `offset`, or 0
+ *         if there is none.
+ */
+size_t tokTokenListFind(const TokTokenList *list, size_t offset) {
+  size_t lo = 0;
+  size_t hi = tokTokenListCount(list);
+
+  // Invariant: tokens before lo start at or before offset, from hi on after
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+
+    if(tokenAt(list, mid).offset <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo ? lo - 1 : 0;
+}
+
+/**
+ * @brief Returns the tokenizer a list reads its current text with.
+ *
+ * @param list The token list.
+ * @return The tokenizer, or NULL.
+ */
+Tokenizer *tokTokenListTokenizer(const TokTokenList *list) {
+  return list ? list->t : NULL;
+}
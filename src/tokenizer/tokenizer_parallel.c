@@ -0,0 +1,409 @@
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+#include "tokenizer_impl.h"
+#include "thread_pool.h"
+
+#if !defined(_WIN32) && !defined(TOK_NO_THREADS)
+#include <unistd.h>
+#define TOK_THREADS 1
+#else
+#define TOK_THREADS 0
+#endif
+
+#define TOK_PARALLEL_MIN_CHUNK (64 * 1024)  // smaller inputs are not worth a thread
+#define TOK_PARALLEL_MAX_CHUNKS TOK_POOL_MAX_THREADS
+#define TOK_SPLIT_WINDOW 4096               // how far a split looks for a newline
+#define TOK_CHUNK_ARENA_SLACK 256           // arena bookkeeping on top of the tokens
+
+// CompactToken.reserved of a chunk token whose scan reported a diagnostic
+#define CHUNK_TOKEN_REPORTED 1
+
+// A slice of the input tokenized speculatively by a pool thread
+typedef struct {
+  const Tokenizer *parent;
+  size_t from;            // Offset the chunk's scan starts at
+  size_t to;              // Stop once the cursor reaches this offset
+  bool last;              // Runs up to and including TOKEN_EOF
+  Arena arena;            // Owns `tokens` and `ends`
+  CompactToken *tokens;
+  uint32_t *ends;         // Offset the scan stopped at after each token
+  size_t count;
+  size_t reported;        // Tokens marked CHUNK_TOKEN_REPORTED
+  bool ok;
+} ParallelChunk;
+
+/**
+ * @brief Tokenizes one chunk as if a token started at its first byte.
+ *
+ * Uses a private tokenizer over the parent's whole input, so the last
+ * token may run past the end of the chunk and offsets are relative to the
+ * parent's input. Where each scan stopped is kept next to the tokens: it
+ * is past the token's bytes after a function's '(' and ahead of them
+ * after a url() token, and the merge needs the real position. Diagnostics
+ * are only counted; tokens whose scan reported one are marked so the
+ * merge can report them again, in order.
+ *
+ * @param c The chunk.
+ */
+static void lexChunk(ParallelChunk *c) {
+  const Tokenizer *parent = c->parent;
+
+  // Every token but TOKEN_EOF consumes at least one byte of the chunk
+  size_t cap = (c->last ? (size_t) (parent->end - parent->start) : c->to) - c->from + 2;
+
+  c->arena = arena_create(cap * (sizeof(CompactToken) + sizeof(uint32_t)) + TOK_CHUNK_ARENA_SLACK);
+  c->tokens = arena_alloc(&c->arena, cap * sizeof(CompactToken), _Alignof(CompactToken));
+  c->ends = arena_alloc(&c->arena, cap * sizeof(uint32_t), _Alignof(uint32_t));
+  c->count = 0;
+  c->reported = 0;
+  c->ok = c->tokens != NULL && c->ends != NULL;
+
+  if(!c->ok)
+    return;
+
+  Tokenizer w;
+  tokInitState(&w, parent->start, (size_t) (parent->end - parent->start), NULL);
+  w.curr = parent->start + c->from;
+  w.skipWhitespace = parent->skipWhitespace;
+  w.skipComments = parent->skipComments;
+  w.trackPositions = false;
+  w.diagMuted = true;
+
+  const char *to = parent->start + c->to;
+
+  while(c->last || w.curr < to) {
+    size_t errorCount = w.errorCount;
+    Token tok = tokNext(&w);
+
+    CompactToken ct = tokCompactToken(&w, &tok);
+    if(w.errorCount != errorCount) {
+      ct.reserved = CHUNK_TOKEN_REPORTED;
+      c->reported++;
+    }
+
+    c->ends[c->count] = (uint32_t) (w.curr - parent->start);
+    c->tokens[c->count++] = ct;
+
+    if(tok.type == TOKEN_EOF)
+      break;
+  }
+}
+
+/**
+ * @brief Pool task running lexChunk() on chunk `index + 1`; the first
+ *        chunk is the caller's.
+ *
+ * @param ctx The chunks.
+ * @param index The task.
+ */
+static void lexChunkTask(void *ctx, size_t index) {
+  ParallelChunk *chunks = ctx;
+
+  lexChunk(&chunks[index + 1]);
+}
+
+/**
+ * @brief Decides how many chunks to split `len` bytes into.
+ *
+ * @param len The number of bytes left to tokenize.
+ * @param threads The requested thread count, 0 for one per online core.
+ * @return The number of chunks, 1 if the input is not worth splitting.
+ */
+static size_t chunkCount(size_t len, size_t threads) {
+#if TOK_THREADS
+  size_t n = threads;
+
+  if(n == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    n = cores > 0 ? (size_t) cores : 1;
+  }
+
+  if(n > TOK_PARALLEL_MAX_CHUNKS)
+    n = TOK_PARALLEL_MAX_CHUNKS;
+
+  if(n > len / TOK_PARALLEL_MIN_CHUNK)
+    n = len / TOK_PARALLEL_MIN_CHUNK;
+
+  return n ? n : 1;
+#else
+  (void) len;
+  (void) threads;
+
+  return 1;
+#endif
+}
+
+/**
+ * @brief Picks the chunk boundaries.
+ *
+ * Each boundary is moved just past a nearby newline: strings, names and
+ * url() bodies cannot contain one, so a chunk usually starts on a real
+ * token boundary. Without a newline close by, the boundary is only moved
+ * to the start of a code point. Boundaries that collide are merged.
+ *
+ * @param t The tokenizer.
+ * @param chunks The chunks to fill.
+ * @param n The number of chunks wanted.
+ * @return The number of chunks actually used.
+ */
+static size_t splitChunks(const Tokenizer *t, ParallelChunk *chunks, size_t n) {
+  size_t base = (size_t) (t->curr - t->start);
+  size_t len = (size_t) (t->end - t->start);
+  size_t used = 0;
+
+  for(size_t i = 0; i < n; i++) {
+    size_t from = base + (len - base) / n * i;
+
+    if(i > 0) {
+      size_t window = len - from < TOK_SPLIT_WINDOW ? len - from : TOK_SPLIT_WINDOW;
+      const char *nl = memchr(t->start + from, '\n', window);
+
+      if(nl)
+        from = (size_t) (nl - t->start) + 1;
+      else {
+        while(from < len && isUtf8ContByte((uint8_t) t->start[from]))
+          from++;
+      }
+
+      if(from >= len || from <= chunks[used - 1].from)
+        continue;
+
+      chunks[used - 1].to = from;
+    }
+
+    chunks[used].parent = t;
+    chunks[used].from = from;
+    chunks[used].last = false;
+    used++;
+  }
+
+  chunks[used - 1].to = len;
+  chunks[used - 1].last = true;
+
+  return used;
+}
+
+/**
+ * @brief Scans one token with the parent tokenizer from `cursor`.
+ *
+ * Diagnostics are reported through the parent's sinks as usual.
+ *
+ * @param t The parent tokenizer, with position tracking off.
+ * @param cursor The offset to scan from.
+ * @param ct Receives the compact token.
+ * @return The offset after the token.
+ */
+static size_t relexToken(Tokenizer *t, size_t cursor, CompactToken *ct) {
+  t->curr = t->start + cursor;
+
+  Token tok = tokNext(t);
+  *ct = tokCompactToken(t, &tok);
+
+  return (size_t) (t->curr - t->start);
+}
+
+/**
+ * @brief Tokenizes the first chunk with the parent tokenizer itself.
+ *
+ * The first chunk starts where the tokenizer is, so its tokens are known
+ * to be right and go straight into `out`, reporting diagnostics as usual.
+ *
+ * @param t The parent tokenizer, with position tracking off.
+ * @param c The first chunk.
+ * @param out The array to fill.
+ * @param max The capacity of `out`.
+ * @return The number of tokens written.
+ */
+static size_t lexFirstChunk(Tokenizer *t, const ParallelChunk *c, CompactToken *out, size_t max) {
+  const char *to = t->start + c->to;
+  size_t count = 0;
+
+  while(count < max && t->curr < to) {
+    Token tok = tokNext(t);
+    out[count++] = tokCompactToken(t, &tok);
+
+    if(tok.type == TOKEN_EOF)
+      break;
+  }
+
+  return count;
+}
+
+/**
+ * @brief Joins the speculative chunks onto the tokens already in `out`.
+ *
+ * Walks the chunks in order, tracking the offset the real scan is at.
+ * A chunk whose scan started there is taken as is. Otherwise (its first
+ * byte was inside a comment or a token of the previous chunk) tokens are
+ * re-scanned from the real position until a scan stops where a scan of
+ * the chunk stopped. The cursor is all the state a scan depends on, so
+ * from there on both are identical and the rest of the chunk is taken.
+ * Token offsets are not enough for this: a url() token and the ')' after
+ * it share one. Diagnostics of the tokens taken are reported again by
+ * the parent tokenizer, re-scanning each from where the previous one
+ * stopped, in token order.
+ *
+ * @param t The parent tokenizer, with position tracking off, positioned
+ *          after the tokens already in `out`.
+ * @param chunks The tokenized chunks.
+ * @param n The number of chunks.
+ * @param out The array to fill.
+ * @param count The number of tokens already in `out`.
+ * @param max The capacity of `out`.
+ * @return The number of tokens in `out`.
+ */
+static size_t mergeChunks(Tokenizer *t, const ParallelChunk *chunks, size_t n,
+                          CompactToken *out, size_t count, size_t max) {
+  size_t cursor = (size_t) (t->curr - t->start);
+  bool eof = count && out[count - 1].type == TOKEN_EOF;
+
+  for(size_t i = 0; i < n && count < max && !eof; i++) {
+    const ParallelChunk *c = &chunks[i];
+    size_t next = 0;
+
+    if(cursor != c->from) {
+      size_t k = 0;
+      next = c->count;
+
+      while(count < max && (c->last || cursor < c->to)) {
+        CompactToken ct;
+        cursor = relexToken(t, cursor, &ct);
+        out[count++] = ct;
+
+        if(ct.type == TOKEN_EOF) {
+          eof = true;
+          break;
+        }
+
+        while(k < c->count && c->ends[k] < cursor)
+          k++;
+
+        if(k < c->count && c->ends[k] == cursor) {
+          next = k + 1;
+          break;
+        }
+      }
+    }
+
+    if(next >= c->count || eof)
+      continue;
+
+    size_t taken = c->count - next < max - count ? c->count - next : max - count;
+    memcpy(out + count, c->tokens + next, taken * sizeof(CompactToken));
+
+    for(size_t j = 0; c->reported && j < taken; j++) {
+      if(out[count + j].reserved) {
+        CompactToken again;
+        relexToken(t, j ? c->ends[next + j - 1] : cursor, &again);
+        out[count + j].reserved = 0;
+      }
+    }
+
+    count += taken;
+    cursor = c->ends[next + taken - 1];
+    eof = out[count - 1].type == TOKEN_EOF;
+  }
+
+  t->curr = t->start + cursor;
+
+  return count;
+}
+
+/**
+ * @brief Retrieves up to `max` compact tokens, tokenizing in chunks on a
+ *        thread pool.
+ *
+ * The caller tokenizes the first chunk while the pool takes the others;
+ * see tokNextCompactParallel(). Chunk tasks can be helped, so a pool
+ * worker calling this gets help from workers that run out of work of
+ * their own instead of starting threads.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param out The array to fill, holding at least `max` entries.
+ * @param max The maximum number of tokens to write.
+ * @param pool The pool running the chunks.
+ * @param chunks The number of chunks wanted.
+ * @return The number of tokens written.
+ */
+size_t tokNextCompactPooled(Tokenizer *t, CompactToken *out, size_t max, TokPool *pool, size_t chunks) {
+  if(!t || !out || t->streaming)
+    return 0;
+
+  if((size_t) (t->end - t->start) > UINT32_MAX)
+    return 0;
+
+  size_t n = chunkCount((size_t) (t->end - t->curr), chunks);
+
+  // Interning is not thread-safe, and order-dependent
+  if(n < 2 || max == 0 || t->interner)
+    return tokNextCompact(t, out, max);
+
+  ParallelChunk parts[TOK_PARALLEL_MAX_CHUNKS];
+  n = splitChunks(t, parts, n);
+
+  if(n < 2)
+    return tokNextCompact(t, out, max);
+
+  // Re-scans jump backwards, which position tracking does not expect
+  bool trackPositions = t->trackPositions;
+  t->trackPositions = false;
+
+  TokPoolJob job;
+  tokPoolStart(pool, &job, lexChunkTask, parts, n - 1, true);
+
+  size_t count = lexFirstChunk(t, &parts[0], out, max);
+
+  tokPoolWait(pool, &job);
+
+  bool ok = true;
+  for(size_t i = 1; i < n; i++)
+    ok &= parts[i].ok;
+
+  if(ok)
+    count = mergeChunks(t, parts + 1, n - 1, out, count, max);
+
+  t->trackPositions = trackPositions;
+
+  if(!ok && count < max && (count == 0 || out[count - 1].type != TOKEN_EOF))
+    count += tokNextCompact(t, out + count, max - count);
+
+  for(size_t i = 1; i < n; i++)
+    arena_destroy(&parts[i].arena);
+
+  return count;
+}
+
+/**
+ * @brief Retrieves up to `max` compact tokens, tokenizing on several threads.
+ *
+ * The rest of the input is split into chunks that are tokenized
+ * speculatively in parallel on the process's thread pool, each as if a
+ * token started at its first byte, and then joined (see mergeChunks()).
+ * The tokens, the diagnostics reported and the tokenizer's final position
+ * are exactly those of tokNextCompact(), which is used instead for inputs
+ * too small to split, when names are interned, or when a chunk cannot get
+ * memory.
+ *
+ * The input holds at most one token per byte plus TOKEN_EOF, which bounds
+ * the size of `out` needed to get every token in one call.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param out The array to fill, holding at least `max` entries.
+ * @param max The maximum number of tokens to write.
+ * @param threads The number of threads to use, 0 for one per online core.
+ * @return The number of tokens written.
+ */
+size_t tokNextCompactParallel(Tokenizer *t, CompactToken *out, size_t max, unsigned threads) {
+  if(!t || !out || t->streaming)
+    return 0;
+
+  size_t n = chunkCount((size_t) (t->end - t->curr), threads);
+
+  return tokNextCompactPooled(t, out, max, tokSharedPool(n), n);
+}
@@ -0,0 +1,166 @@
+#include <string.h>
+#include "comot-css/tokenizer.h"
+#include "comot-css/diag.h"
+#include "tokenizer_impl.h"
+
+/**
+ * @brief Advances a line/column pair over the bytes in [from, to).
+ *
+ * '\n' starts a new line; every other code point (but not UTF-8
+ * continuation bytes) advances the column by one. Newlines are located
+ * with memchr(), which the C library vectorizes, so only the bytes of the
+ * last line are looked at one by one.
+ *
+ * @param from The first byte to scan.
+ * @param to One past the last byte to scan.
+ * @param line The line at `from`, updated to the line at `to`.
+ * @param column The column at `from`, updated to the column at `to`.
+ */
+static void scanPosition(const char *from, const char *to, size_t *line, size_t *column) {
+  const char *nl;
+
+  while(from < to && (nl = memchr(from, '\n', (size_t) (to - from)))) {
+    (*line)++;
+    *column = 1;
+    from = nl + 1;
+  }
+
+  size_t codePoints = 0;
+  for(; from < to; from++)
+    codePoints += !isUtf8ContByte((uint8_t) *from);
+
+  *column += codePoints;
+}
+
+/**
+ * @brief Builds the sorted offsets of every newline in the input.
+ *
+ * Done once, on the first position lookup that cannot be answered from
+ * the tokenizer's position cursor.
+ *
+ * @param t The tokenizer (not in streaming mode).
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool buildNewlineIndex(Tokenizer *t) {
+  size_t count = 0;
+  const char *p = t->start;
+  const char *nl;
+
+  while(p < t->end && (nl = memchr(p, '\n', (size_t) (t->end - p)))) {
+    count++;
+    p = nl + 1;
+  }
+
+  // An index built for an earlier input (see tokReset) is reused if large enough
+  size_t *newlines = t->newlines;
+  if(count > t->newlineCap) {
+    newlines = tokArenaAlloc(t, count * sizeof(size_t), _Alignof(size_t));
+    if(!newlines)
+      return false;
+
+    t->newlineCap = count <= UINT32_MAX ? (uint32_t) count : 0;
+  }
+
+  if(count) {
+    size_t i = 0;
+    p = t->start;
+    while(i < count && (nl = memchr(p, '\n', (size_t) (t->end - p)))) {
+      newlines[i++] = (size_t) (nl - t->start);
+      p = nl + 1;
+    }
+  }
+
+  t->newlines = newlines;
+  t->newlineCount = count;
+  t->newlinesBuilt = true;
+
+  return true;
+}
+
+/**
+ * @brief Resolves the line and column of a byte offset in the input.
+ *
+ * The first call builds an index of every newline in the input; each
+ * lookup is then a binary search over it plus a scan of the start of the
+ * line the offset falls on. Lines and columns are 1-based and columns count
+ * code points.
+ *
+ * @param t The tokenizer (not in streaming mode).
+ * @param offset A byte offset from the start of the input, e.g. a
+ *        CompactToken offset or `tok.value - input`.
+ * @param line Receives the line number.
+ * @param column Receives the column number.
+ *
+ * @return true on success, false for streaming tokenizers or an offset
+ *         past the end of the input.
+ */
+bool tokResolvePosition(Tokenizer *t, size_t offset, size_t *line, size_t *column) {
+  if(!t || !line || !column || t->streaming || offset > (size_t) (t->end - t->start))
+    return false;
+
+  size_t l = 1, c = 1;
+
+  if(!t->newlinesBuilt && !buildNewlineIndex(t)) {
+    // No memory for the index: fall back to scanning from the start
+    scanPosition(t->start, t->start + offset, &l, &c);
+  }
+  else {
+    // Number of newlines before `offset`
+    size_t lo = 0, hi = t->newlineCount;
+    while(lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+
+      if(t->newlines[mid] < offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    l = lo + 1;
+    scanPosition(t->start + (lo ? t->newlines[lo - 1] + 1 : 0), t->start + offset, &l, &c);
+  }
+
+  *line = l;
+  *column = c;
+
+  return true;
+}
+
+/**
+ * @brief Computes the line and column of `p` without moving the cursor.
+ *
+ * Tokens are produced in input order, so positions are normally computed
+ * by scanning forward from the cursor left at the start of the previous
+ * token; every input byte is then scanned once overall. Positions before
+ * the cursor go through the newline index instead.
+ *
+ * @param t The tokenizer.
+ * @param p A pointer into the tokenizer's current input.
+ * @param line Receives the line number.
+ * @param column Receives the column number.
+ */
+void tokPositionAt(Tokenizer *t, const char *p, size_t *line, size_t *column) {
+  *line = t->posLine;
+  *column = t->posColumn;
+
+  if(p >= t->posPtr)
+    scanPosition(t->posPtr, p, line, column);
+  else if(!t->streaming)
+    tokResolvePosition(t, (size_t) (p - t->start), line, column);
+}
+
+/**
+ * @brief Computes the line and column of `p` and moves the cursor there.
+ *
+ * @param t The tokenizer.
+ * @param p A pointer into the tokenizer's current input.
+ * @param line Receives the line number.
+ * @param column Receives the column number.
+ */
+void tokAdvancePosition(Tokenizer *t, const char *p, size_t *line, size_t *column) {
+  tokPositionAt(t, p, line, column);
+
+  t->posPtr = p;
+  t->posLine = *line;
+  t->posColumn = *column;
+}
@@ -0,0 +1,315 @@
+#include <stdalign.h>
+#include <string.h>
+#include "comot-css/tokens.h"
+#include "comot-css/tokenizer.h"
+#include "tokenizer_impl.h"
+
+#define ARENA_ALIGNMENT alignof(max_align_t)
+
+// Bytes that must follow a token before it is known to be complete. No
+// consume routine peeks further than 3 code points past its final position.
+#define TOK_STREAM_LOOKAHEAD 4
+
+// Initial carry capacity, and how many chunk bytes are first borrowed to
+// finish a token that straddles a chunk boundary.
+#define TOK_STREAM_MIN_CARRY 256
+
+/**
+ * @brief Appends bytes to the tokenizer's carry buffer, growing it if needed.
+ *
+ * The carry buffer lives in the arena. When it is too small a buffer twice
+ * as large is allocated and the old one is abandoned, so the total arena use
+ * stays within a small factor of the largest token ever carried. Pointers
+ * into the carry are invalidated; callers keep offsets instead.
+ *
+ * @param t The streaming tokenizer.
+ * @param bytes The bytes to append.
+ * @param len The number of bytes to append.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool appendToCarry(Tokenizer *t, const char *bytes, size_t len) {
+  if(t->carryLen + len > t->carryCap) {
+    size_t cap = t->carryCap ? t->carryCap * 2 : TOK_STREAM_MIN_CARRY;
+    while(cap < t->carryLen + len)
+      cap *= 2;
+
+    char *grown = tokArenaAlloc(t, cap, 1);
+    if(!grown)
+      return false;
+
+    if(t->carryLen)
+      memcpy(grown, t->carry, t->carryLen);
+
+    t->carry = grown;
+    t->carryCap = cap;
+  }
+
+  memcpy(t->carry + t->carryLen, bytes, len);
+  t->carryLen += len;
+
+  return true;
+}
+
+/**
+ * @brief Emits every complete token that starts before `limit`.
+ *
+ * On return the position cursor is at t->curr, so the consumed bytes can
+ * be dropped and t->posPtr simply follows t->curr when it is relocated.
+ *
+ * A token is complete once at least TOK_STREAM_LOOKAHEAD bytes follow it,
+ * because then more input can no longer change how it was tokenized. The
+ * first token that is not complete is rolled back so it can be re-scanned
+ * once more input has arrived. After tokFinish() every token is complete.
+ *
+ * Tokens are scanned with diagnostics muted, since a rolled-back token must
+ * not report anything. The rare complete token that did report something
+ * is scanned once more with reporting on, so that each diagnostic reaches
+ * the caller exactly once, just before its token.
+ *
+ * @param t The streaming tokenizer, positioned at a token boundary.
+ * @param limit Stop before tokenizing a token that starts at or past this.
+ * @return true if a TOKEN_EOF was emitted (only possible after tokFinish).
+ */
+static bool drainTokens(Tokenizer *t, const char *limit) {
+  size_t line, column;
+
+  while(t->curr < limit) {
+    const char *curr = t->curr;
+    const char *posPtr = t->posPtr;
+    size_t posLine = t->posLine;
+    size_t posColumn = t->posColumn;
+    size_t errorCount = t->errorCount;
+
+    t->diagMuted = true;
+    Token tok = tokNext(t);
+    t->diagMuted = false;
+
+    // Some consume routines report running out of input as TOKEN_EOF
+    bool complete = t->finished ||
+      (tok.type != TOKEN_EOF && (size_t) (t->end - t->curr) >= TOK_STREAM_LOOKAHEAD);
+
+    if(!complete || t->errorCount != errorCount) {
+      t->curr = curr;
+      t->posPtr = posPtr;
+      t->posLine = posLine;
+      t->posColumn = posColumn;
+      t->errorCount = errorCount;
+
+      if(!complete) {
+        // The cursor must not point at bytes that are about to be dropped
+        tokAdvancePosition(t, t->curr, &line, &column);
+
+        return false;
+      }
+
+      tok = tokNext(t);
+    }
+
+    t->onToken(&tok, t->userData);
+
+    if(tok.type == TOKEN_EOF)
+      return true;
+  }
+
+  tokAdvancePosition(t, t->curr, &line, &column);
+
+  return false;
+}
+
+/**
+ * @brief Moves the unconsumed tail [t->curr, t->end) into the carry buffer.
+ *
+ * The carry only ever holds the token currently being assembled, so
+ * already-consumed bytes are dropped first.
+ *
+ * @param t The streaming tokenizer.
+ * @param inCarry Whether the cursor currently points into the carry itself.
+ * @return true on success, false if the arena is exhausted.
+ */
+static bool carryRemainder(Tokenizer *t, bool inCarry) {
+  size_t remaining = t->end - t->curr;
+
+  t->streamOffset += (size_t) (t->curr - t->start);
+
+  if(inCarry) {
+    memmove(t->carry, t->curr, remaining);
+    t->carryLen = remaining;
+  }
+  else {
+    t->carryLen = 0;
+    if(remaining && !appendToCarry(t, t->curr, remaining))
+      return false;
+  }
+
+  t->start = t->carry;
+  t->curr = t->carry;
+  t->end = t->carry + t->carryLen;
+  t->posPtr = t->curr;
+
+  // Re-scanning a long unfinished token (e.g. a huge comment) on every small
+  // chunk would be quadratic, so wait until the carry has doubled.
+  t->carryRetryLen = t->carryLen * 2;
+
+  return true;
+}
+
+/**
+ * @brief Create a tokenizer in streaming (push) mode.
+ *
+ * Input is supplied incrementally with tokFeed() and terminated with
+ * tokFinish(). Each complete token is passed to `onToken` as soon as it is
+ * known; tokens split across chunk boundaries are carried over. There is no
+ * limit on the total input size: memory use is bounded by the largest
+ * single token, not by the size of the stylesheet. The input must be UTF-8.
+ *
+ * Token.value points either into the chunk being fed or into the
+ * tokenizer's carry buffer, and is only valid until the callback returns.
+ *
+ * @param arena The arena to allocate memory from.
+ * @param onToken The callback receiving each token, including TOKEN_EOF.
+ * @param userData Opaque pointer passed back to `onToken`.
+ *
+ * @return A pointer to a new Tokenizer, or NULL on failure.
+ */
+Tokenizer *tokCreateStream(Arena *arena, TokTokenCallback onToken, void *userData) {
+  if(!arena || !onToken)
+    return NULL;
+
+  Tokenizer *t = arena_alloc(arena, sizeof(Tokenizer), ARENA_ALIGNMENT);
+  if(!t)
+    return NULL;
+
+  tokInitState(t, NULL, 0, arena);
+  t->streaming = true;
+  t->onToken = onToken;
+  t->userData = userData;
+
+  return t;
+}
+
+/**
+ * @brief Feeds the next chunk of input to a streaming tokenizer.
+ *
+ * Tokens are tokenized directly over `chunk`; only the bytes of a token
+ * that is still incomplete at the end of the chunk are copied into the
+ * carry buffer. The chunk does not need to outlive this call.
+ *
+ * @param t A tokenizer created with tokCreateStream().
+ * @param chunk The next bytes of input.
+ * @param len The number of bytes in `chunk`.
+ *
+ * @return true on success, false on invalid arguments or arena exhaustion.
+ */
+bool tokFeed(Tokenizer *t, const uint8_t *chunk, size_t len) {
+  if(!t || !t->streaming || t->finished || (!chunk && len))
+    return false;
+
+  if(len == 0)
+    return true;
+
+  const char *bytes = (const char *) chunk;
+
+  // Skip a UTF-8 BOM, which may itself be split across chunks
+  if(!t->bomChecked) {
+    if(t->carryLen + len < 3)
+      return appendToCarry(t, bytes, len);
+
+    uint8_t head[3];
+    size_t fromCarry = t->carryLen;
+    if(fromCarry)
+      memcpy(head, t->carry, fromCarry);
+    memcpy(head + fromCarry, bytes, 3 - fromCarry);
+
+    if(head[0] == 0xEF && head[1] == 0xBB && head[2] == 0xBF) {
+      t->carryLen = 0;
+      bytes += 3 - fromCarry;
+      len -= 3 - fromCarry;
+    }
+
+    t->bomChecked = true;
+  }
+
+  size_t offset = 0;
+  size_t pendingLen = t->carryLen;
+
+  if(pendingLen) {
+    if(pendingLen + len < t->carryRetryLen)
+      return appendToCarry(t, bytes, len);
+
+    // Borrow just enough of the chunk to finish the tokens that start in the
+    // carry, doubling the borrowed amount each time that is not enough.
+    size_t borrowed = 0;
+    size_t want = pendingLen > TOK_STREAM_MIN_CARRY ? pendingLen : TOK_STREAM_MIN_CARRY;
+    size_t currOffset = 0;
+
+    while(true) {
+      if(want > len)
+        want = len;
+
+      if(!appendToCarry(t, bytes + borrowed, want - borrowed))
+        return false;
+
+      borrowed = want;
+      t->start = t->carry;
+      t->curr = t->carry + currOffset;
+      t->end = t->carry + t->carryLen;
+      t->posPtr = t->curr;
+
+      drainTokens(t, t->carry + pendingLen);
+      currOffset = t->curr - t->carry;
+
+      if(t->curr >= t->carry + pendingLen) {
+        // The next token starts inside the chunk itself
+        offset = t->curr - (t->carry + pendingLen);
+        break;
+      }
+
+      if(borrowed == len)
+        return carryRemainder(t, true);
+
+      want *= 2;
+    }
+  }
+
+  // The chunk follows the carry's first pendingLen bytes in the stream
+  t->streamOffset += pendingLen;
+  t->carryLen = 0;
+  t->start = bytes;
+  t->curr = bytes + offset;
+  t->end = bytes + len;
+  t->posPtr = t->curr;
+
+  drainTokens(t, t->end);
+
+  return carryRemainder(t, false);
+}
+
+/**
+ * @brief Signals the end of input to a streaming tokenizer.
+ *
+ * Every remaining token is emitted, followed by a TOKEN_EOF token. No
+ * further input can be fed afterwards.
+ *
+ * @param t A tokenizer created with tokCreateStream().
+ *
+ * @return true on success, false on invalid arguments.
+ */
+bool tokFinish(Tokenizer *t) {
+  if(!t || !t->streaming || t->finished)
+    return false;
+
+  t->finished = true;
+  t->start = t->carry;
+  t->curr = t->carry;
+  t->end = t->carry + t->carryLen;
+  t->posPtr = t->curr;
+
+  if(!drainTokens(t, t->end)) {
+    Token eof = tokNext(t);
+    t->onToken(&eof, t->userData);
+  }
+
+  t->carryLen = 0;
+
+  return true;
+}
@@ -1,8 +1,5 @@
 #include "decoder.h"
-
-#define MAX_CSS_INPUT_LEN (1 << 20)        // 1MB max input
-#define MAX_DECODED_OUTPUT_CAP (1 << 19)   // 512k decoded code points
-#define MAX_CHARSET_LEN 32                 // Max declared charset length
+#include "scan.h"
 
 /**
  * Tries to extract the declared character set from the given CSS data.
@@ -169,6 +166,49 @@ int isValidUtf8Cont(uint8_t b) {
   return (b & 0xC0) == 0x80;
 }
 
+/**
+ * Decodes the single UTF-8 sequence starting at `in`.
+ *
+ * This is the lazy counterpart of decodeUtf8: the tokenizer walks raw bytes
+ * and only calls this where it actually needs a code point value. Invalid,
+ * overlong, surrogate and truncated sequences decode to the replacement
+ * character and consume exactly one byte, matching decodeUtf8.
+ *
+ * @param in The first byte of the sequence.
+ * @param len The number of bytes available at `in` (must be non-zero).
+ * @param codePoint Receives the decoded code point.
+ * @return The number of bytes the sequence occupies (1 to 4).
+ */
+size_t utf8DecodeAt(const uint8_t *in, size_t len, uint32_t *codePoint) {
+  uint8_t b = in[0];
+
+  if(b < 0x80) {
+    *codePoint = b;
+    return 1;
+  }
+
+  if((b & 0xE0) == 0xC0 && len > 1 && isValidUtf8Cont(in[1])) {
+    uint32_t cp = ((b & 0x1F) << 6) | (in[1] & 0x3F);
+    *codePoint = cp < 0x80 ? REPLACEMENT_CHAR : cp;
+    return 2;
+  }
+
+  if((b & 0xF0) == 0xE0 && len > 2 && isValidUtf8Cont(in[1]) && isValidUtf8Cont(in[2])) {
+    uint32_t cp = ((b & 0x0F) << 12) | ((in[1] & 0x3F) << 6) | (in[2] & 0x3F);
+    *codePoint = (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF)) ? REPLACEMENT_CHAR : cp;
+    return 3;
+  }
+
+  if((b & 0xF8) == 0xF0 && len > 3 && isValidUtf8Cont(in[1]) && isValidUtf8Cont(in[2]) && isValidUtf8Cont(in[3])) {
+    uint32_t cp = ((b & 0x07) << 18) | ((in[1] & 0x3F) << 12) | ((in[2] & 0x3F) << 6) | (in[3] & 0x3F);
+    *codePoint = cp <= 0x10FFFF ? cp : REPLACEMENT_CHAR;
+    return 4;
+  }
+
+  *codePoint = REPLACEMENT_CHAR;
+  return 1;
+}
+
 /**
  * Decodes a UTF-8 encoded byte sequence into an array of code points.
  *
@@ -178,6 +218,10 @@ int isValidUtf8Cont(uint8_t b) {
  * their original byte position. If the input contains invalid UTF-8
  * sequences, they are replaced with a replacement character.
  *
+ * Runs of ASCII are found 16-32 bytes at a time (see scanAscii) and
+ * copied out without decoding; only the other sequences go through
+ * utf8DecodeAt. The result is identical to decodeUtf8Scalar.
+ *
  * @param in The input byte sequence to decode.
  * @param len The length of the input byte sequence.
  * @param out The output array where decoded code points will be stored.
@@ -189,46 +233,59 @@ size_t decodeUtf8(const uint8_t *in, size_t len, DecodedStream *out, size_t cap)
   if (!in || !out || cap == 0 || len == 0)
     return 0;
 
+  const char *bytes = (const char *) in;
   size_t i = 0, o = 0;
-  const uint8_t *end = in + len;
 
   while(i < len && o < cap) {
-    // if enough bytes remaining
-    if(in + i >= end)
-      break;
+    size_t run = (size_t) (scanAscii(bytes + i, bytes + len) - (bytes + i));
+    if(run > cap - o)
+      run = cap - o;
 
-    uint8_t b = in[i];
+    for(size_t k = 0; k < run; k++) {
+      out[o + k].codePoint = in[i + k];
+      out[o + k].bytePtr = bytes + i + k;
+    }
 
-    out[o].bytePtr = (const char *) (in + i); 
+    i += run;
+    o += run;
 
-    if(b < 0x80) {
-      out[o++].codePoint = b;
-      i++;
-    }
-    else if((b & 0xE0) == 0xC0 && i+1 < len && isValidUtf8Cont(in[i+1])) {
-      uint32_t cp = ((b & 0x1F) << 6) | (in[i+1] & 0x3F);
-      out[o++].codePoint = cp < 0x80 ? REPLACEMENT_CHAR : cp;
-      i += 2;
-    }
-    else if((b & 0xF0) == 0xE0 && i+2 < len && isValidUtf8Cont(in[i+1]) && isValidUtf8Cont(in[i+2])) {
-      uint32_t cp = ((b & 0x0F) << 12) | ((in[i+1] & 0x3F) << 6) | (in[i+2] & 0x3F);
-      out[o++].codePoint = (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF)) ? REPLACEMENT_CHAR : cp;
-      i += 3;
-    }
-    else if((b & 0xF8) == 0xF0 && i+3 < len && isValidUtf8Cont(in[i+1]) && isValidUtf8Cont(in[i+2]) && isValidUtf8Cont(in[i+3])) {
-      uint32_t cp = ((b & 0x07) << 18) | ((in[i+1] & 0x3F) << 12) | ((in[i+2] & 0x3F) << 6) | (in[i+3] & 0x3F);
-      out[o++].codePoint = cp <= 0x10FFFF ? cp : REPLACEMENT_CHAR;
-      i += 4;
-    }
-    else {
-      out[o++].codePoint = REPLACEMENT_CHAR;
-      i++;
+    if(i < len && o < cap) {
+      out[o].bytePtr = bytes + i;
+      i += utf8DecodeAt(in + i, len - i, &out[o].codePoint);
+      o++;
     }
   }
 
   return o;
 }
 
+/**
+ * Reference implementation of decodeUtf8, one sequence at a time.
+ *
+ * Kept to test the fast path against.
+ *
+ * @param in The input byte sequence to decode.
+ * @param len The length of the input byte sequence.
+ * @param out The output array where decoded code points will be stored.
+ * @param cap The maximum capacity of the output array.
+ * @return The number of code points successfully decoded and stored in the
+ *         output array.
+ */
+size_t decodeUtf8Scalar(const uint8_t *in, size_t len, DecodedStream *out, size_t cap) {
+  if (!in || !out || cap == 0 || len == 0)
+    return 0;
+
+  size_t i = 0, o = 0;
+
+  while(i < len && o < cap) {
+    out[o].bytePtr = (const char *) (in + i);
+    i += utf8DecodeAt(in + i, len - i, &out[o].codePoint);
+    o++;
+  }
+
+  return o;
+}
+
 /**
  * Decodes a UTF-16 encoded byte sequence into an array of code points.
  *
@@ -281,6 +338,119 @@ size_t decodeUtf16(const uint8_t *in, size_t len, DecodedStream *out, size_t cap
   return o;
 }
 
+/**
+ * Encodes a code point as UTF-8.
+ *
+ * @param cp The code point (at most 0x10FFFF).
+ * @param out The output buffer, with room for at least 4 bytes.
+ * @return The number of bytes written (1 to 4).
+ */
+size_t utf8Encode(uint32_t cp, uint8_t *out) {
+  if(cp < 0x80) {
+    out[0] = (uint8_t) cp;
+    return 1;
+  }
+
+  if(cp < 0x800) {
+    out[0] = (uint8_t) (0xC0 | (cp >> 6));
+    out[1] = (uint8_t) (0x80 | (cp & 0x3F));
+    return 2;
+  }
+
+  if(cp < 0x10000) {
+    out[0] = (uint8_t) (0xE0 | (cp >> 12));
+    out[1] = (uint8_t) (0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (uint8_t) (0x80 | (cp & 0x3F));
+    return 3;
+  }
+
+  out[0] = (uint8_t) (0xF0 | (cp >> 18));
+  out[1] = (uint8_t) (0x80 | ((cp >> 12) & 0x3F));
+  out[2] = (uint8_t) (0x80 | ((cp >> 6) & 0x3F));
+  out[3] = (uint8_t) (0x80 | (cp & 0x3F));
+  return 4;
+}
+
+/**
+ * Transcodes a UTF-16 byte sequence into UTF-8.
+ *
+ * Used when a UTF-16 BOM is detected so the tokenizer can keep walking
+ * UTF-8 bytes. Unpaired surrogates become the replacement character. A
+ * buffer of `(len / 2) * 3` bytes is always large enough.
+ *
+ * @param in The UTF-16 input (without BOM).
+ * @param len The length of the input in bytes.
+ * @param out The output buffer.
+ * @param cap The capacity of the output buffer in bytes.
+ * @param le If true, the input is little-endian, otherwise big-endian.
+ * @return The number of UTF-8 bytes written.
+ */
+size_t transcodeUtf16ToUtf8(const uint8_t *in, size_t len, uint8_t *out, size_t cap, int le) {
+  if(!in || !out || cap == 0 || len < 2)
+    return 0;
+
+  size_t i = 0, o = 0;
+
+  while(i + 1 < len) {
+    uint32_t cp = le ? (in[i] | (in[i+1] << 8)) : ((in[i] << 8) | in[i+1]);
+    i += 2;
+
+    if(cp >= 0xD800 && cp <= 0xDBFF && i + 1 < len) {
+      uint16_t w2 = le ? (in[i] | (in[i+1] << 8)) : ((in[i] << 8) | in[i+1]);
+
+      if(w2 >= 0xDC00 && w2 <= 0xDFFF) {
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (w2 - 0xDC00);
+        i += 2;
+      }
+      else
+        cp = REPLACEMENT_CHAR;
+    }
+    else if(cp >= 0xD800 && cp <= 0xDFFF) {
+      cp = REPLACEMENT_CHAR;
+    }
+
+    size_t need = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+    if(o + need > cap)
+      break;
+
+    o += utf8Encode(cp, out + o);
+  }
+
+  return o;
+}
+
+/**
+ * Rejects inputs that are very unlikely to be CSS.
+ *
+ * Only the first 1KB is inspected: more than 800 NUL bytes, or two
+ * consecutive 0xFF/0xFE bytes, mark the input as suspicious. A UTF-16 BOM
+ * at the start is such a pair, and is allowed.
+ *
+ * @param raw The input byte sequence.
+ * @param len The length of the input byte sequence.
+ * @return Non-zero if the input should be rejected, zero otherwise.
+ */
+int isSuspiciousCssInput(const uint8_t *raw, size_t len) {
+  size_t suspiciousNulls = 0;
+  size_t checkLen = len < 1024 ? len : 1024;
+  size_t bomLen = len >= 2 && ((raw[0] == 0xFF && raw[1] == 0xFE) || (raw[0] == 0xFE && raw[1] == 0xFF)) ? 2 : 0;
+
+  for(size_t i = bomLen; i < checkLen; ++i) {
+    if(raw[i] == 0x00) {
+      if(++suspiciousNulls > 800) {
+        return 1;
+      }
+    }
+    else if(raw[i] == 0xFF || raw[i] == 0xFE) {
+      if(i > bomLen && (raw[i-1] == 0xFF || raw[i-1] == 0xFE)) {
+        return 1;  // Reject sequences of 0xFF/0xFE
+      }
+    }
+  }
+
+  return 0;
+}
+
 /**
  * Decodes a CSS input byte sequence into an array of code points.
  *
@@ -292,9 +462,10 @@ size_t decodeUtf16(const uint8_t *in, size_t len, DecodedStream *out, size_t cap
  * replacement character.
  *
  * The function performs several checks on the input to prevent it from
- * being used for malicious purposes. These checks include bounds checking,
- * rejecting suspicious patterns, and detecting encoding via BOM or
- * @charset.
+ * being used for malicious purposes. These checks include rejecting
+ * suspicious patterns and detecting encoding via BOM or @charset. The
+ * output is bounded by `cap` only; callers decoding very large inputs
+ * should use the streaming tokenizer instead.
  *
  * @param raw The input byte sequence to decode.
  * @param len The length of the input byte sequence.
@@ -307,29 +478,9 @@ size_t decodeCssInput(const uint8_t *raw, size_t len, DecodedStream *out, size_t
   if(!raw || !out || cap == 0 || len == 0)
     return 0;
 
-  // Strict bounds checking
-  if(len > MAX_CSS_INPUT_LEN)
-    len = MAX_CSS_INPUT_LEN;
-  if(cap > MAX_DECODED_OUTPUT_CAP)
-    cap = MAX_DECODED_OUTPUT_CAP;
-  if(cap == 0)
-    return 0;
-
   // Early rejection of suspicious patterns
-  size_t suspiciousNulls = 0;
-  size_t checkLen = len < 1024 ? len : 1024;
-  for(size_t i = 0; i < checkLen; ++i) {
-    if(raw[i] == 0x00) {
-      if(++suspiciousNulls > 800) {
-        return 0;
-      }
-    }
-    else if(raw[i] == 0xFF || raw[i] == 0xFE) {
-      if(i > 0 && (raw[i-1] == 0xFF || raw[i-1] == 0xFE)) {
-        return 0;  // Reject sequences of 0xFF/0xFE
-      }
-    }
-  }
+  if(isSuspiciousCssInput(raw, len))
+    return 0;
 
   // Detect encoding via BOM or @charset
   char declaredCharset[MAX_CHARSET_LEN] = {0};
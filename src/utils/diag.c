@@ -1,19 +1,166 @@
 #include <stdio.h>
 #include "comot-css/diag.h"
+#include "tokenizer_impl.h"
+
+#define DIAG_CONTEXT_LEN 20   // input bytes shown after a formatted diagnostic
+
+// Message and severity of each diagnostic code
+static const struct {
+  const char *message;
+  TokDiagSeverity severity;
+} diagInfo[TOK_DIAG_CODE_COUNT] = {
+  [TOK_DIAG_EOF_IN_COMMENT]    = { "Unexpected end of file in comment", TOK_DIAG_ERROR },
+  [TOK_DIAG_EOF_IN_STRING]     = { "Unexpected end of file in string", TOK_DIAG_WARNING },
+  [TOK_DIAG_NEWLINE_IN_STRING] = { "Unclosed string literal", TOK_DIAG_ERROR },
+  [TOK_DIAG_EOF_IN_URL]        = { "Unexpected end of file in url", TOK_DIAG_WARNING },
+  [TOK_DIAG_BAD_URL_CHAR]      = { "Unexpected character in url", TOK_DIAG_ERROR },
+  [TOK_DIAG_BAD_URL_ESCAPE]    = { "Invalid escape sequence in url", TOK_DIAG_ERROR },
+  [TOK_DIAG_EOF_IN_ESCAPE]     = { "Unexpected end of file in escape", TOK_DIAG_WARNING },
+  [TOK_DIAG_INVALID_ESCAPE]    = { "Invalid escape sequence", TOK_DIAG_WARNING },
+  [TOK_DIAG_EOF_IN_BLOCK]      = { "Unexpected end of file in block", TOK_DIAG_WARNING },
+  [TOK_DIAG_INVALID_DECLARATION] = { "Invalid declaration", TOK_DIAG_ERROR },
+  [TOK_DIAG_RULE_WITHOUT_BLOCK] = { "Rule without a block", TOK_DIAG_ERROR },
+  [TOK_DIAG_INVALID_SELECTOR] = { "Invalid selector", TOK_DIAG_ERROR },
+};
+
+/**
+ * @brief Reports a diagnostic for the input at `at`.
+ *
+ * Nothing is formatted, printed or allocated: a small record is written to
+ * the caller's buffer and/or handed to the callback, if there are any.
+ * Once `maxErrors` diagnostics were reported, they are only counted.
+ *
+ * @param t The tokenizer.
+ * @param code What went wrong.
+ * @param at The input position the diagnostic refers to.
+ */
+void reportDiagnostic(Tokenizer *t, TokDiagCode code, const char *at) {
+  t->errorCount++;
+
+  if(t->diagMuted || t->errorCount > t->maxErrors)
+    return;
+
+  TokDiagnostic diag;
+  diag.code = code;
+  diag.severity = diagInfo[code].severity;
+  diag.offset = t->streamOffset + (size_t) (at - t->start);
+
+  if(t->diagBuf && t->diagHead - t->diagTail < t->diagCap)
+    t->diagBuf[t->diagHead++ % t->diagCap] = diag;
+
+  if(t->onDiag)
+    t->onDiag(&diag, t->diagUserData);
+}
+
+/**
+ * @brief Sets the buffer diagnostic records are queued in.
+ *
+ * Any records still queued in a previous buffer are discarded.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param records The buffer, owned by the caller, or NULL to stop queueing.
+ * @param capacity The number of records `records` holds.
+ */
+void tokSetDiagnosticBuffer(Tokenizer *t, TokDiagnostic *records, size_t capacity) {
+  if(!t)
+    return;
+
+  t->diagBuf = capacity ? records : NULL;
+  t->diagCap = records ? capacity : 0;
+  t->diagHead = 0;
+  t->diagTail = 0;
+}
+
+/**
+ * @brief Takes queued diagnostic records, oldest first.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param out The array to fill.
+ * @param max The capacity of `out`.
+ * @return The number of records written.
+ */
+size_t tokReadDiagnostics(Tokenizer *t, TokDiagnostic *out, size_t max) {
+  if(!t || !out || !t->diagBuf)
+    return 0;
+
+  size_t n = 0;
+  for(; n < max && t->diagTail < t->diagHead; n++, t->diagTail++)
+    out[n] = t->diagBuf[t->diagTail % t->diagCap];
+
+  return n;
+}
+
+/**
+ * @brief Hands every diagnostic to a callback as it is reported.
+ *
+ * @param t Pointer to the Tokenizer instance.
+ * @param onDiag The callback, or NULL to stop calling back.
+ * @param userData Opaque pointer passed back to `onDiag`.
+ */
+void tokSetDiagnosticCallback(Tokenizer *t, TokDiagCallback onDiag, void *userData) {
+  if(!t)
+    return;
+
+  t->onDiag = onDiag;
+  t->diagUserData = userData;
+}
 
 /**
- * @brief Logs a diagnostic message to stderr with details about the parse error.
+ * @brief Returns the number of diagnostics reported so far.
  *
- * This function prints an error message specifying the line and column where 
- * the error occurred, along with the provided diagnostic message and a snippet 
- * of the context in which the error occurred.
+ * @param t Pointer to the Tokenizer instance.
+ * @return The count, including records that were dropped.
+ */
+size_t tokDiagnosticCount(const Tokenizer *t) {
+  return t ? t->errorCount : 0;
+}
+
+/**
+ * @brief Returns the description of a diagnostic code.
  *
- * @param message A human-readable diagnostic message describing the error.
- * @param ctx A snippet of the source code context where the error occurred.
- * @param line The line number in the source code where the error was detected.
- * @param column The column number in the source code where the error was detected.
+ * @param code The code.
+ * @return A static string, "Unknown diagnostic" for invalid codes.
  */
-void logDiagnostic(const char* message, const char *ctx, size_t line, size_t column) {
-  fprintf(stderr, "PARSE ERR at %ld:%ld: %s\nContext: %.20s...\n", line, column, message, ctx);
+const char *tokDiagnosticMessage(TokDiagCode code) {
+  if((unsigned) code >= TOK_DIAG_CODE_COUNT)
+    return "Unknown diagnostic";
+
+  return diagInfo[code].message;
 }
 
+/**
+ * @brief Formats a diagnostic record as text.
+ *
+ * Produces "PARSE ERR at line:column: message", followed by a line with up
+ * to DIAG_CONTEXT_LEN bytes of the input at the diagnostic (never reading
+ * past the end of input). Streaming tokenizers no longer hold the input,
+ * so only the stream offset is shown for them.
+ *
+ * @param t The tokenizer the diagnostic came from.
+ * @param diag The record.
+ * @param buf The output buffer (may be NULL if `cap` is 0).
+ * @param cap The capacity of `buf`.
+ * @return The length of the full text, as snprintf() does, or -1 on
+ *         invalid arguments.
+ */
+int tokFormatDiagnostic(Tokenizer *t, const TokDiagnostic *diag, char *buf, size_t cap) {
+  if(!t || !diag || (!buf && cap))
+    return -1;
+
+  const char *message = tokDiagnosticMessage(diag->code);
+  size_t line, column;
+
+  if(t->streaming || !tokResolvePosition(t, diag->offset, &line, &column))
+    return snprintf(buf, cap, "PARSE ERR at offset %zu: %s", diag->offset, message);
+
+  const char *at = t->start + diag->offset;
+  size_t left = (size_t) (t->end - at);
+
+  if(left == 0)
+    return snprintf(buf, cap, "PARSE ERR at %zu:%zu: %s", line, column, message);
+
+  int contextLen = (int) (left < DIAG_CONTEXT_LEN ? left : DIAG_CONTEXT_LEN);
+
+  return snprintf(buf, cap, "PARSE ERR at %zu:%zu: %s\nContext: %.*s%s", line, column, message,
+                  contextLen, at, left > DIAG_CONTEXT_LEN ? "..." : "");
+}
@@ -0,0 +1,206 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "number.h"
+
+#define MAX_FAST_DIGITS 19            // always fit in a uint64_t
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+#define MAX_EXPONENT 100000000        // larger exponents only saturate
+#define MAX_SLOW_DIGITS 768           // enough to round any double correctly
+
+// Powers of ten that are exact in a double
+static const double exactPow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * @brief Checks if a byte is an ASCII digit.
+ *
+ * @param p Pointer to the byte.
+ * @param end One past the last input byte.
+ * @return true if `p` is before `end` and points at '0'..'9'.
+ */
+static inline bool digitAt(const char *p, const char *end) {
+  return p < end && (unsigned char) (*p - '0') < 10;
+}
+
+/**
+ * @brief Converts a number that the fast path cannot round exactly.
+ *
+ * Rewrites the number as "<digits>e<exponent>", keeping the first
+ * MAX_SLOW_DIGITS significant digits plus a sticky '1' when non-zero
+ * digits were dropped, and converts that with strtod(). The rewritten
+ * form has no decimal point, so the result does not depend on the locale.
+ *
+ * @param p The first byte of the number.
+ * @param end One past the last byte of the number.
+ * @param exponent The value of the exponent part, 0 if there is none.
+ * @return The correctly rounded value.
+ */
+static double slowNumberValue(const char *p, const char *end, int64_t exponent) {
+  char buf[1 + MAX_SLOW_DIGITS + 1 + 2 + 24];
+  size_t n = 0;
+  bool sticky = false;
+  int64_t scale = exponent;
+
+  if(*p == '+' || *p == '-') {
+    if(*p == '-')
+      buf[n++] = '-';
+    p++;
+  }
+
+  size_t kept = 0;
+  bool fraction = false;
+  for(; p < end && *p != 'e' && *p != 'E'; p++) {
+    if(*p == '.') {
+      fraction = true;
+      continue;
+    }
+
+    if(fraction)
+      scale--;
+
+    if(kept == 0 && *p == '0')
+      continue;
+
+    if(kept < MAX_SLOW_DIGITS) {
+      buf[n++] = *p;
+      kept++;
+    }
+    else {
+      scale++;
+      sticky |= *p != '0';
+    }
+  }
+
+  if(kept == 0)
+    buf[n++] = '0';
+
+  if(sticky) {
+    buf[n++] = '1';
+    scale--;
+  }
+
+  snprintf(buf + n, sizeof(buf) - n, "e%lld", (long long) scale);
+
+  return strtod(buf, NULL);
+}
+
+/**
+ * @brief Scans a CSS number and computes its value.
+ *
+ * Follows "consume a number" from CSS Syntax: an optional sign, digits, an
+ * optional '.' followed by digits and an optional exponent. Up to 19
+ * significant digits are accumulated into an integer while scanning; when
+ * that integer and the power of ten are both exact in a double, a single
+ * multiply or divide gives the correctly rounded result (Clinger's fast
+ * path). Everything else goes through strtod().
+ *
+ * @param p The first byte of the number.
+ * @param end One past the last input byte.
+ * @param out Receives the value, type and length (as unitOffset).
+ * @return One past the last byte of the number.
+ */
+const char *parseNumber(const char *p, const char *end, TokenNumeric *out) {
+  const char *start = p;
+  bool negative = false;
+  uint64_t mantissa = 0;
+  int digits = 0;               // significant digits in mantissa
+  int64_t scale = 0;            // mantissa * 10^scale is the number
+  bool truncated = false;       // non-zero digits were left out of mantissa
+  bool isInteger = true;
+  int64_t exponent = 0;
+
+  if(p < end && (*p == '+' || *p == '-')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  for(; digitAt(p, end); p++) {
+    if(digits < MAX_FAST_DIGITS) {
+      mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+      digits += mantissa != 0;
+    }
+    else {
+      scale++;
+      truncated |= *p != '0';
+    }
+  }
+
+  if(p < end && *p == '.' && digitAt(p + 1, end)) {
+    isInteger = false;
+
+    for(p++; digitAt(p, end); p++) {
+      if(digits < MAX_FAST_DIGITS) {
+        mantissa = mantissa * 10 + (uint64_t) (*p - '0');
+        digits += mantissa != 0;
+        scale--;
+      }
+      else {
+        truncated |= *p != '0';
+      }
+    }
+  }
+
+  if(p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool expNegative = false;
+
+    if(q < end && (*q == '+' || *q == '-')) {
+      expNegative = *q == '-';
+      q++;
+    }
+
+    if(digitAt(q, end)) {
+      isInteger = false;
+
+      for(; digitAt(q, end); q++) {
+        if(exponent < MAX_EXPONENT)
+          exponent = exponent * 10 + (*q - '0');
+      }
+
+      if(expNegative)
+        exponent = -exponent;
+
+      p = q;
+    }
+  }
+
+  int64_t e = scale + exponent;
+  double value;
+
+  if(mantissa == 0 && !truncated) {
+    value = 0.0;    // -0 keeps its sign below
+  }
+  else if(!truncated && mantissa <= MAX_EXACT_MANTISSA && e >= -22 && e <= 22) {
+    value = e < 0 ? (double) mantissa / exactPow10[-e] : (double) mantissa * exactPow10[e];
+  }
+  else if(!truncated && e > 22 && e <= 22 + 15 &&
+          mantissa <= MAX_EXACT_MANTISSA / (uint64_t) exactPow10[e - 22]) {
+    // Move the excess power into the mantissa while it stays exact
+    value = (double) (mantissa * (uint64_t) exactPow10[e - 22]) * exactPow10[22];
+  }
+  else {
+    value = slowNumberValue(start, p, exponent);
+  }
+
+  // The slow path already parsed the sign along with the digits
+  out->value = negative && !signbit(value) ? -value : value;
+  out->type = isInteger ? TOKEN_NUMERIC_INTEGER : TOKEN_NUMERIC_NUMBER;
+  out->unitOffset = (uint32_t) (p - start);
+  out->integer = 0;
+
+  if(isInteger) {
+    if(!truncated && scale == 0 && mantissa <= (uint64_t) INT64_MAX)
+      out->integer = negative ? -(int64_t) mantissa : (int64_t) mantissa;
+    else if(!truncated && scale == 0 && negative && mantissa == (uint64_t) INT64_MAX + 1)
+      out->integer = INT64_MIN;
+    else
+      out->integer = negative ? INT64_MIN : INT64_MAX;
+  }
+
+  return p;
+}
@@ -0,0 +1,306 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define SCAN_SSE2 1
+#define SCAN_AVX2 1   // compiled with a target attribute, used if the CPU has it
+#elif defined(__GNUC__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCAN_NEON 1
+#endif
+
+// What a scanner stops at
+typedef enum {
+  SCAN_NOT_WHITESPACE,
+  SCAN_STAR,
+  SCAN_STRING,
+  SCAN_URL,
+  SCAN_NON_ASCII
+} ScanKind;
+
+/**
+ * @brief Scalar reference for all the scanners.
+ *
+ * @param b The byte to test.
+ * @param kind The scanner.
+ * @param quote The closing quote, for SCAN_STRING.
+ * @return true if the scanner must stop at `b`.
+ */
+static inline bool isStopByte(uint8_t b, ScanKind kind, char quote) {
+  switch(kind) {
+    case SCAN_NOT_WHITESPACE:
+      return !(b == ' ' || b == '\t' || b == '\n' || b == '\r' || b == '\f');
+    case SCAN_STAR:
+      return b == '*';
+    case SCAN_STRING:
+      return b == (uint8_t) quote || b == '\\' || b == '\n';
+    case SCAN_URL:
+      return b <= 0x20 || b == 0x7F || b == '"' || b == '\'' || b == '(' || b == ')' || b == '\\';
+    case SCAN_NON_ASCII:
+      return b >= 0x80;
+  }
+
+  return true;
+}
+
+#if SCAN_SSE2
+/**
+ * @brief 16-byte version of isStopByte(): 0xFF in every lane that stops.
+ */
+static inline __m128i stopBytesSse2(__m128i v, ScanKind kind, char quote) {
+  switch(kind) {
+    case SCAN_NOT_WHITESPACE: {
+      __m128i ws = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')))));
+
+      return _mm_andnot_si128(ws, _mm_set1_epi8(-1));
+    }
+    case SCAN_STAR:
+      return _mm_cmpeq_epi8(v, _mm_set1_epi8('*'));
+    case SCAN_STRING:
+      return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(quote)),
+                          _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+    case SCAN_URL: {
+      __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, _mm_set1_epi8(0x20)), v);   // v <= 0x20
+      __m128i a = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F)), _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+      __m128i b = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(v, _mm_set1_epi8('(')));
+      __m128i c = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(')')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+
+      return _mm_or_si128(_mm_or_si128(ctrl, a), _mm_or_si128(b, c));
+    }
+    case SCAN_NON_ASCII:
+      return v;   // movemask only looks at the high bit
+  }
+
+  return _mm_set1_epi8(-1);
+}
+
+/**
+ * @brief Skips whole 16-byte blocks that contain no stop byte.
+ *
+ * @return The first stop byte, or the start of the final partial block.
+ */
+static inline const char *scanSse2(const char *p, const char *end, ScanKind kind, char quote) {
+  while(end - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    unsigned mask = (unsigned) _mm_movemask_epi8(stopBytesSse2(v, kind, quote));
+
+    if(mask)
+      return p + __builtin_ctz(mask);
+
+    p += 16;
+  }
+
+  return p;
+}
+#endif
+
+#if SCAN_AVX2
+/**
+ * @brief 32-byte version of isStopByte(): 0xFF in every lane that stops.
+ */
+__attribute__((target("avx2")))
+static inline __m256i stopBytesAvx2(__m256i v, ScanKind kind, char quote) {
+  switch(kind) {
+    case SCAN_NOT_WHITESPACE: {
+      __m256i ws = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f')))));
+
+      return _mm256_andnot_si256(ws, _mm256_set1_epi8(-1));
+    }
+    case SCAN_STAR:
+      return _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*'));
+    case SCAN_STRING:
+      return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(quote)),
+                             _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+    case SCAN_URL: {
+      __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, _mm256_set1_epi8(0x20)), v);
+      __m256i a = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7F)), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+      __m256i b = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('(')));
+      __m256i c = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+
+      return _mm256_or_si256(_mm256_or_si256(ctrl, a), _mm256_or_si256(b, c));
+    }
+    case SCAN_NON_ASCII:
+      return v;
+  }
+
+  return _mm256_set1_epi8(-1);
+}
+
+__attribute__((target("avx2")))
+static const char *scanAvx2(const char *p, const char *end, ScanKind kind, char quote) {
+  while(end - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) p);
+    unsigned mask = (unsigned) _mm256_movemask_epi8(stopBytesAvx2(v, kind, quote));
+
+    if(mask)
+      return p + __builtin_ctz(mask);
+
+    p += 32;
+  }
+
+  return p;
+}
+#endif
+
+#if SCAN_NEON
+/**
+ * @brief 16-byte version of isStopByte(): 0xFF in every lane that stops.
+ */
+static inline uint8x16_t stopBytesNeon(uint8x16_t v, ScanKind kind, char quote) {
+  switch(kind) {
+    case SCAN_NOT_WHITESPACE: {
+      uint8x16_t ws = vorrq_u8(
+        vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\t'))),
+        vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vorrq_u8(vceqq_u8(v, vdupq_n_u8('\r')), vceqq_u8(v, vdupq_n_u8('\f')))));
+
+      return vmvnq_u8(ws);
+    }
+    case SCAN_STAR:
+      return vceqq_u8(v, vdupq_n_u8('*'));
+    case SCAN_STRING:
+      return vorrq_u8(vceqq_u8(v, vdupq_n_u8((uint8_t) quote)),
+                      vorrq_u8(vceqq_u8(v, vdupq_n_u8('\\')), vceqq_u8(v, vdupq_n_u8('\n'))));
+    case SCAN_URL: {
+      uint8x16_t ctrl = vcleq_u8(v, vdupq_n_u8(0x20));
+      uint8x16_t a = vorrq_u8(vceqq_u8(v, vdupq_n_u8(0x7F)), vceqq_u8(v, vdupq_n_u8('"')));
+      uint8x16_t b = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\'')), vceqq_u8(v, vdupq_n_u8('(')));
+      uint8x16_t c = vorrq_u8(vceqq_u8(v, vdupq_n_u8(')')), vceqq_u8(v, vdupq_n_u8('\\')));
+
+      return vorrq_u8(vorrq_u8(ctrl, a), vorrq_u8(b, c));
+    }
+    case SCAN_NON_ASCII:
+      return vcgeq_u8(v, vdupq_n_u8(0x80));
+  }
+
+  return vdupq_n_u8(0xFF);
+}
+
+static inline const char *scanNeon(const char *p, const char *end, ScanKind kind, char quote) {
+  while(end - p >= 16) {
+    uint8x16_t v = vld1q_u8((const uint8_t *) p);
+    uint8x16_t stop = stopBytesNeon(v, kind, quote);
+
+    // Narrow to 4 bits per lane so the mask fits a 64-bit scalar
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+
+    if(mask)
+      return p + (__builtin_ctzll(mask) >> 2);
+
+    p += 16;
+  }
+
+  return p;
+}
+#endif
+
+/**
+ * @brief Finds the first stop byte of `kind` in [p, end).
+ *
+ * Uses the widest vector unit available, then finishes the tail (fewer
+ * bytes than a vector) one byte at a time.
+ *
+ * @param p The first byte to scan.
+ * @param end One past the last byte to scan.
+ * @param kind The scanner.
+ * @param quote The closing quote, for SCAN_STRING.
+ * @return The first stop byte, or `end`.
+ */
+static inline const char *scanRun(const char *p, const char *end, ScanKind kind, char quote) {
+#if SCAN_AVX2
+  if(end - p >= 32 && __builtin_cpu_supports("avx2"))
+    p = scanAvx2(p, end, kind, quote);
+#endif
+#if SCAN_SSE2
+  p = scanSse2(p, end, kind, quote);
+#elif SCAN_NEON
+  p = scanNeon(p, end, kind, quote);
+#endif
+
+  while(p < end && !isStopByte((uint8_t) *p, kind, quote))
+    p++;
+
+  return p;
+}
+
+/**
+ * @brief Skips CSS whitespace.
+ *
+ * @param p The first byte to scan.
+ * @param end One past the last byte to scan.
+ * @return The first byte that is not whitespace, or `end`.
+ */
+const char *scanWhitespace(const char *p, const char *end) {
+  // Most whitespace runs are a single space: skip the vector setup
+  if(p < end && isStopByte((uint8_t) *p, SCAN_NOT_WHITESPACE, 0))
+    return p;
+
+  return scanRun(p, end, SCAN_NOT_WHITESPACE, 0);
+}
+
+/**
+ * @brief Finds the end of a comment body.
+ *
+ * @param p The first byte of the comment body.
+ * @param end One past the last byte to scan.
+ * @return The '*' of the first "*\/", or `end` if the comment is unclosed.
+ */
+const char *scanCommentEnd(const char *p, const char *end) {
+  while(p < end) {
+    p = scanRun(p, end, SCAN_STAR, 0);
+
+    if(end - p >= 2 && p[1] == '/')
+      return p;
+
+    if(p < end)
+      p++;
+  }
+
+  return end;
+}
+
+/**
+ * @brief Finds the next byte of a string body that needs handling.
+ *
+ * @param p The first byte to scan.
+ * @param end One past the last byte to scan.
+ * @param quote The closing quote of the string.
+ * @return The first `quote`, '\\' or '\n', or `end`.
+ */
+const char *scanStringBody(const char *p, const char *end, char quote) {
+  return scanRun(p, end, SCAN_STRING, quote);
+}
+
+/**
+ * @brief Skips the plain bytes of a url() body.
+ *
+ * @param p The first byte to scan.
+ * @param end One past the last byte to scan.
+ * @return The first byte that needs handling by consumeUrlToken(), or `end`.
+ */
+const char *scanUrlBody(const char *p, const char *end) {
+  return scanRun(p, end, SCAN_URL, 0);
+}
+
+/**
+ * @brief Skips a run of ASCII bytes.
+ *
+ * @param p The first byte to scan.
+ * @param end One past the last byte to scan.
+ * @return The first byte >= 0x80, or `end`.
+ */
+const char *scanAscii(const char *p, const char *end) {
+  // Non-ASCII text calls this once per code point: skip the vector setup
+  if(p < end && isStopByte((uint8_t) *p, SCAN_NON_ASCII, 0))
+    return p;
+
+  return scanRun(p, end, SCAN_NON_ASCII, 0);
+}
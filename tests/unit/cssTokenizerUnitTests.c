@@ -1,7 +1,30 @@
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "comot-css/tokenizer.h"
+#include "comot-css/diag.h"
+#include "comot-css/documents.h"
+#include "comot-css/incremental.h"
+#include "comot-css/minify.h"
+#include "comot-css/parser.h"
+#include "comot-css/sax.h"
+#include "comot-css/selector.h"
+#include "decoder.h"
+#include "char_class.h"
+
+// Asserts `ok`, which is evaluated once, printing the printf() arguments
+// after it first if it is false
+#define CHECK(ok, ...)          \
+  do {                          \
+    bool checkOk = (ok);        \
+    if(!checkOk) {              \
+      printf(__VA_ARGS__);      \
+      fflush(stdout);           \
+    }                           \
+    assert(checkOk && #ok);     \
+  } while(0)
 
 typedef struct {
   TokenType type;
@@ -144,8 +167,2282 @@ void test_all_tokens() {
   printf("\n🎉 test_all_tokens passed\n");
 }
 
+void test_raw_byte_walk() {
+  // Far smaller than the input: the tokenizer must not allocate per byte
+  Arena arena = arena_create(256);
+
+  const char *css = ".caf\xC3\xA9 { content: \"\xE2\x98\xBA\"; }\n"
+                    ".caf\xC3\xA9 { content: \"\xE2\x98\xBA\"; }\n"
+                    ".caf\xC3\xA9 { content: \"\xE2\x98\xBA\"; }\n";
+
+  Tokenizer *t = tokCreate((const uint8_t *)css, strlen(css), &arena);
+  assert(t);
+
+  Token tok = tokNext(t);
+  assert(tok.type == TOKEN_DELIM);
+  assert(tok.value == css);
+
+  tok = tokNext(t);
+  assert(tok.type == TOKEN_IDENT);
+  assert(tok.value == css + 1);
+  assert(tok.length == 5);  // bytes, not code points
+  assert(tok.column == 2);
+
+  size_t count = 2;
+  do {
+    tok = tokNext(t);
+    assert(tok.value >= css && tok.value + tok.length <= css + strlen(css));
+    count++;
+  } while(tok.type != TOKEN_EOF);
+
+  assert(tok.line == 4);
+  assert(count == 3 * 13 + 1);
+
+  arena_destroy(&arena);
+
+  // UTF-16 with a BOM, either byte order, is transcoded to UTF-8 once
+  const char *utf8 = ".caf\xC3\xA9{a:\"\xF0\x9F\x98\x80\"}";
+  static const uint16_t units[] = { 0xFEFF, '.', 'c', 'a', 'f', 0xE9, '{', 'a', ':', '"', 0xD83D, 0xDE00, '"', '}' };
+  uint8_t le[sizeof(units)], be[sizeof(units)];
+
+  for(size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+    le[2 * i] = (uint8_t) units[i];
+    le[2 * i + 1] = (uint8_t) (units[i] >> 8);
+    be[2 * i] = (uint8_t) (units[i] >> 8);
+    be[2 * i + 1] = (uint8_t) units[i];
+  }
+
+  const uint8_t *utf16[] = { le, be };
+  arena = arena_create(1 << 12);
+
+  for(size_t i = 0; i < 2; i++) {
+    Tokenizer *expected = tokCreate((const uint8_t *)utf8, strlen(utf8), &arena);
+    t = tokCreate(utf16[i], sizeof(units), &arena);
+    assert(t);
+
+    Token want;
+    do {
+      want = tokNext(expected);
+      tok = tokNext(t);
+      assert(tok.type == want.type && tok.length == want.length);
+      assert(memcmp(tok.value, want.value, want.length) == 0);
+    } while(want.type != TOKEN_EOF);
+  }
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_raw_byte_walk passed\n");
+}
+
+typedef struct {
+  Token tokens[256];
+  char text[4096];    // Stream token values only live during the callback
+  size_t textLen;
+  size_t count;
+  size_t total;
+} CollectedTokens;
+
+static void collectToken(const Token *tok, void *userData) {
+  CollectedTokens *c = userData;
+
+  c->total++;
+  if(c->count == sizeof(c->tokens) / sizeof(c->tokens[0]))
+    return;
+
+  Token copy = *tok;
+  memcpy(c->text + c->textLen, tok->value, tok->length);
+  copy.value = c->text + c->textLen;
+  c->textLen += tok->length;
+  c->tokens[c->count++] = copy;
+}
+
+void test_streaming_chunks() {
+  const char *css =
+  "/* license header */ @import url(  a\\)b.css  );\n"
+  ".a-b, #id > .c::after { content: \"x\\\"y\"; margin: -1.5e+3px 10% }\n"
+  "@media (min-width: 768px) { .x { color: rgb(1, 2, 3) } } <!-- -->\n"
+  "\\41 x \"unterminated\n";
+  size_t len = strlen(css);
+
+  Arena arena = arena_create(1 << 16);
+  Tokenizer *t = tokCreate((const uint8_t *)css, len, &arena);
+  assert(t);
+
+  static CollectedTokens expected;
+  expected.count = expected.textLen = expected.total = 0;
+  Token tok;
+  do {
+    tok = tokNext(t);
+    collectToken(&tok, &expected);
+  } while(tok.type != TOKEN_EOF);
+
+  for(size_t chunk = 1; chunk <= len; chunk++) {
+    static CollectedTokens actual;
+    actual.count = actual.textLen = actual.total = 0;
+
+    Arena streamArena = arena_create(1 << 16);
+    Tokenizer *s = tokCreateStream(&streamArena, collectToken, &actual);
+    assert(s);
+
+    for(size_t off = 0; off < len; off += chunk) {
+      size_t n = len - off < chunk ? len - off : chunk;
+      assert(tokFeed(s, (const uint8_t *)css + off, n));
+    }
+    assert(tokFinish(s));
+
+    assert(actual.count == expected.count);
+    for(size_t i = 0; i < expected.count; i++) {
+      assert(actual.tokens[i].type == expected.tokens[i].type);
+      assert(actual.tokens[i].length == expected.tokens[i].length);
+      assert(memcmp(actual.tokens[i].value, expected.tokens[i].value, expected.tokens[i].length) == 0);
+      assert(actual.tokens[i].line == expected.tokens[i].line);
+      assert(actual.tokens[i].column == expected.tokens[i].column);
+    }
+
+    arena_destroy(&streamArena);
+  }
+
+  arena_destroy(&arena);
+
+  // Well past the old 1MB cap
+  const char *rule = ".selector-name { color: red; }\n";
+  size_t ruleLen = strlen(rule);
+  size_t repeat = (3 << 20) / ruleLen;
+
+  static CollectedTokens big;
+  big.count = big.textLen = big.total = 0;
+
+  // Memory is bounded by the largest token, not by the input
+  Arena bigArena = arena_create(64 * 1024);
+  Tokenizer *s = tokCreateStream(&bigArena, collectToken, &big);
+  assert(s);
+
+  for(size_t i = 0; i < repeat; i++) {
+    assert(tokFeed(s, (const uint8_t *)rule, ruleLen));
+    big.count = big.textLen = 0;
+  }
+  assert(tokFinish(s));
+  assert(big.total == repeat * 13 + 1);
+
+  arena_destroy(&bigArena);
+  printf("\n🎉 test_streaming_chunks passed\n");
+}
+
+void test_file_input() {
+  Arena arena = arena_create(64 * 1024);
+
+  const char *css = "@media screen { .a::after { content: \"x\"; margin: -1.5em } }\n";
+  size_t len = strlen(css);
+
+  char path[] = "cssTokenizerUnitTests.tmp.css";
+  FILE *f = fopen(path, "wb");
+  assert(f);
+  assert(fwrite(css, 1, len, f) == len);
+  fclose(f);
+
+  unsigned modes[] = { TOK_FILE_DEFAULT, TOK_FILE_WILLNEED, TOK_FILE_NO_MMAP };
+  for(size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+    Tokenizer *ref = tokCreate((const uint8_t *)css, len, &arena);
+    Tokenizer *t = tokCreateFromFile(path, &arena, modes[m]);
+    assert(ref && t);
+
+    Token want, got;
+    do {
+      want = tokNext(ref);
+      got = tokNext(t);
+      assert(got.type == want.type);
+      assert(got.length == want.length);
+      assert(memcmp(got.value, want.value, want.length) == 0);
+      assert(got.line == want.line && got.column == want.column);
+    } while(want.type != TOKEN_EOF);
+
+    tokClose(t);
+    tokClose(t);
+  }
+
+  assert(tokCreateFromFile("does/not/exist.css", &arena, TOK_FILE_DEFAULT) == NULL);
+
+  remove(path);
+  arena_destroy(&arena);
+  printf("\n🎉 test_file_input passed\n");
+}
+
+void test_batch() {
+  Arena arena = arena_create(64 * 1024);
+
+  const char *css = "a{color:red;margin:0 auto}\n"
+                    "@media (min-width: 10px) { .x #y::before { content: \"\\263A\" } }\n";
+  size_t len = strlen(css);
+
+  uint8_t types[64];
+  uint32_t offsets[64], lengths[64];
+  size_t lines[64], columns[64];
+
+  size_t batchSizes[] = { 1, 3, 64 };
+  for(size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+    Tokenizer *ref = tokCreate((const uint8_t *)css, len, &arena);
+    Tokenizer *t = tokCreate((const uint8_t *)css, len, &arena);
+    assert(ref && t);
+
+    // Positions are optional: leave them out on the first pass
+    TokenBatch batch = { types, offsets, lengths, b ? lines : NULL, b ? columns : NULL };
+
+    bool done = false;
+    while(!done) {
+      size_t n = tokNextBatch(t, &batch, batchSizes[b]);
+      assert(n > 0 && n <= batchSizes[b]);
+
+      for(size_t i = 0; i < n; i++) {
+        Token want = tokNext(ref);
+        assert(types[i] == want.type);
+        assert(css + offsets[i] == want.value);
+        assert(lengths[i] == want.length);
+        if(b) {
+          assert(lines[i] == want.line && columns[i] == want.column);
+        }
+
+        done = want.type == TOKEN_EOF;
+        assert(!done || i == n - 1);
+      }
+    }
+  }
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_batch passed\n");
+}
+
+void test_compact_tokens() {
+  Arena arena = arena_create(64 * 1024);
+
+  const char *css = "a{color:red}\n"
+                    ".caf\xC3\xA9 { content: \"oops\n }\n"
+                    "/* unterminated";
+  size_t len = strlen(css);
+
+  assert(sizeof(CompactToken) == 12);
+
+  Tokenizer *ref = tokCreate((const uint8_t *)css, len, &arena);
+  Tokenizer *t = tokCreate((const uint8_t *)css, len, &arena);
+  assert(ref && t);
+
+  CompactToken tokens[64];
+  size_t n = tokNextCompact(t, tokens, 64);
+  assert(n > 0 && n < 64);
+
+  bool sawError = false;
+  for(size_t i = 0; i < n; i++) {
+    Token want = tokNext(ref);
+    Token got = tokExpandToken(t, tokens[i]);
+
+    assert(got.type == want.type && got.kind == want.kind);
+    assert(got.value == want.value && got.length == want.length);
+    assert(got.line == want.line && got.column == want.column);
+
+    CompactToken back = tokCompactToken(t, &want);
+    assert(memcmp(&back, &tokens[i], sizeof(back)) == 0);
+
+    sawError |= (tokens[i].flags & TOK_COMPACT_ERROR) != 0;
+  }
+
+  assert(tokens[n - 1].type == TOKEN_EOF);
+  assert(sawError);
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_compact_tokens passed\n");
+}
+
+void test_resolve_position() {
+  Arena arena = arena_create(64 * 1024);
+
+  const char *css = "a {\n  color: red;\n}\n\n"
+                    ".caf\xC3\xA9::after { content: \"\xE2\x98\xBA\" }\n"
+                    "/* multi\nline */ b{}";
+  size_t len = strlen(css);
+
+  Tokenizer *t = tokCreate((const uint8_t *)css, len, &arena);
+  assert(t);
+
+  Token tok;
+  do {
+    tok = tokNext(t);
+
+    // Reference: walk the input up to the token
+    size_t line = 1, column = 1;
+    for(const char *p = css; p < tok.value; p++) {
+      if(*p == '\n') {
+        line++;
+        column = 1;
+      }
+      else if(((unsigned char) *p & 0xC0) != 0x80) {
+        column++;
+      }
+    }
+
+    assert(tok.line == line && tok.column == column);
+
+    size_t resolvedLine = 0, resolvedColumn = 0;
+    assert(tokResolvePosition(t, (size_t) (tok.value - css), &resolvedLine, &resolvedColumn));
+    assert(resolvedLine == line && resolvedColumn == column);
+  } while(tok.type != TOKEN_EOF);
+
+  assert(tok.line == 7);
+
+  size_t line, column;
+  assert(!tokResolvePosition(t, len + 1, &line, &column));
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_resolve_position passed\n");
+}
+
+void test_long_runs() {
+  Arena arena = arena_create(64 * 1024);
+  char css[256];
+
+  // Runs of every length around the 16/32-byte scanner blocks, with the
+  // interesting byte landing at every offset within a block
+  for(size_t n = 0; n < 80; n++) {
+    char run[128];
+    for(size_t i = 0; i < n; i++)
+      run[i] = (char) ('a' + i % 26);
+    run[n] = '\0';
+
+    struct {
+      const char *fmt;
+      TokenType type;
+      size_t extra;     // bytes of the first token beyond the run
+    } cases[] = {
+      { "/*%s*/x", TOKEN_COMMENT, 4 },
+      { "/*%s**/x", TOKEN_COMMENT, 5 },
+      { "/*%s* /x*/x", TOKEN_COMMENT, 8 },
+      { "\"%s\"x", TOKEN_STRING, 2 },
+      { "'%s\\'x'x", TOKEN_STRING, 5 },
+      { "url(%s)x", TOKEN_URL, 4 },
+    };
+
+    for(size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+      size_t len = (size_t) snprintf(css, sizeof(css), cases[c].fmt, run);
+
+      Tokenizer *t = tokCreate((const uint8_t *)css, len, &arena);
+      assert(t);
+
+      Token tok = tokNext(t);
+      if(cases[c].type == TOKEN_URL) {
+        assert(tok.type == TOKEN_URL);
+        assert(tok.length == n);
+        tok = tokNext(t);
+        assert(tok.type == TOKEN_RIGHT_PAREN);
+      }
+      else {
+        assert(tok.type == cases[c].type);
+        assert(tok.length == n + cases[c].extra);
+      }
+
+      tok = tokNext(t);
+      assert(tok.type == TOKEN_IDENT && *tok.value == 'x');
+    }
+
+    // Whitespace run, and the same with a newline in it
+    memset(css, ' ', n);
+    css[n] = 'x';
+    Tokenizer *t = tokCreate((const uint8_t *)css, n + 1, &arena);
+    Token tok = tokNext(t);
+    if(n) {
+      assert(tok.type == TOKEN_WHITESPACE && tok.length == n);
+      tok = tokNext(t);
+    }
+    assert(tok.type == TOKEN_IDENT && tok.column == n + 1);
+
+    if(n) {
+      css[n / 2] = '\n';
+      t = tokCreate((const uint8_t *)css, n + 1, &arena);
+      assert(tokNext(t).length == n);
+      tok = tokNext(t);
+      assert(tok.line == 2 && tok.column == n - n / 2);
+    }
+
+    // Unterminated comments, strings and urls run to the end of input
+    const char *open[] = { "/*", "\"", "url(" };
+    for(size_t o = 0; o < 3; o++) {
+      size_t len = (size_t) snprintf(css, sizeof(css), "%s%s", open[o], run);
+      t = tokCreate((const uint8_t *)css, len, &arena);
+      tok = tokNext(t);
+      assert(tok.value + tok.length == css + len);
+      assert(tokNext(t).type == TOKEN_EOF);
+    }
+
+    arena_destroy(&arena);
+    arena = arena_create(64 * 1024);
+  }
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_long_runs passed\n");
+}
+
+void test_utf8_decode_fast_path() {
+  static const uint8_t pieces[][4] = {
+    { 'a' }, { ' ' }, { 0x7F }, { 0xC3, 0xA9 }, { 0xE2, 0x98, 0xBA }, { 0xF0, 0x9F, 0x98, 0x80 },
+    { 0xC0, 0x80 }, { 0xED, 0xA0, 0x80 }, { 0xF4, 0x90, 0x80, 0x80 }, { 0x80 }, { 0xFF }, { 0xE2, 0x98 }
+  };
+  static const size_t pieceLens[] = { 1, 1, 1, 2, 3, 4, 2, 3, 4, 1, 1, 2 };
+
+  uint8_t in[300];
+  DecodedStream fast[300], ref[300];
+  unsigned seed = 1;
+
+  for(size_t iter = 0; iter < 20000; iter++) {
+    // Mostly-ASCII runs broken up by valid, overlong, surrogate, out of
+    // range and truncated sequences
+    size_t len = 0;
+    size_t target = (seed = seed * 1103515245 + 12345) % 280;
+    while(len < target) {
+      seed = seed * 1103515245 + 12345;
+      size_t p = (seed >> 16) % 64;
+      if(p >= 12)
+        p = 0;
+
+      memcpy(in + len, pieces[p], pieceLens[p]);
+      len += pieceLens[p];
+    }
+
+    size_t cap = iter % 3 ? sizeof(fast) / sizeof(fast[0]) : len / 2 + 1;
+    size_t n = decodeUtf8(in, len, fast, cap);
+    assert(n == decodeUtf8Scalar(in, len, ref, cap));
+
+    for(size_t i = 0; i < n; i++) {
+      assert(fast[i].codePoint == ref[i].codePoint);
+      assert(fast[i].bytePtr == ref[i].bytePtr);
+    }
+  }
+
+  printf("\n🎉 test_utf8_decode_fast_path passed\n");
+}
+
+void test_char_classes() {
+  for(int b = 0; b < 256; b++) {
+    char c = (char) b;
+
+    bool whitespace = c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+    bool digit = c >= '0' && c <= '9';
+    bool hex = digit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+    bool identStart = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || b >= 0x80;
+    bool ident = identStart || digit || c == '-';
+    bool nonPrintable = b <= 0x08 || b == 0x0B || (b >= 0x0E && b <= 0x1F) || b == 0x7F;
+
+    assert(hasCharClass(&c, CC_WHITESPACE) == whitespace);
+    assert(hasCharClass(&c, CC_DIGIT) == digit);
+    assert(hasCharClass(&c, CC_HEX) == hex);
+    assert(hasCharClass(&c, CC_IDENT_START) == identStart);
+    assert(hasCharClass(&c, CC_IDENT) == ident);
+    assert(hasCharClass(&c, CC_QUOTE) == (c == '"' || c == '\''));
+    assert(hasCharClass(&c, CC_STRUCTURAL) == (b && strchr("()[]{},:;", c) != NULL));
+    assert(hasCharClass(&c, CC_NON_PRINTABLE) == nonPrintable);
+  }
+
+  printf("\n🎉 test_char_classes passed\n");
+}
+
+void test_no_allocations() {
+  const char *rule = "@media screen{.nav>li:hover a[href^='http'],#id::after{"
+                     "background:URL( img.png ) no-repeat;content:\"\\263A\";"
+                     "transform:translate(-50%, 1.5e3px) rotate(45deg);--x:calc(1px + 2em)}}\n";
+  size_t ruleLen = strlen(rule);
+
+  static char css[1 << 20];
+  size_t len = 0;
+  while(len + ruleLen <= sizeof(css)) {
+    memcpy(css + len, rule, ruleLen);
+    len += ruleLen;
+  }
+
+  // Room for the tokenizer and nothing else
+  Arena arena = arena_create(1024);
+
+  Tokenizer *t = tokCreate((const uint8_t *)css, len, &arena);
+  assert(t);
+
+  size_t count = 0;
+  Token tok;
+  do {
+    tok = tokNext(t);
+    assert(tok.type != TOKEN_ERROR && tok.type != TOKEN_BAD_URL && tok.type != TOKEN_BAD_STRING);
+    count++;
+  } while(tok.type != TOKEN_EOF);
+
+  assert(count > len / ruleLen * 50);
+  assert(tokAllocationCount(t) == 0);
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_no_allocations passed\n");
+}
+
+static Token firstTokenOfType(Tokenizer *t, TokenType type) {
+  Token tok;
+  do {
+    tok = tokNext(t);
+  } while(tok.type != type && tok.type != TOKEN_EOF);
+
+  assert(tok.type == type);
+  return tok;
+}
+
+void test_token_values() {
+  Arena arena = arena_create(64 * 1024);
+
+  struct {
+    const char *css;
+    TokenType type;
+    const char *value;
+    bool zeroCopy;
+  } cases[] = {
+    { "color", TOKEN_IDENT, "color", true },
+    { "a\\62 c", TOKEN_IDENT, "abc", false },
+    { "f\\6fo(x)", TOKEN_FUNCTION, "foo", false },
+    { "@m\\65 dia", TOKEN_AT_KEYWORD, "media", false },
+    { "#x\\31 y", TOKEN_HASH, "x1y", false },
+    { "#fff", TOKEN_HASH, "fff", true },
+    { "'plain'", TOKEN_STRING, "plain", true },
+    { "\"a\\\"b\\\nc\"", TOKEN_STRING, "a\"bc", false },
+    { "\"\\0\"", TOKEN_STRING, "\xEF\xBF\xBD", false },
+    { "\"\\2603 !\"", TOKEN_STRING, "\xE2\x98\x83!", false },
+    { "\"open", TOKEN_STRING, "open", true },
+    { "url(x.png)", TOKEN_URL, "x.png", true },
+    { "url(  x.png  )", TOKEN_URL, "x.png", true },
+    { "url(  a\\)b  )", TOKEN_URL, "a)b", false },
+    { "url(a\\  )", TOKEN_URL, "a ", false },
+    { "12px", TOKEN_DIMENSION, "12px", true },
+  };
+
+  for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const char *css = cases[i].css;
+    Tokenizer *t = tokCreate((const uint8_t *)css, strlen(css), &arena);
+    assert(t);
+
+    Token tok = firstTokenOfType(t, cases[i].type);
+    size_t want = strlen(cases[i].value);
+
+    char buf[32];
+    TokenSpan v = tokValue(&tok, buf, sizeof(buf));
+    assert(v.data && v.length == want && memcmp(v.data, cases[i].value, want) == 0);
+    assert(cases[i].zeroCopy == (v.data != buf));
+    if(cases[i].zeroCopy) {
+      assert(v.data >= css && v.data + v.length <= css + strlen(css));
+    }
+
+    TokenSpan a = tokValueArena(&tok, &arena);
+    assert(a.data && a.length == want && memcmp(a.data, cases[i].value, want) == 0);
+
+    if(!cases[i].zeroCopy) {
+      // Too small a buffer reports the size needed
+      TokenSpan small = tokValue(&tok, buf, want - 1);
+      assert(!small.data && small.length == want);
+    }
+  }
+
+  // An escaped NUL byte is an escape like any other, not the end of input
+  static const char nul[] = "\"a\\\0b\";";
+  Tokenizer *t = tokCreate((const uint8_t *)nul, sizeof(nul) - 1, &arena);
+  Token tok = tokNext(t);
+  assert(tok.type == TOKEN_STRING && tok.kind == TOKEN_KIND_VALID && tok.length == 6);
+  TokenSpan v = tokValueArena(&tok, &arena);
+  assert(v.length == 5 && memcmp(v.data, "a\xEF\xBF\xBD" "b", 5) == 0);
+  assert(tokNext(t).type == TOKEN_SEMICOLON && tokNext(t).type == TOKEN_EOF);
+  assert(tokDiagnosticCount(t) == 0);
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_token_values passed\n");
+}
+
+static TokenNumeric numericOf(const char *css, TokenType type) {
+  Arena arena = arena_create(4096);
+  Tokenizer *t = tokCreate((const uint8_t *)css, strlen(css), &arena);
+  assert(t);
+
+  Token tok = tokNext(t);
+  assert(tok.type == type && tok.length == strlen(css));
+
+  // Expanding a compact token parses the same value again
+  Token expanded = tokExpandToken(t, tokCompactToken(t, &tok));
+  assert(expanded.numeric.type == tok.numeric.type);
+  assert(expanded.numeric.integer == tok.numeric.integer);
+  assert(expanded.numeric.unitOffset == tok.numeric.unitOffset);
+  assert(memcmp(&expanded.numeric.value, &tok.numeric.value, sizeof(double)) == 0);
+
+  arena_destroy(&arena);
+  return tok.numeric;
+}
+
+void test_numeric_values() {
+  TokenNumeric n = numericOf("42", TOKEN_NUMBER);
+  assert(n.type == TOKEN_NUMERIC_INTEGER && n.integer == 42 && n.value == 42.0 && n.unitOffset == 2);
+
+  n = numericOf("-7px", TOKEN_DIMENSION);
+  assert(n.type == TOKEN_NUMERIC_INTEGER && n.integer == -7 && n.value == -7.0 && n.unitOffset == 2);
+
+  n = numericOf("+.5%", TOKEN_PERCENTAGE);
+  assert(n.type == TOKEN_NUMERIC_NUMBER && n.value == 0.5 && n.unitOffset == 3);
+
+  n = numericOf("1.5E-2em", TOKEN_DIMENSION);
+  assert(n.type == TOKEN_NUMERIC_NUMBER && n.value == strtod("1.5E-2", NULL) && n.unitOffset == 6);
+
+  n = numericOf("1e3", TOKEN_NUMBER);
+  assert(n.type == TOKEN_NUMERIC_NUMBER && n.value == 1000.0);
+
+  n = numericOf("1e", TOKEN_DIMENSION);    // "e" is the unit
+  assert(n.type == TOKEN_NUMERIC_INTEGER && n.value == 1.0 && n.unitOffset == 1);
+
+  n = numericOf("-0", TOKEN_NUMBER);
+  assert(n.value == 0.0 && signbit(n.value) && n.integer == 0);
+
+  n = numericOf("9223372036854775807", TOKEN_NUMBER);
+  assert(n.integer == INT64_MAX);
+  n = numericOf("-9223372036854775808", TOKEN_NUMBER);
+  assert(n.integer == INT64_MIN);
+  n = numericOf("9223372036854775808", TOKEN_NUMBER);    // saturates
+  assert(n.integer == INT64_MAX && n.value == 9223372036854775808.0);
+
+  n = numericOf("1e400", TOKEN_NUMBER);
+  assert(isinf(n.value));
+  n = numericOf("-1e-400", TOKEN_NUMBER);
+  assert(n.value == 0.0 && signbit(n.value));
+
+  // Values must match strtod() bit for bit, on both the fast and slow paths
+  const char *exact[] = {
+    "0.1", "3.14159", "9007199254740993", "123456789012345678901234567890e-30",
+    "2.2250738585072011e-308", "4.9e-324", "1.7976931348623157e308", "0.000001e22",
+    "7e37", "4503599627370497.5", "1e23",
+  };
+  for(size_t i = 0; i < sizeof(exact) / sizeof(exact[0]); i++) {
+    double want = strtod(exact[i], NULL);
+    n = numericOf(exact[i], TOKEN_NUMBER);
+    assert(memcmp(&n.value, &want, sizeof(double)) == 0);
+  }
+
+  char buf[1100];
+  uint32_t seed = 12345;
+  for(int i = 0; i < 20000; i++) {
+    size_t len = 0;
+    seed = seed * 1103515245u + 12345u;
+    size_t intDigits = (seed >> 16) % (i % 100 == 0 ? 1000 : 25) + 1;
+    seed = seed * 1103515245u + 12345u;
+    size_t fracDigits = (seed >> 16) % 20;
+
+    for(size_t d = 0; d < intDigits; d++) {
+      seed = seed * 1103515245u + 12345u;
+      buf[len++] = (char) ('0' + (seed >> 16) % 10);
+    }
+    if(fracDigits) {
+      buf[len++] = '.';
+      for(size_t d = 0; d < fracDigits; d++) {
+        seed = seed * 1103515245u + 12345u;
+        buf[len++] = (char) ('0' + (seed >> 16) % 10);
+      }
+    }
+    seed = seed * 1103515245u + 12345u;
+    if((seed >> 16) % 2)
+      len += (size_t) sprintf(buf + len, "e%d", (int) ((seed >> 8) % 700) - 350);
+    buf[len] = '\0';
+
+    double want = strtod(buf, NULL);
+    n = numericOf(buf, TOKEN_NUMBER);
+    assert(memcmp(&n.value, &want, sizeof(double)) == 0);
+  }
+
+  printf("\n🎉 test_numeric_values passed\n");
+}
+
+void test_atoms() {
+  // Every name maps back to its atom, in any ASCII case
+  for(int a = TOK_ATOM_UNKNOWN + 1; a < TOK_ATOM_COUNT; a++) {
+    const char *name = tokAtomName((TokAtom) a);
+    size_t len = strlen(name);
+    char upper[TOK_ATOM_MAX_LEN + 1];
+
+    assert(len > 0 && len <= TOK_ATOM_MAX_LEN);
+    assert(tokAtomLookup(name, len) == (TokAtom) a);
+
+    for(size_t i = 0; i < len; i++)
+      upper[i] = (name[i] >= 'a' && name[i] <= 'z') ? (char) (name[i] - 32) : name[i];
+    assert(tokAtomLookup(upper, len) == (TokAtom) a);
+
+    // Prefixes and extensions of a name are not that name
+    upper[len] = 'z';
+    assert(tokAtomLookup(upper, len + 1) != (TokAtom) a);
+    assert(tokAtomLookup(name, len - 1) != (TokAtom) a);
+  }
+
+  assert(tokAtomLookup("", 0) == TOK_ATOM_UNKNOWN);
+  assert(tokAtomLookup("pxx", 3) == TOK_ATOM_UNKNOWN);
+  assert(tokAtomLookup("p\0", 2) == TOK_ATOM_UNKNOWN);
+  assert(tokAtomLookup("p\xC3\xA9", 3) == TOK_ATOM_UNKNOWN);
+  assert(strcmp(tokAtomName(TOK_ATOM_UNKNOWN), "") == 0);
+
+  struct {
+    const char *css;
+    TokenType type;
+    TokAtom atom;
+  } cases[] = {
+    { "color", TOKEN_IDENT, TOK_ATOM_COLOR },
+    { "Background-Color", TOKEN_IDENT, TOK_ATOM_BACKGROUND_COLOR },
+    { "colour", TOKEN_IDENT, TOK_ATOM_UNKNOWN },
+    { "\\70 x", TOKEN_IDENT, TOK_ATOM_PX },
+    { "rgb(", TOKEN_FUNCTION, TOK_ATOM_RGB },
+    { "CALC(", TOKEN_FUNCTION, TOK_ATOM_CALC },
+    { "url('a')", TOKEN_FUNCTION, TOK_ATOM_URL },
+    { "url(a)", TOKEN_URL, TOK_ATOM_UNKNOWN },
+    { "@media", TOKEN_AT_KEYWORD, TOK_ATOM_MEDIA },
+    { "@-webkit-keyframes", TOKEN_AT_KEYWORD, TOK_ATOM_WEBKIT_KEYFRAMES },
+    { "10PX", TOKEN_DIMENSION, TOK_ATOM_PX },
+    { "1.5e2em", TOKEN_DIMENSION, TOK_ATOM_EM },
+    { "1\\70 x", TOKEN_DIMENSION, TOK_ATOM_PX },
+    { "3furlongs", TOKEN_DIMENSION, TOK_ATOM_UNKNOWN },
+    { "50%", TOKEN_PERCENTAGE, TOK_ATOM_PERCENT },
+    { "12", TOKEN_NUMBER, TOK_ATOM_UNKNOWN },
+    { "#color", TOKEN_HASH, TOK_ATOM_UNKNOWN },
+    { "'px'", TOKEN_STRING, TOK_ATOM_UNKNOWN },
+  };
+
+  for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    Arena arena = arena_create(4096);
+    Tokenizer *t = tokCreate((const uint8_t *)cases[i].css, strlen(cases[i].css), &arena);
+    assert(t);
+
+    Token tok = tokNext(t);
+    assert(tok.type == cases[i].type && tok.atom == cases[i].atom);
+    assert(tokExpandToken(t, tokCompactToken(t, &tok)).atom == cases[i].atom);
+
+    arena_destroy(&arena);
+  }
+
+  printf("\n🎉 test_atoms passed\n");
+}
+
+void test_interning() {
+  Arena arena = arena_create(1024 * 1024);
+  TokInterner *in = tokInternerCreate(&arena, 0);
+  assert(in && tokInternerCount(in) == 0);
+
+  // Names are compared exactly, hashes ignore ASCII case
+  uint32_t foo = tokIntern(in, "foo", 3);
+  assert(foo != TOK_NO_NAME && tokIntern(in, "foo", 3) == foo);
+  assert(tokIntern(in, "Foo", 3) != foo);
+  assert(tokNameHash("Foo", 3) == tokNameHash("foo", 3));
+  assert(tokInternedHash(in, foo) == tokNameHash("foo", 3));
+  assert(tokInternerCount(in) == 2);
+
+  TokenSpan name = tokInternedName(in, foo);
+  assert(name.length == 3 && memcmp(name.data, "foo", 3) == 0);
+  assert(tokInternedName(in, TOK_NO_NAME).data == NULL);
+  assert(tokInternedName(in, 99).data == NULL);
+
+  // Tokens with the same name get the same handle, escaped or not, across
+  // tokenizers sharing the interner
+  const char *css = ".btn .btn-primary #btn{--x:var(--x)} b\\74 n";
+  uint32_t handles[2][8] = {{0}};
+  size_t count = 0;
+
+  for(int pass = 0; pass < 2; pass++) {
+    Tokenizer *t = tokCreate((const uint8_t *)css, strlen(css), &arena);
+    tokSetInterner(t, in);
+    count = 0;
+
+    for(Token tok = tokNext(t); tok.type != TOKEN_EOF; tok = tokNext(t)) {
+      bool named = tok.type == TOKEN_IDENT || tok.type == TOKEN_FUNCTION || tok.type == TOKEN_HASH;
+      assert(named == (tok.nameId != TOK_NO_NAME));
+
+      if(named)
+        handles[pass][count++] = tok.nameId;
+    }
+  }
+
+  assert(count == 7);
+  assert(memcmp(handles[0], handles[1], sizeof(handles[0])) == 0);
+  assert(handles[0][0] == handles[0][2] && handles[0][0] == handles[0][6]);   // btn, #btn, b\74 n
+  assert(handles[0][3] == handles[0][5]);                                     // --x
+  assert(handles[0][0] != handles[0][1]);
+
+  name = tokInternedName(in, handles[0][6]);
+  assert(name.length == 3 && memcmp(name.data, "btn", 3) == 0);
+  assert(name.data < css || name.data >= css + strlen(css));     // a copy
+
+  // Without an interner tokens carry no handle
+  Tokenizer *plain = tokCreate((const uint8_t *)css, strlen(css), &arena);
+  assert(tokNext(plain).nameId == TOK_NO_NAME && tokNext(plain).nameId == TOK_NO_NAME);
+
+  // The tables grow past their initial size
+  char buf[16];
+  for(int i = 0; i < 5000; i++) {
+    int len = snprintf(buf, sizeof(buf), "name-%d", i);
+    uint32_t h = tokIntern(in, buf, (size_t) len);
+    assert(h != TOK_NO_NAME);
+
+    TokenSpan back = tokInternedName(in, h);
+    assert(back.length == (size_t) len && memcmp(back.data, buf, (size_t) len) == 0);
+  }
+  for(int i = 0; i < 5000; i += 7) {
+    int len = snprintf(buf, sizeof(buf), "name-%d", i);
+    TokenSpan back = tokInternedName(in, tokIntern(in, buf, (size_t) len));
+    assert(back.length == (size_t) len && memcmp(back.data, buf, (size_t) len) == 0);
+  }
+  assert(tokIntern(in, "foo", 3) == foo);
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_interning passed\n");
+}
+
+typedef struct {
+  TokDiagnostic diags[16];
+  size_t count;
+  size_t tokens;              // tokens emitted so far (streaming)
+  size_t tokensBefore[16];    // tokens emitted before each diagnostic
+} CollectedDiagnostics;
+
+static void collectDiagnostic(const TokDiagnostic *diag, void *userData) {
+  CollectedDiagnostics *c = userData;
+
+  if(c->count < 16) {
+    c->tokensBefore[c->count] = c->tokens;
+    c->diags[c->count++] = *diag;
+  }
+}
+
+static void countStreamedToken(const Token *tok, void *userData) {
+  (void) tok;
+  ((CollectedDiagnostics *) userData)->tokens++;
+}
+
+void test_diagnostics() {
+  const char *css = "a \\\n b \"x\n y url(a\"b) /* end";
+  size_t len = strlen(css);
+  const TokDiagnostic expected[] = {
+    { TOK_DIAG_INVALID_ESCAPE, TOK_DIAG_WARNING, 2 },
+    { TOK_DIAG_NEWLINE_IN_STRING, TOK_DIAG_ERROR, 7 },
+    { TOK_DIAG_BAD_URL_CHAR, TOK_DIAG_ERROR, 17 },
+    { TOK_DIAG_EOF_IN_COMMENT, TOK_DIAG_ERROR, 22 },
+  };
+  Arena arena = arena_create(1 << 16);
+
+  // Silent by default, but still counted
+  Tokenizer *t = tokCreate((const uint8_t *)css, len, &arena);
+  for(Token tok = tokNext(t); tok.type != TOKEN_EOF; tok = tokNext(t));
+  TokDiagnostic out[8];
+  assert(tokDiagnosticCount(t) == 4 && tokReadDiagnostics(t, out, 8) == 0);
+
+  // Records queue in a caller buffer and are read oldest first
+  TokDiagnostic records[8];
+  t = tokCreate((const uint8_t *)css, len, &arena);
+  tokSetDiagnosticBuffer(t, records, 8);
+  for(Token tok = tokNext(t); tok.type != TOKEN_EOF; tok = tokNext(t));
+
+  assert(tokReadDiagnostics(t, out, 3) == 3 && tokReadDiagnostics(t, out + 3, 8) == 1);
+  assert(tokReadDiagnostics(t, out, 8) == 0);
+  for(size_t i = 0; i < 4; i++) {
+    assert(out[i].code == expected[i].code);
+    assert(out[i].severity == expected[i].severity);
+    assert(out[i].offset == expected[i].offset);
+  }
+
+  // Formatting is on demand and never reads past the input
+  char text[128];
+  int n = tokFormatDiagnostic(t, &out[3], text, sizeof(text));
+  assert(n > 0 && strcmp(text, "PARSE ERR at 3:13: Unexpected end of file in comment\nContext: /* end") == 0);
+  n = tokFormatDiagnostic(t, &out[0], text, 8);
+  assert(n > 8 && strlen(text) == 7);
+  assert(strcmp(tokDiagnosticMessage(TOK_DIAG_EOF_IN_STRING), "Unexpected end of file in string") == 0);
+
+  // A full buffer drops records, the count keeps going
+  t = tokCreate((const uint8_t *)css, len, &arena);
+  tokSetDiagnosticBuffer(t, records, 2);
+  for(Token tok = tokNext(t); tok.type != TOKEN_EOF; tok = tokNext(t));
+  assert(tokDiagnosticCount(t) == 4 && tokReadDiagnostics(t, out, 8) == 2);
+  assert(out[0].code == TOK_DIAG_INVALID_ESCAPE && out[1].code == TOK_DIAG_NEWLINE_IN_STRING);
+
+  // Callbacks get every record, up to the tokenizer's error limit
+  static CollectedDiagnostics seen;
+  seen.count = 0;
+  t = tokCreate((const uint8_t *)"'\n'\n'\n'\n'\n'\n'\n'\n'\n'\n'\n'\n", 24, &arena);
+  tokSetDiagnosticCallback(t, collectDiagnostic, &seen);
+  for(Token tok = tokNext(t); tok.type != TOKEN_EOF; tok = tokNext(t));
+  assert(tokDiagnosticCount(t) == 12 && seen.count == 10);
+  assert(seen.diags[9].code == TOK_DIAG_NEWLINE_IN_STRING && seen.diags[9].offset == 18);
+
+  // Streaming reports each diagnostic once, before its token, with offsets
+  // into the whole stream, however the input is split
+  for(size_t chunk = 1; chunk <= len; chunk++) {
+    seen.count = seen.tokens = 0;
+
+    Arena streamArena = arena_create(1 << 16);
+    Tokenizer *s = tokCreateStream(&streamArena, countStreamedToken, &seen);
+    tokSetDiagnosticCallback(s, collectDiagnostic, &seen);
+
+    for(size_t off = 0; off < len; off += chunk)
+      assert(tokFeed(s, (const uint8_t *)css + off, len - off < chunk ? len - off : chunk));
+    assert(tokFinish(s));
+
+    assert(seen.count == 4 && tokDiagnosticCount(s) == 4);
+    for(size_t i = 0; i < 4; i++) {
+      assert(seen.diags[i].code == expected[i].code);
+      assert(seen.diags[i].offset == expected[i].offset);
+    }
+    assert(seen.tokensBefore[0] == 2 && seen.tokensBefore[1] == 6);
+    assert(seen.tokensBefore[2] == 10 && seen.tokensBefore[3] == 13);
+
+    assert(tokFormatDiagnostic(s, &seen.diags[2], text, sizeof(text)) > 0);
+    assert(strcmp(text, "PARSE ERR at offset 17: Unexpected character in url") == 0);
+
+    arena_destroy(&streamArena);
+  }
+
+  // A NULL tokenizer yields EOF rather than exiting
+  assert(tokNext(NULL).type == TOKEN_EOF);
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_diagnostics passed\n");
+}
+
+void test_options() {
+  const char *css = "a { /* c */ color : red ; }\n/**/ .b{}  /* open";
+  size_t len = strlen(css);
+  Arena arena = arena_create(1 << 16);
+
+  // NULL options are tokCreate's defaults
+  Tokenizer *plain = tokCreate((const uint8_t *)css, len, &arena);
+  Tokenizer *same = tokCreateEx((const uint8_t *)css, len, &arena, NULL);
+  Token a, b;
+  do {
+    a = tokNext(plain);
+    b = tokNext(same);
+    assert(a.type == b.type && a.value == b.value && a.line == b.line && a.column == b.column);
+  } while(a.type != TOKEN_EOF);
+
+  // Skipping trivia gives the other tokens, positions unchanged
+  TokDiagnostic records[4];
+  TokOptions options = {0};
+  options.flags = TOK_OPT_SKIP_WHITESPACE | TOK_OPT_SKIP_COMMENTS;
+  options.diagBuffer = records;
+  options.diagCapacity = 4;
+
+  plain = tokCreate((const uint8_t *)css, len, &arena);
+  Tokenizer *t = tokCreateEx((const uint8_t *)css, len, &arena, &options);
+  size_t kept = 0;
+  do {
+    do {
+      a = tokNext(plain);
+    } while(a.type == TOKEN_WHITESPACE || a.type == TOKEN_COMMENT || a.type == TOKEN_ERROR);
+
+    b = tokNext(t);
+    assert(a.type == b.type && a.value == b.value && a.length == b.length);
+    assert(a.line == b.line && a.column == b.column);
+    kept++;
+  } while(a.type != TOKEN_EOF);
+  assert(kept == 12);
+
+  // The open comment is still reported
+  TokDiagnostic out[4];
+  assert(tokReadDiagnostics(t, out, 4) == 1);
+  assert(out[0].code == TOK_DIAG_EOF_IN_COMMENT && out[0].offset == len - 7);
+
+  // Either kind of trivia alone
+  options.flags = TOK_OPT_SKIP_COMMENTS;
+  t = tokCreateEx((const uint8_t *)"/**/ /**/a", 10, &arena, &options);
+  assert(tokNext(t).type == TOKEN_WHITESPACE && tokNext(t).type == TOKEN_IDENT);
+
+  options.flags = TOK_OPT_SKIP_WHITESPACE;
+  t = tokCreateEx((const uint8_t *)" /**/ a", 7, &arena, &options);
+  assert(tokNext(t).type == TOKEN_COMMENT && tokNext(t).type == TOKEN_IDENT);
+  assert(tokNext(t).type == TOKEN_EOF);
+
+  // No positions: tokens carry none, they can still be resolved
+  options.flags = TOK_OPT_NO_POSITIONS;
+  t = tokCreateEx((const uint8_t *)css, len, &arena, &options);
+  Token tok;
+  do {
+    tok = tokNext(t);
+    assert(tok.line == 0 && tok.column == 0);
+  } while(tok.type != TOKEN_EOF);
+
+  size_t line, column;
+  assert(tokResolvePosition(t, strchr(css, '.') - css, &line, &column) && line == 2 && column == 6);
+
+  // Error limit
+  static CollectedDiagnostics seen;
+  seen.count = 0;
+  options.flags = TOK_OPT_DEFAULT;
+  options.maxErrors = 3;
+  options.diagBuffer = NULL;
+  options.onDiagnostic = collectDiagnostic;
+  options.diagUserData = &seen;
+
+  t = tokCreateEx((const uint8_t *)"'\n'\n'\n'\n'\n", 10, &arena, &options);
+  while(tokNext(t).type != TOKEN_EOF);
+  assert(seen.count == 3 && tokDiagnosticCount(t) == 5);
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_options passed\n");
+}
+
+void test_reset() {
+  const char *inputs[] = {
+    "color: red", "a > b.c", "margin:0 auto !important", "", "--x: calc(1px + 2%)",
+    "\xEF\xBB\xBFwidth: 1px", "url( a.png ) \"s\\\"q\"", "#id::after"
+  };
+  size_t count = sizeof(inputs) / sizeof(inputs[0]);
+  Arena arena = arena_create(1 << 16);
+
+  TokOptions options = {0};
+  options.flags = TOK_OPT_UTF8;
+  Tokenizer *t = tokCreateEx((const uint8_t *)"x", 1, &arena, &options);
+  assert(t);
+
+  // A reset tokenizer tokenizes like a new one, without allocating
+  for(int round = 0; round < 3; round++) {
+    for(size_t i = 0; i < count; i++) {
+      size_t len = strlen(inputs[i]);
+      assert(tokReset(t, (const uint8_t *)inputs[i], len));
+
+      Tokenizer *fresh = len ? tokCreate((const uint8_t *)inputs[i], len, &arena) : NULL;
+      Token a, b;
+      do {
+        a = tokNext(t);
+        b = fresh ? tokNext(fresh) : tokNext(t);
+        assert(a.type == b.type && a.length == b.length && a.line == b.line && a.column == b.column);
+        assert(!fresh || memcmp(a.value, b.value, a.length) == 0);
+      } while(a.type != TOKEN_EOF);
+    }
+  }
+  assert(tokAllocationCount(t) == 0);
+
+  // Options and diagnostics sinks are kept, the diagnostics start over
+  TokDiagnostic records[4], out[4];
+  options.flags = TOK_OPT_UTF8 | TOK_OPT_SKIP_WHITESPACE;
+  options.diagBuffer = records;
+  options.diagCapacity = 4;
+  t = tokCreateEx((const uint8_t *)"'\n", 2, &arena, &options);
+  assert(tokReset(t, (const uint8_t *)"a  '\n", 5));
+  assert(tokNext(t).type == TOKEN_IDENT && tokNext(t).type == TOKEN_BAD_STRING);
+  assert(tokNext(t).type == TOKEN_EOF);
+  assert(tokDiagnosticCount(t) == 1 && tokReadDiagnostics(t, out, 4) == 1 && out[0].offset == 3);
+
+  // The newline index is reused when it is large enough
+  size_t line, column;
+  assert(tokReset(t, (const uint8_t *)"a\nb\nc", 5));
+  assert(tokResolvePosition(t, 4, &line, &column) && line == 3 && column == 1);
+  size_t allocations = tokAllocationCount(t);
+  assert(tokReset(t, (const uint8_t *)"\n\nd", 3));
+  assert(tokResolvePosition(t, 2, &line, &column) && line == 3 && column == 1);
+  assert(tokAllocationCount(t) == allocations);
+
+  // Without TOK_OPT_UTF8, input is checked like tokCreate does
+  Tokenizer *sniffing = tokCreate((const uint8_t *)"x", 1, &arena);
+  assert(tokReset(sniffing, (const uint8_t *)"\xEF\xBB\xBF{}", 5));
+  assert(tokNext(sniffing).type == TOKEN_LEFT_CURLY);
+
+  static uint8_t nuls[1024];
+  assert(!tokReset(sniffing, nuls, sizeof(nuls)));
+  assert(tokNext(sniffing).type == TOKEN_EOF);
+  assert(tokReset(t, nuls, sizeof(nuls)));        // declared UTF-8
+
+  // Streaming tokenizers cannot be reset
+  static CollectedTokens ignored;
+  assert(!tokReset(tokCreateStream(&arena, collectToken, &ignored), (const uint8_t *)"a", 1));
+  assert(!tokReset(NULL, (const uint8_t *)"a", 1));
+
+  arena_destroy(&arena);
+  printf("\n🎉 test_reset passed\n");
+}
+
+static void compareParallel(const char *css, size_t len, unsigned flags, unsigned threads) {
+  static CompactToken expected[1 << 21], actual[1 << 21];
+  static TokDiagnostic expectedDiags[1 << 18], actualDiags[1 << 18];
+  Arena arena = arena_create(1 << 16);
+
+  TokOptions options = {0};
+  options.flags = flags;
+  options.maxErrors = SIZE_MAX;
+
+  options.diagBuffer = expectedDiags;
+  options.diagCapacity = 1 << 18;
+  Tokenizer *seq = tokCreateEx((const uint8_t *)css, len, &arena, &options);
+  size_t n = tokNextCompact(seq, expected, len + 1);
+
+  options.diagBuffer = actualDiags;
+  Tokenizer *par = tokCreateEx((const uint8_t *)css, len, &arena, &options);
+  assert(tokNextCompactParallel(par, actual, len + 1, threads) == n);
+  assert(memcmp(expected, actual, n * sizeof(CompactToken)) == 0);
+  assert(expected[n - 1].type == TOKEN_EOF);
+
+  // Every diagnostic, in the same order
+  assert(tokDiagnosticCount(par) == tokDiagnosticCount(seq));
+  size_t d = tokReadDiagnostics(seq, expectedDiags, 1 << 18);
+  assert(d == tokDiagnosticCount(seq) && d < (1 << 18));
+  assert(tokReadDiagnostics(par, actualDiags, 1 << 18) == d);
+  for(size_t i = 0; i < d; i++)
+    assert(actualDiags[i].code == expectedDiags[i].code && actualDiags[i].offset == expectedDiags[i].offset);
+
+  // Stopping early leaves the tokenizer where tokNextCompact would
+  par = tokCreateEx((const uint8_t *)css, len, &arena, &options);
+  size_t half = n / 2;
+  assert(tokNextCompactParallel(par, actual, half, threads) == half);
+  assert(tokNextCompactParallel(par, actual + half, len + 1, threads) == n - half);
+  assert(memcmp(expected, actual, n * sizeof(CompactToken)) == 0);
+
+  arena_destroy(&arena);
+}
+
+void test_parallel() {
+  // Constructs that a chunk boundary can fall into
+  const char *fragments[] = {
+    ".a-b > #c::after { color: rgb(1, 2, 3); margin: -1.5e3px 10%; }\n",
+    "/* a comment\n spanning { lines } \"with quotes\n */\n",
+    "a { content: \"str\\\n continued\\\"\" }\n",
+    "b { background: url( img/a\\ b.png ) url(x\"y) }\n",
+    "url() url(x) url(\n)\n",
+    "\xE2\x82\xAC('x\n",
+    "f(\n",
+    "c { content: 'bad\n",
+    "@media (min-width: 768px) { .x { width: calc(100% - 2em) } }\n",
+    "\xC3\xA9l\xC3\xA9ment \\263A \\\n <!-- --> u+1f600 \n",
+  };
+  size_t fragmentCount = sizeof(fragments) / sizeof(fragments[0]);
+
+  static char css[(1 << 21) + 1];
+  size_t len = 0;
+  uint32_t seed = 12345;
+
+  while(len < (1 << 21) - 70000) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t pick = (seed >> 16) % (fragmentCount + 2);
+
+    if(pick < fragmentCount) {
+      size_t n = strlen(fragments[pick]);
+      memcpy(css + len, fragments[pick], n);
+      len += n;
+    }
+    else if(pick == fragmentCount && (seed & 0x300) == 0) {
+      // A long comment with newlines, which chunks start inside of
+      memcpy(css + len, "/*", 2);
+      len += 2;
+      for(size_t i = 0; i < 3000; i++, len += 20)
+        memcpy(css + len, "x \"y url( '\n z * /1 ", 20);
+      len -= 20;
+      memcpy(css + len, "*/", 2);
+      len += 2;
+    }
+    else if((seed & 0x700) == 0) {
+      // A long line, so some boundaries find no newline to split after
+      for(size_t i = 0; i < 600; i++, len += 10)
+        memcpy(css + len, "a:b;\"c d\" ", 10);
+    }
+  }
+
+  memcpy(css + len, "/* open", 7);
+  len += 7;
+  css[len] = '\0';
+
+  unsigned threadCounts[] = { 2, 3, 4, 7, 0 };
+  for(size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); i++)
+    compareParallel(css, len, TOK_OPT_DEFAULT, threadCounts[i]);
+
+  compareParallel(css, len, TOK_OPT_SKIP_WHITESPACE | TOK_OPT_SKIP_COMMENTS, 5);
+  compareParallel(css, len, TOK_OPT_SKIP_COMMENTS, 4);
+
+  // A comment covering whole chunks, and a small input run sequentially
+  static char wide[300000];
+  memset(wide, '\n', sizeof(wide));
+  memcpy(wide, "a /*", 4);
+  memcpy(wide + sizeof(wide) - 6, "*/ b{}", 6);
+  compareParallel(wide, sizeof(wide), TOK_OPT_DEFAULT, 4);
+  compareParallel(".a { color: red }", 17, TOK_OPT_DEFAULT, 4);
+
+  // Chunks that start inside a comment, where they read a bad url ending
+  // on the ')' that follows the real, empty url() token; and a string
+  // error right after a function's '('
+  static const char trap[] = "/*\n url( y*/url() \xE2\x82\xAC('x\n";
+  memset(wide, ' ', sizeof(wide));
+  for(size_t threads = 2; threads <= 4; threads++) {
+    for(size_t i = 1; i < threads; i++)
+      memcpy(wide + sizeof(wide) / threads * i - 2, trap, sizeof(trap) - 1);
+  }
+  compareParallel(wide, sizeof(wide), TOK_OPT_DEFAULT, 2);
+  compareParallel(wide, sizeof(wide), TOK_OPT_DEFAULT, 3);
+  compareParallel(wide, sizeof(wide), TOK_OPT_DEFAULT, 4);
+
+  printf("\n🎉 test_parallel passed\n");
+}
+
+#define DOCUMENT_COUNT 300
+
+typedef struct {
+  size_t calls[DOCUMENT_COUNT];
+  size_t tokens[DOCUMENT_COUNT];
+  bool rejected[DOCUMENT_COUNT];
+} DocumentVisits;
+
+static void visitDocument(size_t index, Tokenizer *t, void *userData) {
+  DocumentVisits *v = userData;
+
+  v->calls[index]++;
+  v->rejected[index] = t == NULL;
+
+  for(Token tok = tokNext(t); tok.type != TOKEN_EOF; tok = tokNext(t))
+    v->tokens[index]++;
+}
+
+void test_documents() {
+  const char *fragments[] = {
+    ".a > #b::after { color: rgb(1, 2, 3) }\n", "/* c\n */ @media x { .y { z: 1px } }\n",
+    "a { content: 'bad\n", "b { background: url( i.png ) url(x\"y) }\n", "\\\n \xC3\xA9 \\263A\n",
+  };
+  static char text[1 << 21];
+  static TokDocument docs[DOCUMENT_COUNT];
+  size_t used = 0;
+  uint32_t seed = 7;
+
+  // Sizes from nothing to about 1 MB, the largest in the middle
+  for(size_t i = 0; i < DOCUMENT_COUNT; i++) {
+    size_t want = i == DOCUMENT_COUNT / 2 ? 1000000 : (i % 10 == 0 ? 20000 : i % 7 * 40);
+    size_t start = used;
+
+    while(used - start < want) {
+      seed = seed * 1103515245 + 12345;
+      const char *f = fragments[(seed >> 16) % 5];
+      memcpy(text + used, f, strlen(f));
+      used += strlen(f);
+    }
+
+    docs[i].input = (const uint8_t *)text + start;
+    docs[i].len = used - start;
+  }
+
+  // A BOM, and input rejected as binary
+  static uint8_t bom[] = "\xEF\xBB\xBF.x{}";
+  static uint8_t nuls[1024];
+  docs[3].input = bom;
+  docs[3].len = sizeof(bom) - 1;
+  docs[5].input = nuls;
+  docs[5].len = sizeof(nuls);
+
+  // More than a fair share, so it is split across threads itself, with
+  // an empty url() and an error after a function's '(' where chunks start
+  static const char trap[] = "/*\n url( y*/url() \xE2\x82\xAC('x\n";
+  static char oversized[600000];
+  memset(oversized, ' ', sizeof(oversized));
+  for(size_t threads = 2; threads <= 4; threads++) {
+    for(size_t i = 1; i < threads; i++)
+      memcpy(oversized + sizeof(oversized) / threads * i - 2, trap, sizeof(trap) - 1);
+  }
+  docs[7].input = (const uint8_t *)oversized;
+  docs[7].len = sizeof(oversized);
+
+  static CompactToken expected[1 << 20];
+  TokOptions options = {0};
+  options.maxErrors = SIZE_MAX;
+  unsigned threadCounts[] = { 1, 4, 0 };
+
+  for(size_t run = 0; run < 3; run++) {
+    TokDocumentSet *set = tokTokenizeDocuments(docs, DOCUMENT_COUNT, &options, threadCounts[run]);
+    assert(set);
+
+    for(size_t i = 0; i < DOCUMENT_COUNT; i++) {
+      TokDocumentTokens got = tokDocumentTokens(set, i);
+
+      if(i == 5) {
+        assert(got.tokens == NULL && got.count == 0);
+        continue;
+      }
+
+      Arena arena = arena_create(1 << 16);
+      Tokenizer *t = tokCreateEx(docs[i].input, docs[i].len, &arena, &options);
+      size_t n = t ? tokNextCompact(t, expected, docs[i].len + 1) : 0;
+
+      if(!t) {
+        // Empty documents have just TOKEN_EOF
+        assert(docs[i].len == 0 && got.count == 1 && got.tokens[0].type == TOKEN_EOF);
+      }
+      else {
+        assert(got.count == n && memcmp(got.tokens, expected, n * sizeof(CompactToken)) == 0);
+        assert(got.errorCount == tokDiagnosticCount(t));
+        assert(got.text == (const char *) docs[i].input + (i == 3 ? 3 : 0));
+      }
+
+      arena_destroy(&arena);
+    }
+
+    assert(tokDocumentTokens(set, DOCUMENT_COUNT).tokens == NULL);
+    tokDocumentSetDestroy(set);
+  }
+
+  // Callbacks see every document once
+  static DocumentVisits visits;
+  memset(&visits, 0, sizeof(visits));
+  assert(tokForEachDocument(docs, DOCUMENT_COUNT, NULL, 3, visitDocument, &visits));
+
+  for(size_t i = 0; i < DOCUMENT_COUNT; i++) {
+    assert(visits.calls[i] == 1 && visits.rejected[i] == (i == 5));
+
+    Arena arena = arena_create(1 << 16);
+    Tokenizer *t = tokCreate(docs[i].input, docs[i].len, &arena);
+    size_t n = 0;
+    for(Token tok = tokNext(t); t && tok.type != TOKEN_EOF; tok = tokNext(t))
+      n++;
+    assert(visits.tokens[i] == n);
+    arena_destroy(&arena);
+  }
+
+  assert(!tokForEachDocument(docs, 1, NULL, 2, NULL, NULL));
+  assert(tokForEachDocument(NULL, 0, NULL, 2, visitDocument, &visits));
+  assert(!tokTokenizeDocuments(NULL, 3, NULL, 2));
+  tokDocumentSetDestroy(tokTokenizeDocuments(NULL, 0, NULL, 2));
+
+  printf("\n🎉 test_documents passed\n");
+}
+
+// Checks a token list against tokenizing its text from scratch
+static void assertListMatches(TokTokenList *list, const char *text, size_t len, const TokOptions *options) {
+  static CompactToken expected[1 << 16];
+  Arena arena = arena_create(1 << 16);
+  Tokenizer *t = tokCreateEx((const uint8_t *) text, len, &arena, options);
+  size_t n = t ? tokNextCompact(t, expected, len + 1) : 0;
+
+  if(!t) {
+    expected[0] = (CompactToken) { (uint32_t) len, 0, TOKEN_EOF, 0, 0 };
+    n = 1;
+  }
+
+  assert(tokTokenListCount(list) == n);
+  for(size_t i = 0; i < n; i++) {
+    CompactToken ct = tokTokenListGet(list, i);
+    assert(memcmp(&ct, &expected[i], sizeof(CompactToken)) == 0);
+  }
+
+  arena_destroy(&arena);
+}
+
+void test_incremental() {
+  const char *pieces[] = {
+    "a", " ", "\n", "{", "}", ":", ";", "'", "\"", "/*", "*/", "url(", ")", "\\", "-", "1e", "5px",
+    "#x", "@m", "<!--", "-->", "\xC3\xA9", "rgb(", "%", ".", "color", "+",
+  };
+  const char *fragments[] = {
+    ".a > #b::after { color: rgb(1, 2, 3) }\n", "/* c\n */ @media x { .y { z: 1px } }\n",
+    "a { content: 'bad\n", "b { background: url( i.png ) url(x\"y) }\n", "\\\n \xC3\xA9 \\263A\n",
+  };
+  static char text[1 << 16];
+  static char next[1 << 16];
+  static CompactToken old[1 << 16];
+  TokOptions optionSets[2] = { {0}, {0} };
+  optionSets[0].flags = TOK_OPT_UTF8 | TOK_OPT_NO_POSITIONS;
+  optionSets[1].flags = TOK_OPT_UTF8 | TOK_OPT_NO_POSITIONS | TOK_OPT_SKIP_WHITESPACE | TOK_OPT_SKIP_COMMENTS;
+  uint32_t seed = 11;
+
+  for(size_t run = 0; run < 2; run++) {
+    size_t len = 0;
+    while(len < 20000) {
+      seed = seed * 1103515245 + 12345;
+      const char *f = fragments[(seed >> 16) % 5];
+      memcpy(text + len, f, strlen(f));
+      len += strlen(f);
+    }
+
+    Arena arena = arena_create(1 << 20);
+    TokTokenList *list = tokTokenListCreate((const uint8_t *) text, len, &arena, &optionSets[run]);
+    assert(list);
+    assertListMatches(list, text, len, &optionSets[run]);
+
+    for(size_t i = 0; i < 2000; i++) {
+      TokEdit edit;
+      seed = seed * 1103515245 + 12345;
+      edit.offset = (seed >> 8) % (len + 1);
+      seed = seed * 1103515245 + 12345;
+      edit.removed = (seed >> 16) % 6;
+      if(edit.removed > len - edit.offset)
+        edit.removed = len - edit.offset;
+
+      // Typing tends to stay in one place
+      if(i % 4)
+        edit.removed = 0;
+
+      seed = seed * 1103515245 + 12345;
+      const char *piece = (seed >> 16) % 3 ? pieces[(seed >> 20) % 27] : "";
+      edit.inserted = strlen(piece);
+
+      memcpy(next, text, edit.offset);
+      memcpy(next + edit.offset, piece, edit.inserted);
+      memcpy(next + edit.offset + edit.inserted, text + edit.offset + edit.removed,
+             len - edit.offset - edit.removed);
+      len = len - edit.removed + edit.inserted;
+      memcpy(text, next, len);
+
+      size_t oldCount = tokTokenListCount(list);
+      for(size_t k = 0; k < oldCount; k++)
+        old[k] = tokTokenListGet(list, k);
+
+      TokTokenChange change;
+      assert(tokTokenListEdit(list, (const uint8_t *) text, len, &edit, &change));
+      assertListMatches(list, text, len, &optionSets[run]);
+
+      // Tokens outside the reported range are the old ones, shifted
+      size_t count = tokTokenListCount(list);
+      assert(change.first + change.removed <= oldCount && change.first + change.inserted <= count);
+      assert(count - change.inserted == oldCount - change.removed);
+      for(size_t k = 0; k < change.first; k++) {
+        CompactToken ct = tokTokenListGet(list, k);
+        assert(memcmp(&old[k], &ct, sizeof(CompactToken)) == 0);
+      }
+      for(size_t k = change.first + change.removed; k < oldCount; k++) {
+        CompactToken ct = tokTokenListGet(list, k - change.removed + change.inserted);
+        assert(ct.offset == old[k].offset - edit.removed + edit.inserted && ct.type == old[k].type);
+      }
+    }
+
+    arena_destroy(&arena);
+  }
+
+  // Only the tokens around the edit are reported as changed
+  const char *before = "a { color: red }";
+  const char *after = "a { color: blue }";
+  Arena arena = arena_create(1 << 16);
+  TokTokenList *list = tokTokenListCreate((const uint8_t *) before, strlen(before), &arena, NULL);
+  TokEdit edit = { 11, 3, 4 };
+  TokTokenChange change;
+
+  assert(tokTokenListEdit(list, (const uint8_t *) after, strlen(after), &edit, &change));
+  assert(change.first == 7 && change.removed == 1 && change.inserted == 1);
+  assert(tokTokenListGet(list, 7).type == TOKEN_IDENT && tokTokenListGet(list, 7).length == 4);
+  assert(tokTokenListFind(list, 12) == 7 && tokTokenListFind(list, 16) == 9);
+
+  // An empty edit at the end of the text, where an empty url() token and
+  // TOKEN_EOF sit at the edit offset, keeps a single TOKEN_EOF
+  TokTokenList *open = tokTokenListCreate((const uint8_t *) "url(", 4, &arena, NULL);
+  TokEdit atEnd = { 4, 0, 0 };
+  size_t openCount = tokTokenListCount(open);
+  assert(tokTokenListEdit(open, (const uint8_t *) "url(", 4, &atEnd, &change));
+  assert(tokTokenListCount(open) == openCount && change.removed == 0 && change.inserted == 0);
+  assert(tokTokenListGet(open, openCount - 1).type == TOKEN_EOF);
+  assertListMatches(open, "url(", 4, NULL);
+
+  // Invalid edits leave the list as it was
+  TokEdit bad = { 10, 20, 0 };
+  assert(!tokTokenListEdit(list, (const uint8_t *) after, strlen(after), &bad, &change));
+  assert(tokTokenListCount(list) == 11);
+  assert(!tokTokenListCreate((const uint8_t *) "\xEF\xBB\xBF" "a", 4, &arena, NULL));
+  arena_destroy(&arena);
+
+  printf("\n🎉 test_incremental passed\n");
+}
+
+// Checks that every node but the root is the child of exactly one node
+static void assertTreeShape(const TokSyntaxTree *tree) {
+  static unsigned char seen[1 << 20];
+  assert(tree->count <= sizeof(seen));
+  memset(seen, 0, tree->count);
+
+  for(size_t i = 0; i < tree->count; i++) {
+    const TokNode *node = &tree->nodes[i];
+    assert(node->first + (size_t) node->count <= tree->count);
+
+    for(uint32_t c = 0; c < node->count; c++) {
+      assert(node->first + c != 0 && !seen[node->first + c]);
+      seen[node->first + c] = 1;
+    }
+  }
+
+  for(size_t i = 1; i < tree->count; i++)
+    assert(seen[i]);
+}
+
+static bool nodeNameIs(const TokSyntaxTree *tree, const TokNode *node, const char *name) {
+  return node->nameLength == strlen(name) && memcmp(tree->text + node->offset, name, node->nameLength) == 0;
+}
+
+void test_parser() {
+  const char *css =
+    "@charset \"x\";\n"
+    "<!-- a, .b > c:hover { color: red !important; margin : 0 auto ; 12px; bad decl; @media x { } }\n"
+    "@media screen and (min-width: 1px) { .x { top: f(1, [2]) } }\n"
+    "@import url(x.css) screen; -->\n"
+    "foo { } }bar";
+  Arena arena = arena_create(1 << 20);
+  TokDiagnostic diags[8];
+  TokOptions options = {0};
+  options.diagBuffer = diags;
+  options.diagCapacity = 8;
+
+  Tokenizer *t = tokCreateEx((const uint8_t *) css, strlen(css), &arena, &options);
+  TokSyntaxTree tree;
+  assert(tokParseStylesheet(t, &arena, &tree));
+  assertTreeShape(&tree);
+
+  const TokNode *root = &tree.nodes[0];
+  assert(root->type == TOK_NODE_STYLESHEET && root->count == 5 && root->length == strlen(css));
+
+  const TokNode *rules = &tree.nodes[root->first];
+  assert(rules[0].type == TOK_NODE_AT_RULE && nodeNameIs(&tree, &rules[0], "@charset"));
+  assert(rules[0].flags == 0 && rules[0].length == 13);
+  assert(rules[1].type == TOK_NODE_QUALIFIED_RULE && (rules[1].flags & TOK_NODE_HAS_BLOCK));
+  assert(rules[2].type == TOK_NODE_AT_RULE && rules[2].atom == TOK_ATOM_MEDIA);
+  assert(rules[3].type == TOK_NODE_AT_RULE && rules[3].count == 4);
+  assert(rules[4].type == TOK_NODE_QUALIFIED_RULE && rules[4].length == 7);
+
+  // The prelude keeps whitespace; the block holds declarations
+  const TokNode *style = &rules[1];
+  assert(tree.text[style->offset] == 'a' && style->count == 13);
+  const TokNode *block = &tree.nodes[style->first + style->count - 1];
+  assert(block->type == TOK_NODE_BLOCK && block->token == TOKEN_LEFT_CURLY && block->count == 3);
+
+  const TokNode *decls = &tree.nodes[block->first];
+  assert(decls[0].type == TOK_NODE_DECLARATION && nodeNameIs(&tree, &decls[0], "color"));
+  assert(decls[0].atom == TOK_ATOM_COLOR && (decls[0].flags & TOK_NODE_IMPORTANT) && decls[0].count == 1);
+  assert(decls[0].length == strlen("color: red !important"));
+  assert(nodeNameIs(&tree, &decls[1], "margin") && decls[1].count == 3 && !(decls[1].flags & TOK_NODE_IMPORTANT));
+  assert(tree.nodes[decls[1].first].token == TOKEN_NUMBER);
+  assert(decls[2].type == TOK_NODE_AT_RULE && (decls[2].flags & TOK_NODE_HAS_BLOCK));
+
+  // Blocks of @media hold rules; functions and simple blocks nest
+  const TokNode *media = &tree.nodes[rules[2].first + rules[2].count - 1];
+  const TokNode *inner = &tree.nodes[media->first];
+  assert(media->count == 1 && inner->type == TOK_NODE_QUALIFIED_RULE);
+  const TokNode *top = &tree.nodes[tree.nodes[inner->first + inner->count - 1].first];
+  const TokNode *func = &tree.nodes[top->first];
+  assert(top->count == 1 && func->type == TOK_NODE_FUNCTION && nodeNameIs(&tree, func, "f"));
+  assert(func->count == 4 && tree.nodes[func->first + 3].type == TOK_NODE_BLOCK);
+  assert(tree.nodes[func->first + 3].token == TOKEN_LEFT_SQUARE);
+
+  // The url token takes its ')'
+  const TokNode *url = &tree.nodes[rules[3].first + 1];
+  assert(url->token == TOKEN_URL && url->offset + url->length + 1 == tree.nodes[rules[3].first + 2].offset);
+
+  // Two dropped declarations and the rule left without a block
+  TokDiagnostic got[8];
+  assert(tokReadDiagnostics(t, got, 8) == 3);
+  assert(got[0].code == TOK_DIAG_INVALID_DECLARATION && got[1].code == TOK_DIAG_INVALID_DECLARATION);
+  assert(got[2].code == TOK_DIAG_RULE_WITHOUT_BLOCK);
+
+  // A style attribute
+  const char *style2 = "color: red; ; 12px; margin:0!IMPORTANT";
+  assert(tokReset(t, (const uint8_t *) style2, strlen(style2)));
+  assert(tokParseDeclarations(t, &arena, &tree));
+  assertTreeShape(&tree);
+  assert(tree.nodes[0].type == TOK_NODE_DECLARATION_LIST && tree.nodes[0].count == 2);
+  assert(tree.nodes[tree.nodes[0].first + 1].flags & TOK_NODE_IMPORTANT);
+  assert(tree.nodes[tree.nodes[0].first + 1].count == 1);
+
+  // Unclosed blocks at the end of input, and nesting too deep to recurse
+  static char deep[300000];
+  size_t len = 0;
+  for(size_t i = 0; i < 1000; i++)
+    len += (size_t) sprintf(deep + len, "@media x { ");
+  for(size_t i = 0; i < 100000; i++)
+    deep[len++] = i % 2 ? '(' : '[';
+  deep[len++] = '}';
+
+  Arena big = arena_create(1 << 24);
+  assert(tokReset(t, (const uint8_t *) deep, len));
+  assert(tokParseStylesheet(t, &big, &tree));
+  assertTreeShape(&tree);
+
+  // 64 levels of rules, then plain blocks: "{ @media x " and the brackets
+  assert(tree.count == 1 + 65 * 5 + 935 * 6 + 1 + 100000 + 1);
+  const TokNode *outer = &tree.nodes[tree.nodes[0].first];
+  assert(tree.nodes[outer->first + outer->count - 1].flags & TOK_NODE_UNCLOSED);
+
+  // Running out of memory
+  Arena tiny = arena_create(4096);
+  assert(tokReset(t, (const uint8_t *) deep, len));
+  assert(!tokParseStylesheet(t, &tiny, &tree) && tree.nodes == NULL);
+  assert(!tokParseStylesheet(NULL, &arena, &tree));
+
+  arena_destroy(&tiny);
+  arena_destroy(&big);
+  arena_destroy(&arena);
+
+  printf("\n🎉 test_parser passed\n");
+}
+
+// Events written out as text, so the two parsers can be compared
+typedef struct {
+  char buf[1 << 16];
+  size_t len;
+} EventLog;
+
+static void logEvent(EventLog *log, char kind, const char *a, size_t aLen, const char *b, size_t bLen, int flag) {
+  int n = snprintf(log->buf + log->len, sizeof(log->buf) - log->len, "%c%.*s|%.*s|%d\n",
+                   kind, (int) aLen, a ? a : "", (int) bLen, b ? b : "", flag);
+  assert(n > 0 && (size_t) n < sizeof(log->buf) - log->len);
+  log->len += (size_t) n;
+}
+
+static void onSaxRule(const TokSaxRule *rule, void *userData) {
+  logEvent(userData, rule->name.length ? 'A' : 'Q', rule->name.data, rule->name.length,
+           rule->prelude.data, rule->prelude.length, rule->hasBlock);
+}
+
+static void onSaxDeclaration(const TokSaxDeclaration *decl, void *userData) {
+  logEvent(userData, 'D', decl->name.data, decl->name.length, decl->value.data, decl->value.length,
+           decl->important);
+}
+
+static void onSaxBlockEnd(size_t offset, void *userData) {
+  logEvent(userData, '}', NULL, 0, NULL, 0, (int) offset);
+}
+
+// Logs the events a tree stands for, children from `from` to `to`
+static void logTreeEvents(EventLog *log, const TokSyntaxTree *tree, const TokNode *node, size_t depth) {
+  const TokNode *children = &tree->nodes[node->first];
+  const char *text = tree->text;
+
+  for(uint32_t i = 0; i < node->count; i++) {
+    const TokNode *child = &children[i];
+    bool hasBlock = child->flags & TOK_NODE_HAS_BLOCK;
+    uint32_t values = child->count - (hasBlock ? 1 : 0);
+    size_t from = 0, to = 0;
+
+    // Without surrounding whitespace
+    uint32_t a = 0, b = values;
+    const TokNode *v = &tree->nodes[child->first];
+    while(a < b && v[a].type == TOK_NODE_TOKEN && v[a].token == TOKEN_WHITESPACE)
+      a++;
+    while(b > a && v[b - 1].type == TOK_NODE_TOKEN && v[b - 1].token == TOKEN_WHITESPACE)
+      b--;
+    if(a < b) {
+      from = v[a].offset;
+      to = v[b - 1].offset + v[b - 1].length;
+    }
+
+    if(child->type == TOK_NODE_DECLARATION) {
+      logEvent(log, 'D', text + child->offset, child->nameLength, text + from, to - from,
+               (child->flags & TOK_NODE_IMPORTANT) != 0);
+      continue;
+    }
+
+    if(child->type == TOK_NODE_AT_RULE)
+      logEvent(log, 'A', text + child->offset + 1, child->nameLength - 1, text + from, to - from, hasBlock);
+    else
+      logEvent(log, 'Q', NULL, 0, text + from, to - from, hasBlock);
+
+    if(hasBlock) {
+      const TokNode *block = &v[child->count - 1];
+      if(depth < 64)
+        logTreeEvents(log, tree, block, depth + 1);
+      logEvent(log, '}', NULL, 0, NULL, 0,
+               (int) (block->offset + block->length - (block->flags & TOK_NODE_UNCLOSED ? 0 : 1)));
+    }
+  }
+}
+
+static void compareEvents(const char *css, size_t len, bool declarations) {
+  static EventLog fromTree, fromSax;
+  TokDiagnostic treeDiags[64], saxDiags[64];
+  TokOptions options = {0};
+  options.diagBuffer = treeDiags;
+  options.diagCapacity = 64;
+  Arena arena = arena_create(1 << 22);
+
+  Tokenizer *t = tokCreateEx((const uint8_t *) css, len, &arena, &options);
+  TokSyntaxTree tree;
+  assert(declarations ? tokParseDeclarations(t, &arena, &tree) : tokParseStylesheet(t, &arena, &tree));
+  fromTree.len = 0;
+  logTreeEvents(&fromTree, &tree, &tree.nodes[0], 0);
+  size_t treeDiagCount = tokReadDiagnostics(t, treeDiags, 64);
+
+  TokSaxHandler handler = { onSaxRule, onSaxRule, onSaxDeclaration, onSaxBlockEnd, &fromSax };
+  fromSax.len = 0;
+  assert(tokReset(t, (const uint8_t *) css, len));
+  assert(declarations ? tokParseDeclarationEvents(t, &handler) : tokParseStylesheetEvents(t, &handler));
+  size_t saxDiagCount = tokReadDiagnostics(t, saxDiags, 64);
+
+  CHECK(fromTree.len == fromSax.len && memcmp(fromTree.buf, fromSax.buf, fromTree.len) == 0,
+        "Events differ for \"%.*s\":\n%.*s---\n%.*s", (int) len, css,
+        (int) fromTree.len, fromTree.buf, (int) fromSax.len, fromSax.buf);
+
+  assert(treeDiagCount == saxDiagCount);
+  for(size_t i = 0; i < treeDiagCount; i++)
+    assert(treeDiags[i].code == saxDiags[i].code && treeDiags[i].offset == saxDiags[i].offset);
+
+  arena_destroy(&arena);
+}
+
+static void countDeclaration(const TokSaxDeclaration *decl, void *userData) {
+  TokSaxDeclaration *last = userData;
+  *last = *decl;
+}
+
+void test_sax() {
+  static const char *pieces[] = {
+    " ", "a", "b-c", "{", "}", "{", "}", ";", ":", ": ", "@media", "@font-face", "@x", "!", "important",
+    "(", ")", "[", "]", "f(", "1px", ",", "<!--", "-->", "/**/", "\"s\"", "#x", ".b", "0.5"
+  };
+  char css[512];
+  srand(23);
+
+  for(int round = 0; round < 20000; round++) {
+    size_t len = 0;
+    int n = 1 + rand() % 40;
+    for(int i = 0; i < n; i++) {
+      const char *piece = pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))];
+      memcpy(css + len, piece, strlen(piece));
+      len += strlen(piece);
+    }
+
+    compareEvents(css, len, round % 4 == 0);
+  }
+
+  // Nesting past the inline stack and the rule depth limit
+  static char deep[20000];
+  size_t len = 0;
+  for(size_t i = 0; i < 100; i++)
+    len += (size_t) sprintf(deep + len, "@media x { a{b:c} ");
+  for(size_t i = 0; i < 1000; i++)
+    deep[len++] = i % 2 ? '(' : '[';
+  len += (size_t) sprintf(deep + len, "} } x:y");
+  compareEvents(deep, len, false);
+
+  // Token range of a value
+  const char *style = "color : rgb(1, 2) /**/ url(x) !important";
+  Arena arena = arena_create(1 << 16);
+  Tokenizer *t = tokCreate((const uint8_t *) style, strlen(style), &arena);
+  TokSaxDeclaration decl = {0};
+  TokSaxHandler handler = { NULL, NULL, countDeclaration, NULL, &decl };
+  assert(tokParseDeclarationEvents(t, &handler));
+  assert(decl.atom == TOK_ATOM_COLOR && decl.important && decl.offset == 0);
+  assert(decl.value.length == strlen("rgb(1, 2) /**/ url(x)"));
+
+  // "rgb(" 1 , ws 2 ) ws comment ws url ), after "color", ws, ':' and ws
+  assert(decl.firstToken == 4 && decl.tokenCount == 11);
+
+  assert(!tokParseStylesheetEvents(NULL, &handler));
+  assert(!tokParseStylesheetEvents(t, NULL));
+  arena_destroy(&arena);
+
+  printf("\n🎉 test_sax passed\n");
+}
+
+typedef struct {
+  char buf[1 << 16];
+  size_t len;
+  size_t calls;
+} MinifyOutput;
+
+static bool collectMinified(const TokenSpan *spans, size_t count, void *userData) {
+  MinifyOutput *out = userData;
+
+  assert(count > 0 && count <= TOK_MINIFY_BATCH);
+  for(size_t i = 0; i < count; i++) {
+    assert(spans[i].length && out->len + spans[i].length <= sizeof(out->buf));
+    memcpy(out->buf + out->len, spans[i].data, spans[i].length);
+    out->len += spans[i].length;
+  }
+
+  out->calls++;
+
+  return true;
+}
+
+static size_t minifyInto(MinifyOutput *out, const char *css, size_t len) {
+  Arena arena = arena_create(1 << 20);
+  Tokenizer *t = tokCreate((const uint8_t *) css, len, &arena);
+
+  out->len = 0;
+  out->calls = 0;
+  assert(tokMinify(t, collectMinified, out));
+  arena_destroy(&arena);
+
+  return out->len;
+}
+
+// Reads the tokens that carry meaning: no whitespace, no comments, and no
+// ';' right before a '}'
+static size_t significantTokens(const char *css, size_t len, Token *tokens, size_t max, Arena *arena) {
+  Tokenizer *t = tokCreate((const uint8_t *) css, len, arena);
+  size_t count = 0;
+
+  while(true) {
+    Token tok = tokNext(t);
+    if(tok.type == TOKEN_WHITESPACE || tok.type == TOKEN_COMMENT)
+      continue;
+
+    while(tok.type == TOKEN_RIGHT_CURLY && count && tokens[count - 1].type == TOKEN_SEMICOLON)
+      count--;
+
+    assert(count < max);
+    tokens[count++] = tok;
+
+    if(tok.type == TOKEN_EOF)
+      return count;
+  }
+}
+
+static void assertMinifiedEquivalent(const char *css, size_t len) {
+  static MinifyOutput out;
+  static Token before[16384], after[16384];
+  Arena arena = arena_create(1 << 20);
+
+  minifyInto(&out, css, len);
+
+  size_t n = significantTokens(css, len, before, 16384, &arena);
+  size_t m = significantTokens(out.buf, out.len, after, 16384, &arena);
+
+  CHECK(n == m, "Minified \"%.*s\" to \"%.*s\"\n", (int) len, css, (int) out.len, out.buf);
+
+  for(size_t i = 0; i < n; i++) {
+    const Token *a = &before[i], *b = &after[i];
+
+    if(a->type == TOKEN_NUMBER || a->type == TOKEN_PERCENTAGE || a->type == TOKEN_DIMENSION) {
+      // Zero lengths may lose their unit
+      assert(a->type == b->type || (a->type == TOKEN_DIMENSION && b->type == TOKEN_NUMBER && a->numeric.value == 0));
+      assert(a->numeric.value == b->numeric.value);
+      continue;
+    }
+
+    bool same = a->type == b->type && a->length == b->length &&
+                (!a->length || memcmp(a->value, b->value, a->length) == 0);
+    CHECK(same, "Minified \"%.*s\" to \"%.*s\"\n", (int) len, css, (int) out.len, out.buf);
+  }
+
+  arena_destroy(&arena);
+}
+
+static bool failAfterOneBatch(const TokenSpan *spans, size_t count, void *userData) {
+  (void) spans;
+  (void) count;
+  return ++*(size_t *) userData < 2;
+}
+
+void test_minify() {
+  const char *css =
+    "/* header */\n"
+    "a  >  b , c  d:hover {\n"
+    "  color : red ;\n"
+    "  margin: 0.50px 0px -0.0em 010.0% 1e3px +.50 0.0% ;\n"
+    "  width: calc( 100% - 0px ) ;\n"
+    "  --x: 0px 0.50 ;\n"
+    "  background: url( a.png ) url(b.png) !important ;\n"
+    "}\n"
+    "@media screen and (min-width: 0px) { x { top: 0 } }\n"
+    "@import \"x.css\" ;";
+  const char *expected =
+    "a>b,c d:hover{color :red;margin:.5px 0 -0 10% 1e3px +.5 0%;width:calc(100% - 0px);"
+    "--x:0px 0.50;background:url( a.png ) url(b.png)!important}"
+    "@media screen and (min-width:0){x{top:0}}@import \"x.css\";";
+  static MinifyOutput out;
+
+  minifyInto(&out, css, strlen(css));
+  CHECK(out.len == strlen(expected) && memcmp(out.buf, expected, out.len) == 0, "Got \"%.*s\"\n", (int) out.len, out.buf);
+  assertMinifiedEquivalent(css, strlen(css));
+
+  // A zero flex-basis keeps its unit, or it would read as flex-shrink
+  const char *flex = "a { flex: 1 0px; -WEBKIT-flex: 0.0 1 0.0em; margin: 0px } b { flex: 0px }";
+  const char *flexMinified = "a{flex:1 0px;-WEBKIT-flex:0 1 0em;margin:0}b{flex:0px}";
+  minifyInto(&out, flex, strlen(flex));
+  CHECK(out.len == strlen(flexMinified) && memcmp(out.buf, flexMinified, out.len) == 0, "Got \"%.*s\"\n", (int) out.len, out.buf);
+
+  // Tokens that would run together keep something between them
+  minifyInto(&out, "a/**/b 1/**/.5 #x/**/-y a /**/ b", 32);
+  assert(out.len == 27 && memcmp(out.buf, "a/**/b 1/**/.5 #x/**/-y a b", 27) == 0);
+  assertMinifiedEquivalent("a/**/b 1/**/.5 #x/**/-y a /**/ b", 32);
+
+  // Random token soups read back as the same tokens
+  static const char *pieces[] = {
+    " ", "  ", "\n", "a", "-", "--", "-b", "#x", ".", ".5", "0", "0.0", "0px", "00.10em", "1e3", "+1", "%",
+    "{", "}", ";", ":", ",", ">", "~", "!", "important", "(", ")", "[", "]", "f(", "url(x)", "url( y )",
+    "/**/", "/* c */", "\"s\"", "@m", "<!--", "-->", "*", "/", "\\"
+  };
+  char soup[512];
+  srand(24);
+
+  for(int round = 0; round < 20000; round++) {
+    size_t len = 0;
+    int n = 1 + rand() % 40;
+    for(int i = 0; i < n; i++) {
+      const char *piece = pieces[rand() % (sizeof(pieces) / sizeof(pieces[0]))];
+      memcpy(soup + len, piece, strlen(piece));
+      len += strlen(piece);
+    }
+
+    assertMinifiedEquivalent(soup, len);
+  }
+
+  // Unchanged stretches go out as one span, batches stay within the limit
+  static char big[20000];
+  size_t len = 0;
+  while(len < sizeof(big) - 100)
+    len += (size_t) sprintf(big + len, "a{b:c} d { e : 0.50 } ");
+  minifyInto(&out, big, len);
+  assert(out.calls > 1);
+  assertMinifiedEquivalent(big, len);
+
+  // A sink can stop the output; options that hide trivia are refused
+  Arena arena = arena_create(1 << 16);
+  size_t calls = 0;
+  Tokenizer *t = tokCreate((const uint8_t *) big, len, &arena);
+  assert(!tokMinify(t, failAfterOneBatch, &calls) && calls == 2);
+
+  TokOptions options = {0};
+  options.flags = TOK_OPT_SKIP_COMMENTS;
+  t = tokCreateEx((const uint8_t *) css, strlen(css), &arena, &options);
+  assert(!tokMinify(t, collectMinified, &out));
+  assert(!tokMinify(NULL, collectMinified, &out));
+  arena_destroy(&arena);
+
+  printf("\n🎉 test_minify passed\n");
+}
+
+// A small document for the selector tests: elements in an array, linked by
+// index, -1 for none
+typedef struct {
+  const char *name;
+  const char *id;
+  const char *classes;    // space-separated
+  const char *attrName;
+  const char *attrValue;
+  int parent, previous, next, lastChild;
+} TestElement;
+
+typedef struct {
+  TestElement elements[64];
+  int count;
+} TestDocument;
+
+static int addElement(TestDocument *doc, int parent, const char *name) {
+  int index = doc->count++;
+  TestElement *el = &doc->elements[index];
+
+  memset(el, 0, sizeof(TestElement));
+  el->name = name;
+  el->parent = parent;
+  el->previous = el->next = el->lastChild = -1;
+
+  if(parent >= 0) {
+    el->previous = doc->elements[parent].lastChild;
+    if(el->previous >= 0)
+      doc->elements[el->previous].next = index;
+    doc->elements[parent].lastChild = index;
+  }
+
+  return index;
+}
+
+static const void *linked(const TestDocument *doc, int index) {
+  return index < 0 ? NULL : &doc->elements[index];
+}
+
+static const void *testParent(const void *element, void *userData) {
+  return linked(userData, ((const TestElement *) element)->parent);
+}
+
+static const void *testPreviousSibling(const void *element, void *userData) {
+  return linked(userData, ((const TestElement *) element)->previous);
+}
+
+static const void *testNextSibling(const void *element, void *userData) {
+  return linked(userData, ((const TestElement *) element)->next);
+}
+
+static TokenSpan testLocalName(const void *element, void *userData) {
+  (void) userData;
+  const char *name = ((const TestElement *) element)->name;
+  return (TokenSpan) { name, strlen(name) };
+}
+
+static TokenSpan testId(const void *element, void *userData) {
+  (void) userData;
+  const char *id = ((const TestElement *) element)->id;
+  return (TokenSpan) { id, id ? strlen(id) : 0 };
+}
+
+static bool testHasClass(const void *element, const TokSelectorName *name, void *userData) {
+  (void) userData;
+  const char *classes = ((const TestElement *) element)->classes;
+
+  for(const char *p = classes; p && *p;) {
+    size_t len = strcspn(p, " ");
+    if(len == name->length && memcmp(p, name->data, len) == 0)
+      return true;
+    p += len + (p[len] == ' ');
+  }
+
+  return false;
+}
+
+static bool testAttribute(const void *element, const TokSelectorName *name, TokenSpan *value, void *userData) {
+  (void) userData;
+  const TestElement *el = element;
+
+  if(!el->attrName || strcmp(el->attrName, name->data) != 0)
+    return false;
+
+  *value = (TokenSpan) { el->attrValue, strlen(el->attrValue) };
+  return true;
+}
+
+static bool testIsEmpty(const void *element, void *userData) {
+  (void) userData;
+  return ((const TestElement *) element)->lastChild < 0;
+}
+
+static bool testPseudoClass(const void *element, const TokSelectorName *name, void *userData) {
+  (void) userData;
+  // Every element with an id is :hover
+  return strcmp(name->data, "hover") == 0 && ((const TestElement *) element)->id;
+}
+
+static TokElementInterface testInterface(TestDocument *doc) {
+  TokElementInterface dom = {
+    testParent, testPreviousSibling, testNextSibling, testLocalName, testId,
+    testHasClass, testAttribute, testIsEmpty, testPseudoClass, doc
+  };
+  return dom;
+}
+
+static bool compileSelectors(const char *css, Arena *arena, TokSelectorList *list) {
+  Tokenizer *t = tokCreate((const uint8_t *) css, strlen(css), arena);
+  return tokCompileSelectors(t, arena, list);
+}
+
+// Whether `css` matches element `index`, and with which specificity
+static bool selectorMatches(TestDocument *doc, const char *css, int index, uint32_t *specificity) {
+  Arena arena = arena_create(1 << 16);
+  TokSelectorList list;
+  TokElementInterface dom = testInterface(doc);
+
+  bool compiled = compileSelectors(css, &arena, &list);
+  CHECK(compiled && list.count > 0, "Failed to compile \"%s\"\n", css);
+
+  bool matched = tokSelectorListMatches(&list, &doc->elements[index], &dom, specificity);
+  arena_destroy(&arena);
+
+  return matched;
+}
+
+// The matches of compounds [0, k] of a random selector, found by trying
+// every candidate of every combinator
+static bool naiveMatches(const TestDocument *doc, const char **names, const char *combinators, int k, int index) {
+  const TestElement *el = &doc->elements[index];
+
+  if(strcmp(names[k], "*") != 0 && strcmp(names[k], el->name) != 0)
+    return false;
+
+  if(k == 0)
+    return true;
+
+  switch(combinators[k - 1]) {
+    case '>':
+      return el->parent >= 0 && naiveMatches(doc, names, combinators, k - 1, el->parent);
+    case '+':
+      return el->previous >= 0 && naiveMatches(doc, names, combinators, k - 1, el->previous);
+    case '~':
+      for(int i = el->previous; i >= 0; i = doc->elements[i].previous) {
+        if(naiveMatches(doc, names, combinators, k - 1, i))
+          return true;
+      }
+      return false;
+    default:
+      for(int i = el->parent; i >= 0; i = doc->elements[i].parent) {
+        if(naiveMatches(doc, names, combinators, k - 1, i))
+          return true;
+      }
+      return false;
+  }
+}
+
+void test_selector() {
+  // html > body > (div#main.box.wide[lang=en-US] > p p span), ul > li*4
+  TestDocument doc = { .count = 0 };
+  int html = addElement(&doc, -1, "html");
+  int body = addElement(&doc, html, "body");
+  int box = addElement(&doc, body, "div");
+  int p1 = addElement(&doc, box, "p");
+  int p2 = addElement(&doc, box, "p");
+  int span = addElement(&doc, p2, "span");
+  int ul = addElement(&doc, body, "ul");
+  int li[4];
+  for(int i = 0; i < 4; i++)
+    li[i] = addElement(&doc, ul, "li");
+
+  doc.elements[box].id = "main";
+  doc.elements[box].classes = "box wide";
+  doc.elements[box].attrName = "lang";
+  doc.elements[box].attrValue = "en-US";
+  doc.elements[span].classes = "note";
+  doc.elements[li[1]].attrName = "class";
+  doc.elements[li[1]].attrValue = "a b  c";
+
+  uint32_t spec;
+
+  // Simple selectors and specificity
+  assert(selectorMatches(&doc, "div", box, &spec) && spec == TOK_SPECIFICITY(0, 0, 1));
+  assert(selectorMatches(&doc, "DIV#main.box", box, &spec) && spec == TOK_SPECIFICITY(1, 1, 1));
+  assert(selectorMatches(&doc, "*", span, &spec) && spec == 0);
+  assert(!selectorMatches(&doc, "div.box.narrow", box, &spec) && spec == 0);
+  assert(!selectorMatches(&doc, "#Main", box, NULL));
+  assert(selectorMatches(&doc, "p, .box, #main", box, &spec) && spec == TOK_SPECIFICITY(1, 0, 0));
+  assert(selectorMatches(&doc, "div:hover", box, &spec) && spec == TOK_SPECIFICITY(0, 1, 1));
+  assert(!selectorMatches(&doc, "p:hover", p1, NULL));
+
+  // Combinators
+  assert(selectorMatches(&doc, "html span", span, NULL));
+  assert(selectorMatches(&doc, "body > div > p > span", span, NULL));
+  assert(!selectorMatches(&doc, "body > p span", span, NULL));
+  assert(selectorMatches(&doc, "div p+p>span", span, NULL));
+  assert(selectorMatches(&doc, "p ~ p", p2, NULL) && !selectorMatches(&doc, "p ~ p", p1, NULL));
+  assert(selectorMatches(&doc, "div ~ ul > li + li", li[3], NULL));
+  assert(!selectorMatches(&doc, "ul ~ div li", li[0], NULL));
+  assert(selectorMatches(&doc, "html/* c */>body", body, NULL));
+
+  // Attributes
+  assert(selectorMatches(&doc, "[lang]", box, &spec) && spec == TOK_SPECIFICITY(0, 1, 0));
+  assert(selectorMatches(&doc, "[lang=\"en-US\"]", box, NULL));
+  assert(!selectorMatches(&doc, "[lang=en-us]", box, NULL));
+  assert(selectorMatches(&doc, "[lang=en-us i]", box, NULL));
+  assert(selectorMatches(&doc, "[lang|=en]", box, NULL) && !selectorMatches(&doc, "[lang|=e]", box, NULL));
+  assert(selectorMatches(&doc, "[lang^=en]", box, NULL) && selectorMatches(&doc, "[lang$=US]", box, NULL));
+  assert(selectorMatches(&doc, "[lang*=\"-\"]", box, NULL) && !selectorMatches(&doc, "[lang*=\"\"]", box, NULL));
+  assert(selectorMatches(&doc, "[class~=c]", li[1], NULL) && !selectorMatches(&doc, "[class~=\"b c\"]", li[1], NULL));
+
+  // Structural pseudo-classes
+  assert(selectorMatches(&doc, ":root", html, NULL) && !selectorMatches(&doc, ":root", body, NULL));
+  assert(selectorMatches(&doc, "span:empty", span, NULL) && !selectorMatches(&doc, ":empty", p2, NULL));
+  assert(selectorMatches(&doc, "li:first-child", li[0], NULL) && !selectorMatches(&doc, "li:first-child", li[1], NULL));
+  assert(selectorMatches(&doc, "li:last-child", li[3], NULL) && selectorMatches(&doc, "span:only-child", span, NULL));
+  assert(selectorMatches(&doc, "ul:last-of-type", ul, NULL) && selectorMatches(&doc, "div:only-of-type", box, NULL));
+  assert(!selectorMatches(&doc, "p:only-of-type", p1, NULL));
+
+  // An+B
+  static const struct {
+    const char *nth;
+    bool matches[4];
+  } nths[] = {
+    { "odd", { true, false, true, false } },
+    { "EVEN", { false, true, false, true } },
+    { "3", { false, false, true, false } },
+    { "n", { true, true, true, true } },
+    { "-n+2", { true, true, false, false } },
+    { "2n+0", { false, true, false, true } },
+    { "+n + 3", { false, false, true, true } },
+    { "+n - 3", { true, true, true, true } },
+    { "2n- 1", { true, false, true, false } },
+    { "n-2", { true, true, true, true } },
+    { "3n + 1", { true, false, false, true } },
+    { " -2n+3 ", { true, false, true, false } },
+    { "0n+0", { false, false, false, false } }
+  };
+
+  for(size_t i = 0; i < sizeof(nths) / sizeof(nths[0]); i++) {
+    for(int j = 0; j < 4; j++) {
+      char css[64];
+      snprintf(css, sizeof(css), "li:nth-child(%s)", nths[i].nth);
+      CHECK(selectorMatches(&doc, css, li[j], NULL) == nths[i].matches[j], "%s on li %d\n", css, j);
+    }
+  }
+
+  assert(selectorMatches(&doc, "li:nth-last-child(2n+1)", li[3], &spec) && spec == TOK_SPECIFICITY(0, 1, 1));
+  assert(selectorMatches(&doc, "p:nth-of-type(2)", p2, NULL) && selectorMatches(&doc, "p:nth-last-of-type(1)", p2, NULL));
+
+  // :is(), :not(), :where() and pseudo-elements
+  assert(selectorMatches(&doc, ":is(p, #main) > span", span, &spec) && spec == TOK_SPECIFICITY(1, 0, 1));
+  assert(selectorMatches(&doc, ":where(p, #main) > span", span, &spec) && spec == TOK_SPECIFICITY(0, 0, 1));
+  assert(selectorMatches(&doc, "p:not(:first-child, .x)", p2, &spec) && spec == TOK_SPECIFICITY(0, 1, 1));
+  assert(!selectorMatches(&doc, "p:not(:first-child, .x)", p1, NULL));
+  assert(selectorMatches(&doc, "span:is(:not(:is(li)) span)", span, NULL));
+  assert(selectorMatches(&doc, ":is(p, 1x, ::before x) span", span, NULL));
+  assert(!selectorMatches(&doc, ":is(1x) span, :is()", span, NULL));
+  assert(selectorMatches(&doc, ":is(:not(1x), p) > span", span, NULL));
+  assert(selectorMatches(&doc, "span::before", span, &spec) && spec == TOK_SPECIFICITY(0, 0, 2));
+  assert(selectorMatches(&doc, "span:after", span, &spec) && spec == TOK_SPECIFICITY(0, 0, 2));
+
+  Arena arena = arena_create(1 << 16);
+  TokSelectorList list;
+  assert(compileSelectors("a::after, b, #x.y z", &arena, &list) && list.count == 3);
+  assert(list.selectors[0].flags == TOK_SELECTOR_PSEUDO_ELEMENT && list.selectors[1].flags == 0);
+  assert(list.selectors[2].specificity == TOK_SPECIFICITY(1, 1, 1));
+  assert(list.nameCount == 5 && strcmp(list.names[3].data, "y") == 0);
+
+  // Invalid selectors are reported and compile to nothing
+  static const char *invalidSelectors[] = {
+    "", "a,", ",a", "a >", "> a", "a > > b", "#1x", ". a", "a .", "[a", "[a=]", "[a=b c]", "[a ~ = b]",
+    "a::before b", "::before:hover", "ns|a", ":nth-child(n+)", ":nth-child(n - -1)", ":nth-child(+ n)",
+    ":nth-child(2.5n)", ":not(1x)", ":not(:is(1x), )", ":has(a)", "a{", "a)", ":is(a", "a !"
+  };
+
+  for(size_t i = 0; i < sizeof(invalidSelectors) / sizeof(invalidSelectors[0]); i++) {
+    const char *css = invalidSelectors[i];
+    TokDiagnostic records[4], diag;
+    Tokenizer *t = tokCreate((const uint8_t *) (*css ? css : " "), *css ? strlen(css) : 1, &arena);
+
+    tokSetDiagnosticBuffer(t, records, 4);
+    bool compiled = tokCompileSelectors(t, &arena, &list);
+    CHECK(!compiled && list.count == 0 && list.selectors == NULL, "Compiled \"%s\"\n", css);
+    assert(tokReadDiagnostics(t, &diag, 1) == 1 && diag.code == TOK_DIAG_INVALID_SELECTOR);
+  }
+
+  assert(!tokCompileSelectors(NULL, &arena, &list) && !tokCompileSelectors(tokCreate((const uint8_t *) "a", 1, &arena), NULL, &list));
+  arena_destroy(&arena);
+
+  // Combinator matching finds what trying every candidate finds, on random
+  // trees with selectors of a few compounds
+  static const char *tags[] = { "a", "b", "c", "*" };
+  static const char combinatorChars[] = { ' ', '>', '+', '~' };
+  srand(25);
+
+  for(int round = 0; round < 2000; round++) {
+    TestDocument tree = { .count = 0 };
+    addElement(&tree, -1, tags[rand() % 3]);
+    while(tree.count < 40)
+      addElement(&tree, rand() % tree.count, tags[rand() % 3]);
+
+    const char *names[5];
+    char combinators[5];
+    char css[64];
+    int compounds = 1 + rand() % 5;
+    size_t len = 0;
+
+    for(int k = 0; k < compounds; k++) {
+      names[k] = tags[rand() % 4];
+      if(k)
+        len += (size_t) sprintf(css + len, " %c ", combinators[k - 1]);
+      len += (size_t) sprintf(css + len, "%s", names[k]);
+      combinators[k] = combinatorChars[rand() % 4];
+    }
+
+    Arena arena = arena_create(1 << 16);
+    TokElementInterface dom = testInterface(&tree);
+    assert(compileSelectors(css, &arena, &list) && list.count == 1);
+
+    for(int i = 0; i < tree.count; i++) {
+      bool expected = naiveMatches(&tree, names, combinators, compounds - 1, i);
+      CHECK(tokSelectorMatches(&list, 0, &tree.elements[i], &dom) == expected, "\"%s\" on element %d\n", css, i);
+    }
+
+    arena_destroy(&arena);
+  }
+
+  printf("\n🎉 test_selector passed\n");
+}
+
 int main() {
   test_all_tokens();
+  test_raw_byte_walk();
+  test_batch();
+  test_compact_tokens();
+  test_resolve_position();
+  test_long_runs();
+  test_utf8_decode_fast_path();
+  test_char_classes();
+  test_no_allocations();
+  test_token_values();
+  test_numeric_values();
+  test_atoms();
+  test_interning();
+  test_diagnostics();
+  test_options();
+  test_reset();
+  test_parallel();
+  test_documents();
+  test_incremental();
+  test_parser();
+  test_sax();
+  test_minify();
+  test_selector();
+  test_streaming_chunks();
+  test_file_input();
 
   return 0;
 }
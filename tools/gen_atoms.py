@@ -0,0 +1,274 @@
+#!/usr/bin/env python3
+"""Generates the atom table from tools/atoms.txt.
+
+Writes include/comot-css/atoms.h (the TokAtom enum) and src/tokenizer/atoms.c
+(a perfect hash over the names). Run it from anywhere after editing
+atoms.txt and commit the generated files:
+
+    python3 tools/gen_atoms.py
+
+The hash is two-level "hash and displace": a name's tokNameHash() (32-bit
+FNV-1a of the lower-cased name, which the tokenizer computes while scanning
+names) picks a bucket, and the bucket's displacement is mixed into the hash
+to pick the slot. Displacements are searched here so that no two names
+share a slot, which leaves one slot load and one compare per lookup at
+runtime.
+"""
+
+import os
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SLOT_BITS = 9
+BUCKET_BITS = 7
+MASK32 = 0xFFFFFFFF
+
+
+def read_names(path):
+    names = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if line and not line.startswith("#"):
+                names.append(line)
+
+    if len(set(names)) != len(names):
+        sys.exit("atoms.txt: duplicate names")
+    for name in names:
+        if name != name.lower() or not name.isascii():
+            sys.exit("atoms.txt: names must be lower-case ASCII: " + name)
+
+    return names
+
+
+def enum_name(name):
+    if name == "%":
+        return "TOK_ATOM_PERCENT"
+    return "TOK_ATOM_" + name.lstrip("-").replace("-", "_").upper()
+
+
+# Must match tokNameHash() and atomSlot() in atoms.c
+def fnv1a(name):
+    h = 0x811C9DC5
+    for c in name.encode():
+        h = ((h ^ c) * 0x01000193) & MASK32
+    return h
+
+
+def mix(h, displacement):
+    h ^= displacement
+    h ^= h >> 16
+    h = (h * 0x7FEB352D) & MASK32
+    h ^= h >> 15
+    h = (h * 0x846CA68B) & MASK32
+    h ^= h >> 16
+    return h
+
+
+def build_table(names):
+    slots = [0] * (1 << SLOT_BITS)
+    displacements = [0] * (1 << BUCKET_BITS)
+    buckets = [[] for _ in displacements]
+
+    for atom, name in enumerate(names, 1):
+        h = fnv1a(name)
+        buckets[h & ((1 << BUCKET_BITS) - 1)].append((atom, h))
+
+    order = sorted(range(len(buckets)), key=lambda b: -len(buckets[b]))
+    for b in order:
+        if not buckets[b]:
+            continue
+
+        for d in range(1, 1 << 16):
+            taken = [mix(h, d) & ((1 << SLOT_BITS) - 1) for _, h in buckets[b]]
+            if len(set(taken)) == len(taken) and all(slots[s] == 0 for s in taken):
+                for (atom, _), s in zip(buckets[b], taken):
+                    slots[s] = atom
+                displacements[b] = d
+                break
+        else:
+            sys.exit("no displacement found, raise SLOT_BITS")
+
+    return slots, displacements
+
+
+def rows(values, per_row, fmt):
+    out = []
+    for i in range(0, len(values), per_row):
+        out.append("  " + ", ".join(fmt(v) for v in values[i:i + per_row]) + ",")
+    out[-1] = out[-1].rstrip(",")
+    return "\n".join(out)
+
+
+def write_header(names, path):
+    width = max(len(enum_name(n)) for n in names) + 2
+    lines = ["  TOK_ATOM_UNKNOWN = 0,".ljust(width + 8) + "// not a known name"]
+    for name in names:
+        lines.append(("  " + enum_name(name) + ",").ljust(width + 8) + "// " + name)
+
+    with open(path, "w") as f:
+        f.write("""\
+#ifndef ATOMS_H
+#define ATOMS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Generated by tools/gen_atoms.py from tools/atoms.txt, do not edit.
+
+// Known CSS names: units, at-rules, functions, properties and keywords.
+// Names are matched ignoring ASCII case; the values are stable.
+typedef enum {
+%s
+  TOK_ATOM_COUNT
+} TokAtom;
+
+// Longest known name, in bytes
+#define TOK_ATOM_MAX_LEN %d
+
+// Atom of a name (without '@', '(' or a number), TOK_ATOM_UNKNOWN if none
+TokAtom tokAtomLookup(const char *name, size_t len);
+
+// Same, for a name whose tokNameHash() is already known
+TokAtom tokAtomLookupHashed(const char *name, size_t len, uint32_t hash);
+
+// Lower-case name of an atom, "" for TOK_ATOM_UNKNOWN
+const char *tokAtomName(TokAtom atom);
+
+#endif  // !ATOMS_H
+""" % ("\n".join(lines), max(len(n) for n in names)))
+
+
+def write_source(names, slots, displacements, path):
+    with open(path, "w") as f:
+        f.write("""\
+#include <stdint.h>
+#include "comot-css/atoms.h"
+#include "comot-css/intern.h"
+
+// Generated by tools/gen_atoms.py from tools/atoms.txt, do not edit.
+
+#define ATOM_SLOT_MASK %d
+#define ATOM_BUCKET_MASK %d
+
+// Names by atom, lower-case
+static const char *const atomNames[TOK_ATOM_COUNT] = {
+  "",
+%s
+};
+
+// Name lengths by atom
+static const uint8_t atomLengths[TOK_ATOM_COUNT] = {
+%s
+};
+
+// Per-bucket displacement, chosen so that no two names share a slot
+static const uint16_t atomDisplacements[ATOM_BUCKET_MASK + 1] = {
+%s
+};
+
+// Atom in each slot, 0 for empty slots
+static const uint8_t atomSlots[ATOM_SLOT_MASK + 1] = {
+%s
+};
+
+/**
+ * @brief Lower-cases an ASCII letter, leaving every other byte as is.
+ *
+ * @param c The byte.
+ * @return The lower-cased byte.
+ */
+static inline uint8_t asciiLower(uint8_t c) {
+  return (uint8_t) (c - 'A') < 26 ? (uint8_t) (c | 0x20) : c;
+}
+
+/**
+ * @brief Maps a name's hash and bucket displacement to its slot.
+ *
+ * @param h tokNameHash() of the name.
+ * @return The slot index.
+ */
+static inline uint32_t atomSlot(uint32_t h) {
+  h ^= atomDisplacements[h & ATOM_BUCKET_MASK];
+  h ^= h >> 16;
+  h *= 0x7feb352dU;
+  h ^= h >> 15;
+  h *= 0x846ca68bU;
+  h ^= h >> 16;
+
+  return h & ATOM_SLOT_MASK;
+}
+
+/**
+ * @brief Looks up the atom of a name whose tokNameHash() is known.
+ *
+ * Compares the name against the only known name that can live in its
+ * slot, so unknown names cost the same as known ones.
+ *
+ * @param name The name bytes (not NUL-terminated).
+ * @param len The number of bytes.
+ * @param hash tokNameHash() of the name.
+ * @return The atom, or TOK_ATOM_UNKNOWN.
+ */
+TokAtom tokAtomLookupHashed(const char *name, size_t len, uint32_t hash) {
+  if(!name || len == 0 || len > TOK_ATOM_MAX_LEN)
+    return TOK_ATOM_UNKNOWN;
+
+  TokAtom atom = (TokAtom) atomSlots[atomSlot(hash)];
+  if(atomLengths[atom] != len)
+    return TOK_ATOM_UNKNOWN;
+
+  const char *known = atomNames[atom];
+  for(size_t i = 0; i < len; i++) {
+    if(asciiLower((uint8_t) name[i]) != (uint8_t) known[i])
+      return TOK_ATOM_UNKNOWN;
+  }
+
+  return atom;
+}
+
+/**
+ * @brief Looks up the atom of a name, ignoring ASCII case.
+ *
+ * @param name The name bytes (not NUL-terminated).
+ * @param len The number of bytes.
+ * @return The atom, or TOK_ATOM_UNKNOWN.
+ */
+TokAtom tokAtomLookup(const char *name, size_t len) {
+  if(!name || len == 0 || len > TOK_ATOM_MAX_LEN)
+    return TOK_ATOM_UNKNOWN;
+
+  return tokAtomLookupHashed(name, len, tokNameHash(name, len));
+}
+
+/**
+ * @brief Returns the name of an atom.
+ *
+ * @param atom The atom.
+ * @return The lower-case name, or "" for TOK_ATOM_UNKNOWN and invalid atoms.
+ */
+const char *tokAtomName(TokAtom atom) {
+  if(atom <= TOK_ATOM_UNKNOWN || atom >= TOK_ATOM_COUNT)
+    return "";
+
+  return atomNames[atom];
+}
+""" % ((1 << SLOT_BITS) - 1, (1 << BUCKET_BITS) - 1,
+       rows(names, 6, lambda n: '"%s"' % n),
+       rows([0] + [len(n) for n in names], 16, str),
+       rows(displacements, 12, str),
+       rows(slots, 16, str)))
+
+
+def main():
+    names = read_names(os.path.join(ROOT, "tools", "atoms.txt"))
+    if len(names) > 255:
+        sys.exit("atomSlots holds uint8_t atoms, widen it")
+
+    slots, displacements = build_table(names)
+    write_header(names, os.path.join(ROOT, "include", "comot-css", "atoms.h"))
+    write_source(names, slots, displacements, os.path.join(ROOT, "src", "tokenizer", "atoms.c"))
+
+
+if __name__ == "__main__":
+    main()